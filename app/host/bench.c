@@ -0,0 +1,321 @@
+/**
+ * @file bench.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Host benchmark and regression run for the scanner and parser. Replays a corpus of console
+ * lines through compileLine() and reports lines/sec, tokens/sec and line arena allocations per
+ * line. The board layer is mocked, nothing is run. Built and run by "make bench" in app/.
+ * @note the token and allocation counters hook compileTokens() and allocateLineArena() with
+ *       the linker's --wrap, so the firmware sources build unchanged.
+ * @version 0.1
+ * @date 2025-03-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interpreter.h"
+#include "local-memory.h"
+#include "script-control.h"
+
+// Macro definitions
+#define BENCH_MAX_LINES      (1024)
+#define BENCH_LINE_SIZE      (256)
+#define BENCH_DEFAULT_PASSES (20000)
+
+/**
+ * @brief A corpus line and what the parser has to make of it.
+ * @param text line, without its marker
+ * @param accept true for "+" lines, false for "-" lines
+ * @param number line number in the corpus file
+ */
+typedef struct BenchLine
+{
+    char   text[BENCH_LINE_SIZE];
+    bool   accept;
+    size_t number;
+} BenchLine;
+
+// The corpus file and what the hooks counted.
+static BenchLine corpus[BENCH_MAX_LINES];
+static size_t    corpus_count = 0;
+static uint64_t  tokens_counted = 0;
+static uint64_t  allocations_counted = 0;
+static size_t    arena_peak = 0;
+
+bool __real_compileTokens(TokenVector *vec, Chunk *chunk);
+bool __wrap_compileTokens(TokenVector *vec, Chunk *chunk);
+void *__real_allocateLineArena(size_t size);
+void *__wrap_allocateLineArena(size_t size);
+
+/**
+ * @brief Counts the tokens of every scanned line on its way to the parser.
+ *
+ * @param vec scanned line
+ * @param chunk chunk to compile into
+ * @return true compiled
+ * @return false parse error
+ */
+bool __wrap_compileTokens(TokenVector *vec, Chunk *chunk)
+{
+    tokens_counted += sizeTokenVector(vec);
+    return __real_compileTokens(vec, chunk);
+}
+
+/**
+ * @brief Counts line arena allocations and keeps the high water mark.
+ *
+ * @param size bytes to allocate
+ * @return void* allocated memory, NULL if the arena is exhausted
+ */
+void *__wrap_allocateLineArena(size_t size)
+{
+    allocations_counted++;
+    void *result = __real_allocateLineArena(size);
+    arena_peak = usedLineArena() > arena_peak ? usedLineArena() : arena_peak;
+    return result;
+}
+
+/**
+ * @brief Board mock, interpret() links against it but the bench only compiles lines.
+ *
+ * @param bc unused
+ * @param chunk unused
+ * @return true always
+ */
+bool runChunk(BoardController *bc, Chunk *chunk)
+{
+    (void)bc;
+    (void)chunk;
+    return true;
+}
+
+/**
+ * @brief Script mock, never recording. See runChunk().
+ *
+ * @return false always
+ */
+bool scriptRecording(void)
+{
+    return false;
+}
+
+/**
+ * @brief Script mock, see runChunk().
+ *
+ * @param chunk unused
+ * @return true always
+ */
+bool scriptRecord(const Chunk *chunk)
+{
+    (void)chunk;
+    return true;
+}
+
+/**
+ * @brief Loads a corpus. Each line is "+ <line>" for one that must compile, "- <line>" for one
+ * that must be rejected, '#' starts a comment and blank lines are skipped.
+ *
+ * @param path corpus file
+ * @return true loaded
+ * @return false unreadable file, bad marker, long line or too many lines
+ */
+static bool loadCorpus(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "bench: can't open %s\n", path);
+        return false;
+    }
+
+    char   buffer[BENCH_LINE_SIZE + 4];
+    size_t number = 0;
+    while (fgets(buffer, sizeof(buffer), file) != NULL)
+    {
+        number++;
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (buffer[0] == '\0' || buffer[0] == '#')
+        {
+            continue;
+        }
+        if ((buffer[0] != '+' && buffer[0] != '-') || buffer[1] != ' ')
+        {
+            fprintf(stderr, "bench: %s:%zu: lines start with \"+ \", \"- \" or '#'\n", path,
+                    number);
+            fclose(file);
+            return false;
+        }
+        if (corpus_count == BENCH_MAX_LINES)
+        {
+            fprintf(stderr, "bench: %s: more than %d lines\n", path, BENCH_MAX_LINES);
+            fclose(file);
+            return false;
+        }
+
+        size_t length = strlen(&buffer[2]);
+        if (length >= BENCH_LINE_SIZE)
+        {
+            fprintf(stderr, "bench: %s:%zu: longer than %d characters\n", path, number,
+                    BENCH_LINE_SIZE - 1);
+            fclose(file);
+            return false;
+        }
+
+        BenchLine *line = &corpus[corpus_count++];
+        line->accept = buffer[0] == '+';
+        line->number = number;
+        memcpy(line->text, &buffer[2], length + 1);
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief Points stdout at /dev/null, or back again. The parser reports errors with printf and
+ * the timed passes shouldn't measure the terminal.
+ *
+ * @param quiet true to discard output
+ */
+static void quietStdout(bool quiet)
+{
+    static int saved = -1;
+    fflush(stdout);
+    if (quiet && saved < 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        saved = dup(STDOUT_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    else if (!quiet && saved >= 0)
+    {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        saved = -1;
+    }
+}
+
+/**
+ * @brief Compiles every corpus line once and checks each is accepted or rejected as marked.
+ * Parser output for a line that goes the wrong way is shown.
+ *
+ * @param path corpus file, for the report
+ * @return size_t lines that went the wrong way
+ */
+static size_t regressionPass(const char *path)
+{
+    size_t failures = 0;
+    Chunk  chunk;
+    for (size_t index = 0; index < corpus_count; index++)
+    {
+        const BenchLine *line = &corpus[index];
+        quietStdout(true);
+        resetLineArena();
+        bool compiled = compileLine(line->text, &chunk);
+        quietStdout(false);
+        if (compiled == line->accept)
+        {
+            continue;
+        }
+
+        failures++;
+        printf("FAIL %s:%zu: \"%s\" %s\n", path, line->number, line->text,
+               line->accept ? "was rejected:" : "was accepted");
+        if (line->accept)
+        {
+            resetLineArena();
+            (void)compileLine(line->text, &chunk);
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief Returns the monotonic clock in seconds.
+ *
+ * @return double seconds
+ */
+static double secondsNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 4)
+    {
+        fprintf(stderr, "usage: %s <corpus> [passes] [min lines/sec]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    long        passes = argc > 2 ? strtol(argv[2], NULL, 10) : BENCH_DEFAULT_PASSES;
+    double      minimum = argc > 3 ? strtod(argv[3], NULL) : 0.0;
+    if (passes <= 0)
+    {
+        passes = BENCH_DEFAULT_PASSES;
+    }
+    if (!loadCorpus(path) || corpus_count == 0)
+    {
+        fprintf(stderr, "bench: %s has no lines\n", path);
+        return 2;
+    }
+
+    size_t accepted = 0;
+    for (size_t index = 0; index < corpus_count; index++)
+    {
+        accepted += corpus[index].accept ? 1 : 0;
+    }
+    size_t failures = regressionPass(path);
+
+    // Timed passes. A line's result is ignored here, the regression pass has checked them.
+    tokens_counted = 0;
+    allocations_counted = 0;
+    arena_peak = 0;
+    Chunk chunk;
+    quietStdout(true);
+    double start = secondsNow();
+    for (long pass = 0; pass < passes; pass++)
+    {
+        for (size_t index = 0; index < corpus_count; index++)
+        {
+            resetLineArena();
+            (void)compileLine(corpus[index].text, &chunk);
+        }
+    }
+    double elapsed = secondsNow() - start;
+    quietStdout(false);
+
+    double lines = (double)passes * (double)corpus_count;
+    double rate = elapsed > 0.0 ? lines / elapsed : 0.0;
+    printf("corpus       %s: %zu lines, %zu accepted, %zu rejected\n", path, corpus_count,
+           accepted, corpus_count - accepted);
+    printf("passes       %ld in %.3f s\n", passes, elapsed);
+    printf("lines/sec    %.0f (%.1f ns/line)\n", rate, elapsed * 1e9 / lines);
+    printf("tokens/sec   %.0f (%.2f tokens/line)\n",
+           elapsed > 0.0 ? (double)tokens_counted / elapsed : 0.0,
+           (double)tokens_counted / lines);
+    printf("allocs/line  %.2f, arena peak %zu of %d bytes\n",
+           (double)allocations_counted / lines, arena_peak, LINE_ARENA_SIZE);
+    printf("regressions  %zu\n", failures);
+
+    if (failures > 0)
+    {
+        return 1;
+    }
+    if (rate < minimum)
+    {
+        printf("FAIL %.0f lines/sec is under the %.0f minimum\n", rate, minimum);
+        return 1;
+    }
+    return 0;
+}
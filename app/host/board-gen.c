@@ -0,0 +1,195 @@
+/**
+ * @file board-gen.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Generates the pin table of the board selected by BOARD (BOARD_TABLE) from the pin lists
+ * in its description: for every port and pin, where it is in each peripheral's list, so the
+ * parser indexes straight to a pin's mapping instead of searching for it. The Makefile reruns it
+ * whenever the description changes.
+ * @version 0.1
+ * @date 2025-04-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board-description.h"
+
+// Macro definitions
+#define GEN_PORT(base, clock)    #base,
+#define GEN_PIN(port, pin, ...)  {#port, #pin},
+#define GEN_SIZE(list)           (sizeof(list) / sizeof(list[0]))
+#define GEN_LIST(field, list, mask, max)                                                          \
+    {field, list, GEN_SIZE(list), mask, max}
+
+/**
+ * @brief A pin of a list, as written in the description.
+ *
+ */
+typedef struct GenPin {
+    const char *port;
+    const char *pin;
+} GenPin;
+
+/**
+ * @brief A pin list and the BoardPin field it fills in.
+ *
+ * @param field BoardPin field
+ * @param pins pins of the list
+ * @param count number of pins
+ * @param mask field is a bit per entry, a pin can be in the list more than once
+ * @param max most entries the field can hold
+ */
+typedef struct GenList {
+    const char   *field;
+    const GenPin *pins;
+    size_t        count;
+    bool          mask;
+    size_t        max;
+} GenList;
+
+static const char  *ports[] = {BOARD_PORT_LIST(GEN_PORT)};
+static const GenPin adc_pins[] = {BOARD_ADC_LIST(GEN_PIN)};
+static const GenPin uart_pins[] = {BOARD_UART_LIST(GEN_PIN)};
+static const GenPin pwm_pins[] = {BOARD_PWM_LIST(GEN_PIN)};
+static const GenPin measure_pins[] = {BOARD_MEASURE_LIST(GEN_PIN)};
+static const GenPin spi_pins[] = {BOARD_SPI_LIST(GEN_PIN)};
+static const GenPin i2c_pins[] = {BOARD_I2C_LIST(GEN_PIN)};
+
+static const GenList lists[] = {
+    GEN_LIST("adc", adc_pins, false, 255),
+    GEN_LIST("uart", uart_pins, false, 255),
+    GEN_LIST("pwm", pwm_pins, false, 255),
+    GEN_LIST("measure", measure_pins, false, 255),
+    GEN_LIST("spi", spi_pins, true, 32),
+    GEN_LIST("i2c", i2c_pins, true, 16),
+};
+#define GEN_LIST_COUNT GEN_SIZE(lists)
+
+/**
+ * @brief Finds where a pin of a list is in the table.
+ *
+ * @param pin pin as written in the description
+ * @param port_index returned port index
+ * @param pin_index returned pin number
+ * @return true pin is on the board
+ * @return false port isn't in BOARD_PORT_LIST or pin isn't GPIO<0-15>
+ */
+static bool findPin(const GenPin *pin, size_t *port_index, size_t *pin_index)
+{
+    for (*port_index = 0; *port_index < GEN_SIZE(ports); (*port_index)++)
+    {
+        if (strcmp(ports[*port_index], pin->port) == 0)
+        {
+            break;
+        }
+    }
+    char *end = NULL;
+    if (strncmp(pin->pin, "GPIO", 4) != 0)
+    {
+        return false;
+    }
+    *pin_index = strtoul(pin->pin + 4, &end, 10);
+    return *port_index < GEN_SIZE(ports) && end != pin->pin + 4 && *end == '\0' &&
+           *pin_index < BOARD_PINS_PER_PORT;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <output header>\n", argv[0]);
+        return 2;
+    }
+    if (GEN_SIZE(ports) != BOARD_PORT_COUNT)
+    {
+        fprintf(stderr, "board-gen: BOARD_PORT_LIST has %zu ports, BOARD_PORT_COUNT is %d\n",
+                GEN_SIZE(ports), BOARD_PORT_COUNT);
+        return 1;
+    }
+
+    static unsigned long table[BOARD_PORT_COUNT][BOARD_PINS_PER_PORT][GEN_LIST_COUNT];
+    for (size_t list = 0; list < GEN_LIST_COUNT; list++)
+    {
+        if (lists[list].count > lists[list].max)
+        {
+            fprintf(stderr, "board-gen: %zu %s pins, the table holds %zu\n", lists[list].count,
+                    lists[list].field, lists[list].max);
+            return 1;
+        }
+        for (size_t entry = 0; entry < lists[list].count; entry++)
+        {
+            const GenPin *pin = &lists[list].pins[entry];
+            size_t        port_index = 0;
+            size_t        pin_index = 0;
+            if (!findPin(pin, &port_index, &pin_index))
+            {
+                fprintf(stderr, "board-gen: %s pin %s %s isn't on the board\n", lists[list].field,
+                        pin->port, pin->pin);
+                return 1;
+            }
+            unsigned long *slot = &table[port_index][pin_index][list];
+            if (lists[list].mask)
+            {
+                *slot |= 1UL << entry;
+            }
+            else if (*slot != 0)
+            {
+                fprintf(stderr, "board-gen: %s pin %s %s is in the list twice\n",
+                        lists[list].field, pin->port, pin->pin);
+                return 1;
+            }
+            else
+            {
+                *slot = entry + 1;
+            }
+        }
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "board-gen: can't write %s\n", argv[1]);
+        return 1;
+    }
+    fprintf(out, "// Generated by host/board-gen.c from the %s board description, don't edit.\n",
+            BOARD_NAME);
+    fprintf(out, "#ifndef BOARD_TABLE_H_\n#define BOARD_TABLE_H_\n\n");
+    fprintf(out, "static const BoardPin boardPins[BOARD_PORT_COUNT][BOARD_PINS_PER_PORT] = {\n");
+    for (size_t port_index = 0; port_index < BOARD_PORT_COUNT; port_index++)
+    {
+        for (size_t pin_index = 0; pin_index < BOARD_PINS_PER_PORT; pin_index++)
+        {
+            const char *separator = "";
+            for (size_t list = 0; list < GEN_LIST_COUNT; list++)
+            {
+                unsigned long value = table[port_index][pin_index][list];
+                if (value == 0)
+                {
+                    continue;
+                }
+                if (separator[0] == '\0')
+                {
+                    fprintf(out, "    [%zu][%zu] = {", port_index, pin_index);
+                }
+                fprintf(out, lists[list].mask ? "%s.%s = 0x%08lXU" : "%s.%s = %lu", separator,
+                        lists[list].field, value);
+                separator = ", ";
+            }
+            if (separator[0] != '\0')
+            {
+                fprintf(out, "},\n");
+            }
+        }
+    }
+    fprintf(out, "};\n\n#endif\n");
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "board-gen: can't write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
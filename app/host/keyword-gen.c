@@ -0,0 +1,145 @@
+/**
+ * @file keyword-gen.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Generates inc/keyword-hash.h from KEYWORD_LIST in inc/keywords.h: searches for a seed
+ * that hashes every keyword to its own slot of the smallest table that has one, and writes the
+ * table out. The Makefile reruns it whenever keywords.h changes.
+ * @version 0.1
+ * @date 2025-03-23
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keywords.h"
+
+// Macro definitions
+#define GEN_MIN_SIZE  (32)
+#define GEN_MAX_SIZE  (1024)
+#define GEN_MAX_SEEDS (1U << 20) // per table size
+
+#define GEN_TEXT(text, type) text,
+#define GEN_TYPE(text, type) #type,
+
+static const char *texts[] = {KEYWORD_LIST(GEN_TEXT)};
+static const char *types[] = {KEYWORD_LIST(GEN_TYPE)};
+#define GEN_COUNT (sizeof(texts) / sizeof(texts[0]))
+
+/**
+ * @brief Hashes a keyword the way the scanner does.
+ *
+ * @param seed starting value
+ * @param text keyword
+ * @return uint32_t hash
+ */
+static uint32_t hashKeyword(uint32_t seed, const char *text)
+{
+    uint32_t hash = seed;
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        hash = KEYWORD_HASH_STEP(hash, *c);
+    }
+    return hash;
+}
+
+/**
+ * @brief Tries a seed, filling slots with the keyword index + 1 of each slot.
+ *
+ * @param seed starting value
+ * @param size table size, a power of two
+ * @param slots returned table
+ * @return true every keyword has its own slot
+ * @return false two keywords collide
+ */
+static bool trySeed(uint32_t seed, uint32_t size, size_t *slots)
+{
+    memset(slots, 0, size * sizeof(slots[0]));
+    for (size_t keyword = 0; keyword < GEN_COUNT; keyword++)
+    {
+        uint32_t slot = KEYWORD_HASH_SLOT(hashKeyword(seed, texts[keyword]), size);
+        if (slots[slot] != 0)
+        {
+            return false;
+        }
+        slots[slot] = keyword + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <output header>\n", argv[0]);
+        return 2;
+    }
+    for (size_t keyword = 0; keyword < GEN_COUNT; keyword++)
+    {
+        for (size_t other = keyword + 1; other < GEN_COUNT; other++)
+        {
+            if (strcmp(texts[keyword], texts[other]) == 0)
+            {
+                fprintf(stderr, "keyword-gen: \"%s\" is in KEYWORD_LIST twice\n", texts[keyword]);
+                return 1;
+            }
+        }
+    }
+
+    size_t longest = 0;
+    for (size_t keyword = 0; keyword < GEN_COUNT; keyword++)
+    {
+        longest = strlen(texts[keyword]) > longest ? strlen(texts[keyword]) : longest;
+    }
+
+    static size_t slots[GEN_MAX_SIZE];
+    uint32_t      size = GEN_MIN_SIZE;
+    uint32_t      seed = 0;
+    while (size < GEN_COUNT || !trySeed(seed, size, slots))
+    {
+        if (size >= GEN_COUNT && ++seed < GEN_MAX_SEEDS)
+        {
+            continue;
+        }
+        seed = 0;
+        size *= 2;
+        if (size > GEN_MAX_SIZE)
+        {
+            fprintf(stderr, "keyword-gen: no seed found for %zu keywords\n", GEN_COUNT);
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "keyword-gen: can't write %s\n", argv[1]);
+        return 1;
+    }
+    fprintf(out, "// Generated by host/keyword-gen.c from inc/keywords.h, don't edit.\n");
+    fprintf(out, "#ifndef KEYWORD_HASH_H_\n#define KEYWORD_HASH_H_\n\n");
+    fprintf(out, "#include \"keywords.h\"\n\n");
+    fprintf(out, "#define KEYWORD_HASH_SEED    (0x%08XU)\n", seed);
+    fprintf(out, "#define KEYWORD_HASH_SIZE    (%u)\n", size);
+    fprintf(out, "#define KEYWORD_HASH_COUNT   (%zu)\n", GEN_COUNT);
+    fprintf(out, "#define KEYWORD_HASH_LONGEST (%zu)\n\n", longest);
+    fprintf(out, "static const Keyword keyword_table[KEYWORD_HASH_SIZE] = {\n");
+    for (uint32_t slot = 0; slot < size; slot++)
+    {
+        if (slots[slot] != 0)
+        {
+            size_t keyword = slots[slot] - 1;
+            fprintf(out, "    [%u] = {\"%s\", %zu, %s},\n", slot, texts[keyword],
+                    strlen(texts[keyword]), types[keyword]);
+        }
+    }
+    fprintf(out, "};\n\n#endif\n");
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "keyword-gen: can't write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file libopencm3-host.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief The slice of libopencm3 the scanner and parser see through the board headers, so they
+ * build on a host for "make bench". Values match libopencm3 for the STM32F4 where the parser
+ * cares (GPIO bases, pin masks), everything else only has to be distinct. No functions: nothing
+ * on the host build path touches hardware.
+ * @version 0.1
+ * @date 2025-03-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LIBOPENCM3_HOST_H_
+#define LIBOPENCM3_HOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* gpio */
+#define GPIOA              (0x40020000U)
+#define GPIOB              (0x40020400U)
+#define GPIOC              (0x40020800U)
+#define GPIOD              (0x40020C00U)
+#define GPIOE              (0x40021000U)
+#define GPIOH              (0x40021C00U)
+#define GPIO0              (1 << 0)
+#define GPIO1              (1 << 1)
+#define GPIO2              (1 << 2)
+#define GPIO3              (1 << 3)
+#define GPIO4              (1 << 4)
+#define GPIO5              (1 << 5)
+#define GPIO6              (1 << 6)
+#define GPIO7              (1 << 7)
+#define GPIO8              (1 << 8)
+#define GPIO9              (1 << 9)
+#define GPIO10             (1 << 10)
+#define GPIO11             (1 << 11)
+#define GPIO12             (1 << 12)
+#define GPIO13             (1 << 13)
+#define GPIO14             (1 << 14)
+#define GPIO15             (1 << 15)
+#define GPIO_MODE_INPUT    (0)
+#define GPIO_MODE_OUTPUT   (1)
+#define GPIO_MODE_AF       (2)
+#define GPIO_MODE_ANALOG   (3)
+#define GPIO_PUPD_NONE     (0)
+#define GPIO_PUPD_PULLUP   (1)
+#define GPIO_PUPD_PULLDOWN (2)
+#define GPIO_AF0           (0)
+#define GPIO_AF1           (1)
+#define GPIO_AF2           (2)
+#define GPIO_AF3           (3)
+#define GPIO_AF4           (4)
+#define GPIO_AF5           (5)
+#define GPIO_AF6           (6)
+#define GPIO_AF7           (7)
+#define GPIO_AF8           (8)
+#define GPIO_AF9           (9)
+
+/* rcc */
+#define _REG_BIT(base, bit) (((base) << 5) + (bit))
+enum rcc_periph_clken
+{
+    RCC_GPIOA = _REG_BIT(0x30, 0),
+    RCC_GPIOB = _REG_BIT(0x30, 1),
+    RCC_GPIOC = _REG_BIT(0x30, 2),
+    RCC_GPIOD = _REG_BIT(0x30, 3),
+    RCC_GPIOE = _REG_BIT(0x30, 4),
+    RCC_GPIOH = _REG_BIT(0x30, 7),
+    RCC_GPIOK = _REG_BIT(0x30, 10),
+    RCC_DMA1 = _REG_BIT(0x30, 21),
+    RCC_DMA2 = _REG_BIT(0x30, 22),
+    RCC_TIM2 = _REG_BIT(0x40, 0),
+    RCC_TIM3 = _REG_BIT(0x40, 1),
+    RCC_TIM4 = _REG_BIT(0x40, 2),
+    RCC_TIM5 = _REG_BIT(0x40, 3),
+    RCC_SPI2 = _REG_BIT(0x40, 14),
+    RCC_SPI3 = _REG_BIT(0x40, 15),
+    RCC_USART2 = _REG_BIT(0x40, 17),
+    RCC_I2C1 = _REG_BIT(0x40, 21),
+    RCC_I2C2 = _REG_BIT(0x40, 22),
+    RCC_I2C3 = _REG_BIT(0x40, 23),
+    RCC_TIM1 = _REG_BIT(0x44, 0),
+    RCC_USART1 = _REG_BIT(0x44, 4),
+    RCC_USART6 = _REG_BIT(0x44, 5),
+    RCC_ADC1 = _REG_BIT(0x44, 8),
+    RCC_SPI1 = _REG_BIT(0x44, 12),
+    RCC_SPI4 = _REG_BIT(0x44, 13),
+    RCC_SPI5 = _REG_BIT(0x44, 20),
+};
+
+/* adc */
+#define ADC1              (0x40012000U)
+#define ADC_CHANNEL0      (0)
+#define ADC_CHANNEL1      (1)
+#define ADC_CHANNEL4      (4)
+#define ADC_CHANNEL5      (5)
+#define ADC_CHANNEL6      (6)
+#define ADC_CHANNEL7      (7)
+#define ADC_CHANNEL8      (8)
+#define ADC_CHANNEL9      (9)
+#define ADC_CHANNEL10     (10)
+#define ADC_CHANNEL11     (11)
+#define ADC_CHANNEL12     (12)
+#define ADC_CHANNEL13     (13)
+#define ADC_CHANNEL14     (14)
+#define ADC_CHANNEL15     (15)
+#define ADC_CHANNEL18     (18)
+#define ADC_SMPR_SMP_3CYC   (0)
+#define ADC_SMPR_SMP_15CYC  (1)
+#define ADC_SMPR_SMP_28CYC  (2)
+#define ADC_SMPR_SMP_56CYC  (3)
+#define ADC_SMPR_SMP_84CYC  (4)
+#define ADC_SMPR_SMP_112CYC (5)
+#define ADC_SMPR_SMP_144CYC (6)
+#define ADC_SMPR_SMP_480CYC (7)
+
+/* usart */
+#define USART1          (0x40011000U)
+#define USART2          (0x40004400U)
+#define USART6          (0x40011400U)
+
+/* spi */
+#define SPI1            (0x40013000U)
+#define SPI2            (0x40003800U)
+#define SPI3            (0x40003C00U)
+#define SPI4            (0x40013400U)
+#define SPI5            (0x40015000U)
+
+/* i2c */
+#define I2C1            (0x40005400U)
+#define I2C2            (0x40005800U)
+#define I2C3            (0x40005C00U)
+
+/* nvic */
+#define NVIC_USART1_IRQ (37)
+#define NVIC_USART2_IRQ (38)
+#define NVIC_USART6_IRQ (71)
+
+/* timer */
+#define TIM1 (0x40010000U)
+#define TIM2 (0x40000000U)
+#define TIM3 (0x40000400U)
+#define TIM4 (0x40000800U)
+#define TIM5 (0x40000C00U)
+enum tim_oc_id
+{
+    TIM_OC1 = 0,
+    TIM_OC1N,
+    TIM_OC2,
+    TIM_OC2N,
+    TIM_OC3,
+    TIM_OC3N,
+    TIM_OC4,
+};
+enum tim_ic_id
+{
+    TIM_IC1,
+    TIM_IC2,
+    TIM_IC3,
+    TIM_IC4,
+};
+
+/* dma */
+#define DMA1        (0x40026000U)
+#define DMA2        (0x40026400U)
+#define DMA_STREAM0 (0)
+#define DMA_STREAM1 (1)
+#define DMA_STREAM2 (2)
+#define DMA_STREAM3 (3)
+#define DMA_STREAM4 (4)
+#define DMA_STREAM5 (5)
+#define DMA_STREAM6 (6)
+#define DMA_STREAM7 (7)
+
+#endif
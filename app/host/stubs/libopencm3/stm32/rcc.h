@@ -0,0 +1,2 @@
+// Host build stand in, everything the scanner and parser need is in libopencm3-host.h.
+#include "libopencm3-host.h"
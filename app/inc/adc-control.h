@@ -19,6 +19,28 @@
 #include "libopencm3/stm32/gpio.h"
 #include "libopencm3/stm32/rcc.h"
 
+// Scan engine. TIM3 TRGO starts one conversion of the whole regular sequence, DMA2 stream 4 copies
+// every result into a circular buffer whose two halves are handed out as ping-pong blocks.
+#define ADC_SCAN_MAX_CHANNELS    (16)   // Longest regular sequence ADC1 supports
+#define ADC_SCAN_FRAMES_PER_HALF (8)    // Frames (one sample of every channel) per block
+#define ADC_SCAN_DEFAULT_HZ      (1000) // Frame rate while nothing is streaming
+#define ADC_SCAN_MIN_HZ          (2)    // Limits of the 16 bit TIM3 period at a 100kHz tick
+#define ADC_SCAN_MAX_HZ          (20000)
+#define ADC_STREAM_DEFAULT_HZ    (100)  // "stream" with no rate, fits 8 channels at 115200 baud
+
+// Per pin settings. ADC1 runs at the finest resolution any pin asks for, coarser pins are shifted.
+#define ADC_DEFAULT_BITS         (12)
+#define ADC_MIN_BITS             (6)
+// Every complete frame the scan buffer holds, the one DMA is filling isn't.
+#define ADC_MAX_AVERAGE          (2 * ADC_SCAN_FRAMES_PER_HALF - 1)
+
+/**
+ * @brief ADC pin.
+ * @param sample_time ADC_SMPR_SMP_* for this channel
+ * @param bits resolution reads are returned in, 6, 8, 10 or 12
+ * @param average frames averaged into each read, 1 for the latest sample only
+ * @param scan_rank position of this channel in the scan sequence, set when the scan is rebuilt.
+ */
 typedef struct ADCPinController
 {
     uint32_t              port;
@@ -29,11 +51,31 @@ typedef struct ADCPinController
     uint8_t               mode;
     uint32_t              adc_port;
     uint8_t               adc_channel;
+    uint8_t               scan_rank;
+    uint8_t               bits;
+    uint8_t               average;
 
 } ADCPinController;
 
 ADCPinController createADCPin(uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                               enum rcc_periph_clken adc_clock, uint32_t sample_time, uint8_t mode,
-                              uint32_t adc_port, uint8_t adc_channel);
+                              uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                              uint8_t average);
+
+bool     adcScanStart(const uint8_t *channels, uint8_t count, uint8_t bits);
+void     adcScanStop(void);
+bool     adcScanRunning(void);
+uint8_t  adcScanChannels(void);
+uint32_t adcScanHalves(void);
+bool     adcScanSetRate(uint32_t rate_hz);
+void     adcSetPrescaler(void);
+void     adcClockChanged(void);
+uint16_t adcScanRead(uint8_t rank, uint8_t frames, uint8_t bits);
+uint16_t adcConvert(uint8_t channel, uint8_t samples, uint8_t bits);
+void     adcStreamStart(uint32_t rate_hz);
+uint32_t adcStreamStop(void);
+bool     adcStreamActive(void);
+bool     adcStreamPending(void);
+void     adcStreamService(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+/**
+ * @file bench-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief On-target benchmark for "bench": GPIO toggle rate, ADC throughput, user UART loopback
+ * throughput and interpreter lines per second, timed with the DWT cycle counter. Build with
+ * -D BOARD_BENCH to turn it on, otherwise BENCH_SERVICE() compiles to nothing.
+ * @version 0.1
+ * @date 2025-04-04
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef BENCH_CONTROL_H_
+#define BENCH_CONTROL_H_
+
+// libgcc includes
+#include <stdbool.h>
+
+// libopencm3 includes
+
+// local includes
+#include "board-control.h"
+
+// Macro definitions
+#define BENCH_GPIO_TOGGLES  (100000) // per raw and actionDigitalPin run, even so the pin ends as it was
+#define BENCH_GPIO_LINES    (2000)   // "toggle <pin>" lines through interpret()
+#define BENCH_ADC_READS     (10000)
+#define BENCH_ADC_SCAN_MS   (200)    // window the scan is counted over, at ADC_SCAN_MAX_HZ
+#define BENCH_UART_BYTES    (2048)
+#define BENCH_CORPUS_PASSES (250)
+#define BENCH_LINE_SIZE     (48)
+#define BENCH_RESTORE_MHZ   (100)    // clock a snapshot is restored at, 84 MHz if already there
+
+#ifdef BOARD_BENCH
+// Function prototypes
+bool benchStart(void);
+void benchService(BoardController *bc);
+
+#define BENCH_SERVICE(bc) benchService(bc)
+#else
+#define BENCH_SERVICE(bc) ((void)0)
+#endif
+
+#endif
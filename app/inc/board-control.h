@@ -19,58 +19,109 @@
 // libopencm3 includes
 
 // local includes
+#include "board-description.h"
 #include "clocks-control.h"
 #include "local-memory.h"
 #include "peripheral-controller.h"
 
+// UART handle wildcard, matches whichever UART was set up first.
+#define UART_ANY            (0)
+
+// SPI handle wildcard, matches whichever SPI was set up first.
+#define SPI_ANY             (0)
+
+// I2C handle wildcard, matches whichever I2C was set up first.
+#define I2C_ANY             (0)
+
+#ifdef BOARD_STATIC_POOLS
+// Every live peripheral owns at least one pin, so the pin table bounds the pool.
+#define BOARD_MAX_PERIPHERALS (BOARD_PORT_COUNT * BOARD_PINS_PER_PORT)
+#endif
+
+// Most clocks one peripheral uses: a UART with RTS/CTS has its own, RX, TX, CTS and RTS.
+#define BOARD_PERIPHERAL_CLOCKS (5)
+
 /**
- * @brief entire board control struct.
+ * @brief entire board control struct. With BOARD_STATIC_POOLS defined peripherals are a fixed
+ * size pool inside the struct and nothing is allocated on the heap.
  * @param peripherals list of all peripherals enabled.
- * @param clocks list of all clocks (enabled/disabled, static)
- * @param peripherals_count size of peripherals list
- * @param clocks_count size of clocks
+ * @param clocks every gateable clock, indexed by clockIndex(). Each counts the live peripherals
+ * using it and is gated off when that reaches 0.
+ * @param peripherals_count size of peripherals list (slots ever used when static)
+ * @param free_slots stack of released peripheral slots, reused before new ones (static only)
+ * @param free_count number of entries in free_slots (static only)
+ * @param pin_table direct port x pin index of the live peripheral that owns each pin, NULL if the
+ * pin is free. Points into peripherals, so it is rebuilt whenever that array moves.
+ * @param generation bumped on every configuration change, compiled lines rebind when it moves.
  */
 typedef struct BoardController
 {
+#ifdef BOARD_STATIC_POOLS
+    PeripheralController peripherals[BOARD_MAX_PERIPHERALS];
+    uint8_t              free_slots[BOARD_MAX_PERIPHERALS];
+    size_t               free_count;
+#else
     PeripheralController *peripherals;
-    ClockController      *clocks;
+#endif
+    ClockController       clocks[CLOCK_TABLE_SIZE];
     size_t                peripherals_count;
-    size_t                clocks_count;
-    size_t                clocks_size;
     size_t                peripherals_size;
+    PeripheralController *pin_table[BOARD_PORT_COUNT][BOARD_PINS_PER_PORT];
+    uint32_t              generation;
 } BoardController;
 
-typedef struct clockExistsReturn
-{
-    bool exists;
-    bool status;
-    size_t index; // only if exists
-} clockExistsReturn;
-
 // Function Prototypes
 BoardController *initBoard(void);
 void             deinitBoard(BoardController *bc);
 void createDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                       PeripheralType input_output, uint8_t pupd);
 uint16_t actionDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, GPIOAction action);
+uint16_t actionDigitalPort(BoardController *bc, uint32_t port, uint16_t mask, GPIOAction action);
+uint16_t getDigitalPortMask(BoardController *bc, uint32_t port, uint16_t mask, GPIOAction action);
+uint16_t applyDigitalPort(uint32_t port, uint16_t mask, GPIOAction action);
 PeripheralType pinExists(BoardController *bc, uint32_t port, uint32_t pin);
+PeripheralController *getPinPeripheral(BoardController *bc, uint32_t port, uint32_t pin);
 void mutateDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, PeripheralType new_type,
                       uint8_t new_pupd);
 void mutateADCToDigital(BoardController *bc, uint32_t port, uint32_t pin,
                         enum rcc_periph_clken clock, PeripheralType input_output, uint8_t pupd);
 void mutateDigitalToADC(BoardController *bc, uint32_t port, uint32_t pin,
                         enum rcc_periph_clken clock, uint32_t sample_time, uint32_t adc_port,
-                        uint8_t adc_channel);
+                        uint8_t adc_channel, uint8_t bits, uint8_t average);
+void mutateADCSettings(BoardController *bc, uint32_t port, uint32_t pin, uint32_t sample_time,
+                       uint8_t bits, uint8_t average);
 void createAnalogPin(BoardController *bc, uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
-                     uint32_t sample_time, uint32_t adc_port, uint8_t adc_channel);
+                     uint32_t sample_time, uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                     uint8_t average);
 uint16_t actionAnalogPin(BoardController *bc, uint32_t port, uint32_t pin);
+uint16_t actionAnalogPeripheral(PeripheralController *periph);
 void createUART(BoardController *bc, uint32_t handle, enum rcc_periph_clken uart_clock,
                 uint32_t baudrate, uint32_t rx_port, uint32_t tx_port, uint32_t rx_pin,
                 uint32_t tx_pin, enum rcc_periph_clken rx_clock, enum rcc_periph_clken tx_clock,
                 uint8_t rx_af_mode, uint8_t tx_af_mode, int nvic_entry);
 void killPeripheralOrPin(BoardController *bc, uint32_t port, uint32_t pin);
-uint32_t readUARTPort(BoardController *bc, char *data, size_t len);
-uint32_t writeUARTPort(BoardController *bc, const char *data, size_t len);
+void clearBoard(BoardController *bc);
+bool setBoardClock(BoardController *bc, uint32_t mhz);
+void printClocks(BoardController *bc);
+PeripheralController *restorePeripheral(BoardController *bc, PeripheralController periph);
+uint32_t readUARTPort(BoardController *bc, uint32_t handle, char *data, size_t len);
+uint32_t writeUARTPort(BoardController *bc, uint32_t handle, const char *data, size_t len);
+PeripheralController *getUARTPeripheral(BoardController *bc, uint32_t handle);
+bool setUARTFlowControl(BoardController *bc, uint32_t handle, UartFlowControl flow);
+void createSPI(BoardController *bc, SPIController spi);
+PeripheralController *getSPIPeripheral(BoardController *bc, uint32_t handle);
+uint32_t transferSPIPort(BoardController *bc, uint32_t handle, uint8_t *data, size_t len);
+void createI2C(BoardController *bc, I2CController i2c);
+PeripheralController *getI2CPeripheral(BoardController *bc, uint32_t handle);
+size_t createPWMPin(BoardController *bc, PWMPeripheral pwm);
+void   createMeasurePin(BoardController *bc, MeasurePeripheral measure);
+PeripheralController *getTimerUser(BoardController *bc, uint32_t timer, PeripheralType type,
+                                   uint32_t port, uint32_t pin);
+PeripheralController *getPWMChannelUser(BoardController *bc, uint32_t timer,
+                                        enum tim_oc_id channel, uint32_t port, uint32_t pin);
+bool   watchDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, uint8_t edges);
+size_t updatePWMPin(BoardController *bc, PeripheralController *periph, uint32_t frequency,
+                    float duty_cycle);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+/**
+ * @file board-description.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Selects the description of the board being built for, BOARD in the Makefile. A
+ * description (board-<board>.h) gives the port and pin limits and lists the pins each peripheral
+ * can use, its generated table (BOARD_TABLE) indexes those lists by port and pin.
+ * @version 0.1
+ * @date 2025-04-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef BOARD_DESCRIPTION_H_
+#define BOARD_DESCRIPTION_H_
+
+// libgcc includes
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#if defined(BOARD_STM32F411RE)
+#include "board-stm32f411re.h"
+#else
+#error "No board description for BOARD, see app/Makefile."
+#endif
+
+// Macro definitions
+// Index of a port letter, either case. Anything that isn't a port letter is BOARD_PORT_COUNT or
+// more, so one compare checks it.
+#define BOARD_PORT_INDEX(c) ((uint8_t)(((uint8_t)(c) | 0x20U) - (uint8_t)'a'))
+
+#endif
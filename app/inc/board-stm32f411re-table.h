@@ -0,0 +1,45 @@
+// Generated by host/board-gen.c from the STM32F411RE board description, don't edit.
+#ifndef BOARD_TABLE_H_
+#define BOARD_TABLE_H_
+
+static const BoardPin boardPins[BOARD_PORT_COUNT][BOARD_PINS_PER_PORT] = {
+    [0][0] = {.adc = 1, .pwm = 1, .measure = 1},
+    [0][1] = {.adc = 2, .pwm = 2, .measure = 2, .spi = 0x00100000U},
+    [0][4] = {.adc = 3},
+    [0][5] = {.adc = 4, .pwm = 3, .measure = 3, .spi = 0x00000001U},
+    [0][6] = {.adc = 5, .spi = 0x00000002U},
+    [0][7] = {.adc = 6, .spi = 0x00000004U},
+    [0][8] = {.i2c = 0x00000080U},
+    [0][9] = {.uart = 1},
+    [0][10] = {.uart = 2, .spi = 0x00800000U},
+    [0][11] = {.uart = 3, .spi = 0x00080000U},
+    [0][12] = {.uart = 4, .spi = 0x00400000U},
+    [0][15] = {.uart = 5, .pwm = 4, .measure = 4},
+    [1][0] = {.adc = 7, .spi = 0x00200000U},
+    [1][1] = {.adc = 8},
+    [1][3] = {.uart = 6, .pwm = 5, .measure = 5, .spi = 0x00001008U, .i2c = 0x00000020U},
+    [1][4] = {.spi = 0x00002010U, .i2c = 0x00000100U},
+    [1][5] = {.spi = 0x00004020U},
+    [1][6] = {.uart = 7, .pwm = 7, .i2c = 0x00000001U},
+    [1][7] = {.uart = 8, .pwm = 8, .i2c = 0x00000002U},
+    [1][8] = {.pwm = 9, .spi = 0x01000000U, .i2c = 0x00000204U},
+    [1][9] = {.pwm = 10, .i2c = 0x00000048U},
+    [1][10] = {.pwm = 6, .spi = 0x00000040U, .i2c = 0x00000010U},
+    [1][13] = {.spi = 0x00040080U},
+    [1][14] = {.spi = 0x00000100U},
+    [1][15] = {.spi = 0x00000200U},
+    [2][0] = {.adc = 9},
+    [2][1] = {.adc = 10},
+    [2][2] = {.adc = 11, .spi = 0x00000400U},
+    [2][3] = {.adc = 12, .spi = 0x00000800U},
+    [2][4] = {.adc = 13},
+    [2][5] = {.adc = 14},
+    [2][6] = {.uart = 9},
+    [2][7] = {.uart = 10},
+    [2][9] = {.i2c = 0x00000400U},
+    [2][10] = {.spi = 0x00008000U},
+    [2][11] = {.spi = 0x00010000U},
+    [2][12] = {.spi = 0x00020000U},
+};
+
+#endif
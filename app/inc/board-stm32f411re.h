@@ -0,0 +1,137 @@
+/**
+ * @file board-stm32f411re.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Board description of the NUCLEO-F411RE: its GPIO ports and the pins each peripheral can
+ * use, from the STM32F411RE datasheet. host/board-gen.c turns the pin lists into
+ * board-stm32f411re-table.h, a table indexed by port and pin, whenever this file changes. To add
+ * a pin mapping add a line to its list.
+ * @version 0.1
+ * @date 2025-04-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef BOARD_STM32F411RE_H_
+#define BOARD_STM32F411RE_H_
+
+// Macro definitions
+#define BOARD_NAME          "STM32F411RE"
+#define BOARD_TABLE         "board-stm32f411re-table.h"
+
+// Size between ports
+#define PORT_SIZE           (0x400)
+
+// Dimensions of the pin lookup tables. Ports A-E, 16 pins per port.
+#define BOARD_PORT_COUNT    (5)
+#define BOARD_PINS_PER_PORT (16)
+
+// Other hardware will need to implement a whole shebang for more than one ADC.
+#define BOARD_ADC_BASE      (ADC1)
+
+// X(base, clock) for every GPIO port, from port A, PORT_SIZE apart.
+#define BOARD_PORT_LIST(X)                                                                         \
+    X(GPIOA, RCC_GPIOA)                                                                            \
+    X(GPIOB, RCC_GPIOB)                                                                            \
+    X(GPIOC, RCC_GPIOC)                                                                            \
+    X(GPIOD, RCC_GPIOD)                                                                            \
+    X(GPIOE, RCC_GPIOE)
+
+// X(port, pin, channel) for every ADC pin.
+#define BOARD_ADC_LIST(X)                                                                          \
+    X(GPIOA, GPIO0, ADC_CHANNEL0)                                                                  \
+    X(GPIOA, GPIO1, ADC_CHANNEL1)                                                                  \
+    X(GPIOA, GPIO4, ADC_CHANNEL4)                                                                  \
+    X(GPIOA, GPIO5, ADC_CHANNEL5)                                                                  \
+    X(GPIOA, GPIO6, ADC_CHANNEL6)                                                                  \
+    X(GPIOA, GPIO7, ADC_CHANNEL7)                                                                  \
+    X(GPIOB, GPIO0, ADC_CHANNEL8)                                                                  \
+    X(GPIOB, GPIO1, ADC_CHANNEL9)                                                                  \
+    X(GPIOC, GPIO0, ADC_CHANNEL10)                                                                 \
+    X(GPIOC, GPIO1, ADC_CHANNEL11)                                                                 \
+    X(GPIOC, GPIO2, ADC_CHANNEL12)                                                                 \
+    X(GPIOC, GPIO3, ADC_CHANNEL13)                                                                 \
+    X(GPIOC, GPIO4, ADC_CHANNEL14)                                                                 \
+    X(GPIOC, GPIO5, ADC_CHANNEL15)
+
+// X(port, pin, handle, clock, nvic, role, af) for every UART pin. USART2 is the console.
+#define BOARD_UART_LIST(X)                                                                         \
+    X(GPIOA, GPIO9, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_TX, GPIO_AF7)                    \
+    X(GPIOA, GPIO10, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_RX, GPIO_AF7)                   \
+    X(GPIOA, GPIO11, USART6, RCC_USART6, NVIC_USART6_IRQ, UART_PIN_TX, GPIO_AF8)                   \
+    X(GPIOA, GPIO12, USART6, RCC_USART6, NVIC_USART6_IRQ, UART_PIN_RX, GPIO_AF8)                   \
+    X(GPIOA, GPIO15, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_TX, GPIO_AF7)                   \
+    X(GPIOB, GPIO3, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_RX, GPIO_AF7)                    \
+    X(GPIOB, GPIO6, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_TX, GPIO_AF7)                    \
+    X(GPIOB, GPIO7, USART1, RCC_USART1, NVIC_USART1_IRQ, UART_PIN_RX, GPIO_AF7)                    \
+    X(GPIOC, GPIO6, USART6, RCC_USART6, NVIC_USART6_IRQ, UART_PIN_TX, GPIO_AF8)                    \
+    X(GPIOC, GPIO7, USART6, RCC_USART6, NVIC_USART6_IRQ, UART_PIN_RX, GPIO_AF8)
+
+// X(port, pin, timer, clock, channel, af) for every PWM pin. TIM3 is left out because it paces
+// the ADC scan, and PA2/PA3 are the console.
+#define BOARD_PWM_LIST(X)                                                                          \
+    X(GPIOA, GPIO0, TIM2, RCC_TIM2, TIM_OC1, GPIO_AF1)                                             \
+    X(GPIOA, GPIO1, TIM2, RCC_TIM2, TIM_OC2, GPIO_AF1)                                             \
+    X(GPIOA, GPIO5, TIM2, RCC_TIM2, TIM_OC1, GPIO_AF1)                                             \
+    X(GPIOA, GPIO15, TIM2, RCC_TIM2, TIM_OC1, GPIO_AF1)                                            \
+    X(GPIOB, GPIO3, TIM2, RCC_TIM2, TIM_OC2, GPIO_AF1)                                             \
+    X(GPIOB, GPIO10, TIM2, RCC_TIM2, TIM_OC3, GPIO_AF1)                                            \
+    X(GPIOB, GPIO6, TIM4, RCC_TIM4, TIM_OC1, GPIO_AF2)                                             \
+    X(GPIOB, GPIO7, TIM4, RCC_TIM4, TIM_OC2, GPIO_AF2)                                             \
+    X(GPIOB, GPIO8, TIM4, RCC_TIM4, TIM_OC3, GPIO_AF2)                                             \
+    X(GPIOB, GPIO9, TIM4, RCC_TIM4, TIM_OC4, GPIO_AF2)
+
+// X(port, pin, timer, clock, channel, af) for every measure pin. Only the 32 bit timers, so a
+// period never needs the prescaler, and only channels 1 and 2 as PWM input pairs each with the
+// other.
+#define BOARD_MEASURE_LIST(X)                                                                      \
+    X(GPIOA, GPIO0, TIM5, RCC_TIM5, TIM_IC1, GPIO_AF2)                                             \
+    X(GPIOA, GPIO1, TIM5, RCC_TIM5, TIM_IC2, GPIO_AF2)                                             \
+    X(GPIOA, GPIO5, TIM2, RCC_TIM2, TIM_IC1, GPIO_AF1)                                             \
+    X(GPIOA, GPIO15, TIM2, RCC_TIM2, TIM_IC1, GPIO_AF1)                                            \
+    X(GPIOB, GPIO3, TIM2, RCC_TIM2, TIM_IC2, GPIO_AF1)
+
+// X(port, pin, handle, clock, role, af) for every SPI pin. Pins can be on more than one SPI
+// (B03-B05 are SPI1 or SPI3). Port E and the NSS pins are left out.
+#define BOARD_SPI_LIST(X)                                                                          \
+    X(GPIOA, GPIO5, SPI1, RCC_SPI1, SPI_PIN_SCK, GPIO_AF5)                                         \
+    X(GPIOA, GPIO6, SPI1, RCC_SPI1, SPI_PIN_MISO, GPIO_AF5)                                        \
+    X(GPIOA, GPIO7, SPI1, RCC_SPI1, SPI_PIN_MOSI, GPIO_AF5)                                        \
+    X(GPIOB, GPIO3, SPI1, RCC_SPI1, SPI_PIN_SCK, GPIO_AF5)                                         \
+    X(GPIOB, GPIO4, SPI1, RCC_SPI1, SPI_PIN_MISO, GPIO_AF5)                                        \
+    X(GPIOB, GPIO5, SPI1, RCC_SPI1, SPI_PIN_MOSI, GPIO_AF5)                                        \
+    X(GPIOB, GPIO10, SPI2, RCC_SPI2, SPI_PIN_SCK, GPIO_AF5)                                        \
+    X(GPIOB, GPIO13, SPI2, RCC_SPI2, SPI_PIN_SCK, GPIO_AF5)                                        \
+    X(GPIOB, GPIO14, SPI2, RCC_SPI2, SPI_PIN_MISO, GPIO_AF5)                                       \
+    X(GPIOB, GPIO15, SPI2, RCC_SPI2, SPI_PIN_MOSI, GPIO_AF5)                                       \
+    X(GPIOC, GPIO2, SPI2, RCC_SPI2, SPI_PIN_MISO, GPIO_AF5)                                        \
+    X(GPIOC, GPIO3, SPI2, RCC_SPI2, SPI_PIN_MOSI, GPIO_AF5)                                        \
+    X(GPIOB, GPIO3, SPI3, RCC_SPI3, SPI_PIN_SCK, GPIO_AF6)                                         \
+    X(GPIOB, GPIO4, SPI3, RCC_SPI3, SPI_PIN_MISO, GPIO_AF6)                                        \
+    X(GPIOB, GPIO5, SPI3, RCC_SPI3, SPI_PIN_MOSI, GPIO_AF6)                                        \
+    X(GPIOC, GPIO10, SPI3, RCC_SPI3, SPI_PIN_SCK, GPIO_AF6)                                        \
+    X(GPIOC, GPIO11, SPI3, RCC_SPI3, SPI_PIN_MISO, GPIO_AF6)                                       \
+    X(GPIOC, GPIO12, SPI3, RCC_SPI3, SPI_PIN_MOSI, GPIO_AF6)                                       \
+    X(GPIOB, GPIO13, SPI4, RCC_SPI4, SPI_PIN_SCK, GPIO_AF6)                                        \
+    X(GPIOA, GPIO11, SPI4, RCC_SPI4, SPI_PIN_MISO, GPIO_AF6)                                       \
+    X(GPIOA, GPIO1, SPI4, RCC_SPI4, SPI_PIN_MOSI, GPIO_AF5)                                        \
+    X(GPIOB, GPIO0, SPI5, RCC_SPI5, SPI_PIN_SCK, GPIO_AF6)                                         \
+    X(GPIOA, GPIO12, SPI5, RCC_SPI5, SPI_PIN_MISO, GPIO_AF6)                                       \
+    X(GPIOA, GPIO10, SPI5, RCC_SPI5, SPI_PIN_MOSI, GPIO_AF6)                                       \
+    X(GPIOB, GPIO8, SPI5, RCC_SPI5, SPI_PIN_MOSI, GPIO_AF6)
+
+// X(port, pin, handle, clock, role, af) for every I2C pin. B08 and B09 are on two I2Cs each. The
+// SMBA pins are left out.
+#define BOARD_I2C_LIST(X)                                                                          \
+    X(GPIOB, GPIO6, I2C1, RCC_I2C1, I2C_PIN_SCL, GPIO_AF4)                                         \
+    X(GPIOB, GPIO7, I2C1, RCC_I2C1, I2C_PIN_SDA, GPIO_AF4)                                         \
+    X(GPIOB, GPIO8, I2C1, RCC_I2C1, I2C_PIN_SCL, GPIO_AF4)                                         \
+    X(GPIOB, GPIO9, I2C1, RCC_I2C1, I2C_PIN_SDA, GPIO_AF4)                                         \
+    X(GPIOB, GPIO10, I2C2, RCC_I2C2, I2C_PIN_SCL, GPIO_AF4)                                        \
+    X(GPIOB, GPIO3, I2C2, RCC_I2C2, I2C_PIN_SDA, GPIO_AF9)                                         \
+    X(GPIOB, GPIO9, I2C2, RCC_I2C2, I2C_PIN_SDA, GPIO_AF9)                                         \
+    X(GPIOA, GPIO8, I2C3, RCC_I2C3, I2C_PIN_SCL, GPIO_AF4)                                         \
+    X(GPIOB, GPIO4, I2C3, RCC_I2C3, I2C_PIN_SDA, GPIO_AF9)                                         \
+    X(GPIOB, GPIO8, I2C3, RCC_I2C3, I2C_PIN_SDA, GPIO_AF9)                                         \
+    X(GPIOC, GPIO9, I2C3, RCC_I2C3, I2C_PIN_SDA, GPIO_AF4)
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file bridge-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines and prototypes for the UART bridge, which passes bytes straight between the
+ * console and a user UART, ring buffer to ring buffer, instead of through the interpreter.
+ * @version 0.1
+ * @date 2025-03-27
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef BRIDGE_CONTROL_H_
+#define BRIDGE_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "board-control.h"
+
+// Escape back to the console: "+++" with at least a guard time of silence either side, like a
+// modem. Anything else, including a lone "+++" inside a stream of data, is passed on.
+#define BRIDGE_ESCAPE_CHAR  ('+')
+#define BRIDGE_ESCAPE_COUNT (3)
+#define BRIDGE_GUARD_MS     (1000)
+
+bool bridgeStart(BoardController *bc, uint32_t handle);
+bool bridgeActive(void);
+void bridgeService(BoardController *bc);
+
+#endif
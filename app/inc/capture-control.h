@@ -0,0 +1,37 @@
+/**
+ * @file capture-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines and prototypes for the logic analyser, which samples a whole port's input data
+ * register into RAM with timer triggered DMA and sends it back run length encoded.
+ * @version 0.1
+ * @date 2025-03-30
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef CAPTURE_CONTROL_H_
+#define CAPTURE_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Capture engine. Every TIM1 period the CC3 request (CCR3 = 0) has DMA2 stream 6 copy the port's
+// IDR into the sample buffer. TIM1 is the only timer DMA2, the one that reaches GPIO, answers,
+// so a capture and the pattern engine can't run at once.
+#define CAPTURE_MAX_SAMPLES (8192)    // 16 KB of RAM
+#define CAPTURE_MIN_SAMPLES (16)
+#define CAPTURE_MIN_HZ      (1)
+#define CAPTURE_MAX_HZ      (5000000) // One stream reading AHB1 keeps up to about here
+// Runs per FRAME_CAPTURE, after its 10 byte header. Fits FRAME_MAX_PAYLOAD.
+#define CAPTURE_FRAME_RUNS  (125)
+
+bool     captureStart(uint32_t port, uint16_t pins, uint32_t rate_hz, uint32_t samples,
+                      uint16_t trigger_mask, uint16_t trigger_value);
+bool     captureStop(void);
+bool     captureActive(void);
+uint32_t captureRate(void);
+void     captureClockChanged(void);
+bool     capturePending(void);
+void     captureService(void);
+
+#endif
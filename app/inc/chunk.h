@@ -0,0 +1,305 @@
+/**
+ * @file chunk.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Definitions for compiled lines ("chunks") of NiTTY bytecode.
+ * @note Loosely follows the chunk/VM split of clox from Crafting Interpreters, but with fixed
+ *       size storage so compiled lines can be cached and copied around freely.
+ * @version 0.1
+ * @date 2025-03-03
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "peripheral-controller.h"
+
+// enum definitions
+/**
+ * @brief Enum that defines different operations that can be carried out on pins & peripherals.
+ *
+ */
+typedef enum OpCode
+{
+    OP_SET,          // port, mask: set all pins in mask with one register write
+    OP_RESET,        // port, mask: clear all pins in mask with one register write
+    OP_TOGGLE,       // port, mask: toggle all pins in mask
+    OP_READ,         // port, mask (one pin): report digital or ADC value of a pin
+    OP_MAKE_INPUT,   // port, mask (one pin), operand: constants {clock, pupd}
+    OP_MAKE_OUTPUT,  // port, mask (one pin), operand: constants {clock, pupd}
+    OP_READ_PORT,    // port, mask: sample input data register once for later OP_READs
+    OP_ECHO,         // port, mask (one pin), operand: OpCode being acknowledged
+    OP_MAKE_ADC,     // port, mask (one pin), operand: constants {clock, base, channel, sample}
+    OP_UART_INIT,    // operand: constants, see UARTConstant
+    OP_UART_READ,    // port: uart handle or UART_ANY
+    OP_UART_WRITE,   // port: uart handle or UART_ANY, operand: (string offset << 16) | length
+    OP_UART_STATS,   // port: uart handle or UART_ANY
+    OP_STREAM,       // operand: frame rate in Hz, 0 to stop
+    OP_MODE,         // operand: 1 for binary console frames, 0 for text
+    OP_MAKE_PWM,     // port, mask (one pin), operand: constants, see PWMConstant
+    OP_PATTERN_STEP, // port, mask: pins to set, operand: constants, see PatternConstant
+    OP_PATTERN,      // operand: PatternCommand
+    OP_SCHEDULE,     // port: period ms, mask: 1 to repeat, operand: (string offset << 16) | length
+    OP_TASKS_LIST,   // no operands
+    OP_TASKS_KILL,   // operand: task id, 0 for every task
+    OP_IDLE,         // no operands
+    OP_WATCH,        // port, mask (one pin), operand: EXTI_EDGE_* to record, 0 to stop
+    OP_EVENTS,       // operand: 1 to forget the recorded edges, 0 to print them
+    OP_MAKE_MEASURE, // port, mask (one pin), operand: constants, see MeasureConstant
+    OP_STATS,        // operand: 1 to clear the latency records, 0 to print them
+    OP_SCRIPT_DEF,   // operand: (string offset << 16) | length of the script name
+    OP_SCRIPT_END,   // no operands
+    OP_SCRIPT_RUN,   // operand: (string offset << 16) | length of the script name
+    OP_SCRIPT_LIST,  // no operands
+    OP_SCRIPT_DEL,   // operand: (string offset << 16) | length of the script name
+    OP_UART_FLOW,    // port: uart handle, UART_ANY, USART2 for the console, operand: UartFlowControl
+    OP_VERBOSITY,    // operand: Verbosity
+    OP_UPDATE,       // no operands
+    OP_SAVE,         // operand: 1 to clear the saved configuration instead
+    OP_RESTORE,      // no operands
+    OP_CLOCK,        // operand: new CPU clock in MHz, 0 to print it
+    OP_CLOCKS,       // no operands
+    OP_UART_BRIDGE,  // port: uart handle or UART_ANY
+    OP_SPI_INIT,     // operand: constants, see SPIConstant
+    OP_SPI_XFER,     // port: SPI handle or SPI_ANY, operand: (string offset << 16) | length
+    OP_SPI_READ,     // port: SPI handle or SPI_ANY, operand: number of bytes
+    OP_I2C_INIT,     // operand: constants, see I2CConstant
+    OP_I2C_BATCH,    // port: I2C handle or I2C_ANY, mask: transactions, operand: constants
+    OP_I2C_SCAN,     // port: I2C handle or I2C_ANY
+    OP_CAPTURE,      // port, mask: trigger pins, operand: constants, see CaptureConstant
+    OP_CAPTURE_STOP, // no operands
+    OP_MEM,          // operand: 1 to reset the heap peaks and repaint the stack, 0 to print
+    OP_REPEAT,       // operand: passes of every instruction after it in the chunk
+    OP_DELAY,        // operand: microseconds to busy wait
+    OP_BENCH,        // no operands
+} OpCode;
+
+/**
+ * @brief Layout of the constants group used by OP_MAKE_INPUT and OP_MAKE_OUTPUT.
+ *
+ */
+typedef enum DigitalConstant
+{
+    DIGITAL_CONST_CLOCK,
+    DIGITAL_CONST_PUPD,
+    DIGITAL_CONST_COUNT,
+} DigitalConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_MAKE_ADC.
+ *
+ */
+typedef enum ADCConstant
+{
+    ADC_CONST_CLOCK,
+    ADC_CONST_BASE,
+    ADC_CONST_CHANNEL,
+    ADC_CONST_SAMPLE_TIME,
+    ADC_CONST_BITS,
+    ADC_CONST_AVERAGE,
+    ADC_CONST_COUNT,
+} ADCConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_UART_INIT.
+ *
+ */
+typedef enum UARTConstant
+{
+    UART_CONST_HANDLE,
+    UART_CONST_CLOCK,
+    UART_CONST_BAUDRATE,
+    UART_CONST_RX_PORT,
+    UART_CONST_TX_PORT,
+    UART_CONST_RX_PIN,
+    UART_CONST_TX_PIN,
+    UART_CONST_RX_CLOCK,
+    UART_CONST_TX_CLOCK,
+    UART_CONST_RX_AF,
+    UART_CONST_TX_AF,
+    UART_CONST_NVIC,
+    UART_CONST_COUNT,
+} UARTConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_MAKE_PWM.
+ *
+ */
+typedef enum PWMConstant
+{
+    PWM_CONST_CLOCK,
+    PWM_CONST_TIMER,
+    PWM_CONST_TIMER_CLOCK,
+    PWM_CONST_CHANNEL,
+    PWM_CONST_AF,
+    PWM_CONST_FREQUENCY,
+    PWM_CONST_DUTY,
+    PWM_CONST_COUNT,
+} PWMConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_MAKE_MEASURE.
+ *
+ */
+typedef enum MeasureConstant
+{
+    MEASURE_CONST_CLOCK,
+    MEASURE_CONST_TIMER,
+    MEASURE_CONST_TIMER_CLOCK,
+    MEASURE_CONST_CHANNEL,
+    MEASURE_CONST_AF,
+    MEASURE_CONST_PERIODS,
+    MEASURE_CONST_COUNT,
+} MeasureConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_SPI_INIT.
+ *
+ */
+typedef enum SPIConstant
+{
+    SPI_CONST_HANDLE,
+    SPI_CONST_CLOCK,
+    SPI_CONST_DIVIDER,
+    SPI_CONST_MODE,
+    SPI_CONST_SCK_PORT,
+    SPI_CONST_SCK_PIN,
+    SPI_CONST_SCK_CLOCK,
+    SPI_CONST_SCK_AF,
+    SPI_CONST_MISO_PORT,
+    SPI_CONST_MISO_PIN,
+    SPI_CONST_MISO_CLOCK,
+    SPI_CONST_MISO_AF,
+    SPI_CONST_MOSI_PORT,
+    SPI_CONST_MOSI_PIN,
+    SPI_CONST_MOSI_CLOCK,
+    SPI_CONST_MOSI_AF,
+    SPI_CONST_COUNT,
+} SPIConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_I2C_INIT.
+ *
+ */
+typedef enum I2CInitConstant
+{
+    I2C_CONST_HANDLE,
+    I2C_CONST_CLOCK,
+    I2C_CONST_SPEED,
+    I2C_CONST_SCL_PORT,
+    I2C_CONST_SCL_PIN,
+    I2C_CONST_SCL_CLOCK,
+    I2C_CONST_SCL_AF,
+    I2C_CONST_SDA_PORT,
+    I2C_CONST_SDA_PIN,
+    I2C_CONST_SDA_CLOCK,
+    I2C_CONST_SDA_AF,
+    I2C_CONST_COUNT,
+} I2CInitConstant;
+
+/**
+ * @brief Layout of each transaction's constants in an OP_I2C_BATCH group, one after another.
+ *
+ */
+typedef enum I2CBatchConstant
+{
+    I2C_CONST_WRITE, // (string offset << 16) | length, the address is the first byte
+    I2C_CONST_READ,  // bytes to read after the write, 0 for none
+    I2C_CONST_PER_TRANSACTION,
+} I2CBatchConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_CAPTURE.
+ *
+ */
+typedef enum CaptureConstant
+{
+    CAPTURE_CONST_RATE,          // samples per second
+    CAPTURE_CONST_SAMPLES,       // samples kept
+    CAPTURE_CONST_TRIGGER_VALUE, // levels the trigger pins must have, within mask
+    CAPTURE_CONST_COUNT,
+} CaptureConstant;
+
+/**
+ * @brief Layout of the constants group used by OP_PATTERN_STEP.
+ *
+ */
+typedef enum PatternConstant
+{
+    PATTERN_CONST_CLEAR_MASK,
+    PATTERN_CONST_DELAY,
+    PATTERN_CONST_COUNT,
+} PatternConstant;
+
+// Struct definitions
+/**
+ * @brief A single compiled instruction. Operands are resolved by the compiler so the VM never
+ * touches tokens or strings.
+ * @param op OpCode
+ * @param flags op specific flags, see INSTR_FLAG_*
+ * @param mask pin mask decoded by the compiler
+ * @param port GPIO port base address decoded by the compiler
+ * @param operand op specific operand
+ * @param bound_mask subset of mask the operation applies to. Filled in when bound to the board.
+ * @param periph peripheral this instruction acts on. Filled in when bound to the board.
+ */
+typedef struct Instruction
+{
+    uint8_t               op;
+    uint8_t               flags;
+    uint16_t              mask;
+    uint32_t              port;
+    uint32_t              operand;
+    uint16_t              bound_mask;
+    PeripheralController *periph;
+} Instruction;
+
+// Macro definitions
+// Pin identifier was written in lowercase, used to echo it back as typed.
+#define INSTR_FLAG_LOWERCASE   (0x01)
+
+// Fixed chunk storage
+#define CHUNK_MAX_INSTRUCTIONS (48)
+#define CHUNK_MAX_CONSTANTS    (32)
+#define CHUNK_MAX_STRINGS      (128)
+
+// Marks a chunk as not bound to any board state.
+#define CHUNK_UNBOUND          (0)
+
+/**
+ * @brief A compiled line.
+ * @param count number of instructions in code
+ * @param constants_count number of constants used
+ * @param strings_length number of bytes used in strings
+ * @param bound_generation board generation the instructions were last bound against
+ * @param code instructions
+ * @param constants constants pool for ops with more operands than fit in an instruction
+ * @param strings string pool (not null terminated)
+ */
+typedef struct Chunk
+{
+    uint16_t    count;
+    uint16_t    constants_count;
+    uint16_t    strings_length;
+    uint32_t    bound_generation;
+    Instruction code[CHUNK_MAX_INSTRUCTIONS];
+    uint32_t    constants[CHUNK_MAX_CONSTANTS];
+    char        strings[CHUNK_MAX_STRINGS];
+} Chunk;
+
+// Function prototypes
+void         initChunk(Chunk *chunk);
+Instruction *writeChunk(Chunk *chunk, OpCode op, uint32_t port, uint16_t mask, uint32_t operand);
+int          addConstants(Chunk *chunk, const uint32_t *values, size_t count);
+int          addString(Chunk *chunk, const char *string, size_t length);
+
+#endif
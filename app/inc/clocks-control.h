@@ -13,19 +13,31 @@
 
 // gcclib includes
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // libopencm3 includes
 #include "libopencm3/stm32/rcc.h"
 
 // local includes
 
+// Clock table. An rcc_periph_clken is (enable register offset << 5) + bit, so the table has a
+// row of 32 for each enable register: AHB1ENR, AHB2ENR, APB1ENR and APB2ENR.
+#define CLOCK_TABLE_ROWS (4)
+#define CLOCK_TABLE_SIZE (CLOCK_TABLE_ROWS * 32)
+#define CLOCK_NONE       (CLOCK_TABLE_SIZE) // clockIndex() of a clock outside the table
+
 /**
  * @brief ClockController structure
  * @param clock enum for actual peripheral clock
+ * @param refs live peripherals using the clock, it is gated off when the last one goes
+ * @param pinned held on by the firmware itself (the console's port), never gated off
  * @param clock_enabled whether that clock is enabled or not
  */
 typedef struct ClockController {
     enum rcc_periph_clken clock;
+    uint8_t refs;
+    bool pinned;
     bool clock_enabled;
 } ClockController;
 
@@ -34,5 +46,11 @@ typedef struct ClockController {
 ClockController create_clock(enum rcc_periph_clken clock_rcc);
 void enableClock(ClockController *clock_controller);
 void disableClock(ClockController *clock_controller);
+void clockTakeRef(ClockController *clock_controller);
+void clockDropRef(ClockController *clock_controller);
+size_t clockIndex(enum rcc_periph_clken clock_rcc);
+enum rcc_periph_clken clockFromIndex(size_t index);
+bool clockRunning(enum rcc_periph_clken clock_rcc);
+const char *clockName(enum rcc_periph_clken clock_rcc);
 
 #endif
\ No newline at end of file
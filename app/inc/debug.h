@@ -19,4 +19,7 @@
 #define UART_DEBUG
 #endif
 
+// LATENCY_STATS (per command timing for "stats") is switched on in the Makefile rather than here,
+// as the console output code in shared/ has to see it too. So is MEM_STATS ("mem").
+
 #endif
\ No newline at end of file
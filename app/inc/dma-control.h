@@ -0,0 +1,68 @@
+/**
+ * @file dma-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines, types and prototypes for sharing the DMA streams between peripherals.
+ * @version 0.1
+ * @date 2025-03-05
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef DMA_CONTROL_H_
+#define DMA_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libopencm3/cm3/nvic.h"
+#include "libopencm3/stm32/dma.h"
+#include "libopencm3/stm32/rcc.h"
+
+/**
+ * @brief A DMA stream and the request channel it is used with.
+ * @param dma DMA controller (DMA1 or DMA2)
+ * @param stream stream 0-7
+ * @param channel request channel, DMA_SxCR_CHSEL_n
+ * @param nvic_entry interrupt table entry for the stream
+ */
+typedef struct DMAStream {
+    uint32_t dma;
+    uint8_t  stream;
+    uint32_t channel;
+    int      nvic_entry;
+} DMAStream;
+
+// Stream assignments, see RM0383 table 27/28. DMA1 cannot reach AHB1 (GPIO), DMA2 can.
+#define DMA_CONSOLE_RX ((DMAStream){.dma = DMA1, .stream = DMA_STREAM5, .channel = DMA_SxCR_CHSEL_4, .nvic_entry = NVIC_DMA1_STREAM5_IRQ})
+#define DMA_USART1_RX  ((DMAStream){.dma = DMA2, .stream = DMA_STREAM2, .channel = DMA_SxCR_CHSEL_4, .nvic_entry = NVIC_DMA2_STREAM2_IRQ})
+#define DMA_USART6_RX  ((DMAStream){.dma = DMA2, .stream = DMA_STREAM1, .channel = DMA_SxCR_CHSEL_5, .nvic_entry = NVIC_DMA2_STREAM1_IRQ})
+#define DMA_ADC1       ((DMAStream){.dma = DMA2, .stream = DMA_STREAM4, .channel = DMA_SxCR_CHSEL_0, .nvic_entry = NVIC_DMA2_STREAM4_IRQ})
+#define DMA_TIM1_UP    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM5, .channel = DMA_SxCR_CHSEL_6, .nvic_entry = NVIC_DMA2_STREAM5_IRQ})
+#define DMA_TIM1_CH1   ((DMAStream){.dma = DMA2, .stream = DMA_STREAM3, .channel = DMA_SxCR_CHSEL_6, .nvic_entry = NVIC_DMA2_STREAM3_IRQ})
+#define DMA_TIM1_CH3   ((DMAStream){.dma = DMA2, .stream = DMA_STREAM6, .channel = DMA_SxCR_CHSEL_6, .nvic_entry = NVIC_DMA2_STREAM6_IRQ})
+// SPI streams are only claimed for the length of a transfer. SPI3 TX avoids stream 5, the console's.
+#define DMA_SPI1_RX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM0, .channel = DMA_SxCR_CHSEL_3, .nvic_entry = NVIC_DMA2_STREAM0_IRQ})
+#define DMA_SPI1_TX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM3, .channel = DMA_SxCR_CHSEL_3, .nvic_entry = NVIC_DMA2_STREAM3_IRQ})
+#define DMA_SPI2_RX    ((DMAStream){.dma = DMA1, .stream = DMA_STREAM3, .channel = DMA_SxCR_CHSEL_0, .nvic_entry = NVIC_DMA1_STREAM3_IRQ})
+#define DMA_SPI2_TX    ((DMAStream){.dma = DMA1, .stream = DMA_STREAM4, .channel = DMA_SxCR_CHSEL_0, .nvic_entry = NVIC_DMA1_STREAM4_IRQ})
+#define DMA_SPI3_RX    ((DMAStream){.dma = DMA1, .stream = DMA_STREAM0, .channel = DMA_SxCR_CHSEL_0, .nvic_entry = NVIC_DMA1_STREAM0_IRQ})
+#define DMA_SPI3_TX    ((DMAStream){.dma = DMA1, .stream = DMA_STREAM7, .channel = DMA_SxCR_CHSEL_0, .nvic_entry = NVIC_DMA1_STREAM7_IRQ})
+#define DMA_SPI4_RX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM0, .channel = DMA_SxCR_CHSEL_4, .nvic_entry = NVIC_DMA2_STREAM0_IRQ})
+#define DMA_SPI4_TX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM1, .channel = DMA_SxCR_CHSEL_4, .nvic_entry = NVIC_DMA2_STREAM1_IRQ})
+#define DMA_SPI5_RX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM5, .channel = DMA_SxCR_CHSEL_7, .nvic_entry = NVIC_DMA2_STREAM5_IRQ})
+#define DMA_SPI5_TX    ((DMAStream){.dma = DMA2, .stream = DMA_STREAM6, .channel = DMA_SxCR_CHSEL_7, .nvic_entry = NVIC_DMA2_STREAM6_IRQ})
+
+bool claimDMAStream(DMAStream stream);
+void releaseDMAStream(DMAStream stream);
+bool isDMAStreamClaimed(DMAStream stream);
+void setupDMAPeripheralToMemory(DMAStream stream, uint32_t peripheral_address, void *memory,
+                                uint16_t count, bool circular);
+void setupDMAPeripheralToMemory16(DMAStream stream, uint32_t peripheral_address, void *memory,
+                                  uint16_t count, bool circular);
+void setupDMAMemoryToPeripheral(DMAStream stream, uint32_t peripheral_address, const void *memory,
+                                uint16_t count, bool circular);
+void setupDMAMemoryToPeripheral32(DMAStream stream, uint32_t peripheral_address,
+                                  const void *memory, uint16_t count, bool circular);
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * @file exti-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines, types and prototypes for watching input pins for edges with EXTI.
+ * @version 0.1
+ * @date 2025-03-17
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef EXTI_CONTROL_H_
+#define EXTI_CONTROL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Edges a watched pin records. EXTI has one line per pin number, shared between ports.
+#define EXTI_EDGE_NONE        (0)
+#define EXTI_EDGE_RISING      (1)
+#define EXTI_EDGE_FALLING     (2)
+#define EXTI_EDGE_BOTH        (EXTI_EDGE_RISING | EXTI_EDGE_FALLING)
+
+#define EXTI_LINE_COUNT       (16)
+#define EXTI_EVENT_QUEUE_SIZE (1024) // bytes, must be a power of two. 63 events.
+
+/**
+ * @brief One recorded edge.
+ * @param cycles CPU cycle count when the interrupt ran, see coreSystemCycles()
+ * @param port_index port of the pin, 0 = A
+ * @param pin_number pin 0-15
+ * @param level pin level just after the edge, 1 for rising
+ */
+typedef struct ExtiEvent
+{
+    uint64_t cycles;
+    uint8_t  port_index;
+    uint8_t  pin_number;
+    uint8_t  level;
+    uint8_t  reserved[5];
+} ExtiEvent;
+
+void     extiSetup(void);
+bool     extiWatch(uint32_t port, uint16_t pin, uint8_t edges);
+void     extiUnwatch(uint32_t port, uint16_t pin);
+size_t   extiReadEvents(ExtiEvent *events, size_t max_events);
+void     extiClearEvents(void);
+uint32_t extiTakeDropped(void);
+
+#endif
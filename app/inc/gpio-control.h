@@ -36,6 +36,7 @@ typedef enum GPIOAction {
  * @param mode whether the structure is being used as input, output, analog or alternative function
  * @param af_mode what alternative function mode is used. Ignore if in any other mode.
  * @param pupd_resistor where a pull-up/pull-down resistor is in use. 
+ * @param exti_edges edges the pin's EXTI line records, EXTI_EDGE_NONE unless "watch"ed.
  */
 typedef struct GPIOPinController {
     uint32_t port;
@@ -44,6 +45,7 @@ typedef struct GPIOPinController {
     uint8_t mode; //  input/output/AF/Analog
     uint8_t af_mode; // if mode != AF or ANALOG ingore
     uint8_t pupd_resistor;
+    uint8_t exti_edges;
 } GPIOPinController;
 
 // Function definitions
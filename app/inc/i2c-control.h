@@ -0,0 +1,80 @@
+/**
+ * @file i2c-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines, types and prototypes for I2C masters. Transactions are queued as a batch and run
+ * from the I2C interrupts, the reply is sent from the main loop once the whole batch is done.
+ * @version 0.1
+ * @date 2025-03-29
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef I2C_CONTROL_H_
+#define I2C_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gpio-control.h"
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/i2c.h"
+#include "libopencm3/stm32/rcc.h"
+
+// Bus speeds, standard and fast mode.
+#define I2C_STANDARD_KHZ     (100)
+#define I2C_FAST_KHZ         (400)
+
+// One batch per bus at a time. Reads are limited so every byte fits on the one reply line.
+#define I2C_MAX_TRANSACTIONS (8)
+#define I2C_MAX_WRITE        (64)  // bytes written by a batch, addresses not counted
+#define I2C_MAX_READ         (32)  // bytes read by a batch
+#define I2C_BATCH_TIMEOUT_MS (200) // a held bus or a missing pull-up, the batch is abandoned
+
+// Addresses probed by a scan, the reserved ones at either end are left out.
+#define I2C_SCAN_FIRST       (0x08)
+#define I2C_SCAN_LAST        (0x77)
+
+/**
+ * @brief How one transaction of a batch ended.
+ *
+ */
+typedef enum I2CStatus
+{
+    I2C_STATUS_PENDING, // not run yet
+    I2C_STATUS_ACK,     // every byte written was acknowledged, and every byte asked for read
+    I2C_STATUS_NACK,    // the address or a written byte was not acknowledged
+    I2C_STATUS_ERROR,   // bus error or arbitration lost
+    I2C_STATUS_TIMEOUT, // the batch timed out before this ran
+} I2CStatus;
+
+/**
+ * @brief I2C master.
+ * @param handle I2C peripheral (I2C1-I2C3)
+ * @param i2c_clock RCC clock of the peripheral
+ * @param speed_khz bus speed, I2C_STANDARD_KHZ or I2C_FAST_KHZ
+ * @param SCL clock pin, open drain
+ * @param SDA data pin, open drain
+ */
+typedef struct I2CController {
+    uint32_t              handle;
+    enum rcc_periph_clken i2c_clock;
+    uint16_t              speed_khz;
+    GPIOPinController     SCL;
+    GPIOPinController     SDA;
+} I2CController;
+
+I2CController createI2CPeripheral(uint32_t handle, enum rcc_periph_clken i2c_clock,
+                                  uint16_t speed_khz, GPIOPinController scl,
+                                  GPIOPinController sda);
+void currentI2CSetup(I2CController *i2c);
+void currentI2CStop(I2CController *i2c);
+bool currentI2CBegin(const I2CController *i2c);
+bool currentI2CQueue(const I2CController *i2c, uint8_t address, const uint8_t *write,
+                     uint8_t write_length, uint8_t read_length);
+void currentI2CStart(const I2CController *i2c, bool scan);
+int  currentI2CNumber(uint32_t handle);
+bool i2cPending(void);
+void i2cService(void);
+
+#endif
@@ -23,6 +23,7 @@
 
 // local includes
 #include "board-control.h"
+#include "chunk.h"
 #include "token.h"
 #include "parser.h"
 
@@ -39,9 +40,24 @@ typedef struct Scanner {
 } Scanner;
 
 // Macro definitions
+// Compiled line cache. Lines are short (see repl()) so a handful of slots covers typical use.
+#define LINE_CACHE_SIZE      (4)
+#define LINE_CACHE_TEXT_SIZE (32)
 
+/**
+ * @brief A compiled line kept for reuse.
+ * @param valid slot holds a compiled line
+ * @param text source text the chunk was compiled from
+ * @param chunk compiled line
+ */
+typedef struct LineCacheEntry {
+    bool  valid;
+    char  text[LINE_CACHE_TEXT_SIZE];
+    Chunk chunk;
+} LineCacheEntry;
 
 // function prototypes
+bool compileLine(const char *source, Chunk *chunk);
 bool interpret(BoardController *bc, char *source, size_t length);
 
 
@@ -0,0 +1,81 @@
+// Generated by host/keyword-gen.c from inc/keywords.h, don't edit.
+#ifndef KEYWORD_HASH_H_
+#define KEYWORD_HASH_H_
+
+#include "keywords.h"
+
+#define KEYWORD_HASH_SEED    (0x000011C9U)
+#define KEYWORD_HASH_SIZE    (256)
+#define KEYWORD_HASH_COUNT   (66)
+#define KEYWORD_HASH_LONGEST (9)
+
+static const Keyword keyword_table[KEYWORD_HASH_SIZE] = {
+    [0] = {"pup", 3, TOKEN_GPIO_PULLUP},
+    [1] = {"every", 5, TOKEN_EVERY},
+    [3] = {"def", 3, TOKEN_DEF},
+    [4] = {"rising", 6, TOKEN_RISING},
+    [8] = {"mem", 3, TOKEN_MEM},
+    [27] = {"pattern", 7, TOKEN_PATTERN},
+    [29] = {"terse", 5, TOKEN_TERSE},
+    [34] = {"after", 5, TOKEN_AFTER},
+    [38] = {"end", 3, TOKEN_END},
+    [40] = {"clocks", 6, TOKEN_CLOCKS},
+    [41] = {"reset", 5, TOKEN_GPIO_RESET},
+    [43] = {"flow", 4, TOKEN_FLOW},
+    [44] = {"binary", 6, TOKEN_BINARY},
+    [51] = {"list", 4, TOKEN_LIST},
+    [55] = {"measure", 7, TOKEN_MEASURE},
+    [56] = {"mode", 4, TOKEN_MODE},
+    [58] = {"ms", 2, TOKEN_MS},
+    [63] = {"adc", 3, TOKEN_ADC},
+    [66] = {"stats", 5, TOKEN_STATS},
+    [67] = {"scan", 4, TOKEN_SCAN},
+    [68] = {"repeat", 6, TOKEN_REPEAT},
+    [70] = {"bits", 4, TOKEN_BITS},
+    [86] = {"spi", 3, TOKEN_SPI},
+    [88] = {"toggle", 6, TOKEN_GPIO_TOGGLE},
+    [90] = {"i2c", 3, TOKEN_I2C},
+    [91] = {"xonxoff", 7, TOKEN_XONXOFF},
+    [93] = {"del", 3, TOKEN_DEL},
+    [102] = {"stop", 4, TOKEN_STOP},
+    [103] = {"falling", 7, TOKEN_FALLING},
+    [105] = {"clear", 5, TOKEN_CLEAR},
+    [107] = {"uart", 4, TOKEN_UART},
+    [111] = {"update", 6, TOKEN_UPDATE},
+    [112] = {"watch", 5, TOKEN_WATCH},
+    [119] = {"us", 2, TOKEN_US},
+    [121] = {"xfer", 4, TOKEN_XFER},
+    [125] = {"sample", 6, TOKEN_SAMPLE},
+    [128] = {"delay", 5, TOKEN_DELAY},
+    [134] = {"both", 4, TOKEN_BOTH},
+    [137] = {"bench", 5, TOKEN_BENCH},
+    [140] = {"output", 6, TOKEN_GPIO_OUTPUT},
+    [147] = {"bridge", 6, TOKEN_BRIDGE},
+    [151] = {"save", 4, TOKEN_SAVE},
+    [156] = {"tasks", 5, TOKEN_TASKS},
+    [157] = {"write", 5, TOKEN_WRITE},
+    [161] = {"events", 6, TOKEN_EVENTS},
+    [162] = {"pwm", 3, TOKEN_PWM},
+    [175] = {"read", 4, TOKEN_GPIO_READ},
+    [176] = {"set", 3, TOKEN_GPIO_SET},
+    [179] = {"full", 4, TOKEN_FULL},
+    [181] = {"restore", 7, TOKEN_RESTORE},
+    [184] = {"none", 4, TOKEN_GPIO_NORESISTOR},
+    [186] = {"loop", 4, TOKEN_LOOP},
+    [188] = {"kill", 4, TOKEN_KILL},
+    [191] = {"silent", 6, TOKEN_SILENT},
+    [193] = {"clock", 5, TOKEN_CLOCK},
+    [198] = {"stream", 6, TOKEN_STREAM},
+    [210] = {"capture", 7, TOKEN_CAPTURE},
+    [222] = {"idle", 4, TOKEN_IDLE},
+    [223] = {"verbosity", 9, TOKEN_VERBOSITY},
+    [226] = {"average", 7, TOKEN_AVERAGE},
+    [227] = {"text", 4, TOKEN_TEXT},
+    [238] = {"input", 5, TOKEN_GPIO_INPUT},
+    [242] = {"pdown", 5, TOKEN_GPIO_PULLDOWN},
+    [251] = {"run", 3, TOKEN_RUN},
+    [252] = {"rtscts", 6, TOKEN_RTSCTS},
+    [255] = {"trigger", 7, TOKEN_TRIGGER},
+};
+
+#endif
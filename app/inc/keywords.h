@@ -0,0 +1,113 @@
+/**
+ * @file keywords.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Every keyword of the language and the hash the scanner looks them up with. The lookup
+ * table itself is keyword-hash.h, generated from this list by host/keyword-gen.c whenever it
+ * changes. To add a keyword (or another spelling of one) add a line to KEYWORD_LIST.
+ * @version 0.1
+ * @date 2025-03-23
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef KEYWORDS_H_
+#define KEYWORDS_H_
+
+// libgcc includes
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "token.h"
+
+// Macro definitions
+// X(text, token) for every keyword. Case matters, "SET" isn't a keyword.
+#define KEYWORD_LIST(X)                                                                            \
+    X("adc", TOKEN_ADC)                                                                            \
+    X("after", TOKEN_AFTER)                                                                        \
+    X("average", TOKEN_AVERAGE)                                                                    \
+    X("bench", TOKEN_BENCH)                                                                        \
+    X("binary", TOKEN_BINARY)                                                                      \
+    X("bits", TOKEN_BITS)                                                                          \
+    X("both", TOKEN_BOTH)                                                                          \
+    X("bridge", TOKEN_BRIDGE)                                                                      \
+    X("capture", TOKEN_CAPTURE)                                                                    \
+    X("clear", TOKEN_CLEAR)                                                                        \
+    X("clock", TOKEN_CLOCK)                                                                        \
+    X("clocks", TOKEN_CLOCKS)                                                                      \
+    X("def", TOKEN_DEF)                                                                            \
+    X("del", TOKEN_DEL)                                                                            \
+    X("delay", TOKEN_DELAY)                                                                        \
+    X("end", TOKEN_END)                                                                            \
+    X("every", TOKEN_EVERY)                                                                        \
+    X("events", TOKEN_EVENTS)                                                                      \
+    X("falling", TOKEN_FALLING)                                                                    \
+    X("flow", TOKEN_FLOW)                                                                          \
+    X("full", TOKEN_FULL)                                                                          \
+    X("i2c", TOKEN_I2C)                                                                            \
+    X("idle", TOKEN_IDLE)                                                                          \
+    X("input", TOKEN_GPIO_INPUT)                                                                   \
+    X("kill", TOKEN_KILL)                                                                          \
+    X("list", TOKEN_LIST)                                                                          \
+    X("loop", TOKEN_LOOP)                                                                          \
+    X("measure", TOKEN_MEASURE)                                                                    \
+    X("mem", TOKEN_MEM)                                                                            \
+    X("mode", TOKEN_MODE)                                                                          \
+    X("ms", TOKEN_MS)                                                                              \
+    X("none", TOKEN_GPIO_NORESISTOR)                                                               \
+    X("output", TOKEN_GPIO_OUTPUT)                                                                 \
+    X("pattern", TOKEN_PATTERN)                                                                    \
+    X("pdown", TOKEN_GPIO_PULLDOWN)                                                                \
+    X("pup", TOKEN_GPIO_PULLUP)                                                                    \
+    X("pwm", TOKEN_PWM)                                                                            \
+    X("read", TOKEN_GPIO_READ)                                                                     \
+    X("repeat", TOKEN_REPEAT)                                                                      \
+    X("reset", TOKEN_GPIO_RESET)                                                                   \
+    X("restore", TOKEN_RESTORE)                                                                    \
+    X("rising", TOKEN_RISING)                                                                      \
+    X("rtscts", TOKEN_RTSCTS)                                                                      \
+    X("run", TOKEN_RUN)                                                                            \
+    X("sample", TOKEN_SAMPLE)                                                                      \
+    X("save", TOKEN_SAVE)                                                                          \
+    X("scan", TOKEN_SCAN)                                                                          \
+    X("set", TOKEN_GPIO_SET)                                                                       \
+    X("silent", TOKEN_SILENT)                                                                      \
+    X("spi", TOKEN_SPI)                                                                            \
+    X("stats", TOKEN_STATS)                                                                        \
+    X("stop", TOKEN_STOP)                                                                          \
+    X("stream", TOKEN_STREAM)                                                                      \
+    X("tasks", TOKEN_TASKS)                                                                        \
+    X("terse", TOKEN_TERSE)                                                                        \
+    X("text", TOKEN_TEXT)                                                                          \
+    X("toggle", TOKEN_GPIO_TOGGLE)                                                                 \
+    X("trigger", TOKEN_TRIGGER)                                                                    \
+    X("uart", TOKEN_UART)                                                                          \
+    X("update", TOKEN_UPDATE)                                                                      \
+    X("us", TOKEN_US)                                                                              \
+    X("verbosity", TOKEN_VERBOSITY)                                                                \
+    X("watch", TOKEN_WATCH)                                                                        \
+    X("write", TOKEN_WRITE)                                                                        \
+    X("xfer", TOKEN_XFER)                                                                          \
+    X("xonxoff", TOKEN_XONXOFF)
+
+// FNV-1a, one step per character as the scanner reads them. The generator picks the starting
+// value (KEYWORD_HASH_SEED) so no two keywords land in the same slot.
+#define KEYWORD_HASH_STEP(hash, c)    (((hash) ^ (uint8_t)(c)) * 0x01000193U)
+#define KEYWORD_HASH_SLOT(hash, size) ((((hash) >> 16) ^ (hash)) & ((size) - 1))
+
+// Struct definitions
+/**
+ * @brief A slot of the keyword table. Empty slots have length 0, which no word matches.
+ * @param text keyword
+ * @param length characters in text
+ * @param type token the keyword scans as
+ */
+typedef struct Keyword
+{
+    const char *text;
+    int         length;
+    TokenType   type;
+} Keyword;
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file latency-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Per command latency instrumentation from the DWT cycle counter. Build with
+ * -D LATENCY_STATS to turn it on, otherwise every LATENCY_* macro compiles to nothing.
+ * @version 0.1
+ * @date 2025-03-19
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LATENCY_CONTROL_H_
+#define LATENCY_CONTROL_H_
+
+// libgcc includes
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+
+// Macro definitions
+#define LATENCY_MAX_KEYWORDS (16)
+#define LATENCY_BUCKETS      (8) // total time histogram, bucket n is under 4^(n+1) us
+
+/**
+ * @brief Phases of a console line, in the order they happen. Output is the time spent in printf,
+ * whichever phase it happened in.
+ *
+ */
+typedef enum LatencyPhase
+{
+    LATENCY_SCAN,   // '\r' to tokens, or the cache lookup on a hit
+    LATENCY_PARSE,  // tokens to chunk
+    LATENCY_ACTION, // running the chunk: VM and board
+    LATENCY_OUTPUT, // console output
+    LATENCY_TOTAL,  // '\r' to the end of the response
+    LATENCY_PHASE_COUNT,
+} LatencyPhase;
+
+#ifdef LATENCY_STATS
+// Struct definitions
+/**
+ * @brief Min, max and sum of one phase over every line of a keyword.
+ * @param min fewest cycles
+ * @param max most cycles
+ * @param sum total cycles, for the mean
+ */
+typedef struct LatencySpread
+{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} LatencySpread;
+
+// Function prototypes
+void latencyLineBegin(void);
+void latencyMark(LatencyPhase phase);
+void latencyLineEnd(const char *line);
+void latencyPrint(void);
+void latencyReset(void);
+
+#define LATENCY_LINE_BEGIN()    latencyLineBegin()
+#define LATENCY_MARK(phase)     latencyMark(phase)
+#define LATENCY_LINE_END(line)  latencyLineEnd(line)
+#else
+#define LATENCY_LINE_BEGIN()    ((void)0)
+#define LATENCY_MARK(phase)     ((void)0)
+#define LATENCY_LINE_END(line)  ((void)0)
+#endif
+
+#endif
@@ -12,9 +12,40 @@
 #define LOCAL_MEMORY_H_
 
 // gcclib includes
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+/**
+ * @brief Size in bytes of the line arena. Everything allocated while a single line is interpreted
+ * comes from here, so the REPL never touches the heap. Host builds raise it with -D, their
+ * pointers are twice the size.
+ *
+ */
+#ifndef LINE_ARENA_SIZE
+#define LINE_ARENA_SIZE (1024)
+#endif
+
+/**
+ * @brief Alignment of every line arena allocation.
+ *
+ */
+#define LINE_ARENA_ALIGN (8)
+
+/**
+ * @brief Call site passed to reallocate(), "file:line" when MEM_STATS counts allocations per site.
+ *
+ */
+#ifdef MEM_STATS
+#define MEM_SITE_STRING(line) #line
+#define MEM_SITE_LINE(line)   MEM_SITE_STRING(line)
+#define MEM_SITE              (__FILE__ ":" MEM_SITE_LINE(__LINE__))
+#define MEM_MAX_SITES         (16)
+#else
+#define MEM_SITE              (NULL)
+#endif
+
 /**
  * @brief grows previous capacity
  * 
@@ -27,16 +58,78 @@
  */
 #define GROW_ARRAY(type, pointer, oldCount, newCount) \
     (type *)reallocate(pointer, sizeof(type) * (oldCount), \
-    sizeof(type) * (newCount))
+    sizeof(type) * (newCount), MEM_SITE)
 
 /**
  * @brief frees an entire array.
  * 
  */
 #define FREE_ARRAY(type, pointer, oldCount) \
-    reallocate(pointer, sizeof(type) * oldCount, 0)
+    reallocate(pointer, sizeof(type) * oldCount, 0, MEM_SITE)
+
+/**
+ * @brief allocates count of type, for what would otherwise be a bare malloc.
+ *
+ */
+#define ALLOCATE(type, count) \
+    (type *)reallocate(NULL, 0, sizeof(type) * (count), MEM_SITE)
+
+/**
+ * @brief frees a single object from ALLOCATE.
+ *
+ */
+#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0, MEM_SITE)
+
+#ifdef MEM_STATS
+// Struct definitions
+/**
+ * @brief Heap calls made from one call site.
+ * @param site "file:line" of the call
+ * @param allocs new blocks
+ * @param resizes blocks grown or shrunk
+ * @param frees blocks freed
+ * @param failures calls the heap couldn't satisfy
+ * @param largest biggest size asked for, in bytes
+ */
+typedef struct MemSiteRecord
+{
+    const char *site;
+    uint32_t    allocs;
+    uint32_t    resizes;
+    uint32_t    frees;
+    uint32_t    failures;
+    size_t      largest;
+} MemSiteRecord;
+
+/**
+ * @brief Everything reallocate() has handed out, by the sizes its callers gave it.
+ * @param live bytes allocated now
+ * @param peak most bytes allocated at once
+ * @param blocks blocks allocated now
+ * @param peak_blocks most blocks allocated at once
+ * @param sites per call site records
+ * @param sites_count records in use
+ * @param untracked calls whose site didn't fit in the table
+ */
+typedef struct MemHeapStats
+{
+    size_t        live;
+    size_t        peak;
+    uint32_t      blocks;
+    uint32_t      peak_blocks;
+    MemSiteRecord sites[MEM_MAX_SITES];
+    size_t        sites_count;
+    uint32_t      untracked;
+} MemHeapStats;
+
+const MemHeapStats *memHeapStats(void);
+void                memHeapReset(void);
+#endif
 
-void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+void *reallocate(void *pointer, size_t oldSize, size_t newSize, const char *site);
+void  resetLineArena(void);
+void *allocateLineArena(size_t size);
+size_t usedLineArena(void);
 
 
 
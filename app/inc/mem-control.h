@@ -0,0 +1,37 @@
+/**
+ * @file mem-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief RAM instrumentation for "mem": heap totals and call sites from reallocate(), malloc's own
+ * view of the heap, and the stack high-water mark from painting the stack region of
+ * linkerscript.ld. Build with -D MEM_STATS to turn it on.
+ * @version 0.1
+ * @date 2025-04-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef MEM_CONTROL_H_
+#define MEM_CONTROL_H_
+
+// libgcc includes
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+
+// Macro definitions
+#define MEM_STACK_PAINT (0xC5C5C5C5U) // unlikely as data, an address or code
+
+#ifdef MEM_STATS
+// Function prototypes
+void memStackPaint(void);
+void memPrint(void);
+void memReset(void);
+
+#define MEM_STACK_PAINT_AT_BOOT() memStackPaint()
+#else
+#define MEM_STACK_PAINT_AT_BOOT() ((void)0)
+#endif
+
+#endif
@@ -16,114 +16,209 @@
 #include <stdint.h>
 
 // libopencm3 includes
+#include "libopencm3/cm3/nvic.h"
+#include "libopencm3/stm32/adc.h"
 #include "libopencm3/stm32/gpio.h"
 #include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/timer.h"
+#include "libopencm3/stm32/usart.h"
 
 // local includes
 #include "board-control.h"
+#include "chunk.h"
 #include "token.h"
 
-// enum definitions
+// Struct definitions
 /**
- * @brief Enum that defines different operations that can be carried out on pins & peripherals.
+ * @brief A GPIO port of the board.
  *
  */
-typedef enum OpCode
-{
-    OP_SET,
-    OP_RESET,
-    OP_TOGGLE,
-    OP_READ,
-    OP_MAKE_INPUT,
-    OP_MAKE_OUTPUT,
-} OpCode;
+typedef struct BoardPort {
+    uint32_t              base;
+    enum rcc_periph_clken clock;
+} BoardPort;
 
-// Struct definitions
 /**
- * @brief This is the value returned by the function to check if uart pins are valid. 
- * 
+ * @brief What one pin can be used as, from the board's generated table. Each field is 1 + the
+ * index of the pin's entry in that peripheral's mapping table below, 0 if it has none. SPI and
+ * I2C pins can be on more than one peripheral, so those are a bit per entry instead.
+ *
  */
-typedef struct UARTValidPin {
-    bool isValid;
-    bool isTx;
-    bool isRx;
-    uint32_t handle;
-    uint8_t af_mode;
-} UARTValidPin;
-
+typedef struct BoardPin {
+    uint8_t  adc;
+    uint8_t  uart;
+    uint8_t  pwm;
+    uint8_t  measure;
+    uint32_t spi;
+    uint16_t i2c;
+} BoardPin;
 
 // Macro definitions
 // Max args for inputOutput function
 #define INPUT_OUTPUT_MAX_ARGS (3)
 
+// Turns an entry of a board list into an entry of its table, fields in the order of the list.
+#define BOARD_ENTRY(...)      {__VA_ARGS__},
+
+// Every port of the board, indexed by (port - GPIOA) / PORT_SIZE.
+static const BoardPort boardPorts[BOARD_PORT_COUNT] = {BOARD_PORT_LIST(BOARD_ENTRY)};
+
 // ADC defines
-#define ADC_MAX_ARGS          (2)
+#define ADC_MAX_ARGS          (8) // adc and the pin, then bits, sample and average with values
 typedef struct {
     uint32_t port;
     uint32_t pin;
     int adc_channel;
 } ADCPinMapping;
 
-static const ADCPinMapping adcPinMappings[] = {
-    {GPIOA, GPIO0, ADC_CHANNEL0},
-    {GPIOA, GPIO1, ADC_CHANNEL1},
-    {GPIOA, GPIO4, ADC_CHANNEL4},
-    {GPIOA, GPIO5, ADC_CHANNEL5},
-    {GPIOA, GPIO6, ADC_CHANNEL6},
-    {GPIOA, GPIO7, ADC_CHANNEL7},
-    {GPIOB, GPIO0, ADC_CHANNEL8},
-    {GPIOB, GPIO1, ADC_CHANNEL9},
-    {GPIOC, GPIO0, ADC_CHANNEL10},
-    {GPIOC, GPIO1, ADC_CHANNEL11},
-    {GPIOC, GPIO2, ADC_CHANNEL12},
-    {GPIOC, GPIO3, ADC_CHANNEL13},
-    {GPIOC, GPIO4, ADC_CHANNEL14},
-    {GPIOC, GPIO5, ADC_CHANNEL15}
- 
+static const ADCPinMapping adcPinMappings[] = {BOARD_ADC_LIST(BOARD_ENTRY)};
+
+typedef struct {
+    uint32_t cycles;
+    uint32_t sample_time;
+} ADCSampleTimeMapping;
+
+static const ADCSampleTimeMapping adcSampleTimeMappings[] = {
+    {3, ADC_SMPR_SMP_3CYC},
+    {15, ADC_SMPR_SMP_15CYC},
+    {28, ADC_SMPR_SMP_28CYC},
+    {56, ADC_SMPR_SMP_56CYC},
+    {84, ADC_SMPR_SMP_84CYC},
+    {112, ADC_SMPR_SMP_112CYC},
+    {144, ADC_SMPR_SMP_144CYC},
+    {480, ADC_SMPR_SMP_480CYC}
 };
 
-#define ADC_PIN_MAP_SIZE (14)
+#define ADC_SAMPLE_TIME_MAP_SIZE (8)
 
 // defines for UART
 #define UART_INIT_MAX_ARGS    (4)
-#define UART1_AF GPIO_AF7
-#define UART6_AF GPIO_AF8
-#define UART1_TX_PIN ((UARTValidPin) {.isValid = true, .handle = USART1, .isTx = true, .isRx = false, .af_mode = UART1_AF})
-#define UART1_RX_PIN ((UARTValidPin) {.isValid = true, .handle = USART1, .isTx = false, .isRx = true, .af_mode = UART1_AF})
-#define UART6_TX_PIN ((UARTValidPin) {.isValid = true, .handle = USART6, .isTx = true, .isRx = false, .af_mode = UART6_AF})
-#define UART6_RX_PIN ((UARTValidPin) {.isValid = true, .handle = USART6, .isTx = false, .isRx = true, .af_mode = UART6_AF})
-#define UART_INVALID_PIN ((UARTValidPin){.isValid = false, .handle = 0, .isRx = false, .isTx = false, .af_mode = 0})
-
 #define UART_MAX_READ (32)
 
+/**
+ * @brief What a UART pin carries.
+ *
+ */
+typedef enum UARTPinRole {
+    UART_PIN_RX,
+    UART_PIN_TX,
+} UARTPinRole;
+
 // Defines for UART pin mappings
 typedef struct {
     uint32_t port;
     uint32_t pin;
-    UARTValidPin uartPin;
+    uint32_t handle;
+    enum rcc_periph_clken uart_clock;
+    uint8_t nvic_entry;
+    UARTPinRole role;
+    uint8_t af_mode;
 } UARTPinMapping;
 
 // "lookup  table" for UART pin maps
-static const UARTPinMapping uartPinMappings[] = {
-    {GPIOA, GPIO9, UART1_TX_PIN},
-    {GPIOA, GPIO10, UART1_RX_PIN},
-    {GPIOA, GPIO11, UART6_TX_PIN},
-    {GPIOA, GPIO12, UART6_RX_PIN},
-    {GPIOA, GPIO15, UART1_TX_PIN},
-    {GPIOB, GPIO3, UART1_RX_PIN},
-    {GPIOB, GPIO6, UART1_TX_PIN},
-    {GPIOB, GPIO7, UART1_RX_PIN},
-    {GPIOC, GPIO6, UART6_TX_PIN},
-    {GPIOC, GPIO7, UART6_RX_PIN}
-};
+static const UARTPinMapping uartPinMappings[] = {BOARD_UART_LIST(BOARD_ENTRY)};
+
+// defines for PWM
+#define PWM_MAX_ARGS          (4)
+#define PWM_MAX_DUTY          (100)
+
+// Defines for PWM pin mappings
+typedef struct {
+    uint32_t port;
+    uint32_t pin;
+    uint32_t timer;
+    enum rcc_periph_clken timer_clock;
+    enum tim_oc_id channel;
+    uint8_t af_mode;
+} PWMPinMapping;
+
+// "lookup  table" for PWM pin maps
+static const PWMPinMapping pwmPinMappings[] = {BOARD_PWM_LIST(BOARD_ENTRY)};
+
+// defines for measure
+#define MEASURE_MIN_ARGS      (2)
+#define MEASURE_MAX_ARGS      (3)
+
+// Defines for measure pin mappings
+typedef struct {
+    uint32_t port;
+    uint32_t pin;
+    uint32_t timer;
+    enum rcc_periph_clken timer_clock;
+    enum tim_ic_id channel;
+    uint8_t af_mode;
+} MeasurePinMapping;
+
+// "lookup  table" for measure pin maps
+static const MeasurePinMapping measurePinMappings[] = {BOARD_MEASURE_LIST(BOARD_ENTRY)};
+
+// defines for SPI
+#define SPI_INIT_MIN_ARGS     (4) // spi and its three pins, then [divider] [mode <0-3>]
+#define SPI_INIT_MAX_ARGS     (7)
+
+/**
+ * @brief What an SPI pin carries.
+ *
+ */
+typedef enum SPIPinRole {
+    SPI_PIN_SCK,
+    SPI_PIN_MISO,
+    SPI_PIN_MOSI,
+} SPIPinRole;
+
+// Defines for SPI pin mappings. A pin can be on more than one SPI, the SPI all three pins share is
+// the one used.
+typedef struct {
+    uint32_t port;
+    uint32_t pin;
+    uint32_t handle;
+    enum rcc_periph_clken spi_clock;
+    SPIPinRole role;
+    uint8_t af_mode;
+} SPIPinMapping;
+
+// "lookup  table" for SPI pin maps
+static const SPIPinMapping spiPinMappings[] = {BOARD_SPI_LIST(BOARD_ENTRY)};
+
+// defines for I2C
+#define I2C_INIT_MIN_ARGS     (3) // i2c and its two pins, then [100|400]
+#define I2C_INIT_MAX_ARGS     (4)
+#define I2C_ADDRESS_MAX       (0x7F)
+
+/**
+ * @brief What an I2C pin carries.
+ *
+ */
+typedef enum I2CPinRole {
+    I2C_PIN_SCL,
+    I2C_PIN_SDA,
+} I2CPinRole;
+
+// Defines for I2C pin mappings. As with SPI the I2C both pins share is the one used.
+typedef struct {
+    uint32_t port;
+    uint32_t pin;
+    uint32_t handle;
+    enum rcc_periph_clken i2c_clock;
+    I2CPinRole role;
+    uint8_t af_mode;
+} I2CPinMapping;
+
+// "lookup  table" for I2C pin maps
+static const I2CPinMapping i2cPinMappings[] = {BOARD_I2C_LIST(BOARD_ENTRY)};
 
-#define UART_PIN_MAP_SIZE (10)
+// The board's generated table, boardPins[port index][pin number] is what the pin can be used as.
+#include BOARD_TABLE
 
-// Size between ports
-#define PORT_SIZE (0x400)
+// defines for capture
+#define CAPTURE_MIN_ARGS      (4) // capture, port, rate and samples, then [trigger ...]
 
-// Size to jump between
-#define JUMP_TO_LOWERCASE (0x1B)
+// defines for repeat and delay
+#define DELAY_ARGS            (3) // delay, time and unit
+#define DELAY_MAX_US          (1000000)
+#define REPEAT_MAX_COUNT      (1000000)
+#define REPEAT_MAX_READS      (8)        // reads summarised by one repeat
+#define REPEAT_MAX_DELAY_US   (60000000) // passes times the delays in one, the console waits on it
 
 // Shit way to make sure a clock is in bounds.
 #define CLOCK_OUT_OF_BOUNDS (RCC_GPIOK)
@@ -131,6 +226,6 @@ static const UARTPinMapping uartPinMappings[] = {
 #define ADC_OUT_OF_BOUNDS   (ADC_CHANNEL18)
 
 // Function prototypes
-bool parseTokensAndExecute(BoardController *bc, TokenVector *vec);
+bool compileTokens(TokenVector *vec, Chunk *chunk);
 
 #endif
\ No newline at end of file
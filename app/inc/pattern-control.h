@@ -0,0 +1,48 @@
+/**
+ * @file pattern-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines and prototypes for the GPIO pattern engine, which plays a list of pin steps out
+ * of memory with DMA instead of through the interpreter.
+ * @version 0.1
+ * @date 2025-03-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef PATTERN_CONTROL_H_
+#define PATTERN_CONTROL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pattern engine. Every TIM1 update DMA2 stream 5 writes the next step's set/clear word to the
+// port's BSRR, and the CC1 request that follows (CCR1 = 0) has stream 3 load the next step's
+// delay into the preloaded ARR. One port per pattern as a stream only has one destination.
+#define PATTERN_MAX_STEPS (128)
+#define PATTERN_MIN_NS    (250)        // Below this the two DMA writes can't keep up
+#define PATTERN_MAX_NS    (1000000000) // 1 second
+
+/**
+ * @brief What a "pattern" line asks the engine to do, other than adding a step.
+ *
+ */
+typedef enum PatternCommand
+{
+    PATTERN_RUN,   // play every step once
+    PATTERN_LOOP,  // play the steps round and round until stopped
+    PATTERN_STOP,  // stop playing, the steps are kept
+    PATTERN_CLEAR, // stop playing and forget the steps
+} PatternCommand;
+
+bool     patternAddStep(uint32_t port, uint16_t set_mask, uint16_t clear_mask, uint32_t delay_ns);
+void     patternClear(void);
+bool     patternStart(bool loop);
+uint32_t patternStop(void);
+void     patternClockChanged(void);
+bool     patternRunning(void);
+size_t   patternLength(void);
+uint32_t patternPort(void);
+uint16_t patternPins(void);
+
+#endif
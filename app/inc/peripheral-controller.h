@@ -20,6 +20,9 @@
 // local includes
 #include "adc-control.h"
 #include "gpio-control.h"
+#include "i2c-control.h"
+#include "spi-control.h"
+#include "sys_timer.h"
 #include "uart-control.h"
 
 /**
@@ -32,6 +35,10 @@ typedef enum PeripheralType
     TYPE_GPIO_OUTPUT,
     TYPE_UART,
     TYPE_ADC,
+    TYPE_PWM,
+    TYPE_MEASURE,
+    TYPE_SPI,
+    TYPE_I2C,
     TYPE_OTHER, // Placeholder
     TYPE_NONE,
 } PeripheralType;
@@ -54,6 +61,10 @@ typedef struct PeripheralController
         GPIOPinController gpio;
         ADCPinController  adc;
         UARTController uart;
+        PWMPeripheral     pwm;
+        MeasurePeripheral measure;
+        SPIController     spi;
+        I2CController     i2c;
     } peripheral;
     void (*enablePeripheral)(struct PeripheralController *);
     void (*disablePeripheral)(struct PeripheralController *);
@@ -66,12 +77,18 @@ PeripheralController createStandardGPIO(uint32_t port, uint32_t pin, enum rcc_pe
                                         PeripheralType input_output, uint8_t pupd);
 PeripheralController createStandardADCPin(uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                                           enum rcc_periph_clken adc_clock, uint32_t sample_time,
-                                          uint32_t adc_port, uint8_t adc_channel);
+                                          uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                                          uint8_t average);
 PeripheralController createStandardUARTUSART(uint32_t uart_handle, enum rcc_periph_clken uart_clock,
                                              uint32_t baudrate, uint32_t rx_port, uint32_t tx_port,
                                              uint32_t rx_pin, uint32_t tx_pin,
                                              enum rcc_periph_clken rx_clock,
                                              enum rcc_periph_clken tx_clock, uint8_t rx_af_mode,
                                              uint8_t tx_af_mode, int nvic_entry);                                          
+PeripheralController createStandardPWMPin(PWMPeripheral pwm);
+PeripheralController createStandardMeasurePin(MeasurePeripheral measure);
+PeripheralController createStandardSPI(SPIController spi);
+PeripheralController createStandardI2C(I2CController i2c);
+PeripheralController rebuildStandardPeripheral(PeripheralType type, const void *saved);
 
 #endif
\ No newline at end of file
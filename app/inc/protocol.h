@@ -0,0 +1,67 @@
+/**
+ * @file protocol.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Binary framed console protocol, used instead of text once "mode binary" is run.
+ * @note Every frame on USART2 is laid out as (multi byte fields little endian):
+ *
+ *       | 0xA5 | length (2) | id (1) | timestamp ms (4) | payload (length) | CRC-16 (2) |
+ *
+ *       The CRC is CRC-16/CCITT-FALSE over everything after the start byte up to the end of the
+ *       payload. Commands are still sent as text lines, but aren't echoed, and every line is
+ *       answered with a FRAME_RESULT once it has run, so a host can pipeline lines and match up
+ *       replies by counting results.
+ * @version 0.1
+ * @date 2025-03-10
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+
+// Macro definitions
+#define FRAME_START        (0xA5)
+#define FRAME_HEADER_SIZE  (8) // start, length, id, timestamp
+#define FRAME_CRC_SIZE     (2)
+#define FRAME_MAX_PAYLOAD  (512) // a whole frame fits the console's TX buffer, see protocol.c
+
+// Enum definitions
+/**
+ * @brief What a frame's payload holds.
+ *
+ */
+typedef enum FrameID
+{
+    FRAME_TEXT = 0x01,      // text that would have been printed in text mode
+    FRAME_RESULT = 0x02,    // u8 1 if the line ran, 0 if it failed. Ends every line's replies
+    FRAME_DIGITAL = 0x10,   // u8 port (0 = A), u8 pin, u8 level
+    FRAME_ANALOG = 0x11,    // u8 port (0 = A), u8 pin, u16 sample
+    FRAME_ADC_BLOCK = 0x12, // u8 channels, u8 frames, u16 samples[frames][channels]
+    FRAME_UART_DATA = 0x13, // u8 uart number (1 or 6), received bytes
+    FRAME_EVENTS = 0x14,    // {u8 port, u8 pin, u8 level, u8 0, u32 time us}[events]
+    FRAME_MEASURE = 0x15,   // u8 port, u8 pin, u16 periods (0 = no signal), u32 mHz, u16 duty 0.01%
+    FRAME_SPI_DATA = 0x16,  // u8 SPI number (1-5), bytes clocked in
+    FRAME_I2C_DATA = 0x17,  // u8 I2C number (1-3), {u8 I2CStatus, u8 count, bytes read}[batch]
+    FRAME_I2C_SCAN = 0x18,  // u8 I2C number (1-3), addresses acknowledged
+    FRAME_CAPTURE = 0x19,   // u8 port, u8 last, u16 pins, u32 Hz, u16 trigger, {u16 levels, u16 run}
+    FRAME_REPEAT = 0x1A,    // u32 passes, u32 us, {u8 port, u8 pin, u16 min, u16 max, u32 mean x100}
+} FrameID;
+
+// Function prototypes
+void     protocolSetBinaryMode(bool binary);
+bool     protocolBinaryMode(void);
+void     protocolSendFrame(FrameID id, const uint8_t *payload, uint16_t length);
+void     protocolSendTimedFrame(FrameID id, uint32_t timestamp, const uint8_t *payload,
+                                uint16_t length);
+uint16_t protocolCrc16(uint16_t crc, const uint8_t *data, size_t length);
+
+#endif
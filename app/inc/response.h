@@ -0,0 +1,57 @@
+/**
+ * @file response.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Console verbosity and a small formatter for the fixed shape replies on the hot path
+ * (acknowledgements and read values), so they don't go through printf.
+ * @note A reply is built with responseBegin(), the response*() pieces and responseEnd(), which
+ *       sends the whole line with one write. In the terse and silent modes printf output is
+ *       discarded, so the only bytes sent back are read values and one ACK/NAK per line.
+ * @version 0.1
+ * @date 2025-03-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef RESPONSE_H_
+#define RESPONSE_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "core/uart.h"
+
+// Macro definitions
+#define RESPONSE_LINE_SIZE (96) // longest reply built by the formatter, longer ones are cut
+#define RESPONSE_ACK       (0x06)
+#define RESPONSE_NAK       (0x15)
+
+// Enum definitions
+/**
+ * @brief How much the console says back. Binary mode ignores it, frames are already compact.
+ *
+ */
+typedef enum Verbosity
+{
+    VERBOSITY_FULL,   // echo, acknowledgements, reports and errors as text
+    VERBOSITY_TERSE,  // no echo, read values only, then ACK or NAK
+    VERBOSITY_SILENT, // nothing at all
+} Verbosity;
+
+// Function prototypes
+void          responseSetVerbosity(Verbosity verbosity);
+Verbosity     responseVerbosity(void);
+UartWriteHook responseTextHook(void);
+void          responseBegin(void);
+void          responseString(const char *text);
+void          responseChars(const char *text, size_t length);
+void          responseUnsigned(uint32_t value, uint8_t width);
+void          responsePin(char letter, unsigned int number);
+void          responseEnd(void);
+void          responseLineResult(bool result);
+
+#endif
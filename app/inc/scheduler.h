@@ -0,0 +1,62 @@
+/**
+ * @file scheduler.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Cooperative scheduler for "every" and "after" lines, run from the main loop between
+ * console input.
+ * @version 0.1
+ * @date 2025-03-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "board-control.h"
+#include "chunk.h"
+
+// Macro definitions
+#define SCHEDULER_MAX_TASKS (4)
+#define SCHEDULER_TEXT_SIZE (CHUNK_MAX_STRINGS + 1)
+#define SCHEDULER_MAX_MS    (86400000) // One day
+
+// Struct definitions
+/**
+ * @brief A scheduled line. The line is compiled once when scheduled and the chunk rebinds
+ * itself if the board changes, so running it costs the same as a cached console line.
+ * @param active slot holds a task
+ * @param repeat run every period_ms, otherwise once after period_ms
+ * @param period_ms period or delay in ms
+ * @param due tick the task next runs at
+ * @param runs times the task has run
+ * @param text source line, for "tasks list"
+ * @param chunk compiled line
+ */
+typedef struct Task
+{
+    bool     active;
+    bool     repeat;
+    uint32_t period_ms;
+    uint64_t due;
+    uint32_t runs;
+    char     text[SCHEDULER_TEXT_SIZE];
+    Chunk    chunk;
+} Task;
+
+// Function prototypes
+int  schedulerAdd(const char *text, size_t length, uint32_t period_ms, bool repeat);
+bool schedulerKill(int id);
+void schedulerKillAll(void);
+void schedulerList(void);
+bool schedulerPending(void);
+void schedulerService(BoardController *bc);
+
+#endif
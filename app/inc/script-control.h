@@ -0,0 +1,126 @@
+/**
+ * @file script-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines, types and prototypes for named scripts: lines recorded between "def" and "end",
+ * kept compiled in flash and played back by "run".
+ * @version 0.1
+ * @date 2025-03-21
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef SCRIPT_CONTROL_H_
+#define SCRIPT_CONTROL_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "board-control.h"
+#include "chunk.h"
+
+// Macro definitions
+// Scripts live in flash sectors 6 and 7, carved out of rom in linkerscript.ld. One bank is
+// active, the other is where the live scripts are compacted to when the active one fills up.
+#define SCRIPT_BANK_COUNT        (2)
+#define SCRIPT_BANK_SIZE         (0x20000U) // 128kB, one sector each
+#define SCRIPT_BANK_ADDRESS      (0x08040000U)
+#define SCRIPT_BANK_FIRST_SECTOR (6)
+
+#define SCRIPT_NAME_SIZE         (16)   // including the terminator
+#define SCRIPT_RECORD_SIZE       (8192) // bytes of compiled lines one "def" can record
+#define SCRIPT_MAGIC             (0x5459544EU) // "NTTY"
+// Bump whenever a stored layout, an existing OpCode's number or a constants layout changes.
+// Scripts stored in another format are ignored rather than run. New ops at the end are fine.
+#define SCRIPT_FORMAT            (2)
+// Records whose names start with this aren't scripts, see scriptSaveData(). Script names are
+// letters, digits and _ only, so the two can't clash.
+#define SCRIPT_HIDDEN_PREFIX     ('.')
+
+// Struct definitions
+/**
+ * @brief Start of a bank. Magic is programmed last, so a bank that was being compacted when the
+ * power went is never picked.
+ * @param magic SCRIPT_MAGIC once the bank is complete
+ * @param sequence higher sequence is the newer bank
+ * @param format SCRIPT_FORMAT of the scripts in the bank
+ * @param reserved padding, left erased
+ */
+typedef struct ScriptBankHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t format;
+    uint16_t reserved;
+} ScriptBankHeader;
+
+/**
+ * @brief Start of a stored script, followed by its lines. Magic is programmed last, a script
+ * without it was cut short and is skipped.
+ * @param magic SCRIPT_MAGIC once the script is complete, erased past the last script
+ * @param deleted erased while live, programmed to 0 by "del" or a newer script of the same name
+ * @param size bytes of lines after the header
+ * @param lines number of lines
+ * @param reserved padding
+ * @param name script name, null terminated
+ */
+typedef struct ScriptHeader
+{
+    uint32_t magic;
+    uint32_t deleted;
+    uint32_t size;
+    uint16_t lines;
+    uint16_t reserved;
+    char     name[SCRIPT_NAME_SIZE];
+} ScriptHeader;
+
+/**
+ * @brief Start of one stored line, followed by its instructions, constants and strings, padded
+ * to a word.
+ * @param count instructions
+ * @param constants_count constants
+ * @param strings_length bytes of strings
+ * @param size bytes of the whole line including this header
+ */
+typedef struct ScriptLine
+{
+    uint16_t count;
+    uint16_t constants_count;
+    uint16_t strings_length;
+    uint16_t size;
+} ScriptLine;
+
+/**
+ * @brief A stored instruction: an Instruction without its board binding, which run redoes.
+ * @param op OpCode
+ * @param flags INSTR_FLAG_*
+ * @param mask pin mask
+ * @param port GPIO port base address
+ * @param operand op specific operand
+ */
+typedef struct ScriptInstruction
+{
+    uint8_t  op;
+    uint8_t  flags;
+    uint16_t mask;
+    uint32_t port;
+    uint32_t operand;
+} ScriptInstruction;
+
+// Function prototypes
+bool scriptRecording(void);
+bool scriptDefine(const char *name, size_t length);
+bool scriptRecord(const Chunk *chunk);
+bool scriptEnd(void);
+bool scriptRun(BoardController *bc, const char *name, size_t length);
+bool scriptDelete(const char *name, size_t length);
+void scriptList(void);
+bool scriptSaveData(const char *name, const void *data, size_t size);
+const void *scriptFindData(const char *name, size_t *size);
+bool scriptDeleteData(const char *name);
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file snapshot-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Saving the board configuration (its peripherals) to flash with "save", and putting
+ * it back with "restore" or at boot without going through the interpreter.
+ * @note The snapshot is a hidden record in the script banks (see scriptSaveData()), so it shares
+ *       their flash, compaction and wear. Output pin levels, "watch" logs, "every" tasks and
+ *       "pattern"s aren't part of it, only what each peripheral was set up with.
+ * @version 0.1
+ * @date 2025-03-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef SNAPSHOT_CONTROL_H_
+#define SNAPSHOT_CONTROL_H_
+
+// libgcc includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// libopencm3 includes
+
+// local includes
+#include "board-control.h"
+
+// Macro definitions
+#define SNAPSHOT_NAME   ".snapshot" // hidden record name, see SCRIPT_HIDDEN_PREFIX
+#define SNAPSHOT_SIZE   (4096)      // most bytes a snapshot can take
+// Bump whenever a peripheral struct changes layout. Snapshots in another format are ignored.
+#define SNAPSHOT_FORMAT (4)
+
+// Struct definitions
+/**
+ * @brief Start of a snapshot, followed by the peripherals. Clocks aren't stored, each peripheral
+ * takes the ones it needs when it is restored, and anything derived from the CPU clock is worked
+ * out again for the one in force then.
+ * @param format SNAPSHOT_FORMAT
+ * @param peripherals SnapshotRecords after the header
+ */
+typedef struct SnapshotHeader
+{
+    uint16_t format;
+    uint16_t peripherals;
+} SnapshotHeader;
+
+/**
+ * @brief One saved peripheral. Followed by size bytes holding its settings struct.
+ * @param type PeripheralType
+ * @param reserved 0
+ * @param size bytes of settings, the struct rounded up to a multiple of 4
+ */
+typedef struct SnapshotRecord
+{
+    uint8_t  type;
+    uint8_t  reserved;
+    uint16_t size;
+} SnapshotRecord;
+
+// Function prototypes
+bool snapshotSave(BoardController *bc);
+bool snapshotClear(void);
+bool snapshotRestore(BoardController *bc);
+void snapshotBoot(BoardController *bc);
+
+#endif
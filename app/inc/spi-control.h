@@ -0,0 +1,64 @@
+/**
+ * @file spi-control.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Defines, types and prototypes for SPI master peripherals.
+ * @version 0.1
+ * @date 2025-03-28
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef SPI_CONTROL_H_
+#define SPI_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dma-control.h"
+#include "gpio-control.h"
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/spi.h"
+
+#define SPI_MAX_TRANSFER    (256) // longest "spi read", one FRAME_SPI_DATA payload with the number
+#define SPI_DMA_MIN_BYTES   (8)   // shorter transfers are polled, setting up two streams costs more
+#define SPI_DEFAULT_DIVIDER (16)  // bus clock divider, a power of two from 2 to 256
+#define SPI_MIN_DIVIDER     (2)
+#define SPI_MAX_DIVIDER     (256)
+#define SPI_MAX_MODE        (3)   // CPOL in bit 1, CPHA in bit 0
+
+/**
+ * @brief SPI master. Chip select is left to the user, any output pin will do.
+ * @param handle SPI peripheral (SPI1-SPI5)
+ * @param spi_clock RCC clock of the peripheral
+ * @param divider bus clock divider, a power of two from 2 to 256
+ * @param frequency SCK asked for in Hz, kept so a clock change can pick the divider again
+ * @param mode SPI mode 0-3
+ * @param SCK clock pin
+ * @param MISO data in pin
+ * @param MOSI data out pin
+ */
+typedef struct SPIController {
+    uint32_t              handle;
+    enum rcc_periph_clken spi_clock;
+    uint16_t              divider;
+    uint32_t              frequency;
+    uint8_t               mode;
+    GPIOPinController     SCK;
+    GPIOPinController     MISO;
+    GPIOPinController     MOSI;
+} SPIController;
+
+SPIController createSPIPeripheral(uint32_t handle, enum rcc_periph_clken spi_clock,
+                                  uint16_t divider, uint8_t mode, GPIOPinController sck,
+                                  GPIOPinController miso, GPIOPinController mosi);
+void     currentSPISetup(SPIController *spi);
+void     currentSPIStop(SPIController *spi);
+uint16_t currentSPIDivider(const SPIController *spi);
+void     currentSPIClockChanged(SPIController *spi);
+uint32_t currentSPITransfer(const SPIController *spi, uint8_t *data, uint32_t len);
+uint32_t currentSPIFrequency(const SPIController *spi);
+int      currentSPINumber(uint32_t handle);
+
+#endif
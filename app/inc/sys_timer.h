@@ -1,7 +1,8 @@
 /**
  * @file sys_timer.h
  * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
- * @brief Definitions for timer logic. Mostly unused.
+ * @brief Definitions for timer logic: PWM outputs, input capture measurement and timer period
+ * maths.
  * @version 0.1
  * @date 2024-11-21
  * 
@@ -11,21 +12,103 @@
 #ifndef TIMER_H_
 #define TIMER_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "libopencm3/stm32/rcc.h"
 #include "libopencm3/stm32/timer.h"
 
+// PWM frequency limits. Above 1MHz there are fewer than 84 steps of duty resolution.
+#define PWM_MIN_HZ (1)
+#define PWM_MAX_HZ (1000000)
+
+// Measurement averages over 1 to this many periods. Slower than ~0.02Hz the 32 bit counter wraps.
+#define MEASURE_MAX_PERIODS (1000)
+// A result older than this, or twice its own window if longer, means the signal has stopped.
+#define MEASURE_STALE_MS    (1000)
+
+/**
+ * @brief A PWM output: one channel of a timer driving one pin.
+ * @param timer timer peripheral (e.g. TIM2)
+ * @param timer_clock RCC clock of the timer
+ * @param channel output compare channel
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param clock GPIO port clock
+ * @param af_mode alternate function connecting the pin to the channel
+ * @param frequency requested frequency in Hz
+ * @param prescaler timer prescaler (divide by this, not by this + 1)
+ * @param arr_val timer period in ticks (counts 0 to arr_val - 1)
+ * @param duty_cycle percent high, 0-100
+ */
 typedef struct {
     uint32_t timer;
+    enum rcc_periph_clken timer_clock;
     enum tim_oc_id channel;
+    uint32_t port;
+    uint32_t pin;
+    enum rcc_periph_clken clock;
+    uint8_t af_mode;
+    uint32_t frequency;
     uint32_t prescaler;
     uint32_t arr_val;
     float duty_cycle;
 } PWMPeripheral;
 
-void coreTimerSetup(void);
-void corePWMSetDutyCycle(float duty_cycle);
+/**
+ * @brief A measured input: a timer in PWM input mode on one pin. The pin's own channel captures
+ * each rising edge and resets the counter, the timer's other channel captures the falling edge
+ * from the same input, so the hardware times both the period and the high time.
+ * @param timer 32 bit timer peripheral (TIM2 or TIM5). The whole timer is used.
+ * @param timer_clock RCC clock of the timer
+ * @param channel input capture channel wired to the pin, TIM_IC1 or TIM_IC2
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param clock GPIO port clock
+ * @param af_mode alternate function connecting the pin to the channel
+ * @param periods periods averaged into each result, 1 to MEASURE_MAX_PERIODS
+ */
+typedef struct {
+    uint32_t timer;
+    enum rcc_periph_clken timer_clock;
+    enum tim_ic_id channel;
+    uint32_t port;
+    uint32_t pin;
+    enum rcc_periph_clken clock;
+    uint8_t af_mode;
+    uint16_t periods;
+} MeasurePeripheral;
+
+/**
+ * @brief The last complete window of periods from a measured input.
+ * @param periods periods in the window
+ * @param period_ticks timer ticks the whole window took
+ * @param high_ticks timer ticks the input was high during the window
+ */
+typedef struct {
+    uint32_t periods;
+    uint64_t period_ticks;
+    uint64_t high_ticks;
+} MeasureResult;
+
+PWMPeripheral createPWMPeripheral(uint32_t timer, enum rcc_periph_clken timer_clock,
+                                  enum tim_oc_id channel, uint32_t port, uint32_t pin,
+                                  enum rcc_periph_clken clock, uint8_t af_mode,
+                                  uint32_t frequency, float duty_cycle);
+uint32_t coreTimerClockFrequency(uint32_t timer);
+bool coreTimerComputePeriod(uint32_t timer, uint32_t frequency, uint32_t *prescaler,
+                            uint32_t *arr_val);
+void coreTimerSetup(PWMPeripheral *pwm);
+void corePWMSetDutyCycle(PWMPeripheral *pwm, float duty_cycle);
+uint32_t corePWMActualFrequency(const PWMPeripheral *pwm);
+MeasurePeripheral createMeasurePeripheral(uint32_t timer, enum rcc_periph_clken timer_clock,
+                                          enum tim_ic_id channel, uint32_t port, uint32_t pin,
+                                          enum rcc_periph_clken clock, uint8_t af_mode,
+                                          uint16_t periods);
+void coreMeasureSetup(const MeasurePeripheral *measure);
+void coreMeasureStop(const MeasurePeripheral *measure);
+bool coreMeasureRead(const MeasurePeripheral *measure, MeasureResult *result);
 
 
-#endif
\ No newline at end of file
+#endif
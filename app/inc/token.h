@@ -13,6 +13,7 @@
 #define TOKEN_H_
 
 // libgcc includes
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -40,6 +41,62 @@ typedef enum TokenType {
     TOKEN_GPIO_PULLDOWN,
     TOKEN_GPIO_NORESISTOR,
     TOKEN_WRITE,
+    TOKEN_STATS,
+    TOKEN_STREAM,
+    TOKEN_STOP,
+    TOKEN_MODE,
+    TOKEN_BINARY,
+    TOKEN_TEXT,
+    TOKEN_PWM,
+    TOKEN_PATTERN,
+    TOKEN_RUN,
+    TOKEN_LOOP,
+    TOKEN_CLEAR,
+    TOKEN_EVERY,
+    TOKEN_AFTER,
+    TOKEN_TASKS,
+    TOKEN_LIST,
+    TOKEN_KILL,
+    TOKEN_IDLE,
+    TOKEN_WATCH,
+    TOKEN_EVENTS,
+    TOKEN_RISING,
+    TOKEN_FALLING,
+    TOKEN_BOTH,
+    TOKEN_MEASURE,
+    TOKEN_DEF,
+    TOKEN_END,
+    TOKEN_DEL,
+    TOKEN_IDENTIFIER,
+    TOKEN_SEMICOLON,
+    TOKEN_FLOW,
+    TOKEN_XONXOFF,
+    TOKEN_RTSCTS,
+    TOKEN_VERBOSITY,
+    TOKEN_FULL,
+    TOKEN_TERSE,
+    TOKEN_SILENT,
+    TOKEN_UPDATE,
+    TOKEN_SAVE,
+    TOKEN_RESTORE,
+    TOKEN_CLOCK,
+    TOKEN_CLOCKS,
+    TOKEN_AVERAGE,
+    TOKEN_BITS,
+    TOKEN_SAMPLE,
+    TOKEN_BRIDGE,
+    TOKEN_SPI,
+    TOKEN_XFER,
+    TOKEN_I2C,
+    TOKEN_SCAN,
+    TOKEN_CAPTURE,
+    TOKEN_TRIGGER,
+    TOKEN_MEM,
+    TOKEN_REPEAT,
+    TOKEN_DELAY,
+    TOKEN_US,
+    TOKEN_MS,
+    TOKEN_BENCH,
     TOKEN_NUMBER,
     TOKEN_STRING,
     TOKEN_EOL,
@@ -60,10 +117,11 @@ typedef struct Token {
 } Token;
 
 /**
- * @brief TokenVector structure. A vector of tokens (duh)
+ * @brief TokenVector structure. A vector of tokens (duh). Allocated from the line arena, so it is
+ * only valid until the next line is interpreted.
  * @param used current used size of vector
- * @param capacity absolute size of vector
- * @param tokens dynamic array of tokens.
+ * @param capacity absolute size of vector, always LINE_MAX_TOKENS
+ * @param tokens array of tokens.
  *
  */
 typedef struct TokenVector {
@@ -73,19 +131,17 @@ typedef struct TokenVector {
 } TokenVector;
 
 // macro defines
-#define PORTA_STM32F411RE ('A')
-#define PORTa_STM32F411RE ('a')
-#define PORTE_STM32F411RE ('E')
-#define PORTe_STM32F411RE ('e')
-
 #define PIN0              ('0')
 #define PIN9              ('9')
 #define PIN15             ('5')
 #define PIN10             ('1')
 
+// Maximum number of tokens in one line, including separators and the end of line token.
+#define LINE_MAX_TOKENS   (64)
+
 // Function prototypes
 TokenVector *initTokenVector(void);
-void         appendTokenVector(TokenVector *vec, Token tok);
+bool         appendTokenVector(TokenVector *vec, Token tok);
 Token        getTokenVector(TokenVector *vec, size_t index);
 size_t       sizeTokenVector(TokenVector *vec);
 void         deinitTokenVector(TokenVector *vec);
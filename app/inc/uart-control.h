@@ -16,7 +16,9 @@
 #include <stdlib.h>
 
 #include "core/ring-buffer.h"
+#include "core/uart.h"
 
+#include "dma-control.h"
 #include "gpio-control.h"
 #include "libopencm3/stm32/f4/nvic.h"
 #include "libopencm3/stm32/f4/rcc.h"
@@ -26,7 +28,24 @@
 #include "libopencm3/cm3/nvic.h"
 #include "libopencm3/stm32/usart.h"
 
-#define RING_BUFFER_SIZE (128)
+#define RING_BUFFER_SIZE (512) // Must be a power of two! ~5ms at 921600
+#define UART_PORT_TX_BUFFER_SIZE (256) // Must be a power of two! ~2.8ms at 921600
+
+// User UARTs, USART2 is reserved for the console. Indices into the per-UART state.
+#define UART_PORT_USART1 (0)
+#define UART_PORT_USART6 (1)
+#define UART_PORT_COUNT  (2)
+
+// Hardware flow control pins, AF7. Only USART1 has them on the F411RE: USART6's CTS and RTS are
+// not bonded out on this package.
+#define UART1_CTS_PORT   (GPIOA)
+#define UART1_CTS_PIN    (GPIO11)
+#define UART1_RTS_PORT   (GPIOA)
+#define UART1_RTS_PIN    (GPIO12)
+#define UART1_CTS_AF     (GPIO_AF7)
+
+// Per-UART buffers, defined in uart-control.c.
+typedef struct UARTPortState UARTPortState;
 
 typedef struct UARTController {
     enum rcc_periph_clken uart_clock;
@@ -35,6 +54,10 @@ typedef struct UARTController {
     GPIOPinController TX;
     uint32_t handle;
     int nvic_entry;
+    UartFlowControl flow;
+    GPIOPinController CTS; // only used with UART_FLOW_RTSCTS
+    GPIOPinController RTS; // driven from the RX watermarks, not by the USART
+    UARTPortState *state;
 } UARTController;
 
 UARTController createUARTPeripheral(uint32_t uart_handle, enum rcc_periph_clken uart_clock,
@@ -42,18 +65,21 @@ UARTController createUARTPeripheral(uint32_t uart_handle, enum rcc_periph_clken
                                     uint32_t rx_pin, uint32_t tx_pin,
                                     enum rcc_periph_clken rx_clock, enum rcc_periph_clken tx_clock,
                                     uint8_t rx_af_mode, uint8_t tx_af_mode, int nvic_entry);
-void general_uart_isr(void);
-void currentUartWrite(UARTController uart, uint8_t *data, uint32_t len);
-void currentUartWriteByte(UARTController uart, uint8_t byte);
+void uart_isr(UARTPortState *state);
+uint32_t currentUartWrite(UARTController uart, uint8_t *data, uint32_t len);
+bool currentUartWriteByte(UARTController uart, uint8_t byte);
+void currentUartSetTxPolicy(UARTController uart, UartTxPolicy policy);
 uint32_t currentUartRead(UARTController uart, uint8_t *data, uint32_t len);
 uint8_t currentUartReadByte(UARTController uart);
+uint32_t currentUartPeekRead(UARTController uart, const uint8_t **span);
+void currentUartCommitRead(UARTController uart, uint32_t count);
+uint32_t currentUartWriteNoWait(UARTController uart, const uint8_t *data, uint32_t len);
 bool currentUartDataAvailable(UARTController uart);
+void currentUartStartRx(UARTController *uart);
+void currentUartStopRx(UARTController *uart);
+UartRxStats currentUartGetRxStats(UARTController uart);
+bool currentUartFlowAvailable(uint32_t handle, UartFlowControl flow);
+void currentUartSetFlowControl(UARTController *uart, UartFlowControl flow);
+bool currentUartRxPaused(UARTController uart);
 
-// Unused
-#define CREATE_UART_ISR(func_name) \
-void func_name(void) {\
-do {\
-    general_uart_isr(); \
-} while (0)\
-}
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+/**
+ * @file vm.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Definitions for the virtual machine that runs compiled lines against the board.
+ * @version 0.1
+ * @date 2025-03-03
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef VM_H_
+#define VM_H_
+
+// libgcc includes
+#include <stdbool.h>
+
+// libopencm3 includes
+
+// local includes
+#include "board-control.h"
+#include "chunk.h"
+
+// Function prototypes
+bool runChunk(BoardController *bc, Chunk *chunk);
+
+#endif
@@ -10,6 +10,34 @@
  */
 #include "adc-control.h"
 #include <stdint.h>
+#include <stdio.h>
+
+#include "libopencm3/stm32/adc.h"
+#include "libopencm3/stm32/timer.h"
+
+#include "core/system.h"
+#include "core/uart.h"
+#include "dma-control.h"
+#include "protocol.h"
+#include "sys_timer.h"
+
+// TIM3 counts at 100kHz, so the period register sets the frame rate.
+#define SCAN_TIMER_TICK_HZ (100000)
+// Samples per circular buffer pass, both halves.
+#define SCAN_BUFFER_SIZE   (2 * ADC_SCAN_FRAMES_PER_HALF * ADC_SCAN_MAX_CHANNELS)
+
+static volatile uint16_t scan_buffer[SCAN_BUFFER_SIZE];
+static uint8_t           scan_channels[ADC_SCAN_MAX_CHANNELS];
+static uint8_t           scan_count = 0; // 0 when the scan is stopped
+static uint8_t           scan_bits = ADC_DEFAULT_BITS; // ADC1 resolution, reset value until set
+static uint32_t          scan_rate_hz = ADC_SCAN_DEFAULT_HZ;
+// Halves completed since the scan started. Only the DMA ISR writes it.
+static volatile uint32_t scan_halves_done = 0;
+static volatile uint32_t scan_half_ticks[2]; // when each half last completed
+
+static bool              stream_active = false;
+static uint32_t          stream_halves_taken = 0;
+static uint32_t          stream_dropped = 0;
 
 /**
  * @brief Creates the lowest level ADC controller
@@ -22,11 +50,14 @@
  * @param mode GPIO mode, will always be ADC
  * @param adc_port ADC handle
  * @param adc_channel ADC channel
+ * @param bits resolution of reads, 6 to 12
+ * @param average frames each read averages, 1 to ADC_MAX_AVERAGE
  * @return ADCPinController 
  */
 ADCPinController createADCPin(uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                               enum rcc_periph_clken adc_clock, uint32_t sample_time, uint8_t mode,
-                              uint32_t adc_port, uint8_t adc_channel) {
+                              uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                              uint8_t average) {
     return (ADCPinController){.port = port,
                               .pin = pin,
                               .clock = clock,
@@ -34,6 +65,497 @@ ADCPinController createADCPin(uint32_t port, uint32_t pin, enum rcc_periph_clken
                               .mode = mode,
                               .adc_port = adc_port,
                               .adc_channel = adc_channel,
-                              .adc_clock = adc_clock
+                              .adc_clock = adc_clock,
+                              .scan_rank = 0,
+                              .bits = bits,
+                              .average = average
                               };
+}
+
+/**
+ * @brief DMA ISR for the scan buffer. Each interrupt means one half (block) is complete.
+ *
+ */
+void dma2_stream4_isr(void)
+{
+    if (dma_get_interrupt_flag(DMA2, DMA_STREAM4, DMA_HTIF))
+    {
+        dma_clear_interrupt_flags(DMA2, DMA_STREAM4, DMA_HTIF);
+        scan_half_ticks[0] = (uint32_t)coreGetTicks();
+        scan_halves_done++;
+    }
+    if (dma_get_interrupt_flag(DMA2, DMA_STREAM4, DMA_TCIF))
+    {
+        dma_clear_interrupt_flags(DMA2, DMA_STREAM4, DMA_TCIF);
+        scan_half_ticks[1] = (uint32_t)coreGetTicks();
+        scan_halves_done++;
+    }
+}
+
+/**
+ * @brief Total samples the DMA stream writes before wrapping.
+ *
+ * @return uint16_t buffer length in samples
+ */
+static uint16_t scanBufferLength(void)
+{
+    return (uint16_t)(2 * ADC_SCAN_FRAMES_PER_HALF * scan_count);
+}
+
+/**
+ * @brief Returns the ADC1 resolution setting for a number of bits.
+ *
+ * @param bits 6, 8, 10 or 12
+ * @return uint32_t ADC_CR1_RES_* setting
+ */
+static uint32_t resolutionSetting(uint8_t bits)
+{
+    switch (bits)
+    {
+    case 6:
+        return ADC_CR1_RES_6BIT;
+    case 8:
+        return ADC_CR1_RES_8BIT;
+    case 10:
+        return ADC_CR1_RES_10BIT;
+    default:
+        return ADC_CR1_RES_12BIT;
+    }
+}
+
+/**
+ * @brief Averages a sum of samples taken at ADC1's resolution and rescales it to a pin's.
+ *
+ * @param sum samples added together
+ * @param count samples in the sum
+ * @param bits resolution to return
+ * @return uint16_t average at the requested resolution
+ */
+static uint16_t scaleSample(uint32_t sum, uint32_t count, uint8_t bits)
+{
+    uint32_t average = (sum + count / 2) / count;
+    if (bits < scan_bits)
+    {
+        return (uint16_t)(average >> (scan_bits - bits));
+    }
+    return (uint16_t)(average << (bits - scan_bits));
+}
+
+/**
+ * @brief Programs ADC1, the DMA stream and TIM3 for the current channel list and starts them.
+ * Also used to recover from an ADC overrun, which stops DMA requests until reconfigured.
+ *
+ */
+static void scanConfigure(void)
+{
+    timer_disable_counter(TIM3);
+    adc_power_off(ADC1);
+    adc_disable_dma(ADC1);
+
+    adc_enable_scan_mode(ADC1);
+    adc_set_single_conversion_mode(ADC1);
+    adc_set_right_aligned(ADC1);
+    adc_set_resolution(ADC1, resolutionSetting(scan_bits));
+    adc_set_regular_sequence(ADC1, scan_count, scan_channels);
+    adc_eoc_after_group(ADC1);
+    adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM3_TRGO, ADC_CR2_EXTEN_RISING_EDGE);
+
+    scan_halves_done = 0;
+    setupDMAPeripheralToMemory16(DMA_ADC1, (uint32_t)&ADC_DR(ADC1), (void *)scan_buffer,
+                                 scanBufferLength(), true);
+    dma_enable_half_transfer_interrupt(DMA2, DMA_STREAM4);
+    dma_enable_transfer_complete_interrupt(DMA2, DMA_STREAM4);
+    nvic_enable_irq(DMA_ADC1.nvic_entry);
+    dma_enable_stream(DMA2, DMA_STREAM4);
+
+    adc_enable_dma(ADC1);
+    adc_set_dma_continue(ADC1);
+    adcSetPrescaler();
+    adc_power_on(ADC1);
+
+    timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM3, coreTimerClockFrequency(TIM3) / SCAN_TIMER_TICK_HZ - 1);
+    timer_set_period(TIM3, SCAN_TIMER_TICK_HZ / scan_rate_hz - 1);
+    timer_set_master_mode(TIM3, TIM_CR2_MMS_UPDATE);
+    timer_set_counter(TIM3, 0);
+    timer_enable_counter(TIM3);
+}
+
+/**
+ * @brief Starts (or restarts) the timer triggered scan of a set of channels. The sequence is
+ * converted once per frame at the current scan rate. Does nothing if the sequence is unchanged.
+ *
+ * @param channels ADC channels in scan order, a channel's index is its rank
+ * @param count number of channels, 0 stops the scan
+ * @param bits ADC1 resolution, the finest any scanned pin reads at
+ * @return true scan running
+ * @return false DMA stream unavailable or too many channels
+ */
+bool adcScanStart(const uint8_t *channels, uint8_t count, uint8_t bits)
+{
+    if (count == 0)
+    {
+        adcScanStop();
+        return true;
+    }
+    if (count > ADC_SCAN_MAX_CHANNELS)
+    {
+        printf("> Error: Too many ADC channels to scan (max %d).\r\n", ADC_SCAN_MAX_CHANNELS);
+        return false;
+    }
+
+    bool unchanged = count == scan_count && bits == scan_bits;
+    for (uint8_t rank = 0; unchanged && rank < count; rank++)
+    {
+        unchanged = channels[rank] == scan_channels[rank];
+    }
+    if (unchanged)
+    {
+        // Same sequence, leave the running scan (and any stream) alone.
+        return true;
+    }
+
+    if (scan_count == 0)
+    {
+        if (!claimDMAStream(DMA_ADC1))
+        {
+            return false;
+        }
+        rcc_periph_clock_enable(RCC_TIM3);
+    }
+
+    for (uint8_t rank = 0; rank < count; rank++)
+    {
+        scan_channels[rank] = channels[rank];
+    }
+    scan_count = count;
+    scan_bits = bits;
+    // Blocks change size with the channel count, so anything half-streamed is stale.
+    stream_halves_taken = 0;
+    scanConfigure();
+    return true;
+}
+
+/**
+ * @brief Stops the scan and frees its timer and DMA stream. Streaming stops with it.
+ *
+ */
+void adcScanStop(void)
+{
+    if (scan_count == 0)
+    {
+        return;
+    }
+
+    if (stream_active)
+    {
+        stream_active = false;
+        printf("> Stream stopped, no ADC pins left.\r\n");
+    }
+    timer_disable_counter(TIM3);
+    rcc_periph_clock_disable(RCC_TIM3);
+    adc_disable_external_trigger_regular(ADC1);
+    adc_disable_dma(ADC1);
+    releaseDMAStream(DMA_ADC1);
+    adc_power_off(ADC1);
+    scan_count = 0;
+}
+
+/**
+ * @brief Tells whether the scan is running.
+ *
+ * @return true at least one channel is being scanned
+ * @return false scan stopped
+ */
+bool adcScanRunning(void)
+{
+    return scan_count != 0;
+}
+
+/**
+ * @brief Returns how many channels the scan converts each frame.
+ *
+ * @return uint8_t channels in the sequence, 0 when stopped
+ */
+uint8_t adcScanChannels(void)
+{
+    return scan_count;
+}
+
+/**
+ * @brief Returns how many halves of the scan buffer have filled since the scan started. Each is
+ * ADC_SCAN_FRAMES_PER_HALF frames.
+ *
+ * @return uint32_t halves completed
+ */
+uint32_t adcScanHalves(void)
+{
+    return scan_halves_done;
+}
+
+/**
+ * @brief Sets how many frames per second the scan converts. Takes effect immediately if running.
+ *
+ * @param rate_hz frame rate, ADC_SCAN_MIN_HZ to ADC_SCAN_MAX_HZ
+ * @return true rate set
+ * @return false rate out of range
+ */
+bool adcScanSetRate(uint32_t rate_hz)
+{
+    if (rate_hz < ADC_SCAN_MIN_HZ || rate_hz > ADC_SCAN_MAX_HZ)
+    {
+        return false;
+    }
+
+    scan_rate_hz = rate_hz;
+    if (scan_count != 0)
+    {
+        timer_set_period(TIM3, SCAN_TIMER_TICK_HZ / scan_rate_hz - 1);
+        // The counter may already be past a shorter period, don't let it run to 0xFFFF.
+        timer_set_counter(TIM3, 0);
+    }
+    return true;
+}
+
+/**
+ * @brief Keeps the ADC clock under its 36MHz limit at the current APB2 frequency. The common
+ * register is lost while the ADC clock is gated, so this runs every time the ADC is powered on.
+ *
+ */
+void adcSetPrescaler(void)
+{
+    adc_set_clk_prescaler(rcc_apb2_frequency > 72000000 ? ADC_CCR_ADCPRE_BY4 : ADC_CCR_ADCPRE_BY2);
+}
+
+/**
+ * @brief Follows a CPU clock change (coreSystemSetClock()). The ADC prescaler is set again and a
+ * running scan's timer is put back to SCAN_TIMER_TICK_HZ.
+ *
+ */
+void adcClockChanged(void)
+{
+    adcSetPrescaler();
+    if (scan_count != 0)
+    {
+        // Loaded at the next update, so the frame in progress finishes at the old rate.
+        timer_set_prescaler(TIM3, coreTimerClockFrequency(TIM3) / SCAN_TIMER_TICK_HZ - 1);
+    }
+}
+
+/**
+ * @brief Returns the average of the newest completed samples of a scanned channel, one per frame,
+ * at a pin's resolution. Fewer frames are averaged while the scan is too new to hold them all.
+ * Only waits if the scan has just started and no frame has finished yet.
+ *
+ * @param rank channel position in the scan
+ * @param frames frames to average, 1 to ADC_MAX_AVERAGE
+ * @param bits resolution to return
+ * @return uint16_t filtered sample, 0 if the channel isn't scanned
+ */
+uint16_t adcScanRead(uint8_t rank, uint8_t frames, uint8_t bits)
+{
+    if (rank >= scan_count)
+    {
+        return 0;
+    }
+
+    const uint16_t length = scanBufferLength();
+    uint16_t       written = (uint16_t)(length - dma_get_number_of_data(DMA2, DMA_STREAM4));
+    const uint64_t deadline = coreGetTicks() + 1000 / scan_rate_hz + 2;
+    while (scan_halves_done == 0 && written < scan_count && coreGetTicks() < deadline)
+    {
+        written = (uint16_t)(length - dma_get_number_of_data(DMA2, DMA_STREAM4));
+    }
+
+    // Frames before the one DMA is filling are complete, every other one is too once it wrapped.
+    uint16_t frame = (uint16_t)((written % length) / scan_count);
+    uint16_t complete = scan_halves_done >= 2 ? ADC_MAX_AVERAGE : frame;
+    if (frames > complete)
+    {
+        frames = (uint8_t)(complete == 0 ? 1 : complete);
+    }
+
+    uint32_t sum = 0;
+    for (uint8_t taken = 0; taken < frames; taken++)
+    {
+        frame = (uint16_t)((frame == 0 ? 2 * ADC_SCAN_FRAMES_PER_HALF : frame) - 1);
+        sum += scan_buffer[frame * scan_count + rank];
+    }
+    return scaleSample(sum, frames, bits);
+}
+
+/**
+ * @brief Converts a channel by hand, for when the scan couldn't be started. Waits for every
+ * conversion.
+ *
+ * @param channel ADC channel
+ * @param samples conversions to average, at least 1
+ * @param bits resolution to return
+ * @return uint16_t averaged sample
+ */
+uint16_t adcConvert(uint8_t channel, uint8_t samples, uint8_t bits)
+{
+    uint8_t channel_array[1] = {channel};
+    adc_set_regular_sequence(ADC1, 1, channel_array);
+    uint32_t sum = 0;
+    for (uint8_t taken = 0; taken < samples; taken++)
+    {
+        adc_start_conversion_regular(ADC1);
+        while (!adc_eoc(ADC1))
+            ;
+        sum += adc_read_regular(ADC1);
+    }
+    return scaleSample(sum, samples == 0 ? 1 : samples, bits);
+}
+
+/**
+ * @brief Starts printing every scanned frame to the console, one comma separated line per
+ * frame, from adcStreamService().
+ *
+ * @param rate_hz frame rate to stream at, already validated
+ */
+void adcStreamStart(uint32_t rate_hz)
+{
+    (void)adcScanSetRate(rate_hz);
+    stream_halves_taken = scan_halves_done;
+    stream_dropped = 0;
+    stream_active = true;
+}
+
+/**
+ * @brief Stops streaming and puts the scan back to its idle rate.
+ *
+ * @return uint32_t blocks that were overwritten before they could be sent
+ */
+uint32_t adcStreamStop(void)
+{
+    stream_active = false;
+    (void)adcScanSetRate(ADC_SCAN_DEFAULT_HZ);
+    return stream_dropped;
+}
+
+/**
+ * @brief Tells whether frames are being streamed.
+ *
+ * @return true streaming
+ * @return false not streaming
+ */
+bool adcStreamActive(void)
+{
+    return stream_active;
+}
+
+/**
+ * @brief Writes a sample as decimal text.
+ *
+ * @param out destination, at least 5 bytes
+ * @param value sample
+ * @return size_t characters written
+ */
+static size_t formatSample(char *out, uint16_t value)
+{
+    char   digits[5];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * @brief Tells the main loop's sleep that adcStreamService() has something to do.
+ *
+ * @return true an overrun to recover from, or a completed block to send
+ */
+bool adcStreamPending(void)
+{
+    return scan_count != 0 && (adc_get_overrun_flag(ADC1) ||
+                               (stream_active && scan_halves_done != stream_halves_taken));
+}
+
+/**
+ * @brief Called from the main loop. Restarts the scan after an ADC overrun and, while streaming,
+ * sends each completed block. Blocks the console couldn't keep up with are counted as dropped.
+ *
+ */
+void adcStreamService(void)
+{
+    if (scan_count == 0)
+    {
+        return;
+    }
+    if (adc_get_overrun_flag(ADC1))
+    {
+        adc_clear_overrun_flag(ADC1);
+        stream_halves_taken = 0;
+        scanConfigure();
+        return;
+    }
+    if (!stream_active)
+    {
+        return;
+    }
+
+    uint32_t pending = scan_halves_done - stream_halves_taken;
+    if (pending == 0)
+    {
+        return;
+    }
+    if (pending > 1)
+    {
+        // Only the newest completed half is still intact.
+        stream_dropped += pending - 1;
+        stream_halves_taken = scan_halves_done - 1;
+    }
+
+    // Copy first so printing doesn't race DMA. The half stays intact until the other one is done.
+    // Sample 0 is left free so the copy doubles as the framed payload: channels, frames, samples.
+    const uint32_t block = stream_halves_taken;
+    const size_t   samples = ADC_SCAN_FRAMES_PER_HALF * scan_count;
+    const uint32_t ticks = scan_half_ticks[block & 1];
+    uint16_t       copy[1 + ADC_SCAN_FRAMES_PER_HALF * ADC_SCAN_MAX_CHANNELS];
+    for (size_t i = 0; i < samples; i++)
+    {
+        copy[i + 1] = scan_buffer[(block & 1) * samples + i];
+    }
+    stream_halves_taken++;
+    if (scan_halves_done - block > 1)
+    {
+        stream_dropped++;
+        return;
+    }
+
+    if (protocolBinaryMode())
+    {
+        // Samples are little endian already, as is the Cortex-M4.
+        uint8_t *payload = (uint8_t *)copy;
+        payload[0] = scan_count;
+        payload[1] = ADC_SCAN_FRAMES_PER_HALF;
+        protocolSendTimedFrame(FRAME_ADC_BLOCK, ticks, payload, (uint16_t)(2 + samples * 2));
+        return;
+    }
+
+    char line[ADC_SCAN_MAX_CHANNELS * 6 + 2];
+    for (size_t frame = 0; frame < ADC_SCAN_FRAMES_PER_HALF; frame++)
+    {
+        size_t length = 0;
+        for (size_t rank = 0; rank < scan_count; rank++)
+        {
+            if (rank != 0)
+            {
+                line[length++] = ',';
+            }
+            length += formatSample(&line[length], copy[1 + frame * scan_count + rank]);
+        }
+        line[length++] = '\r';
+        line[length++] = '\n';
+        coreUartWrite((uint8_t *)line, (uint32_t)length);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,400 @@
+/**
+ * @file bench-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Runs the "bench" suite from the main loop and prints a compact report, so firmware builds
+ * and clock settings can be compared on real boards.
+ * @version 0.1
+ * @date 2025-04-04
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "bench-control.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BOARD_BENCH
+#include "libopencm3/stm32/gpio.h"
+
+#include "adc-control.h"
+#include "core/system.h"
+#include "interpreter.h"
+#include "protocol.h"
+#include "response.h"
+#include "uart-control.h"
+#include "version.h"
+
+// Lines interpret() runs for the corpus rate, "%s" is the bench pin. More lines than cache slots,
+// and a few that fail to compile, so misses and errors are in the mix as well as hits.
+static const char *const corpus[] = {
+    "toggle %s",          "set %s",        "reset %s",           "read %s",
+    "set %s; reset %s",   "read %s %s %s", "repeat 10 toggle %s", "toggle %s 5",
+};
+#define BENCH_CORPUS_LINES (sizeof(corpus) / sizeof(corpus[0]))
+
+// Set by "bench", the suite runs from benchService() once the line that asked for it is done.
+static bool bench_pending = false;
+
+/**
+ * @brief Queues the suite to run from the main loop. It calls interpret() itself, so it can't
+ * run from inside the line that asked for it.
+ *
+ * @return true queued
+ * @return false the console can't show the report
+ */
+bool benchStart(void)
+{
+    if (responseVerbosity() != VERBOSITY_FULL || protocolBinaryMode())
+    {
+        printf("> Error: \"bench\" reports as text, use \"mode text\" and \"verbosity full\" "
+               "first.\r\n");
+        return false;
+    }
+    bench_pending = true;
+    printf("> Benchmark starting, this takes a few seconds.\r\n");
+    return true;
+}
+
+/**
+ * @brief Turns a count over a number of cycles into a count per second.
+ *
+ * @param count things done
+ * @param cycles CPU cycles they took
+ * @return uint32_t things per second
+ */
+static uint32_t perSecond(uint64_t count, uint64_t cycles)
+{
+    return cycles == 0 ? 0 : (uint32_t)((count * coreSystemCpuFrequency()) / cycles);
+}
+
+/**
+ * @brief Finds the first pin of a type in the pin table.
+ *
+ * @param bc board controller object
+ * @param type peripheral type wanted
+ * @param port returned port
+ * @param pin returned pin mask
+ * @return true found one
+ * @return false no pin of that type
+ */
+static bool findPin(BoardController *bc, PeripheralType type, uint32_t *port, uint32_t *pin)
+{
+    for (size_t port_index = 0; port_index < BOARD_PORT_COUNT; port_index++)
+    {
+        for (size_t pin_index = 0; pin_index < BOARD_PINS_PER_PORT; pin_index++)
+        {
+            const PeripheralController *periph = bc->pin_table[port_index][pin_index];
+            if (periph != NULL && periph->type == type)
+            {
+                *port = GPIOA + PORT_SIZE * port_index;
+                *pin = 1U << pin_index;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Writes a pin as it is typed, e.g. "a05".
+ *
+ * @param name destination, at least 4 bytes
+ * @param port GPIO port
+ * @param pin GPIO pin mask
+ */
+static void pinName(char *name, uint32_t port, uint32_t pin)
+{
+    (void)snprintf(name, 4, "%c%02u", (char)('a' + (port - GPIOA) / PORT_SIZE),
+                   (unsigned int)__builtin_ctz(pin));
+}
+
+/**
+ * @brief Runs lines through interpret() with the console silenced.
+ *
+ * @param bc board controller object
+ * @param lines lines to run, in turn
+ * @param count how many lines
+ * @param passes times through them all
+ * @return uint64_t CPU cycles taken
+ */
+static uint64_t benchInterpret(BoardController *bc, char lines[][BENCH_LINE_SIZE], size_t count,
+                               uint32_t passes)
+{
+    char line[BENCH_LINE_SIZE];
+    responseSetVerbosity(VERBOSITY_SILENT);
+    const uint64_t begin = coreSystemCycles();
+    for (uint32_t pass = 0; pass < passes; pass++)
+    {
+        for (size_t index = 0; index < count; index++)
+        {
+            // interpret() may write to its line, as the console's is reused.
+            size_t length = strlen(lines[index]);
+            memcpy(line, lines[index], length + 1);
+            (void)interpret(bc, line, length);
+        }
+    }
+    const uint64_t cycles = coreSystemCycles() - begin;
+    responseSetVerbosity(VERBOSITY_FULL);
+    return cycles;
+}
+
+/**
+ * @brief Toggle rate of the first output pin: straight to the port, through actionDigitalPin()
+ * and as "toggle" lines through interpret(). Then interpret()'s rate on the corpus.
+ *
+ * @param bc board controller object
+ */
+static void benchGPIO(BoardController *bc)
+{
+    uint32_t port;
+    uint32_t pin;
+    if (!findPin(bc, TYPE_GPIO_OUTPUT, &port, &pin))
+    {
+        printf("> BENCH gpio: skipped, no output pin (e.g. \"output a05\").\r\n");
+        printf("> BENCH interpret: skipped, the corpus runs on an output pin.\r\n");
+        return;
+    }
+    char name[4];
+    pinName(name, port, pin);
+    const uint16_t level = gpio_get(port, (uint16_t)pin);
+
+    uint64_t begin = coreSystemCycles();
+    for (uint32_t toggle = 0; toggle < BENCH_GPIO_TOGGLES; toggle++)
+    {
+        gpio_toggle(port, (uint16_t)pin);
+    }
+    const uint64_t raw = coreSystemCycles() - begin;
+
+    begin = coreSystemCycles();
+    for (uint32_t toggle = 0; toggle < BENCH_GPIO_TOGGLES; toggle++)
+    {
+        (void)actionDigitalPin(bc, port, pin, GPIO_TOGGLE);
+    }
+    const uint64_t action = coreSystemCycles() - begin;
+
+    char toggle_line[1][BENCH_LINE_SIZE];
+    (void)snprintf(toggle_line[0], BENCH_LINE_SIZE, "toggle %s", name);
+    const uint64_t lines = benchInterpret(bc, toggle_line, 1, BENCH_GPIO_LINES);
+
+    printf("> BENCH gpio %s toggles/s: raw %lu, actionDigitalPin %lu, interpret %lu\r\n", name,
+           perSecond(BENCH_GPIO_TOGGLES, raw), perSecond(BENCH_GPIO_TOGGLES, action),
+           perSecond(BENCH_GPIO_LINES, lines));
+
+    char corpus_lines[BENCH_CORPUS_LINES][BENCH_LINE_SIZE];
+    for (size_t index = 0; index < BENCH_CORPUS_LINES; index++)
+    {
+        (void)snprintf(corpus_lines[index], BENCH_LINE_SIZE, corpus[index], name, name, name);
+    }
+    const uint64_t corpus_cycles =
+        benchInterpret(bc, corpus_lines, BENCH_CORPUS_LINES, BENCH_CORPUS_PASSES);
+    printf("> BENCH interpret lines/s: cached %lu, corpus of %u %lu\r\n",
+           perSecond(BENCH_GPIO_LINES, lines), (unsigned int)BENCH_CORPUS_LINES,
+           perSecond((uint64_t)BENCH_CORPUS_LINES * BENCH_CORPUS_PASSES, corpus_cycles));
+
+    if (level)
+    {
+        gpio_set(port, (uint16_t)pin);
+    }
+    else
+    {
+        gpio_clear(port, (uint16_t)pin);
+    }
+}
+
+/**
+ * @brief Read rate of the first ADC pin through actionAnalogPin(), and how many samples the scan
+ * converts per second at its top frame rate.
+ *
+ * @param bc board controller object
+ */
+static void benchADC(BoardController *bc)
+{
+    uint32_t port;
+    uint32_t pin;
+    if (!findPin(bc, TYPE_ADC, &port, &pin))
+    {
+        printf("> BENCH adc: skipped, no ADC pin (e.g. \"adc a00\").\r\n");
+        return;
+    }
+    char name[4];
+    pinName(name, port, pin);
+
+    const uint64_t begin = coreSystemCycles();
+    for (uint32_t read = 0; read < BENCH_ADC_READS; read++)
+    {
+        (void)actionAnalogPin(bc, port, pin);
+    }
+    const uint64_t reads = coreSystemCycles() - begin;
+    printf("> BENCH adc %s reads/s: actionAnalogPin %lu", name, perSecond(BENCH_ADC_READS, reads));
+
+    if (!adcScanRunning() || adcStreamActive())
+    {
+        printf(", scan skipped (%s)\r\n", adcStreamActive() ? "streaming" : "not running");
+        return;
+    }
+    (void)adcScanSetRate(ADC_SCAN_MAX_HZ);
+    // Let the frame in progress at the old rate finish first.
+    coreSystemDelay(2);
+    const uint32_t halves = adcScanHalves();
+    const uint64_t window = coreSystemCycles();
+    coreSystemDelay(BENCH_ADC_SCAN_MS);
+    const uint64_t samples = (uint64_t)(adcScanHalves() - halves) * ADC_SCAN_FRAMES_PER_HALF *
+                             adcScanChannels();
+    const uint64_t cycles = coreSystemCycles() - window;
+    (void)adcScanSetRate(ADC_SCAN_DEFAULT_HZ);
+    printf(", scan %lu samples/s (%u channels at %d Hz)\r\n", perSecond(samples, cycles),
+           (unsigned int)adcScanChannels(), ADC_SCAN_MAX_HZ);
+}
+
+/**
+ * @brief Sends BENCH_UART_BYTES out of the first user UART and reads them back, which needs its
+ * TX wired to its RX. Bytes are queued as fast as the TX buffer takes them and read back as they
+ * arrive, so neither buffer limits the rate.
+ *
+ * @param bc board controller object
+ */
+static void benchUART(BoardController *bc)
+{
+    PeripheralController *periph = getUARTPeripheral(bc, UART_ANY);
+    if (periph == NULL)
+    {
+        printf("> BENCH uart: skipped, no user UART.\r\n");
+        return;
+    }
+    UARTController uart = periph->peripheral.uart;
+
+    // Anything already received isn't ours.
+    uint8_t chunk[64];
+    while (currentUartRead(uart, chunk, sizeof(chunk)) > 0)
+    {
+    }
+
+    // Twice the line time plus a little, then give up on the rest.
+    const uint64_t timeout_ms = (BENCH_UART_BYTES * 10ULL * 2000) / uart.baudrate + 50;
+    const uint64_t deadline = coreGetTicks() + timeout_ms;
+    uint32_t       sent = 0;
+    uint32_t       received = 0;
+    uint32_t       errors = 0;
+    const uint64_t begin = coreSystemCycles();
+    while (received < BENCH_UART_BYTES && coreGetTicks() < deadline)
+    {
+        if (sent < BENCH_UART_BYTES)
+        {
+            uint8_t out[sizeof(chunk)];
+            size_t  length = BENCH_UART_BYTES - sent < sizeof(out) ? BENCH_UART_BYTES - sent
+                                                                   : sizeof(out);
+            for (size_t byte = 0; byte < length; byte++)
+            {
+                out[byte] = (uint8_t)(sent + byte);
+            }
+            sent += currentUartWriteNoWait(uart, out, (uint32_t)length);
+        }
+        uint32_t count = currentUartRead(uart, chunk, sizeof(chunk));
+        for (uint32_t byte = 0; byte < count; byte++)
+        {
+            errors += chunk[byte] != (uint8_t)(received + byte) ? 1 : 0;
+        }
+        received += count;
+    }
+    const uint64_t cycles = coreSystemCycles() - begin;
+
+    const char *name = uart.handle == USART1 ? "USART1" : "USART6";
+    if (received == 0)
+    {
+        printf("> BENCH uart %s: nothing came back, wire TX to RX.\r\n", name);
+        return;
+    }
+    const uint32_t rate = perSecond(received, cycles);
+    printf("> BENCH uart %s at %lu baud: %lu bytes/s (%lu%% of line rate), %lu of %d bytes back, "
+           "%lu wrong\r\n",
+           name, uart.baudrate, rate, (rate * 1000UL) / uart.baudrate, received,
+           BENCH_UART_BYTES, errors);
+}
+
+/**
+ * @brief Finds the first live peripheral of a type.
+ *
+ * @param bc board controller object
+ * @param type peripheral type wanted
+ * @return PeripheralController* peripheral, NULL if there is none
+ */
+static PeripheralController *findPeripheral(BoardController *bc, PeripheralType type)
+{
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        if (bc->peripherals[periph].status && bc->peripherals[periph].type == type)
+        {
+            return &bc->peripherals[periph];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Saves the first PWM pin and SPI as "save" would, moves to another clock and rebuilds
+ * them as a restore would, then checks they come back at the speeds asked for: PWM within 1%, SPI
+ * never faster. The clock is put back after, the flash snapshot isn't touched.
+ *
+ * @param bc board controller object
+ */
+static void benchRestore(BoardController *bc)
+{
+    PeripheralController *pwm = findPeripheral(bc, TYPE_PWM);
+    PeripheralController *spi = findPeripheral(bc, TYPE_SPI);
+    if (pwm == NULL && spi == NULL)
+    {
+        printf("> BENCH restore: skipped, no PWM pin or SPI (e.g. \"pwm a00 1000 50\").\r\n");
+        return;
+    }
+    PWMPeripheral saved_pwm = pwm != NULL ? pwm->peripheral.pwm : (PWMPeripheral){0};
+    SPIController saved_spi = spi != NULL ? spi->peripheral.spi : (SPIController){0};
+
+    const uint32_t saved_mhz = coreSystemCpuFrequency() / 1000000;
+    const uint32_t restore_mhz = saved_mhz == BENCH_RESTORE_MHZ ? CPU_FREQ / 1000000
+                                                                : BENCH_RESTORE_MHZ;
+    (void)setBoardClock(bc, restore_mhz);
+    printf("> BENCH restore at %lu MHz of a save at %lu MHz:", restore_mhz, saved_mhz);
+    bool passed = true;
+    if (pwm != NULL)
+    {
+        PWMPeripheral rebuilt = rebuildStandardPeripheral(TYPE_PWM, &saved_pwm).peripheral.pwm;
+        const uint32_t hz = coreTimerClockFrequency(rebuilt.timer) /
+                            (rebuilt.prescaler * rebuilt.arr_val);
+        const uint32_t error = hz > rebuilt.frequency ? hz - rebuilt.frequency
+                                                      : rebuilt.frequency - hz;
+        passed &= error * 100 <= rebuilt.frequency;
+        printf(" pwm %lu Hz for %lu,", hz, rebuilt.frequency);
+    }
+    if (spi != NULL)
+    {
+        SPIController rebuilt = rebuildStandardPeripheral(TYPE_SPI, &saved_spi).peripheral.spi;
+        const uint32_t hz = currentSPIFrequency(&rebuilt);
+        passed &= hz <= rebuilt.frequency;
+        printf(" spi %lu Hz for %lu,", hz, rebuilt.frequency);
+    }
+    (void)setBoardClock(bc, saved_mhz);
+    printf(" %s\r\n", passed ? "ok" : "FAIL");
+}
+
+/**
+ * @brief Runs the suite if "bench" asked for it. Call from the main loop.
+ *
+ * @param bc board controller object
+ */
+void benchService(BoardController *bc)
+{
+    if (!bench_pending)
+    {
+        return;
+    }
+    bench_pending = false;
+
+    printf("> BENCH firmware %s.%s (%s) at %lu MHz\r\n", VERSION_MJR, VERSION_MIN, GIT_VERSION,
+           coreSystemCpuFrequency() / 1000000);
+    benchGPIO(bc);
+    benchADC(bc);
+    benchUART(bc);
+    benchRestore(bc);
+}
+#endif
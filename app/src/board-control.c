@@ -10,14 +10,21 @@
  *
  */
 #include "board-control.h"
+#include "core/system.h"
+#include "core/uart.h"
+#include "capture-control.h"
 #include "clocks-control.h"
+#include "exti-control.h"
 #include "libopencm3/stm32/f4/rcc.h"
+#include "libopencm3/stm32/f4/usart.h"
 #include "local-memory.h"
+#include "pattern-control.h"
 #include "peripheral-controller.h"
 #include "uart-control.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 /**
  * @brief Initialise the board object. To be called at startup.
@@ -26,17 +33,32 @@
  */
 BoardController *initBoard(void)
 {
-    BoardController *bc = (BoardController *)malloc(sizeof(BoardController));
+#ifdef BOARD_STATIC_POOLS
+    static BoardController board;
+    BoardController       *bc = &board;
+
+    // Fixed pools
+    bc->peripherals_size = BOARD_MAX_PERIPHERALS;
+    bc->free_count = 0;
+#else
+    BoardController *bc = ALLOCATE(BoardController, 1);
 
     // vect
-    bc->clocks_size = 4;
     bc->peripherals_size = 4;
+
+    bc->peripherals = ALLOCATE(PeripheralController, bc->peripherals_size);
+#endif
     bc->peripherals_count = 0;
-    bc->clocks_count = 0;
 
-    bc->clocks = (ClockController *)malloc(sizeof(ClockController) * bc->clocks_size);
-    bc->peripherals =
-        (PeripheralController *)malloc(sizeof(PeripheralController) * bc->peripherals_size);
+    memset(bc->clocks, 0, sizeof(bc->clocks));
+    // The console is on port A, nothing the board does may gate it off.
+    ClockController *console_port = &bc->clocks[clockIndex(RCC_GPIOA)];
+    *console_port = create_clock(RCC_GPIOA);
+    console_port->pinned = true;
+    enableClock(console_port);
+
+    memset(bc->pin_table, 0, sizeof(bc->pin_table));
+    bc->generation = 1;
 
     return bc;
 }
@@ -49,58 +71,255 @@ BoardController *initBoard(void)
  */
 void deinitBoard(BoardController *bc)
 {
-    for (size_t clock = 0; clock < bc->clocks_count; clock++)
-    {
-        disableClock(&bc->clocks[clock]);
-    }
-    bc->clocks_count = 0;
-    free(bc->clocks);
-
     for (size_t peripheral = 0; peripheral < bc->peripherals_count; peripheral++)
     {
         // Disable peripheral
         bc->peripherals[peripheral].disablePeripheral(&bc->peripherals[peripheral]);
     }
     bc->peripherals_count = 0;
-    free(bc->peripherals);
-    free(bc);
+    memset(bc->pin_table, 0, sizeof(bc->pin_table));
+
+    for (size_t clock = 0; clock < CLOCK_TABLE_SIZE; clock++)
+    {
+        if (!bc->clocks[clock].pinned)
+        {
+            disableClock(&bc->clocks[clock]);
+        }
+        bc->clocks[clock].refs = 0;
+    }
+#ifdef BOARD_STATIC_POOLS
+    bc->free_count = 0;
+#else
+    FREE_ARRAY(PeripheralController, bc->peripherals, bc->peripherals_size);
+    FREE(BoardController, bc);
+#endif
 }
 
 /**
- * @brief static function to grow the size of the .clocks member and add a
- * new element. Doesn't reallocate as there's a limited number of clocks, and we always check to see
- * if one is available before allocating another one.
+ * @brief Converts a port/pin pair into pin table indices.
  *
- * @param bc board control object
- * @param clock clock to be added
+ * @param port GPIO port (e.g. GPIOA)
+ * @param pin GPIO pin mask, must have exactly one bit set (e.g. GPIO5)
+ * @param port_index returned port index, 0 = A
+ * @param pin_index returned pin number 0-15
+ * @return true port/pin is covered by the table
+ * @return false port/pin is out of range
+ */
+static bool pinTableIndex(uint32_t port, uint32_t pin, size_t *port_index, size_t *pin_index)
+{
+    if (port < GPIOA || (port - GPIOA) % PORT_SIZE != 0 || pin == 0 || (pin & (pin - 1)) != 0)
+    {
+        return false;
+    }
+
+    *port_index = (port - GPIOA) / PORT_SIZE;
+    *pin_index = (size_t)__builtin_ctz(pin);
+    return *port_index < BOARD_PORT_COUNT && *pin_index < BOARD_PINS_PER_PORT;
+}
+
+/**
+ * @brief Marks the board configuration as changed so compiled lines rebind before running again.
+ * Generation 0 is reserved for CHUNK_UNBOUND so it is skipped on wrap.
+ *
+ * @param bc board controller object
+ */
+static void boardChanged(BoardController *bc)
+{
+    bc->generation++;
+    if (bc->generation == 0)
+    {
+        bc->generation = 1;
+    }
+}
+
+/**
+ * @brief Points a single pin table entry at a peripheral (or NULL to free it).
+ *
+ * @param bc board controller
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param periph owning peripheral, NULL to release the pin.
+ */
+static void pinTableSet(BoardController *bc, uint32_t port, uint32_t pin,
+                        PeripheralController *periph)
+{
+    size_t port_index, pin_index;
+    if (pinTableIndex(port, pin, &port_index, &pin_index))
+    {
+        bc->pin_table[port_index][pin_index] = periph;
+    }
+}
+
+/**
+ * @brief Registers every pin used by a peripheral in the pin table.
+ *
+ * @param bc board controller
+ * @param periph peripheral that now owns its pins.
+ */
+static void pinTableAssign(BoardController *bc, PeripheralController *periph)
+{
+    switch (periph->type)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+        pinTableSet(bc, periph->peripheral.gpio.port, periph->peripheral.gpio.pin, periph);
+        break;
+    case TYPE_ADC:
+        pinTableSet(bc, periph->peripheral.adc.port, periph->peripheral.adc.pin, periph);
+        break;
+    case TYPE_PWM:
+        pinTableSet(bc, periph->peripheral.pwm.port, periph->peripheral.pwm.pin, periph);
+        break;
+    case TYPE_MEASURE:
+        pinTableSet(bc, periph->peripheral.measure.port, periph->peripheral.measure.pin, periph);
+        break;
+    case TYPE_UART:
+        pinTableSet(bc, periph->peripheral.uart.RX.port, periph->peripheral.uart.RX.pin, periph);
+        pinTableSet(bc, periph->peripheral.uart.TX.port, periph->peripheral.uart.TX.pin, periph);
+        if (periph->peripheral.uart.flow == UART_FLOW_RTSCTS)
+        {
+            pinTableSet(bc, periph->peripheral.uart.CTS.port, periph->peripheral.uart.CTS.pin,
+                        periph);
+            pinTableSet(bc, periph->peripheral.uart.RTS.port, periph->peripheral.uart.RTS.pin,
+                        periph);
+        }
+        break;
+    case TYPE_SPI:
+        pinTableSet(bc, periph->peripheral.spi.SCK.port, periph->peripheral.spi.SCK.pin, periph);
+        pinTableSet(bc, periph->peripheral.spi.MISO.port, periph->peripheral.spi.MISO.pin, periph);
+        pinTableSet(bc, periph->peripheral.spi.MOSI.port, periph->peripheral.spi.MOSI.pin, periph);
+        break;
+    case TYPE_I2C:
+        pinTableSet(bc, periph->peripheral.i2c.SCL.port, periph->peripheral.i2c.SCL.pin, periph);
+        pinTableSet(bc, periph->peripheral.i2c.SDA.port, periph->peripheral.i2c.SDA.pin, periph);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Removes every pin table entry that points at the given peripheral.
+ *
+ * @param bc board controller
+ * @param periph peripheral being released.
+ */
+static void pinTableRelease(BoardController *bc, PeripheralController *periph)
+{
+    switch (periph->type)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+        pinTableSet(bc, periph->peripheral.gpio.port, periph->peripheral.gpio.pin, NULL);
+        break;
+    case TYPE_ADC:
+        pinTableSet(bc, periph->peripheral.adc.port, periph->peripheral.adc.pin, NULL);
+        break;
+    case TYPE_PWM:
+        pinTableSet(bc, periph->peripheral.pwm.port, periph->peripheral.pwm.pin, NULL);
+        break;
+    case TYPE_MEASURE:
+        pinTableSet(bc, periph->peripheral.measure.port, periph->peripheral.measure.pin, NULL);
+        break;
+    case TYPE_UART:
+        pinTableSet(bc, periph->peripheral.uart.RX.port, periph->peripheral.uart.RX.pin, NULL);
+        pinTableSet(bc, periph->peripheral.uart.TX.port, periph->peripheral.uart.TX.pin, NULL);
+        if (periph->peripheral.uart.flow == UART_FLOW_RTSCTS)
+        {
+            pinTableSet(bc, periph->peripheral.uart.CTS.port, periph->peripheral.uart.CTS.pin,
+                        NULL);
+            pinTableSet(bc, periph->peripheral.uart.RTS.port, periph->peripheral.uart.RTS.pin,
+                        NULL);
+        }
+        break;
+    case TYPE_SPI:
+        pinTableSet(bc, periph->peripheral.spi.SCK.port, periph->peripheral.spi.SCK.pin, NULL);
+        pinTableSet(bc, periph->peripheral.spi.MISO.port, periph->peripheral.spi.MISO.pin, NULL);
+        pinTableSet(bc, periph->peripheral.spi.MOSI.port, periph->peripheral.spi.MOSI.pin, NULL);
+        break;
+    case TYPE_I2C:
+        pinTableSet(bc, periph->peripheral.i2c.SCL.port, periph->peripheral.i2c.SCL.pin, NULL);
+        pinTableSet(bc, periph->peripheral.i2c.SDA.port, periph->peripheral.i2c.SDA.pin, NULL);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Rebuilds the pin table from scratch. Needed whenever .peripherals is reallocated or
+ * compacted, as the table holds pointers into it.
+ *
+ * @param bc board controller
  */
-static void growClocks(BoardController *bc, enum rcc_periph_clken clock)
+static void pinTableRebuild(BoardController *bc)
 {
-    if (bc->clocks_count == bc->clocks_size)
+    memset(bc->pin_table, 0, sizeof(bc->pin_table));
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        if (bc->peripherals[periph].status)
+        {
+            pinTableAssign(bc, &bc->peripherals[periph]);
+        }
+    }
+}
+
+#ifdef BOARD_STATIC_POOLS
+/**
+ * @brief Takes a slot from the peripheral pool, preferring the most recently released one.
+ *
+ * @param bc board control structure
+ * @param periph peripheral to be added
+ * @return PeripheralController* the stored peripheral, NULL if the pool is full.
+ */
+static PeripheralController *growPeripherals(BoardController *bc, PeripheralController periph)
+{
+    size_t slot;
+    if (bc->free_count > 0)
+    {
+        slot = bc->free_slots[--bc->free_count];
+    }
+    else if (bc->peripherals_count < BOARD_MAX_PERIPHERALS)
+    {
+        slot = bc->peripherals_count++;
+    }
+    else
     {
-        size_t oldSize = bc->clocks_size;
-        bc->clocks_size = GROW_CAPACITY(oldSize);
-        bc->clocks = GROW_ARRAY(ClockController, bc->clocks, oldSize, bc->clocks_size);
+        printf("> Error: peripheral pool full (%d peripherals).\r\n", BOARD_MAX_PERIPHERALS);
+        return NULL;
     }
-    bc->clocks[bc->clocks_count++] = create_clock(clock);
+    bc->peripherals[slot] = periph;
+    return &bc->peripherals[slot];
 }
 
+/**
+ * @brief Returns a killed peripheral's slot to the pool.
+ *
+ * @param bc board control structure
+ * @param periph peripheral being released
+ */
+static void releasePeripheral(BoardController *bc, PeripheralController *periph)
+{
+    bc->free_slots[bc->free_count++] = (uint8_t)(periph - bc->peripherals);
+}
+#else
 /**
  * @brief Grows and adds new element to .peripherals member. If peripherals is huge (i.e., about to
  * suck my memory dry and zip it up when its done) it reallocates the memory, getting rid of any
- * discarded peripherals (status == false).
+ * discarded peripherals (status == false). The pin table is rebuilt whenever the array moves.
  *
  * @param bc board control structure
  * @param periph peripheral to be added
+ * @return PeripheralController* the stored peripheral.
  */
-static void growPeripherals(BoardController *bc, PeripheralController periph)
+static PeripheralController *growPeripherals(BoardController *bc, PeripheralController periph)
 {
+    bool moved = false;
     if (bc->peripherals_count > 90)
     {
         size_t                peripherals_size = 4;
         size_t                peripherals_count = 0;
-        PeripheralController *periphs_new =
-            (PeripheralController *)malloc(sizeof(PeripheralController) * peripherals_size);
+        PeripheralController *periphs_new = ALLOCATE(PeripheralController, peripherals_size);
         for (size_t periph_i = 0; periph_i < bc->peripherals_count; periph_i++)
         {
             if (peripherals_size == peripherals_count)
@@ -116,10 +335,11 @@ static void growPeripherals(BoardController *bc, PeripheralController periph)
                 periphs_new[peripherals_count++] = bc->peripherals[periph_i];
             }
         }
-        FREE_ARRAY(PeripheralType, bc->peripherals, bc->peripherals_count);
+        FREE_ARRAY(PeripheralController, bc->peripherals, bc->peripherals_size);
         bc->peripherals_count = peripherals_count;
         bc->peripherals_size = peripherals_size;
         bc->peripherals = periphs_new;
+        moved = true;
     }
     if (bc->peripherals_count == bc->peripherals_size)
     {
@@ -127,90 +347,348 @@ static void growPeripherals(BoardController *bc, PeripheralController periph)
         bc->peripherals_size = GROW_CAPACITY(oldSize);
         bc->peripherals =
             GROW_ARRAY(PeripheralController, bc->peripherals, oldSize, bc->peripherals_size);
+        moved = true;
+    }
+    if (moved)
+    {
+        pinTableRebuild(bc);
     }
     bc->peripherals[bc->peripherals_count++] = periph;
+    return &bc->peripherals[bc->peripherals_count - 1];
+}
+
+/**
+ * @brief Killed peripherals stay in place (status == false) until growPeripherals() compacts.
+ *
+ * @param bc board control structure
+ * @param periph peripheral being released
+ */
+static void releasePeripheral(BoardController *bc, PeripheralController *periph)
+{
+    (void)bc;
+    (void)periph;
+}
+#endif
+
+/**
+ * @brief Rebuilds the ADC scan sequence from every live ADC pin, in peripheral order, and gives
+ * each pin its rank so reads can pick their sample out of the scan. Resolution is ADC wide, so the
+ * scan runs at the finest any pin asks for. Must run before the ADC clock is dropped.
+ *
+ * @param bc board controller
+ */
+static void rebuildADCScan(BoardController *bc)
+{
+    uint8_t channels[ADC_SCAN_MAX_CHANNELS];
+    uint8_t count = 0;
+    uint8_t bits = ADC_MIN_BITS;
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        PeripheralController *current = &bc->peripherals[periph];
+        if (current->type == TYPE_ADC && current->status && count < ADC_SCAN_MAX_CHANNELS)
+        {
+            current->peripheral.adc.scan_rank = count;
+            channels[count++] = current->peripheral.adc.adc_channel;
+            if (current->peripheral.adc.bits > bits)
+            {
+                bits = current->peripheral.adc.bits;
+            }
+        }
+    }
+    (void)adcScanStart(channels, count, bits);
+}
+
+/**
+ * @brief Counts the live PWM pins driven by a timer.
+ *
+ * @param bc board controller
+ * @param timer timer peripheral
+ * @return int number of channels in use
+ */
+static int pwmTimerInUse(BoardController *bc, uint32_t timer)
+{
+    int pwm_count = 0;
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        if (bc->peripherals[periph].type == TYPE_PWM && bc->peripherals[periph].status &&
+            bc->peripherals[periph].peripheral.pwm.timer == timer)
+        {
+            pwm_count++;
+        }
+    }
+    return pwm_count;
 }
 
 /**
- * @brief Indicates whether there are any adcs available.
+ * @brief Brings the other channels of a timer in line with a new period. The timer registers
+ * are shared, so only each channel's compare value needs working out again.
  *
  * @param bc board controller
- * @return int how many adcs are enabled.
+ * @param pwm channel that set the new period
+ * @return size_t number of other channels retuned
  */
-static int adcExists(BoardController *bc)
+static size_t retunePWMTimer(BoardController *bc, const PWMPeripheral *pwm)
 {
-    int adc_count = 0;
+    size_t retuned = 0;
     for (size_t periph = 0; periph < bc->peripherals_count; periph++)
     {
-        if (bc->peripherals[periph].type == TYPE_ADC && bc->peripherals[periph].status)
+        PWMPeripheral *other = &bc->peripherals[periph].peripheral.pwm;
+        if (bc->peripherals[periph].type == TYPE_PWM && bc->peripherals[periph].status &&
+            other->timer == pwm->timer && other->channel != pwm->channel)
         {
-            adc_count++;
+            if (other->prescaler != pwm->prescaler || other->arr_val != pwm->arr_val)
+            {
+                retuned++;
+            }
+            other->frequency = pwm->frequency;
+            other->prescaler = pwm->prescaler;
+            other->arr_val = pwm->arr_val;
+            corePWMSetDutyCycle(other, other->duty_cycle);
         }
     }
-    return adc_count;
+    return retuned;
 }
 
 /**
- * @brief Checks to see if a UART is currently being used.
+ * @brief Returns the live UART peripheral for a handle.
  *
  * @param bc Board controller object.
- * @param current_uart return value of the uart.
- * @return true
- * @return false
+ * @param handle uart handle (e.g. USART1), UART_ANY for whichever UART was set up first.
+ * @return PeripheralController* the UART, NULL if that UART isn't set up.
  */
-static bool uartExists(BoardController *bc, UARTController *current_uart)
+PeripheralController *getUARTPeripheral(BoardController *bc, uint32_t handle)
 {
     for (size_t periph = 0; periph < bc->peripherals_count; periph++)
     {
-        if (bc->peripherals[periph].type == TYPE_UART && bc->peripherals[periph].status)
+        if (bc->peripherals[periph].type == TYPE_UART && bc->peripherals[periph].status &&
+            (handle == UART_ANY || bc->peripherals[periph].peripheral.uart.handle == handle))
         {
-            *current_uart = bc->peripherals[periph].peripheral.uart;
-            return true;
+            return &bc->peripherals[periph];
         }
     }
-    return false;
+    return NULL;
 }
 
 /**
- * @brief returns whether a clock object already exists for given clock
+ * @brief Returns the live SPI peripheral for a handle.
  *
- * @param bc board control object
- * @param clock clock to check
- * @return true clock already created
- * @return false clock not created
+ * @param bc Board controller object.
+ * @param handle SPI handle (e.g. SPI1), SPI_ANY for whichever SPI was set up first.
+ * @return PeripheralController* the SPI, NULL if that SPI isn't set up.
  */
-static clockExistsReturn clockExists(BoardController *bc, enum rcc_periph_clken clock)
+PeripheralController *getSPIPeripheral(BoardController *bc, uint32_t handle)
 {
-    for (size_t clock_c = 0; clock_c < bc->clocks_count; clock_c++)
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
     {
-        if (bc->clocks[clock_c].clock == clock && bc->clocks[clock_c].clock_enabled)
+        if (bc->peripherals[periph].type == TYPE_SPI && bc->peripherals[periph].status &&
+            (handle == SPI_ANY || bc->peripherals[periph].peripheral.spi.handle == handle))
         {
-            return (clockExistsReturn){.exists = true, .status = true, .index = clock_c};
+            return &bc->peripherals[periph];
         }
-        if (bc->clocks[clock_c].clock == clock && !bc->clocks[clock_c].clock_enabled)
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the live I2C peripheral for a handle.
+ *
+ * @param bc Board controller object.
+ * @param handle I2C handle (e.g. I2C1), I2C_ANY for whichever I2C was set up first.
+ * @return PeripheralController* the I2C, NULL if that I2C isn't set up.
+ */
+PeripheralController *getI2CPeripheral(BoardController *bc, uint32_t handle)
+{
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        if (bc->peripherals[periph].type == TYPE_I2C && bc->peripherals[periph].status &&
+            (handle == I2C_ANY || bc->peripherals[periph].peripheral.i2c.handle == handle))
         {
-            return (clockExistsReturn){.exists = true, .status = false, .index = clock_c};
+            return &bc->peripherals[periph];
         }
     }
-    return (clockExistsReturn){.exists = false, .status = false, .index = 0};
+    return NULL;
+}
+
+/**
+ * @brief Adds a user to a clock in the clock table, turning it on for the first.
+ *
+ * @param bc board controller object
+ * @param clock clock to take
+ */
+static void takeClock(BoardController *bc, enum rcc_periph_clken clock)
+{
+    size_t index = clockIndex(clock);
+    if (index == CLOCK_NONE)
+    {
+        // Not a clock the table gates, it just stays on.
+        rcc_periph_clock_enable(clock);
+        return;
+    }
+    bc->clocks[index].clock = clock;
+    clockTakeRef(&bc->clocks[index]);
 }
 
 /**
- * @brief Uses  the enum rcc_periph_clken to disable a clock controller
+ * @brief Removes a user from a clock in the clock table, gating it off after the last.
  *
  * @param bc board controller object
- * @param clock clock to disable
+ * @param clock clock to drop
+ */
+static void dropClock(BoardController *bc, enum rcc_periph_clken clock)
+{
+    size_t index = clockIndex(clock);
+    if (index != CLOCK_NONE)
+    {
+        clockDropRef(&bc->clocks[index]);
+    }
+}
+
+/**
+ * @brief Lists the clocks a peripheral needs while it is live. A clock can be listed more than
+ * once (both UART pins on one port), it is then referenced once per listing.
+ *
+ * @param periph peripheral
+ * @param clocks returned clocks, BOARD_PERIPHERAL_CLOCKS long
+ * @return size_t number of clocks
  */
-static void disableClockWithEnum(BoardController *bc, enum rcc_periph_clken clock)
+static size_t peripheralClocks(const PeripheralController *periph, enum rcc_periph_clken *clocks)
 {
-    for (size_t clock_c = 0; clock_c < bc->clocks_count; clock_c++)
+    size_t count = 0;
+    switch (periph->type)
     {
-        if (bc->clocks[clock_c].clock == clock)
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+        clocks[count++] = periph->peripheral.gpio.clock;
+        break;
+    case TYPE_ADC:
+        clocks[count++] = periph->peripheral.adc.clock;
+        clocks[count++] = periph->peripheral.adc.adc_clock;
+        break;
+    case TYPE_UART:
+        clocks[count++] = periph->peripheral.uart.uart_clock;
+        clocks[count++] = periph->peripheral.uart.RX.clock;
+        clocks[count++] = periph->peripheral.uart.TX.clock;
+        if (periph->peripheral.uart.flow == UART_FLOW_RTSCTS)
         {
-            disableClock(&bc->clocks[clock_c]);
-            return;
+            clocks[count++] = periph->peripheral.uart.CTS.clock;
+            clocks[count++] = periph->peripheral.uart.RTS.clock;
         }
+        break;
+    case TYPE_PWM:
+        clocks[count++] = periph->peripheral.pwm.clock;
+        clocks[count++] = periph->peripheral.pwm.timer_clock;
+        break;
+    case TYPE_MEASURE:
+        clocks[count++] = periph->peripheral.measure.clock;
+        clocks[count++] = periph->peripheral.measure.timer_clock;
+        break;
+    case TYPE_SPI:
+        clocks[count++] = periph->peripheral.spi.spi_clock;
+        clocks[count++] = periph->peripheral.spi.SCK.clock;
+        clocks[count++] = periph->peripheral.spi.MISO.clock;
+        clocks[count++] = periph->peripheral.spi.MOSI.clock;
+        break;
+    case TYPE_I2C:
+        clocks[count++] = periph->peripheral.i2c.i2c_clock;
+        clocks[count++] = periph->peripheral.i2c.SCL.clock;
+        clocks[count++] = periph->peripheral.i2c.SDA.clock;
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+/**
+ * @brief Finds the pin a peripheral is known by: its only pin, RX for a UART, SCK for an SPI or
+ * SCL for an I2C.
+ *
+ * @param periph peripheral
+ * @param port_index returned port index, 0 = A
+ * @param pin_index returned pin number 0-15
+ * @return true pin found
+ * @return false not a type with pins, or off the pin table
+ */
+static bool peripheralPin(const PeripheralController *periph, size_t *port_index,
+                          size_t *pin_index)
+{
+    switch (periph->type)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+        return pinTableIndex(periph->peripheral.gpio.port, periph->peripheral.gpio.pin,
+                             port_index, pin_index);
+    case TYPE_ADC:
+        return pinTableIndex(periph->peripheral.adc.port, periph->peripheral.adc.pin, port_index,
+                             pin_index);
+    case TYPE_UART:
+        return pinTableIndex(periph->peripheral.uart.RX.port, periph->peripheral.uart.RX.pin,
+                             port_index, pin_index);
+    case TYPE_PWM:
+        return pinTableIndex(periph->peripheral.pwm.port, periph->peripheral.pwm.pin, port_index,
+                             pin_index);
+    case TYPE_MEASURE:
+        return pinTableIndex(periph->peripheral.measure.port, periph->peripheral.measure.pin,
+                             port_index, pin_index);
+    case TYPE_SPI:
+        return pinTableIndex(periph->peripheral.spi.SCK.port, periph->peripheral.spi.SCK.pin,
+                             port_index, pin_index);
+    case TYPE_I2C:
+        return pinTableIndex(periph->peripheral.i2c.SCL.port, periph->peripheral.i2c.SCL.pin,
+                             port_index, pin_index);
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Moves a peripheral's clock references from its old settings to its new ones. The new
+ * ones are taken first, so a clock both need is never gated off in between.
+ *
+ * @param bc board controller object
+ * @param old_periph settings the references are held for, NULL for none
+ * @param new_periph settings to hold them for, NULL for none
+ */
+static void swapPeripheralClocks(BoardController *bc, const PeripheralController *old_periph,
+                                 const PeripheralController *new_periph)
+{
+    enum rcc_periph_clken clocks[BOARD_PERIPHERAL_CLOCKS];
+    size_t                count = new_periph == NULL ? 0 : peripheralClocks(new_periph, clocks);
+    for (size_t clock = 0; clock < count; clock++)
+    {
+        takeClock(bc, clocks[clock]);
+    }
+    count = old_periph == NULL ? 0 : peripheralClocks(old_periph, clocks);
+    for (size_t clock = 0; clock < count; clock++)
+    {
+        dropClock(bc, clocks[clock]);
+    }
+}
+
+/**
+ * @brief Adds a peripheral to the board: takes its clocks, enables it and gives it its pins.
+ *
+ * @param bc board controller object
+ * @param periph peripheral from one of the createStandard*() constructors, its pins free
+ * @return PeripheralController* the live peripheral, NULL if the pool is full
+ */
+static PeripheralController *addPeripheral(BoardController *bc, PeripheralController periph)
+{
+    swapPeripheralClocks(bc, NULL, &periph);
+    PeripheralController *pc = growPeripherals(bc, periph);
+    if (pc == NULL)
+    {
+        swapPeripheralClocks(bc, &periph, NULL);
+        return NULL;
+    }
+    pc->enablePeripheral(pc);
+    pinTableAssign(bc, pc);
+    if (pc->type == TYPE_ADC)
+    {
+        rebuildADCScan(bc);
     }
+    boardChanged(bc);
+    return pc;
 }
 
 /**
@@ -226,26 +704,7 @@ static void disableClockWithEnum(BoardController *bc, enum rcc_periph_clken cloc
 void createDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                       PeripheralType input_output, uint8_t pupd)
 {
-    // if clock is already made and enabled do nothing.
-    clockExistsReturn clock_exists = clockExists(bc, clock);
-
-    // if clock doesn't exist create it and enable it.
-    if (!clock_exists.exists)
-    {
-        growClocks(bc, clock);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
-    }
-
-    if (clock_exists.exists && !clock_exists.status)
-    {
-        enableClock(&bc->clocks[clock_exists.index]);
-    }
-
-    // Create peripheral and enable it.
-    PeripheralController pc = createStandardGPIO(port, pin, clock, input_output, pupd);
-    growPeripherals(bc, pc);
-    bc->peripherals[bc->peripherals_count - 1].enablePeripheral(
-        &bc->peripherals[bc->peripherals_count - 1]);
+    (void)addPeripheral(bc, createStandardGPIO(port, pin, clock, input_output, pupd));
 }
 
 /**
@@ -258,42 +717,16 @@ void createDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, enum rcc
  * @param sample_time sample time of adc
  * @param adc_port adc main channel
  * @param adc_channel adc subchannel 0-15
+ * @param bits resolution of reads
+ * @param average frames each read averages
  */
 void createAnalogPin(BoardController *bc, uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
-                     uint32_t sample_time, uint32_t adc_port, uint8_t adc_channel)
+                     uint32_t sample_time, uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                     uint8_t average)
 {
-    clockExistsReturn clock_exists = clockExists(bc, clock);
-
-    // if clock doesn't exist create it and enable it.
-    if (!clock_exists.exists)
-    {
-        growClocks(bc, clock);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
-    }
-
-    if (clock_exists.exists && !clock_exists.status)
-    {
-        enableClock(&bc->clocks[clock_exists.index]);
-    }
-
-    clockExistsReturn adc_clock_exists = clockExists(bc, RCC_ADC1);
-
-    if (!adc_clock_exists.exists)
-    {
-        growClocks(bc, RCC_ADC1);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
-    }
-    if (adc_clock_exists.exists && !adc_clock_exists.status)
-    {
-        enableClock(&bc->clocks[adc_clock_exists.index]);
-    }
-
     // Just pass normal ADC1 clock in as adc_clock.
-    PeripheralController pc =
-        createStandardADCPin(port, pin, clock, RCC_ADC1, sample_time, adc_port, adc_channel);
-    growPeripherals(bc, pc);
-    bc->peripherals[bc->peripherals_count - 1].enablePeripheral(
-        &bc->peripherals[bc->peripherals_count - 1]);
+    (void)addPeripheral(bc, createStandardADCPin(port, pin, clock, RCC_ADC1, sample_time, adc_port,
+                                                 adc_channel, bits, average));
 }
 
 /**
@@ -318,50 +751,92 @@ void createUART(BoardController *bc, uint32_t handle, enum rcc_periph_clken uart
                 uint32_t tx_pin, enum rcc_periph_clken rx_clock, enum rcc_periph_clken tx_clock,
                 uint8_t rx_af_mode, uint8_t tx_af_mode, int nvic_entry)
 {
+    (void)addPeripheral(
+        bc, createStandardUARTUSART(handle, uart_clock, baudrate, rx_port, tx_port, rx_pin, tx_pin,
+                                    rx_clock, tx_clock, rx_af_mode, tx_af_mode, nvic_entry));
+}
 
-    clockExistsReturn uart_clock_exists = clockExists(bc, uart_clock);
-    clockExistsReturn rx_clock_exists = clockExists(bc, rx_clock);
-    clockExistsReturn tx_clock_exists = clockExists(bc, tx_clock);
+/**
+ * @brief Creates an SPI master. Its pins must be free.
+ *
+ * @param bc board controller object
+ * @param spi SPI master, see createSPIPeripheral()
+ */
+void createSPI(BoardController *bc, SPIController spi)
+{
+    (void)addPeripheral(bc, createStandardSPI(spi));
+}
 
-    if (!uart_clock_exists.exists)
-    {
-        growClocks(bc, uart_clock);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
-    }
+/**
+ * @brief Creates an I2C master. Its pins must be free.
+ *
+ * @param bc board controller object
+ * @param i2c I2C master, see createI2CPeripheral()
+ */
+void createI2C(BoardController *bc, I2CController i2c)
+{
+    (void)addPeripheral(bc, createStandardI2C(i2c));
+}
 
-    if (uart_clock_exists.exists && !uart_clock_exists.status)
+/**
+ * @brief Sets a UART's receive flow control. RTS/CTS takes A11 and A12 from whatever has them,
+ * the same way creating a UART takes its pins.
+ *
+ * @param bc board controller object
+ * @param handle uart handle, UART_ANY for the first one set up
+ * @param flow flow control mode
+ * @return true flow control set
+ * @return false no such UART, or the mode isn't available on it
+ */
+bool setUARTFlowControl(BoardController *bc, uint32_t handle, UartFlowControl flow)
+{
+    PeripheralController *uart = getUARTPeripheral(bc, handle);
+    if (uart == NULL)
     {
-        enableClock(&bc->clocks[uart_clock_exists.index]);
+        printf("> Error: No uart exists!\r\n");
+        return false;
     }
-
-    if (!rx_clock_exists.exists)
+    handle = uart->peripheral.uart.handle;
+    if (!currentUartFlowAvailable(handle, flow))
     {
-        growClocks(bc, rx_clock);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
+        printf("> Error: RTS/CTS is only available on USART1 (CTS A11, RTS A12).\r\n");
+        return false;
     }
 
-    if (rx_clock_exists.exists && !rx_clock_exists.status)
+    if (flow == UART_FLOW_RTSCTS && uart->peripheral.uart.flow != UART_FLOW_RTSCTS)
     {
-        enableClock(&bc->clocks[rx_clock_exists.index]);
+        killPeripheralOrPin(bc, UART1_CTS_PORT, UART1_CTS_PIN);
+        killPeripheralOrPin(bc, UART1_RTS_PORT, UART1_RTS_PIN);
+        // Killing can move the peripherals around.
+        uart = getUARTPeripheral(bc, handle);
     }
 
-    if (!tx_clock_exists.exists)
-    {
-        growClocks(bc, tx_clock);
-        enableClock(&bc->clocks[bc->clocks_count - 1]);
-    }
+    // CTS and RTS are on port A, the console's, so their clock is already on while they're set up.
+    PeripheralController old_uart = *uart;
+    pinTableRelease(bc, uart);
+    currentUartSetFlowControl(&uart->peripheral.uart, flow);
+    swapPeripheralClocks(bc, &old_uart, uart);
+    pinTableAssign(bc, uart);
+    boardChanged(bc);
+    return true;
+}
 
-    if (tx_clock_exists.exists && !tx_clock_exists.status)
+/**
+ * @brief Returns the live peripheral that owns a pin. Constant time lookup in the pin table.
+ *
+ * @param bc board controller to check
+ * @param port port to check
+ * @param pin pin to check
+ * @return PeripheralController* owning peripheral, NULL if the pin is free.
+ */
+PeripheralController *getPinPeripheral(BoardController *bc, uint32_t port, uint32_t pin)
+{
+    size_t port_index, pin_index;
+    if (!pinTableIndex(port, pin, &port_index, &pin_index))
     {
-        enableClock(&bc->clocks[tx_clock_exists.index]);
+        return NULL;
     }
-
-    PeripheralController pc =
-        createStandardUARTUSART(handle, uart_clock, baudrate, rx_port, tx_port, rx_pin, tx_pin,
-                                rx_clock, tx_clock, rx_af_mode, tx_af_mode, nvic_entry);
-    growPeripherals(bc, pc);
-    bc->peripherals[bc->peripherals_count - 1].enablePeripheral(
-        &bc->peripherals[bc->peripherals_count - 1]);
+    return bc->pin_table[port_index][pin_index];
 }
 
 /**
@@ -374,46 +849,9 @@ void createUART(BoardController *bc, uint32_t handle, enum rcc_periph_clken uart
  */
 PeripheralType pinExists(BoardController *bc, uint32_t port, uint32_t pin)
 {
-    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
-    {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (!current_periph->status)
-        {
-            // Skip current peripheral if it is deactivated
-            continue;
-        }
-
-        if (current_periph->type == TYPE_GPIO_INPUT || current_periph->type == TYPE_GPIO_OUTPUT)
-        {
-            if (current_periph->peripheral.gpio.port == port &&
-                current_periph->peripheral.gpio.pin == pin)
-            {
-                return current_periph->type;
-            }
-        }
-        if (current_periph->type == TYPE_ADC)
-        {
-            if (current_periph->peripheral.adc.port == port &&
-                current_periph->peripheral.adc.pin == pin)
-            {
-                return current_periph->type;
-            }
-        }
-        if (current_periph->type == TYPE_UART)
-        {
-            // This peripheral has multiple pins so check both, and return if either exist.
-            if ((current_periph->peripheral.uart.RX.port == port &&
-                 current_periph->peripheral.uart.RX.pin == pin) ||
-                (current_periph->peripheral.uart.TX.port == port &&
-                 current_periph->peripheral.uart.TX.pin == pin))
-            {
-                return current_periph->type;
-            }
-        }
-    }
-
-    return TYPE_NONE;
-}
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    return current_periph != NULL ? current_periph->type : TYPE_NONE;
+}
 
 /**
  * @brief Change the function of a digital pin
@@ -427,27 +865,26 @@ PeripheralType pinExists(BoardController *bc, uint32_t port, uint32_t pin)
 void mutateDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, PeripheralType new_type,
                       uint8_t new_pupd)
 {
-    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL ||
+        (current_periph->type != TYPE_GPIO_INPUT && current_periph->type != TYPE_GPIO_OUTPUT))
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (current_periph->type == TYPE_GPIO_INPUT || current_periph->type == TYPE_GPIO_OUTPUT)
-        {
-            if (current_periph->peripheral.gpio.port == port &&
-                current_periph->peripheral.gpio.pin == pin)
-            {
-                if (current_periph->type == new_type)
-                {
-                    return;
-                }
-
-                current_periph->disablePeripheral(current_periph);
-                *current_periph = createStandardGPIO(
-                    port, pin, current_periph->peripheral.gpio.clock, new_type, new_pupd);
-                current_periph->enablePeripheral(current_periph);
-                return;
-            }
-        }
+        return;
     }
+
+    if (current_periph->type == new_type)
+    {
+        return;
+    }
+
+    // Pins are unchanged, so the pin table entry stays valid.
+    PeripheralController old_periph = *current_periph;
+    current_periph->disablePeripheral(current_periph);
+    *current_periph =
+        createStandardGPIO(port, pin, current_periph->peripheral.gpio.clock, new_type, new_pupd);
+    swapPeripheralClocks(bc, &old_periph, current_periph);
+    current_periph->enablePeripheral(current_periph);
+    boardChanged(bc);
 }
 
 /**
@@ -463,28 +900,191 @@ void mutateDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, Peripher
 void mutateADCToDigital(BoardController *bc, uint32_t port, uint32_t pin,
                         enum rcc_periph_clken clock, PeripheralType input_output, uint8_t pupd)
 {
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL || current_periph->type != TYPE_ADC)
+    {
+        return;
+    }
+
+    PeripheralController old_periph = *current_periph;
+    current_periph->disablePeripheral(current_periph);
+    rebuildADCScan(bc);
+
+    // Drops ADC1 if this was the last ADC pin.
+    *current_periph = createStandardGPIO(port, pin, clock, input_output, pupd);
+    swapPeripheralClocks(bc, &old_periph, current_periph);
+    current_periph->enablePeripheral(current_periph);
+    boardChanged(bc);
+}
+
+/**
+ * @brief Creates a PWM pin on a free pin and starts its timer channel.
+ *
+ * @param bc board controller object
+ * @param pwm PWM output, see createPWMPeripheral()
+ * @return size_t number of other channels on the same timer whose frequency changed with it
+ */
+size_t createPWMPin(BoardController *bc, PWMPeripheral pwm)
+{
+    PeripheralController *pc = addPeripheral(bc, createStandardPWMPin(pwm));
+    if (pc == NULL)
+    {
+        return 0;
+    }
+    return retunePWMTimer(bc, &pc->peripheral.pwm);
+}
+
+/**
+ * @brief Changes the frequency and duty cycle of an existing PWM pin without stopping it.
+ *
+ * @param bc board controller object
+ * @param periph PWM peripheral to change
+ * @param frequency new frequency in Hz
+ * @param duty_cycle new duty cycle, percent
+ * @return size_t number of other channels on the same timer whose frequency changed with it
+ */
+size_t updatePWMPin(BoardController *bc, PeripheralController *periph, uint32_t frequency,
+                    float duty_cycle)
+{
+    PWMPeripheral *pwm = &periph->peripheral.pwm;
+    if (!coreTimerComputePeriod(pwm->timer, frequency, &pwm->prescaler, &pwm->arr_val))
+    {
+        return 0;
+    }
+    pwm->frequency = frequency;
+    pwm->duty_cycle = duty_cycle;
+    coreTimerSetup(pwm);
+    return retunePWMTimer(bc, pwm);
+}
+
+/**
+ * @brief Finds a live PWM or measured pin, other than the given pin, that uses a timer. A
+ * measurement needs a timer to itself, this is how the two are kept apart.
+ *
+ * @param bc board controller object
+ * @param timer timer peripheral
+ * @param type TYPE_PWM or TYPE_MEASURE, TYPE_NONE for either
+ * @param port port of the pin to leave out
+ * @param pin pin to leave out
+ * @return PeripheralController* a user of the timer, NULL if there are none
+ */
+PeripheralController *getTimerUser(BoardController *bc, uint32_t timer, PeripheralType type,
+                                   uint32_t port, uint32_t pin)
+{
+    PeripheralController *own = getPinPeripheral(bc, port, pin);
     for (size_t periph = 0; periph < bc->peripherals_count; periph++)
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (current_periph->type == TYPE_ADC)
+        PeripheralController *current = &bc->peripherals[periph];
+        if (current == own || !current->status || (type != TYPE_NONE && current->type != type))
         {
-            if (current_periph->peripheral.adc.port == port &&
-                current_periph->peripheral.adc.pin == pin)
-            {
-                current_periph->disablePeripheral(current_periph);
+            continue;
+        }
+        if ((current->type == TYPE_PWM && current->peripheral.pwm.timer == timer) ||
+            (current->type == TYPE_MEASURE && current->peripheral.measure.timer == timer))
+        {
+            return current;
+        }
+    }
+    return NULL;
+}
 
-                if (!adcExists(bc))
-                {
-                    disableClockWithEnum(bc, current_periph->peripheral.adc.adc_clock);
-                }
+/**
+ * @brief Finds a live PWM pin, other than the given pin, driven by a timer channel. Pins that
+ * share a channel share its compare value and output enable, so only one can use it.
+ *
+ * @param bc board controller object
+ * @param timer timer peripheral
+ * @param channel output compare channel
+ * @param port port of the pin to leave out
+ * @param pin pin to leave out
+ * @return PeripheralController* the pin on the channel, NULL if it is free
+ */
+PeripheralController *getPWMChannelUser(BoardController *bc, uint32_t timer,
+                                        enum tim_oc_id channel, uint32_t port, uint32_t pin)
+{
+    PeripheralController *own = getPinPeripheral(bc, port, pin);
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        PeripheralController *current = &bc->peripherals[periph];
+        if (current != own && current->status && current->type == TYPE_PWM &&
+            current->peripheral.pwm.timer == timer && current->peripheral.pwm.channel == channel)
+        {
+            return current;
+        }
+    }
+    return NULL;
+}
 
-                *current_periph = createStandardGPIO(port, pin, clock, input_output, pupd);
-                current_periph->enablePeripheral(current_periph);
+/**
+ * @brief Creates a measured pin on a free pin and starts its timer capturing. The timer must be
+ * free, see getTimerUser().
+ *
+ * @param bc board controller object
+ * @param measure measured input, see createMeasurePeripheral()
+ */
+void createMeasurePin(BoardController *bc, MeasurePeripheral measure)
+{
+    (void)addPeripheral(bc, createStandardMeasurePin(measure));
+}
 
-                return;
-            }
-        }
+/**
+ * @brief Starts or stops recording edges on a digital input. The EXTI line belongs to the pin's
+ * controller from then on, so killing or changing the pin frees it.
+ *
+ * @param bc board controller object
+ * @param port port of pin
+ * @param pin pin
+ * @param edges EXTI_EDGE_* to record, EXTI_EDGE_NONE to stop
+ * @return true pin (un)watched
+ * @return false pin isn't an input, or its EXTI line is taken
+ */
+bool watchDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, uint8_t edges)
+{
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL || current_periph->type != TYPE_GPIO_INPUT)
+    {
+        printf("> Error: Only input pins can be watched.\r\n");
+        return false;
+    }
+
+    GPIOPinController *gpio = &current_periph->peripheral.gpio;
+    if (edges == EXTI_EDGE_NONE)
+    {
+        extiUnwatch(port, (uint16_t)pin);
+    }
+    else if (!extiWatch(port, (uint16_t)pin, edges))
+    {
+        return false;
+    }
+    gpio->exti_edges = edges;
+    return true;
+}
+
+/**
+ * @brief Disables a live peripheral and frees its pins, and any clock nothing else needs.
+ *
+ * @param bc Board controller
+ * @param current_periph peripheral to kill
+ */
+static void killPeripheral(BoardController *bc, PeripheralController *current_periph)
+{
+    // Release every pin owned by this peripheral (every pin for UART) before disabling it.
+    pinTableRelease(bc, current_periph);
+    current_periph->disablePeripheral(current_periph);
+    releasePeripheral(bc, current_periph);
+    boardChanged(bc);
+
+    if (current_periph->type == TYPE_ADC)
+    {
+        rebuildADCScan(bc);
     }
+    else if (current_periph->type == TYPE_PWM &&
+             !pwmTimerInUse(bc, current_periph->peripheral.pwm.timer))
+    {
+        timer_disable_counter(current_periph->peripheral.pwm.timer);
+    }
+    // Gates off the port, ADC, UART or timer clock if nothing else is using it.
+    swapPeripheralClocks(bc, current_periph, NULL);
 }
 
 /**
@@ -495,50 +1095,46 @@ void mutateADCToDigital(BoardController *bc, uint32_t port, uint32_t pin,
  * @param pin pin to disable
  */
 void killPeripheralOrPin(BoardController *bc, uint32_t port, uint32_t pin)
+{
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL)
+    {
+        return;
+    }
+    killPeripheral(bc, current_periph);
+}
+
+/**
+ * @brief Kills every live peripheral, which gates off every clock but the console's.
+ *
+ * @param bc Board controller
+ */
+void clearBoard(BoardController *bc)
 {
     for (size_t periph = 0; periph < bc->peripherals_count; periph++)
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (!current_periph->status)
+        if (bc->peripherals[periph].status)
         {
-            continue;
+            killPeripheral(bc, &bc->peripherals[periph]);
         }
+    }
+}
 
-        if (current_periph->type == TYPE_ADC)
-        {
-            if (current_periph->peripheral.adc.port == port &&
-                current_periph->peripheral.adc.pin == pin)
-            {
-                current_periph->disablePeripheral(current_periph);
-                if (!adcExists(bc))
-                {
-                    disableClockWithEnum(bc, current_periph->peripheral.adc.adc_clock);
-                }
-                return;
-            }
-        }
-        if (current_periph->type == TYPE_GPIO_INPUT || current_periph->type == TYPE_GPIO_OUTPUT)
-        {
-            if (current_periph->peripheral.gpio.port == port &&
-                current_periph->peripheral.gpio.pin == pin)
-            {
-                current_periph->disablePeripheral(current_periph);
-                return;
-            }
-        }
-        if (current_periph->type == TYPE_UART)
-        {
-            if ((current_periph->peripheral.uart.RX.port == port &&
-                 current_periph->peripheral.uart.RX.pin) ||
-                (current_periph->peripheral.uart.TX.port == port &&
-                 current_periph->peripheral.uart.TX.pin))
-            {
-                current_periph->disablePeripheral(current_periph);
-                disableClockWithEnum(bc, current_periph->peripheral.uart.uart_clock);
-                return;
-            }
-        }
+/**
+ * @brief Adds a peripheral rebuilt from a saved configuration and enables it, straight through
+ * its enablePeripheral callback. Its pins must be free.
+ *
+ * @param bc Board controller
+ * @param periph peripheral from rebuildStandardPeripheral()
+ * @return PeripheralController* the live peripheral, NULL if it couldn't be added
+ */
+PeripheralController *restorePeripheral(BoardController *bc, PeripheralController periph)
+{
+    if (periph.type == TYPE_NONE)
+    {
+        return NULL;
     }
+    return addPeripheral(bc, periph);
 }
 
 /**
@@ -551,41 +1147,55 @@ void killPeripheralOrPin(BoardController *bc, uint32_t port, uint32_t pin)
  * @param sample_time sample time for adc
  * @param adc_port adc channel controller
  * @param adc_channel adc channel 0-15
+ * @param bits resolution of reads
+ * @param average frames each read averages
  */
 void mutateDigitalToADC(BoardController *bc, uint32_t port, uint32_t pin,
                         enum rcc_periph_clken clock, uint32_t sample_time, uint32_t adc_port,
-                        uint8_t adc_channel)
+                        uint8_t adc_channel, uint8_t bits, uint8_t average)
 {
-    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL ||
+        (current_periph->type != TYPE_GPIO_INPUT && current_periph->type != TYPE_GPIO_OUTPUT))
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (current_periph->type == TYPE_GPIO_INPUT || current_periph->type == TYPE_GPIO_OUTPUT)
-        {
-            if (current_periph->peripheral.gpio.port == port &&
-                current_periph->peripheral.gpio.pin == pin)
-            {
-                current_periph->disablePeripheral(current_periph);
-
-                clockExistsReturn adc_clock_exists = clockExists(bc, RCC_ADC1);
-
-                if (!adc_clock_exists.exists)
-                {
-                    growClocks(bc, RCC_ADC1);
-                    enableClock(&bc->clocks[bc->clocks_count - 1]);
-                }
+        return;
+    }
 
-                if (adc_clock_exists.exists && !adc_clock_exists.status)
-                {
-                    enableClock(&bc->clocks[adc_clock_exists.index]);
-                }
+    PeripheralController old_periph = *current_periph;
+    current_periph->disablePeripheral(current_periph);
+    *current_periph = createStandardADCPin(port, pin, clock, RCC_ADC1, sample_time, adc_port,
+                                           adc_channel, bits, average);
+    swapPeripheralClocks(bc, &old_periph, current_periph);
+    current_periph->enablePeripheral(current_periph);
+    rebuildADCScan(bc);
+    boardChanged(bc);
+}
 
-                *current_periph = createStandardADCPin(port, pin, clock, RCC_ADC1, sample_time,
-                                                       adc_port, adc_channel);
-                current_periph->enablePeripheral(current_periph);
-                return;
-            }
-        }
+/**
+ * @brief Changes the sample time, resolution and averaging of an existing ADC pin.
+ *
+ * @param bc board controller object
+ * @param port port of pin
+ * @param pin pin
+ * @param sample_time sample time for adc
+ * @param bits resolution of reads
+ * @param average frames each read averages
+ */
+void mutateADCSettings(BoardController *bc, uint32_t port, uint32_t pin, uint32_t sample_time,
+                       uint8_t bits, uint8_t average)
+{
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL || current_periph->type != TYPE_ADC)
+    {
+        return;
     }
+
+    current_periph->peripheral.adc.sample_time = (uint16_t)sample_time;
+    current_periph->peripheral.adc.bits = bits;
+    current_periph->peripheral.adc.average = average;
+    current_periph->enablePeripheral(current_periph);
+    rebuildADCScan(bc);
+    boardChanged(bc);
 }
 
 /**
@@ -600,68 +1210,138 @@ void mutateDigitalToADC(BoardController *bc, uint32_t port, uint32_t pin,
  */
 uint16_t actionDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, GPIOAction action)
 {
-    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+    if (current_periph == NULL)
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (current_periph->type == TYPE_GPIO_INPUT || current_periph->type == TYPE_GPIO_OUTPUT)
+        return 0;
+    }
+
+    switch (current_periph->type)
+    {
+    case TYPE_GPIO_INPUT:
+    {
+        if (action == GPIO_READ)
         {
-            if (!current_periph->status)
-            {
-                continue;
-            }
-            if (current_periph->peripheral.gpio.port == port &&
-                current_periph->peripheral.gpio.pin == pin)
-            {
-                switch (current_periph->type)
-                {
-                case TYPE_GPIO_INPUT:
-                {
-                    if (action == GPIO_READ)
-                    {
-                        uint16_t pin_result = gpio_get(port, pin) > 0 ? 1 : 0;
-                        return pin_result;
-                    }
-                    return 0;
-                }
-                case TYPE_GPIO_OUTPUT:
-                {
-                    switch (action)
-                    {
-                    case GPIO_SET:
-                    {
-                        gpio_set(port, pin);
-                        break;
-                    }
-                    case GPIO_CLEAR:
-                    {
-                        gpio_clear(port, pin);
-                        break;
-                    }
-                    case GPIO_TOGGLE:
-                    {
-                        gpio_toggle(port, pin);
-                        break;
-                    }
-                    default:
-                    {
-                        printf("Parse Error: port/pin provided is not GPIO.\r\n");
-                        break;
-                    }
-                    }
-                    return 0;
-                }
-                default:
-                {
-                    printf("Parse Error: port/pin provided is not GPIO.\r\n");
-                    break;
-                }
-                }
-            }
+            uint16_t pin_result = gpio_get(port, pin) > 0 ? 1 : 0;
+            return pin_result;
+        }
+        return 0;
+    }
+    case TYPE_GPIO_OUTPUT:
+    {
+        switch (action)
+        {
+        case GPIO_SET:
+        {
+            gpio_set(port, pin);
+            break;
+        }
+        case GPIO_CLEAR:
+        {
+            gpio_clear(port, pin);
+            break;
+        }
+        case GPIO_TOGGLE:
+        {
+            gpio_toggle(port, pin);
+            break;
         }
+        default:
+        {
+            printf("Parse Error: port/pin provided is not GPIO.\r\n");
+            break;
+        }
+        }
+        return 0;
+    }
+    default:
+    {
+        printf("Parse Error: port/pin provided is not GPIO.\r\n");
+        break;
+    }
     }
     return 0;
 }
 
+/**
+ * @brief Filters a pin mask down to the pins an action may be applied to: outputs for set, clear
+ * and toggle, inputs for reading. Anything else (free pins, ADC, UART) is dropped.
+ *
+ * @param bc Main board structure
+ * @param port port to check
+ * @param mask pins to check, e.g. GPIO0 | GPIO3
+ * @param action action to be carried out.
+ * @return uint16_t pins in mask the action applies to.
+ */
+uint16_t getDigitalPortMask(BoardController *bc, uint32_t port, uint16_t mask, GPIOAction action)
+{
+    uint16_t usable = 0;
+    for (uint16_t remaining = mask; remaining != 0; remaining &= (uint16_t)(remaining - 1))
+    {
+        uint16_t              pin = remaining & (uint16_t)(-remaining);
+        PeripheralController *current_periph = getPinPeripheral(bc, port, pin);
+        if (current_periph == NULL)
+        {
+            continue;
+        }
+        if ((action == GPIO_READ && current_periph->type == TYPE_GPIO_INPUT) ||
+            (action != GPIO_READ && current_periph->type == TYPE_GPIO_OUTPUT))
+        {
+            usable |= pin;
+        }
+    }
+    return usable;
+}
+
+/**
+ * @brief Applies an action to an already filtered pin mask (see getDigitalPortMask()) with a
+ * single register access so every pin changes on the same cycle.
+ *
+ * @param port port to action
+ * @param mask pins to action
+ * @param action action to be carried out.
+ * @return uint16_t input data register masked to mask if reading, else 0.
+ */
+uint16_t applyDigitalPort(uint32_t port, uint16_t mask, GPIOAction action)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+
+    switch (action)
+    {
+    case GPIO_READ:
+        return gpio_port_read(port) & mask;
+    case GPIO_SET:
+        gpio_set(port, mask); // single BSRR write
+        break;
+    case GPIO_CLEAR:
+        gpio_clear(port, mask); // single BSRR write
+        break;
+    case GPIO_TOGGLE:
+        gpio_toggle(port, mask);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Conducts an action on several pins of the same port at once. Only pins configured as
+ * outputs (or inputs, when reading) are touched, and the whole mask is applied with a single
+ * register access so every pin changes on the same cycle.
+ *
+ * @param bc Main board structure
+ * @param port port to action
+ * @param mask pins to action, e.g. GPIO0 | GPIO3
+ * @param action action to be carried out.
+ * @return uint16_t input data register masked to the input pins in mask if reading, else 0.
+ */
+uint16_t actionDigitalPort(BoardController *bc, uint32_t port, uint16_t mask, GPIOAction action)
+{
+    return applyDigitalPort(port, getDigitalPortMask(bc, port, mask, action), action);
+}
+
 /**
  * @brief Reads an analog pin
  *
@@ -672,54 +1352,53 @@ uint16_t actionDigitalPin(BoardController *bc, uint32_t port, uint32_t pin, GPIO
  */
 uint16_t actionAnalogPin(BoardController *bc, uint32_t port, uint32_t pin)
 {
-    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    return actionAnalogPeripheral(getPinPeripheral(bc, port, pin));
+}
+
+/**
+ * @brief Reads an ADC peripheral that has already been looked up. Returns the average of its
+ * latest scanned samples at its own resolution, only converting by hand if the scan couldn't be
+ * started.
+ *
+ * @param periph ADC peripheral
+ * @return uint16_t value read
+ */
+uint16_t actionAnalogPeripheral(PeripheralController *periph)
+{
+    if (periph != NULL && periph->type == TYPE_ADC)
     {
-        PeripheralController *current_periph = &bc->peripherals[periph];
-        if (current_periph->type == TYPE_ADC)
+        const ADCPinController *adc = &periph->peripheral.adc;
+        if (adcScanRunning())
         {
-            if (current_periph->peripheral.adc.port == port &&
-                current_periph->peripheral.adc.pin == pin)
-            {
-                uint8_t channel = current_periph->peripheral.adc.adc_channel;
-                uint8_t channel_array[16];
-                channel_array[0] = channel;
-                adc_set_regular_sequence(ADC1, 1, channel_array);
-                adc_start_conversion_regular(ADC1);
-                while (!adc_eoc(ADC1))
-                    ;
-                uint16_t reg16 = adc_read_regular(ADC1);
-                return reg16;
-            }
+            return adcScanRead(adc->scan_rank, adc->average, adc->bits);
         }
+        return adcConvert(adc->adc_channel, adc->average, adc->bits);
     }
     printf("> Error: could not read pin.\r\n");
     return 0;
 }
 
 /**
- * @brief Read whatever is in the current UART data buffer up to length provided
+ * @brief Read whatever is in a UART's data buffer up to length provided
  *
  * @param bc Board controller object
+ * @param handle uart to read, UART_ANY for the first one set up
  * @param data array of return data.
  * @param len max length of read.
  * @return uint32_t length of read data.
  */
-uint32_t readUARTPort(BoardController *bc, char *data, size_t len)
+uint32_t readUARTPort(BoardController *bc, uint32_t handle, char *data, size_t len)
 {
-    UARTController uart_to_read;
-    if (uartExists(bc, &uart_to_read))
+    PeripheralController *uart_to_read = getUARTPeripheral(bc, handle);
+    if (uart_to_read != NULL)
     {
-        size_t count = 0;
-        while (currentUartDataAvailable(uart_to_read) && count < len)
-        {
-            char byte = (char)currentUartReadByte(uart_to_read);
-            data[count++] = byte;
-        }
+        uint32_t count =
+            currentUartRead(uart_to_read->peripheral.uart, (uint8_t *)data, (uint32_t)len);
         if (count != len)
         {
             data[count] = '\0';
         }
-        return (uint32_t)count;
+        return count;
     }
     else
     {
@@ -729,24 +1408,165 @@ uint32_t readUARTPort(BoardController *bc, char *data, size_t len)
 }
 
 /**
- * @brief Function to write to current UART port.
+ * @brief Function to write to a UART port.
  *
  * @param bc board controller object
+ * @param handle uart to write, UART_ANY for the first one set up
  * @param data data to write
  * @param len length of data
- * @return uint32_t length written, should be = to len, 0 if not written.
+ * @return uint32_t length queued, less than len if the TX buffer policy discarded some.
  */
-uint32_t writeUARTPort(BoardController *bc, const char *data, size_t len)
+uint32_t writeUARTPort(BoardController *bc, uint32_t handle, const char *data, size_t len)
 {
-    UARTController uart_to_write;
-    if (uartExists(bc, &uart_to_write))
+    PeripheralController *uart_to_write = getUARTPeripheral(bc, handle);
+    if (uart_to_write != NULL)
     {
-        currentUartWrite(uart_to_write, (uint8_t *)data, len);
-        return len;
+        return currentUartWrite(uart_to_write->peripheral.uart, (uint8_t *)data, len);
     }
     else
     {
         printf("> Error: No uart exists!\r\n");
         return 0;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Function to transfer over an SPI, full duplex and in place.
+ *
+ * @param bc board controller object
+ * @param handle SPI to transfer on, SPI_ANY for the first one set up
+ * @param data bytes to send, replaced by the bytes received
+ * @param len number of bytes
+ * @return uint32_t number of bytes transferred, 0 if there is no such SPI
+ */
+uint32_t transferSPIPort(BoardController *bc, uint32_t handle, uint8_t *data, size_t len)
+{
+    PeripheralController *spi = getSPIPeripheral(bc, handle);
+    if (spi == NULL)
+    {
+        printf("> Error: No SPI exists!\r\n");
+        return 0;
+    }
+    return currentSPITransfer(&spi->peripheral.spi, data, (uint32_t)len);
+}
+
+/**
+ * @brief Moves the CPU to a new clock and puts everything that counts off a bus clock back to
+ * what it was asked for: systick, the console and every live UART's baudrate, PWM periods, SPI
+ * clocks, I2C bus timing, the ADC scan timer and a playing pattern. Measured inputs are converted at the new
+ * clock from their next window, a capture still sampling is abandoned.
+ *
+ * @param bc Board controller
+ * @param mhz new CPU clock in MHz
+ * @return true switched
+ * @return false out of range, nothing changed
+ */
+bool setBoardClock(BoardController *bc, uint32_t mhz)
+{
+    if (mhz < SYSTEM_CLOCK_MIN_MHZ || mhz > SYSTEM_CLOCK_MAX_MHZ)
+    {
+        return false;
+    }
+    // Let the console drain at the old baudrate, whatever is still going out would be garbled.
+    coreUartFlush();
+    (void)coreSystemSetClock(mhz);
+    coreUartClockChanged();
+
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        PeripheralController *current = &bc->peripherals[periph];
+        if (!current->status)
+        {
+            continue;
+        }
+        switch (current->type)
+        {
+        case TYPE_UART:
+            usart_set_baudrate(current->peripheral.uart.handle, current->peripheral.uart.baudrate);
+            break;
+        case TYPE_PWM:
+            (void)updatePWMPin(bc, current, current->peripheral.pwm.frequency,
+                               current->peripheral.pwm.duty_cycle);
+            break;
+        case TYPE_SPI:
+            currentSPIClockChanged(&current->peripheral.spi);
+            break;
+        case TYPE_I2C:
+            currentI2CSetup(&current->peripheral.i2c);
+            break;
+        default:
+            break;
+        }
+    }
+    adcClockChanged();
+    patternClockChanged();
+    captureClockChanged();
+    return true;
+}
+
+/**
+ * @brief Prints every clock that is on and what keeps it on: the pins of the peripherals using
+ * a board clock, or "firmware" for the ones the drivers gate themselves (console, DMA, EXTI and
+ * the scan and pattern timers).
+ *
+ * @param bc Board controller
+ */
+void printClocks(BoardController *bc)
+{
+    unsigned int on = 0;
+    for (size_t index = 0; index < CLOCK_TABLE_SIZE; index++)
+    {
+        enum rcc_periph_clken clock = clockFromIndex(index);
+        if (!clockRunning(clock))
+        {
+            continue;
+        }
+        on++;
+        const char *name = clockName(clock);
+        if (name != NULL)
+        {
+            printf("> %-7s", name);
+        }
+        else
+        {
+            printf("> 0x%03x  ", (unsigned int)clock);
+        }
+
+        const ClockController *entry = &bc->clocks[index];
+        if (entry->refs == 0 && !entry->pinned)
+        {
+            printf("firmware\r\n");
+            continue;
+        }
+        printf("%u ref%s%s", entry->refs, entry->refs == 1 ? "" : "s",
+               entry->pinned ? ", console" : "");
+        for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+        {
+            const PeripheralController *current = &bc->peripherals[periph];
+            if (!current->status)
+            {
+                continue;
+            }
+            enum rcc_periph_clken clocks[BOARD_PERIPHERAL_CLOCKS];
+            size_t                count = peripheralClocks(current, clocks);
+            size_t                users = 0;
+            for (size_t used = 0; used < count; used++)
+            {
+                users += clocks[used] == clock;
+            }
+            size_t port_index;
+            size_t pin_index;
+            if (users == 0 || !peripheralPin(current, &port_index, &pin_index))
+            {
+                continue;
+            }
+            printf(", %c%02u", (char)('A' + port_index), (unsigned int)pin_index);
+            if (users > 1)
+            {
+                printf(" x%u", (unsigned int)users);
+            }
+        }
+        printf("\r\n");
+    }
+    printf("> %u clocks on.\r\n", on);
+}
@@ -0,0 +1,206 @@
+/**
+ * @file bridge-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Passes bytes between the console and a user UART until the escape sequence arrives.
+ * Each direction is copied once, from the receiving UART's RX ring buffer straight into the other
+ * UART's TX ring buffer, and whatever doesn't fit is left where it is so flow control can hold
+ * the sender back.
+ * @version 0.1
+ * @date 2025-03-27
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "bridge-control.h"
+#include <stdio.h>
+
+#include "core/system.h"
+#include "core/uart.h"
+#include "uart-control.h"
+
+static uint32_t bridge_handle = 0; // uart being bridged, 0 when not bridging
+static uint32_t bridge_sent = 0;     // console bytes passed on to the uart
+static uint32_t bridge_received = 0; // uart bytes passed on to the console
+static uint64_t last_console_ticks = 0; // when console bytes were last seen
+static uint8_t  escape_held = 0;    // escape characters held back, they may not be data
+static uint8_t  escape_pending = 0; // held back characters that turned out to be data
+
+/**
+ * @brief Returns the number a UART is selected by.
+ *
+ * @param handle uart handle
+ * @return int 1 or 6
+ */
+static int uartNumber(uint32_t handle)
+{
+    return handle == USART1 ? 1 : 6;
+}
+
+/**
+ * @brief Ends the bridge and reports what went through it.
+ *
+ */
+static void bridgeStop(void)
+{
+    printf("\r\n> Bridge to UART%d closed: %lu bytes sent, %lu received.\r\n",
+           uartNumber(bridge_handle), bridge_sent, bridge_received);
+    bridge_handle = 0;
+}
+
+/**
+ * @brief Passes console bytes on to the uart, holding back what could be the escape sequence.
+ *
+ * @param uart uart being bridged
+ * @param now current ticks
+ */
+static void forwardConsole(const UARTController *uart, uint64_t now)
+{
+    static const uint8_t escape[BRIDGE_ESCAPE_COUNT] = {BRIDGE_ESCAPE_CHAR, BRIDGE_ESCAPE_CHAR,
+                                                        BRIDGE_ESCAPE_CHAR};
+    const uint8_t       *span;
+    uint32_t             length;
+    while (true)
+    {
+        if (escape_pending > 0)
+        {
+            uint32_t sent = currentUartWriteNoWait(*uart, escape, escape_pending);
+            bridge_sent += sent;
+            escape_pending = (uint8_t)(escape_pending - sent);
+            if (escape_pending > 0)
+            {
+                return;
+            }
+        }
+
+        length = coreUartPeekRead(&span);
+        if (length == 0)
+        {
+            return;
+        }
+        bool quiet = now - last_console_ticks >= BRIDGE_GUARD_MS;
+        last_console_ticks = now;
+
+        if (span[0] == BRIDGE_ESCAPE_CHAR && escape_held < BRIDGE_ESCAPE_COUNT &&
+            (escape_held > 0 || quiet))
+        {
+            escape_held++;
+            coreUartCommitRead(1);
+            continue;
+        }
+        if (escape_held > 0)
+        {
+            // Not the escape after all, what was held back goes out first.
+            escape_pending = escape_held;
+            escape_held = 0;
+            continue;
+        }
+
+        uint32_t sent = currentUartWriteNoWait(*uart, span, length);
+        bridge_sent += sent;
+        coreUartCommitRead(sent);
+        if (sent < length)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Passes uart bytes on to the console.
+ *
+ * @param uart uart being bridged
+ */
+static void forwardUART(const UARTController *uart)
+{
+    const uint8_t *span;
+    uint32_t       length;
+    while ((length = currentUartPeekRead(*uart, &span)) > 0)
+    {
+        uint32_t sent = coreUartWriteNoWait(span, length);
+        bridge_received += sent;
+        currentUartCommitRead(*uart, sent);
+        if (sent < length)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Starts bridging the console to a uart. The console stops being read as lines until the
+ * escape sequence.
+ *
+ * @param bc board controller object
+ * @param handle uart handle, UART_ANY for the first one set up
+ * @return true bridging
+ * @return false no such uart
+ */
+bool bridgeStart(BoardController *bc, uint32_t handle)
+{
+    PeripheralController *uart = getUARTPeripheral(bc, handle);
+    if (uart == NULL)
+    {
+        printf("> Error: No uart exists!\r\n");
+        return false;
+    }
+
+    bridge_handle = uart->peripheral.uart.handle;
+    bridge_sent = 0;
+    bridge_received = 0;
+    last_console_ticks = coreGetTicks();
+    escape_held = 0;
+    escape_pending = 0;
+    printf("> Bridging the console to UART%d at %lu baud. Send \"+++\" with a second of "
+           "silence either side to return.\r\n",
+           uartNumber(bridge_handle), uart->peripheral.uart.baudrate);
+    return true;
+}
+
+/**
+ * @brief Checks whether the console is bridged to a uart.
+ *
+ * @return true bridging, console lines aren't being read
+ * @return false not bridging
+ */
+bool bridgeActive(void)
+{
+    return bridge_handle != 0;
+}
+
+/**
+ * @brief Moves whatever both sides have received since the last call. Call from the main loop in
+ * place of reading console lines while bridging.
+ *
+ * @param bc board controller object
+ */
+void bridgeService(BoardController *bc)
+{
+    if (bridge_handle == 0)
+    {
+        return;
+    }
+    PeripheralController *uart = getUARTPeripheral(bc, bridge_handle);
+    if (uart == NULL)
+    {
+        // Killed from a scheduled line or a restore.
+        bridgeStop();
+        return;
+    }
+
+    uint64_t now = coreGetTicks();
+    forwardConsole(&uart->peripheral.uart, now);
+    forwardUART(&uart->peripheral.uart);
+
+    if (escape_held > 0 && now - last_console_ticks >= BRIDGE_GUARD_MS)
+    {
+        if (escape_held == BRIDGE_ESCAPE_COUNT)
+        {
+            escape_held = 0;
+            bridgeStop();
+            return;
+        }
+        // Too few to be the escape.
+        escape_pending = escape_held;
+        escape_held = 0;
+    }
+}
@@ -0,0 +1,426 @@
+/**
+ * @file capture-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Logic analyser. A port's IDR is copied into RAM by timer triggered DMA, so samples are
+ * evenly spaced at MHz rates with no help from the CPU, then sent back run length encoded.
+ * @note With a trigger the buffer is circular and each half is searched for the trigger
+ *       condition from the DMA interrupt as soon as it fills. Once found, capture stops at the
+ *       end of this half or the next, whichever leaves the trigger nearer the middle.
+ * @version 0.1
+ * @date 2025-03-30
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "capture-control.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/timer.h"
+
+#include "board-control.h"
+#include "dma-control.h"
+#include "pattern-control.h"
+#include "protocol.h"
+#include "response.h"
+#include "sys_timer.h"
+
+// TIM1 has a 16 bit period, slower rates come from the prescaler.
+#define CAPTURE_MAX_PERIOD  (0x10000)
+#define CAPTURE_NO_TRIGGER  (0xFFFF)
+#define CAPTURE_FRAME_HEAD  (10) // port, last, pins, rate, trigger
+#define CAPTURE_TEXT_RUNS   (8)  // runs per text line, "LLLL:NNNN " each
+
+/**
+ * @brief Where a capture is up to.
+ *
+ */
+typedef enum CaptureState
+{
+    CAPTURE_IDLE,    // nothing armed
+    CAPTURE_RUNNING, // sampling, or waiting for the trigger
+    CAPTURE_DONE,    // stopped, waiting for captureService() to send it
+} CaptureState;
+
+static uint16_t capture_buffer[CAPTURE_MAX_SAMPLES];
+static uint32_t capture_port = 0;
+static uint16_t capture_pins = 0;    // inputs when it started, the rest are masked off
+static uint32_t capture_length = 0;  // buffer in use
+static uint32_t capture_rate_hz = 0; // as the timer runs, not as asked for
+static uint16_t trigger_mask = 0;    // 0 for a single shot capture
+static uint16_t trigger_value = 0;
+
+static bool                  capture_armed = false; // stream and TIM1 claimed
+static volatile CaptureState capture_state = CAPTURE_IDLE;
+static volatile uint32_t     capture_halves = 0;  // halves filled since the start
+static volatile bool         capture_triggered = false;
+static volatile uint32_t     trigger_sample = 0;  // samples since the start
+static volatile uint32_t     stop_halves = 0;     // stop once this many halves are filled
+static volatile uint32_t     capture_first = 0;   // buffer index of the oldest sample
+static volatile uint32_t     capture_count = 0;   // samples to send
+static volatile uint16_t     capture_trigger = CAPTURE_NO_TRIGGER; // index in what is sent
+
+/**
+ * @brief Stops sampling where the DMA is now and works out which samples to send: the newest
+ * capture_length of them, oldest first. Called from the DMA interrupt.
+ *
+ */
+static void captureFinish(void)
+{
+    timer_disable_counter(TIM1);
+    dma_disable_stream(DMA2, DMA_STREAM6);
+
+    if (trigger_mask == 0)
+    {
+        capture_first = 0;
+        capture_count = capture_length;
+        capture_trigger = CAPTURE_NO_TRIGGER;
+        capture_state = CAPTURE_DONE;
+        return;
+    }
+
+    // The stream can be a few samples past the last half by the time it stops.
+    uint32_t half = capture_length / 2;
+    uint32_t next = capture_length - dma_get_number_of_data(DMA2, DMA_STREAM6);
+    uint32_t boundary = (capture_halves * half) % capture_length;
+    uint32_t written = capture_halves * half + (next + capture_length - boundary) % capture_length;
+    uint32_t count = written < capture_length ? written : capture_length;
+    uint32_t oldest = written - count;
+
+    capture_first = (next + capture_length - count) % capture_length;
+    capture_count = count;
+    capture_trigger = trigger_sample >= oldest ? (uint16_t)(trigger_sample - oldest)
+                                               : CAPTURE_NO_TRIGGER;
+    capture_state = CAPTURE_DONE;
+}
+
+/**
+ * @brief Handles a filled half of a triggered capture: searches it for the trigger, then stops
+ * once enough has come after it.
+ *
+ * @param first buffer index the half starts at
+ */
+static void captureHalfDone(uint32_t first)
+{
+    uint32_t half = capture_length / 2;
+    capture_halves++;
+    if (!capture_triggered)
+    {
+        const uint16_t *samples = &capture_buffer[first];
+        for (uint32_t i = 0; i < half; i++)
+        {
+            if ((samples[i] & trigger_mask) == trigger_value)
+            {
+                capture_triggered = true;
+                trigger_sample = (capture_halves - 1) * half + i;
+                // Early in the half the buffer already has enough before it, late it needs
+                // another half after it.
+                stop_halves = i < half / 2 ? capture_halves : capture_halves + 1;
+                break;
+            }
+        }
+    }
+    if (capture_triggered && capture_halves >= stop_halves)
+    {
+        captureFinish();
+    }
+}
+
+/**
+ * @brief DMA ISR for the sample stream. A single shot capture ends at transfer complete, a
+ * triggered one gets both half and full interrupts.
+ *
+ */
+void dma2_stream6_isr(void)
+{
+    bool half = dma_get_interrupt_flag(DMA2, DMA_STREAM6, DMA_HTIF);
+    bool full = dma_get_interrupt_flag(DMA2, DMA_STREAM6, DMA_TCIF);
+    dma_clear_interrupt_flags(DMA2, DMA_STREAM6, DMA_HTIF | DMA_TCIF);
+    if (capture_state != CAPTURE_RUNNING)
+    {
+        return;
+    }
+
+    if (trigger_mask == 0)
+    {
+        if (full)
+        {
+            captureFinish();
+        }
+        return;
+    }
+    if (half)
+    {
+        captureHalfDone(0);
+    }
+    if (full && capture_state == CAPTURE_RUNNING)
+    {
+        captureHalfDone(capture_length / 2);
+    }
+}
+
+/**
+ * @brief Starts sampling a port. Without a trigger it fills the buffer once and stops, with one
+ * it samples round and round until the first sample where the trigger pins match.
+ *
+ * @param port GPIO port to sample
+ * @param pins input pins on the port, the only ones sent back
+ * @param rate_hz sample rate, CAPTURE_MIN_HZ to CAPTURE_MAX_HZ
+ * @param samples samples to keep, CAPTURE_MIN_SAMPLES to CAPTURE_MAX_SAMPLES, even if triggered
+ * @param mask trigger pins, 0 for none
+ * @param value levels the trigger pins must have, within mask
+ * @return true sampling
+ * @return false TIM1 or the stream is in use
+ */
+bool captureStart(uint32_t port, uint16_t pins, uint32_t rate_hz, uint32_t samples, uint16_t mask,
+                  uint16_t value)
+{
+    if (patternRunning())
+    {
+        printf("> Error: TIM1 is playing the pattern, \"pattern stop\" first.\r\n");
+        return false;
+    }
+    (void)captureStop();
+    // A finished single pass still holds TIM1.
+    (void)patternStop();
+    if (!claimDMAStream(DMA_TIM1_CH3))
+    {
+        return false;
+    }
+    rcc_periph_clock_enable(RCC_TIM1);
+    rcc_periph_reset_pulse(RST_TIM1);
+    capture_armed = true;
+
+    uint32_t clock = coreTimerClockFrequency(TIM1);
+    uint32_t ticks = (clock + rate_hz / 2) / rate_hz;
+    ticks = ticks == 0 ? 1 : ticks;
+    uint32_t prescaler = ticks / CAPTURE_MAX_PERIOD + 1;
+    uint32_t period = ticks / prescaler;
+    capture_rate_hz = clock / (prescaler * period);
+
+    capture_port = port;
+    capture_pins = pins;
+    capture_length = samples;
+    trigger_mask = mask;
+    trigger_value = value & mask;
+    capture_halves = 0;
+    capture_triggered = false;
+    capture_state = CAPTURE_RUNNING;
+
+    setupDMAPeripheralToMemory16(DMA_TIM1_CH3, (uint32_t)&GPIO_IDR(port), capture_buffer,
+                                 (uint16_t)samples, mask != 0);
+    dma_enable_transfer_complete_interrupt(DMA2, DMA_STREAM6);
+    if (mask != 0)
+    {
+        dma_enable_half_transfer_interrupt(DMA2, DMA_STREAM6);
+    }
+    nvic_enable_irq(DMA_TIM1_CH3.nvic_entry);
+    dma_enable_stream(DMA2, DMA_STREAM6);
+
+    timer_set_mode(TIM1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM1, prescaler - 1);
+    timer_set_period(TIM1, period - 1);
+    timer_set_oc_mode(TIM1, TIM_OC3, TIM_OCM_FROZEN);
+    timer_set_oc_value(TIM1, TIM_OC3, 0);
+    timer_generate_event(TIM1, TIM_EGR_UG);
+    timer_clear_flag(TIM1, TIM_SR_UIF | TIM_SR_CC3IF);
+    timer_enable_irq(TIM1, TIM_DIER_CC3DE);
+    timer_enable_counter(TIM1);
+    return true;
+}
+
+/**
+ * @brief Stops a capture, sent or not, and frees TIM1 and its stream.
+ *
+ * @return true a capture was stopped
+ * @return false nothing was armed
+ */
+bool captureStop(void)
+{
+    if (!capture_armed)
+    {
+        return false;
+    }
+
+    timer_disable_counter(TIM1);
+    timer_disable_irq(TIM1, TIM_DIER_CC3DE);
+    releaseDMAStream(DMA_TIM1_CH3);
+    rcc_periph_clock_disable(RCC_TIM1);
+    capture_state = CAPTURE_IDLE;
+    capture_armed = false;
+    return true;
+}
+
+/**
+ * @brief Tells whether a capture holds TIM1.
+ *
+ * @return true sampling, waiting for the trigger, or not sent yet
+ * @return false idle
+ */
+bool captureActive(void)
+{
+    return capture_armed;
+}
+
+/**
+ * @brief Returns the sample rate of the last capture, as the timer divides it.
+ *
+ * @return uint32_t rate in Hz
+ */
+uint32_t captureRate(void)
+{
+    return capture_rate_hz;
+}
+
+/**
+ * @brief Follows a CPU clock change. The sample period was worked out for the old TIM1 clock, so
+ * a capture still sampling is abandoned. A finished one is sent as normal.
+ *
+ */
+void captureClockChanged(void)
+{
+    if (capture_armed && capture_state == CAPTURE_RUNNING)
+    {
+        (void)captureStop();
+        printf("> Capture abandoned, the clock changed while sampling.\r\n");
+    }
+}
+
+/**
+ * @brief Writes a number as four hex digits.
+ *
+ * @param out destination, at least 4 bytes
+ * @param value number
+ */
+static void formatHex16(char *out, uint16_t value)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 3; i >= 0; i--)
+    {
+        out[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * @brief Returns the next run of equal samples.
+ *
+ * @param index position in what is sent, moved past the run
+ * @param level returned levels of the run's input pins
+ * @return uint16_t length of the run
+ */
+static uint16_t nextRun(uint32_t *index, uint16_t *level)
+{
+    uint32_t start = *index;
+    *level = capture_buffer[(capture_first + start) % capture_length] & capture_pins;
+    while (*index < capture_count &&
+           (capture_buffer[(capture_first + *index) % capture_length] & capture_pins) == *level)
+    {
+        (*index)++;
+    }
+    return (uint16_t)(*index - start);
+}
+
+/**
+ * @brief Sends a finished capture as FRAME_CAPTURE frames, CAPTURE_FRAME_RUNS runs each.
+ *
+ */
+static void sendFrames(void)
+{
+    uint8_t  payload[CAPTURE_FRAME_HEAD + CAPTURE_FRAME_RUNS * 4];
+    uint32_t index = 0;
+    do
+    {
+        size_t length = CAPTURE_FRAME_HEAD;
+        for (size_t run = 0; run < CAPTURE_FRAME_RUNS && index < capture_count; run++)
+        {
+            uint16_t level;
+            uint16_t count = nextRun(&index, &level);
+            memcpy(&payload[length], &level, sizeof(level));
+            memcpy(&payload[length + 2], &count, sizeof(count));
+            length += 4;
+        }
+        // Little endian already, as is the Cortex-M4.
+        uint16_t trigger = capture_trigger;
+        payload[0] = (uint8_t)((capture_port - GPIOA) / PORT_SIZE);
+        payload[1] = index >= capture_count;
+        memcpy(&payload[2], &capture_pins, sizeof(capture_pins));
+        memcpy(&payload[4], &capture_rate_hz, sizeof(capture_rate_hz));
+        memcpy(&payload[8], &trigger, sizeof(trigger));
+        protocolSendFrame(FRAME_CAPTURE, payload, (uint16_t)length);
+    } while (index < capture_count);
+}
+
+/**
+ * @brief Prints a finished capture as lines of runs, "LLLL:N" for N samples at levels LLLL (the
+ * port's IDR in hex, input pins only), after a summary when verbosity is full.
+ *
+ */
+static void printRuns(void)
+{
+    if (responseVerbosity() == VERBOSITY_FULL)
+    {
+        printf("> Capture %c: %lu samples at %lu Hz, pins %04X",
+               (char)('A' + (capture_port - GPIOA) / PORT_SIZE), capture_count, capture_rate_hz,
+               capture_pins);
+        if (capture_trigger != CAPTURE_NO_TRIGGER)
+        {
+            printf(", trigger at %u", capture_trigger);
+        }
+        printf(".\r\n");
+    }
+
+    uint32_t index = 0;
+    while (index < capture_count)
+    {
+        responseBegin();
+        for (size_t run = 0; run < CAPTURE_TEXT_RUNS && index < capture_count; run++)
+        {
+            char     levels[5];
+            uint16_t level;
+            uint16_t count = nextRun(&index, &level);
+            formatHex16(levels, level);
+            levels[4] = ':';
+            if (run != 0)
+            {
+                responseChars(" ", 1);
+            }
+            responseChars(levels, sizeof(levels));
+            responseUnsigned(count, 0);
+        }
+        responseEnd();
+    }
+}
+
+/**
+ * @brief Tells the main loop's sleep that captureService() has something to do.
+ *
+ * @return true a capture has finished
+ */
+bool capturePending(void)
+{
+    return capture_armed && capture_state == CAPTURE_DONE;
+}
+
+/**
+ * @brief Called from the main loop. Sends a finished capture and frees TIM1 for the next one.
+ *
+ */
+void captureService(void)
+{
+    if (!capture_armed || capture_state != CAPTURE_DONE)
+    {
+        return;
+    }
+    if (protocolBinaryMode())
+    {
+        sendFrames();
+    }
+    else
+    {
+        printRuns();
+    }
+    (void)captureStop();
+}
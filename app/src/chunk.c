@@ -0,0 +1,102 @@
+/**
+ * @file chunk.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Logic for building compiled lines (chunks).
+ * @version 0.1
+ * @date 2025-03-03
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "chunk.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Resets a chunk to empty and unbound.
+ *
+ * @param chunk chunk to initialise
+ */
+void initChunk(Chunk *chunk)
+{
+    chunk->count = 0;
+    chunk->constants_count = 0;
+    chunk->strings_length = 0;
+    chunk->bound_generation = CHUNK_UNBOUND;
+}
+
+/**
+ * @brief Appends an instruction to a chunk.
+ *
+ * @param chunk chunk to append to
+ * @param op OpCode
+ * @param port GPIO port base, 0 if unused
+ * @param mask pin mask, 0 if unused
+ * @param operand op specific operand
+ * @return Instruction* the written instruction, NULL if the chunk is full.
+ */
+Instruction *writeChunk(Chunk *chunk, OpCode op, uint32_t port, uint16_t mask, uint32_t operand)
+{
+    if (chunk->count == CHUNK_MAX_INSTRUCTIONS)
+    {
+        printf("> Compile Error: Line is too complex (max %d instructions).\r\n",
+               CHUNK_MAX_INSTRUCTIONS);
+        return NULL;
+    }
+
+    Instruction *instruction = &chunk->code[chunk->count++];
+    instruction->op = (uint8_t)op;
+    instruction->flags = 0;
+    instruction->port = port;
+    instruction->mask = mask;
+    instruction->operand = operand;
+    instruction->bound_mask = 0;
+    instruction->periph = NULL;
+    return instruction;
+}
+
+/**
+ * @brief Adds a group of constants to the constants pool.
+ *
+ * @param chunk chunk to add to
+ * @param values values to add
+ * @param count how many values
+ * @return int index of the first value, -1 if the pool is full.
+ */
+int addConstants(Chunk *chunk, const uint32_t *values, size_t count)
+{
+    if (chunk->constants_count + count > CHUNK_MAX_CONSTANTS)
+    {
+        printf("> Compile Error: Line is too complex (max %d constants).\r\n",
+               CHUNK_MAX_CONSTANTS);
+        return -1;
+    }
+
+    int index = chunk->constants_count;
+    memcpy(&chunk->constants[index], values, sizeof(uint32_t) * count);
+    chunk->constants_count += (uint16_t)count;
+    return index;
+}
+
+/**
+ * @brief Copies a string into the string pool.
+ *
+ * @param chunk chunk to add to
+ * @param string string to copy
+ * @param length length of string
+ * @return int offset of the string in the pool, -1 if the pool is full.
+ */
+int addString(Chunk *chunk, const char *string, size_t length)
+{
+    if (chunk->strings_length + length > CHUNK_MAX_STRINGS)
+    {
+        printf("> Compile Error: String is too long (max %d bytes per line).\r\n",
+               CHUNK_MAX_STRINGS);
+        return -1;
+    }
+
+    int offset = chunk->strings_length;
+    memcpy(&chunk->strings[offset], string, length);
+    chunk->strings_length += (uint16_t)length;
+    return offset;
+}
@@ -23,7 +23,8 @@
  */
 ClockController create_clock(enum rcc_periph_clken clock_rcc)
 {
-    return (ClockController) {.clock = clock_rcc, .clock_enabled = false};
+    return (ClockController) {
+        .clock = clock_rcc, .refs = 0, .pinned = false, .clock_enabled = false};
 }
 
 /**
@@ -58,4 +59,157 @@ void disableClock(ClockController *clock_controller)
         rcc_periph_clock_disable(clock_controller->clock);
         clock_controller->clock_enabled = false;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Adds a user to a clock, enabling it for the first.
+ *
+ * @param clock_controller clock object
+ */
+void clockTakeRef(ClockController *clock_controller)
+{
+    clock_controller->refs++;
+    enableClock(clock_controller);
+}
+
+/**
+ * @brief Removes a user from a clock, disabling it after the last unless it is pinned.
+ *
+ * @param clock_controller clock object
+ */
+void clockDropRef(ClockController *clock_controller)
+{
+    if (clock_controller->refs > 0)
+    {
+        clock_controller->refs--;
+    }
+    if (clock_controller->refs == 0 && !clock_controller->pinned)
+    {
+        disableClock(clock_controller);
+    }
+}
+
+/**
+ * @brief Finds a clock's slot in the clock table, constant time.
+ *
+ * @param clock_rcc clock enum
+ * @return size_t index below CLOCK_TABLE_SIZE, CLOCK_NONE if its register isn't in the table
+ */
+size_t clockIndex(enum rcc_periph_clken clock_rcc)
+{
+    size_t bit = (size_t)clock_rcc & 0x1F;
+    switch ((uint32_t)clock_rcc >> 5)
+    {
+    case 0x30: // AHB1ENR
+        return bit;
+    case 0x34: // AHB2ENR
+        return 32 + bit;
+    case 0x40: // APB1ENR
+        return 64 + bit;
+    case 0x44: // APB2ENR
+        return 96 + bit;
+    default:
+        return CLOCK_NONE;
+    }
+}
+
+/**
+ * @brief Turns a clock table index back into its clock.
+ *
+ * @param index index below CLOCK_TABLE_SIZE
+ * @return enum rcc_periph_clken clock
+ */
+enum rcc_periph_clken clockFromIndex(size_t index)
+{
+    static const uint32_t registers[CLOCK_TABLE_ROWS] = {0x30, 0x34, 0x40, 0x44};
+    return (enum rcc_periph_clken)((registers[index / 32] << 5) + index % 32);
+}
+
+/**
+ * @brief Reads a clock's enable bit straight from RCC, whoever turned it on.
+ *
+ * @param clock_rcc clock enum
+ * @return true clock is on
+ * @return false clock is gated off
+ */
+bool clockRunning(enum rcc_periph_clken clock_rcc)
+{
+    return (_RCC_REG(clock_rcc) & _RCC_BIT(clock_rcc)) != 0;
+}
+
+/**
+ * @brief Returns the name of a clock, as the reference manual has it.
+ *
+ * @param clock_rcc clock enum
+ * @return const char* name, NULL for clocks the firmware never turns on
+ */
+const char *clockName(enum rcc_periph_clken clock_rcc)
+{
+    switch (clock_rcc)
+    {
+    case RCC_GPIOA:
+        return "GPIOA";
+    case RCC_GPIOB:
+        return "GPIOB";
+    case RCC_GPIOC:
+        return "GPIOC";
+    case RCC_GPIOD:
+        return "GPIOD";
+    case RCC_GPIOE:
+        return "GPIOE";
+    case RCC_GPIOH:
+        return "GPIOH";
+    case RCC_ADC1:
+        return "ADC1";
+    case RCC_USART1:
+        return "USART1";
+    case RCC_USART2:
+        return "USART2";
+    case RCC_USART6:
+        return "USART6";
+    case RCC_SPI1:
+        return "SPI1";
+    case RCC_SPI2:
+        return "SPI2";
+    case RCC_SPI3:
+        return "SPI3";
+    case RCC_SPI4:
+        return "SPI4";
+    case RCC_SPI5:
+        return "SPI5";
+    case RCC_I2C1:
+        return "I2C1";
+    case RCC_I2C2:
+        return "I2C2";
+    case RCC_I2C3:
+        return "I2C3";
+    case RCC_TIM1:
+        return "TIM1";
+    case RCC_TIM2:
+        return "TIM2";
+    case RCC_TIM3:
+        return "TIM3";
+    case RCC_TIM4:
+        return "TIM4";
+    case RCC_TIM5:
+        return "TIM5";
+    case RCC_TIM9:
+        return "TIM9";
+    case RCC_TIM10:
+        return "TIM10";
+    case RCC_TIM11:
+        return "TIM11";
+    case RCC_DMA1:
+        return "DMA1";
+    case RCC_DMA2:
+        return "DMA2";
+    case RCC_CRC:
+        return "CRC";
+    case RCC_PWR:
+        return "PWR";
+    case RCC_SYSCFG:
+        return "SYSCFG";
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,199 @@
+/**
+ * @file dma-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Keeps track of which DMA streams are in use so peripherals don't trample each other.
+ * @version 0.1
+ * @date 2025-03-05
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "dma-control.h"
+
+#include <stdio.h>
+
+// One bit per stream, bits 0-7 DMA1, bits 8-15 DMA2.
+static uint16_t claimed_streams = 0;
+
+/**
+ * @brief Returns the claim bit for a stream.
+ *
+ * @param stream stream to check
+ * @return uint16_t bit in claimed_streams
+ */
+static uint16_t streamBit(DMAStream stream)
+{
+    return (uint16_t)(1U << (stream.stream + (stream.dma == DMA2 ? 8 : 0)));
+}
+
+/**
+ * @brief Returns the claim bits covering every stream of a controller.
+ *
+ * @param dma DMA1 or DMA2
+ * @return uint16_t mask of claimed_streams
+ */
+static uint16_t controllerMask(uint32_t dma)
+{
+    return dma == DMA2 ? 0xFF00 : 0x00FF;
+}
+
+/**
+ * @brief Claims a DMA stream, turning the controller clock on if it is the first stream used.
+ *
+ * @param stream stream to claim
+ * @return true stream claimed
+ * @return false stream already in use
+ */
+bool claimDMAStream(DMAStream stream)
+{
+    if (claimed_streams & streamBit(stream))
+    {
+        printf("> Error: DMA%d stream %u is already in use.\r\n", stream.dma == DMA2 ? 2 : 1,
+               stream.stream);
+        return false;
+    }
+
+    if ((claimed_streams & controllerMask(stream.dma)) == 0)
+    {
+        rcc_periph_clock_enable(stream.dma == DMA2 ? RCC_DMA2 : RCC_DMA1);
+    }
+    claimed_streams |= streamBit(stream);
+    return true;
+}
+
+/**
+ * @brief Stops and releases a DMA stream, turning the controller clock off if nothing else uses
+ * it.
+ *
+ * @param stream stream to release
+ */
+void releaseDMAStream(DMAStream stream)
+{
+    if (!(claimed_streams & streamBit(stream)))
+    {
+        return;
+    }
+
+    nvic_disable_irq(stream.nvic_entry);
+    dma_disable_stream(stream.dma, stream.stream);
+    claimed_streams &= (uint16_t)~streamBit(stream);
+
+    if ((claimed_streams & controllerMask(stream.dma)) == 0)
+    {
+        rcc_periph_clock_disable(stream.dma == DMA2 ? RCC_DMA2 : RCC_DMA1);
+    }
+}
+
+/**
+ * @brief Checks whether a stream is currently claimed.
+ *
+ * @param stream stream to check
+ * @return true stream in use
+ * @return false stream free
+ */
+bool isDMAStreamClaimed(DMAStream stream)
+{
+    return (claimed_streams & streamBit(stream)) != 0;
+}
+
+/**
+ * @brief Sets up a claimed stream for transfers of one data size between a peripheral register and
+ * an incrementing memory buffer.
+ *
+ * @param stream claimed stream
+ * @param peripheral_address peripheral data register
+ * @param memory buffer
+ * @param count number of transfers
+ * @param circular wrap around at the end of the buffer
+ * @param direction DMA_SxCR_DIR_PERIPHERAL_TO_MEM or DMA_SxCR_DIR_MEM_TO_PERIPHERAL
+ * @param psize DMA_SxCR_PSIZE_*
+ * @param msize DMA_SxCR_MSIZE_*, matching psize
+ */
+static void setupStream(DMAStream stream, uint32_t peripheral_address, void *memory,
+                        uint16_t count, bool circular, uint32_t direction, uint32_t psize,
+                        uint32_t msize)
+{
+    dma_stream_reset(stream.dma, stream.stream);
+    dma_channel_select(stream.dma, stream.stream, stream.channel);
+    dma_set_peripheral_address(stream.dma, stream.stream, peripheral_address);
+    dma_set_memory_address(stream.dma, stream.stream, (uint32_t)memory);
+    dma_set_number_of_data(stream.dma, stream.stream, count);
+    dma_set_transfer_mode(stream.dma, stream.stream, direction);
+    dma_set_peripheral_size(stream.dma, stream.stream, psize);
+    dma_set_memory_size(stream.dma, stream.stream, msize);
+    dma_disable_peripheral_increment_mode(stream.dma, stream.stream);
+    dma_enable_memory_increment_mode(stream.dma, stream.stream);
+    dma_set_priority(stream.dma, stream.stream, DMA_SxCR_PL_HIGH);
+    if (circular)
+    {
+        dma_enable_circular_mode(stream.dma, stream.stream);
+    }
+}
+
+/**
+ * @brief Sets up a claimed stream for byte wide peripheral to memory transfers. The stream is left
+ * disabled, enable it with dma_enable_stream() once the peripheral side is ready.
+ *
+ * @param stream claimed stream
+ * @param peripheral_address peripheral data register
+ * @param memory destination buffer
+ * @param count number of bytes
+ * @param circular wrap around at the end of the buffer
+ */
+void setupDMAPeripheralToMemory(DMAStream stream, uint32_t peripheral_address, void *memory,
+                                uint16_t count, bool circular)
+{
+    setupStream(stream, peripheral_address, memory, count, circular,
+                DMA_SxCR_DIR_PERIPHERAL_TO_MEM, DMA_SxCR_PSIZE_8BIT, DMA_SxCR_MSIZE_8BIT);
+}
+
+/**
+ * @brief Half word version of setupDMAPeripheralToMemory(), for 16 bit data registers such as the
+ * ADC's.
+ *
+ * @param stream claimed stream
+ * @param peripheral_address peripheral data register
+ * @param memory destination buffer, half word aligned
+ * @param count number of half words
+ * @param circular wrap around at the end of the buffer
+ */
+void setupDMAPeripheralToMemory16(DMAStream stream, uint32_t peripheral_address, void *memory,
+                                  uint16_t count, bool circular)
+{
+    setupStream(stream, peripheral_address, memory, count, circular,
+                DMA_SxCR_DIR_PERIPHERAL_TO_MEM, DMA_SxCR_PSIZE_16BIT, DMA_SxCR_MSIZE_16BIT);
+}
+
+/**
+ * @brief Byte wide memory to peripheral version of setupDMAPeripheralToMemory(), for 8 bit data
+ * registers such as the SPIs'.
+ *
+ * @param stream claimed stream
+ * @param peripheral_address peripheral data register
+ * @param memory source buffer
+ * @param count number of bytes
+ * @param circular wrap around at the end of the buffer
+ */
+void setupDMAMemoryToPeripheral(DMAStream stream, uint32_t peripheral_address, const void *memory,
+                                uint16_t count, bool circular)
+{
+    setupStream(stream, peripheral_address, (void *)memory, count, circular,
+                DMA_SxCR_DIR_MEM_TO_PERIPHERAL, DMA_SxCR_PSIZE_8BIT, DMA_SxCR_MSIZE_8BIT);
+}
+
+/**
+ * @brief Sets up a claimed stream for word wide memory to peripheral transfers, such as GPIO BSRR
+ * or timer register writes. The stream is left disabled like setupDMAPeripheralToMemory().
+ *
+ * @param stream claimed stream
+ * @param peripheral_address peripheral register written on every request
+ * @param memory source buffer, word aligned
+ * @param count number of words
+ * @param circular wrap around at the end of the buffer
+ */
+void setupDMAMemoryToPeripheral32(DMAStream stream, uint32_t peripheral_address,
+                                  const void *memory, uint16_t count, bool circular)
+{
+    setupStream(stream, peripheral_address, (void *)memory, count, circular,
+                DMA_SxCR_DIR_MEM_TO_PERIPHERAL, DMA_SxCR_PSIZE_32BIT, DMA_SxCR_MSIZE_32BIT);
+}
@@ -0,0 +1,232 @@
+/**
+ * @file exti-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Records edges on watched input pins, with cycle counter timestamps, into a queue that
+ * "events" drains.
+ * @version 0.1
+ * @date 2025-03-17
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "exti-control.h"
+#include <stdio.h>
+
+#include "libopencm3/cm3/nvic.h"
+#include "libopencm3/stm32/exti.h"
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/rcc.h"
+
+#include "core/ring-buffer.h"
+#include "core/system.h"
+
+// GPIO port registers are this far apart, port A first.
+#define EXTI_PORT_STRIDE (0x400)
+
+// Every EXTI interrupt has the same priority so none preempts another, which keeps the queue
+// single producer.
+static ring_buffer_t     event_queue = {0U};
+static uint8_t           event_data[EXTI_EVENT_QUEUE_SIZE];
+static volatile uint32_t events_dropped = 0; // only the interrupts write this
+static uint32_t          events_reported = 0;
+
+// Which port owns each line, and the edges it was asked for. 0 edges means the line is free.
+static uint32_t line_ports[EXTI_LINE_COUNT];
+static uint8_t  line_edges[EXTI_LINE_COUNT];
+static uint16_t lines_watched = 0;
+
+/**
+ * @brief Returns the interrupt that serves an EXTI line.
+ *
+ * @param line line 0-15
+ * @return int NVIC entry
+ */
+static int lineNVICEntry(uint8_t line)
+{
+    static const int single_lines[] = {NVIC_EXTI0_IRQ, NVIC_EXTI1_IRQ, NVIC_EXTI2_IRQ,
+                                       NVIC_EXTI3_IRQ, NVIC_EXTI4_IRQ};
+    if (line < 5)
+    {
+        return single_lines[line];
+    }
+    return line < 10 ? NVIC_EXTI9_5_IRQ : NVIC_EXTI15_10_IRQ;
+}
+
+/**
+ * @brief Returns the lines served by the same interrupt as a line.
+ *
+ * @param line line 0-15
+ * @return uint16_t mask of lines
+ */
+static uint16_t lineGroup(uint8_t line)
+{
+    if (line < 5)
+    {
+        return (uint16_t)(1U << line);
+    }
+    return line < 10 ? 0x03E0 : 0xFC00;
+}
+
+/**
+ * @brief Queues an event for every pending line in a group and clears it.
+ *
+ * @param lines lines the calling interrupt serves
+ */
+static void recordEdges(uint16_t lines)
+{
+    uint64_t cycles = coreSystemCycles();
+    uint16_t pending = (uint16_t)(exti_get_flag_status(lines) & lines_watched);
+    exti_reset_request(pending);
+
+    for (uint16_t remaining = pending; remaining != 0; remaining &= (uint16_t)(remaining - 1))
+    {
+        uint8_t   line = (uint8_t)__builtin_ctz(remaining);
+        uint16_t  pin = (uint16_t)(1U << line);
+        ExtiEvent event = {.cycles = cycles, .pin_number = line};
+        event.port_index = (uint8_t)((line_ports[line] - GPIOA) / EXTI_PORT_STRIDE);
+        switch (line_edges[line])
+        {
+        case EXTI_EDGE_RISING:
+            event.level = 1;
+            break;
+        case EXTI_EDGE_FALLING:
+            event.level = 0;
+            break;
+        default:
+            // Either edge, the pin has settled by now unless the pulse was very short.
+            event.level = gpio_get(line_ports[line], pin) ? 1 : 0;
+            break;
+        }
+
+        if (coreRingBufferFree(&event_queue) < sizeof(event))
+        {
+            events_dropped++;
+            continue;
+        }
+        (void)coreRingBufferWriteBulk(&event_queue, (const uint8_t *)&event, sizeof(event));
+    }
+}
+
+void exti0_isr(void) { recordEdges(lineGroup(0)); }
+void exti1_isr(void) { recordEdges(lineGroup(1)); }
+void exti2_isr(void) { recordEdges(lineGroup(2)); }
+void exti3_isr(void) { recordEdges(lineGroup(3)); }
+void exti4_isr(void) { recordEdges(lineGroup(4)); }
+void exti9_5_isr(void) { recordEdges(lineGroup(5)); }
+void exti15_10_isr(void) { recordEdges(lineGroup(10)); }
+
+/**
+ * @brief Sets up the event queue, once at boot. It is kept across watches so edges not yet read
+ * survive every line being unwatched, only extiClearEvents() empties it.
+ *
+ */
+void extiSetup(void)
+{
+    coreRingBufferSetup(&event_queue, event_data, EXTI_EVENT_QUEUE_SIZE);
+}
+
+/**
+ * @brief Starts recording edges on an input pin. The pin must already be set up as an input.
+ *
+ * @param port GPIO port
+ * @param pin single GPIO pin
+ * @param edges EXTI_EDGE_RISING, EXTI_EDGE_FALLING or EXTI_EDGE_BOTH
+ * @return true pin watched
+ * @return false the pin's line is already watched on another port
+ */
+bool extiWatch(uint32_t port, uint16_t pin, uint8_t edges)
+{
+    uint8_t line = (uint8_t)__builtin_ctz(pin);
+    if (line_edges[line] != EXTI_EDGE_NONE && line_ports[line] != port)
+    {
+        printf("> Error: EXTI line %u is already watching %c%02u.\r\n", line,
+               (char)('A' + (line_ports[line] - GPIOA) / EXTI_PORT_STRIDE), line);
+        return false;
+    }
+
+    if (lines_watched == 0)
+    {
+        rcc_periph_clock_enable(RCC_SYSCFG);
+    }
+
+    exti_disable_request(pin);
+    exti_select_source(pin, port);
+    exti_set_trigger(pin, edges == EXTI_EDGE_BOTH      ? EXTI_TRIGGER_BOTH
+                          : edges == EXTI_EDGE_RISING ? EXTI_TRIGGER_RISING
+                                                      : EXTI_TRIGGER_FALLING);
+    line_ports[line] = port;
+    line_edges[line] = edges;
+    lines_watched |= pin;
+    exti_reset_request(pin);
+    exti_enable_request(pin);
+    nvic_enable_irq(lineNVICEntry(line));
+    return true;
+}
+
+/**
+ * @brief Stops recording edges on a pin. Does nothing if the pin isn't watched, so it is safe to
+ * call whenever an input pin goes away.
+ *
+ * @param port GPIO port
+ * @param pin single GPIO pin
+ */
+void extiUnwatch(uint32_t port, uint16_t pin)
+{
+    uint8_t line = (uint8_t)__builtin_ctz(pin);
+    if (line_edges[line] == EXTI_EDGE_NONE || line_ports[line] != port)
+    {
+        return;
+    }
+
+    exti_disable_request(pin);
+    exti_reset_request(pin);
+    line_edges[line] = EXTI_EDGE_NONE;
+    lines_watched &= (uint16_t)~pin;
+    if ((lines_watched & lineGroup(line)) == 0)
+    {
+        nvic_disable_irq(lineNVICEntry(line));
+    }
+    if (lines_watched == 0)
+    {
+        rcc_periph_clock_disable(RCC_SYSCFG);
+    }
+}
+
+/**
+ * @brief Takes recorded events off the queue, oldest first.
+ *
+ * @param events buffer to fill
+ * @param max_events size of events
+ * @return size_t events copied
+ */
+size_t extiReadEvents(ExtiEvent *events, size_t max_events)
+{
+    uint32_t available = coreRingBufferUsed(&event_queue) / sizeof(ExtiEvent);
+    size_t   count = available < max_events ? available : max_events;
+    return coreRingBufferReadBulk(&event_queue, (uint8_t *)events,
+                                  (uint32_t)(count * sizeof(ExtiEvent))) /
+           sizeof(ExtiEvent);
+}
+
+/**
+ * @brief Forgets every event not yet read, and the count of dropped ones. Consumer side, like
+ * extiReadEvents().
+ *
+ */
+void extiClearEvents(void)
+{
+    coreRingBufferCommitRead(&event_queue, coreRingBufferUsed(&event_queue));
+    (void)extiTakeDropped();
+}
+
+/**
+ * @brief Returns how many events were lost to a full queue since the last call, and resets it.
+ *
+ * @return uint32_t events dropped
+ */
+uint32_t extiTakeDropped(void)
+{
+    uint32_t dropped = events_dropped - events_reported;
+    events_reported += dropped;
+    return dropped;
+}
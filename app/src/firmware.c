@@ -20,20 +20,43 @@
 // local includes
 #include "core/system.h"
 #include "core/uart.h"
+#include "core/update.h"
 #include "sys_timer.h"
+#include "bench-control.h"
 #include "board-control.h"
+#include "bridge-control.h"
+#include "dma-control.h"
+#include "capture-control.h"
+#include "exti-control.h"
+#include "i2c-control.h"
 #include "interpreter.h"
+#include "latency-control.h"
+#include "mem-control.h"
+#include "protocol.h"
+#include "response.h"
+#include "scheduler.h"
+#include "snapshot-control.h"
 #include "version.h"
 
 #include "debug.h"
 
-// Size of the bootloader binary
-#define BOOTLOADER_SIZE     (0x8000U)
+// Longest console line plus its terminator. Lines can carry several ";" separated statements.
+#ifndef REPL_LINE_SIZE
+#define REPL_LINE_SIZE      (256)
+#endif
 
 // Built in LED ports, for testing.
 #define BUILTIN_LD2_PORT    (GPIOA)
 #define BUILTIN_LD2_PIN     (GPIO5)
 
+// Filled in by stamp-image.py after linking, the bootloader won't boot an image without it.
+static const BootImageHeader image_header __attribute__((section(".image_header"), used)) = {
+    .magic = BOOT_IMAGE_MAGIC,
+    .length = 0xFFFFFFFFU,
+    .crc = 0xFFFFFFFFU,
+    .checked = BOOT_IMAGE_UNCHECKED,
+};
+
 /**
  * @brief Function that tells the system to skip the bootloader on main() execution
  * 
@@ -80,32 +103,86 @@ static void clearLine(char *line, size_t len)
         line[i] = 0;
 }
 
+/**
+ * @brief Whether anything the main loop services is waiting, so it doesn't sleep on it until the
+ * next tick. Called by coreSystemSleep() with interrupts masked.
+ *
+ * @return true console bytes, a DMA block, a finished I2C batch or capture, or a task due
+ */
+static bool workPending(void)
+{
+    return coreUartDataAvailable() || adcStreamPending() || i2cPending() || capturePending() ||
+           schedulerPending();
+}
+
 /**
  * @brief Main function to create repl interface. After line is completed, pass to interpret.
+ * A line longer than the buffer is dropped whole and reported when its '\r' arrives. Stops as soon
+ * as a line starts a bridge, the bytes after it belong to the bridged UART.
  * 
  * @param bc board controller object.
  */
 static void repl(BoardController *bc)
 {
-    static char line[32]; 
+    static char line[REPL_LINE_SIZE];
     static size_t count = 0;
+    static bool overflowed = false;
 
-    while (coreUartDataAvailable())
+    while (!bridgeActive() && coreUartDataAvailable())
     {
         char byte = (char)coreUartReadByte();
-        coreUartWriteByte(byte);
-        line[count++] = byte;
-        if (byte == '\r')
+        // No echo when framed or terse, the host knows what it sent.
+        if (responseVerbosity() == VERBOSITY_FULL && !protocolBinaryMode())
+        {
+            coreUartWriteByte(byte);
+        }
+        if (byte != '\r')
+        {
+            if (count < REPL_LINE_SIZE - 1)
+            {
+                line[count++] = byte;
+            }
+            else
+            {
+                overflowed = true;
+            }
+        }
+        else
         {
+            LATENCY_LINE_BEGIN();
             //printf("\n> ");
-            printf("\r\n");
-            line[count > 0 ? count - 1 : 0] = '\0';
-            if (!interpret(bc, line, count))
+            if (responseVerbosity() == VERBOSITY_FULL && !protocolBinaryMode())
+            {
+                printf("\r\n");
+            }
+            line[count] = '\0';
+            bool result = false;
+            if (overflowed)
+            {
+                printf("> Error: Line is too long (max %d characters), ignored.\r\n",
+                       REPL_LINE_SIZE - 1);
+            }
+            else
+            {
+                result = interpret(bc, line, count);
+                if (!result)
+                {
+                    printf("> Failed to execute line: \"%s\".\r\n", line);
+                }
+            }
+            if (protocolBinaryMode())
             {
-                printf("> Failed to execute line: \"%s\".\r\n", line);
+                const uint8_t status = result ? 1 : 0;
+                protocolSendFrame(FRAME_RESULT, &status, 1);
             }
+            else
+            {
+                responseLineResult(result);
+            }
+            LATENCY_LINE_END(line);
             clearLine(line, count);
             count = 0;
+            overflowed = false;
         }
     }
 }
@@ -117,6 +194,8 @@ static void repl(BoardController *bc)
  */
 int main(void)
 {
+    // Before anything else runs, so the stack's peak covers all of it.
+    MEM_STACK_PAINT_AT_BOOT();
     // Setup local bootloader offset
     loc_vector_setup();
     // Set up systick and timer
@@ -124,16 +203,41 @@ int main(void)
 
     // Setup reserved UART port 2.    
     coreUartSetup(115200);
+#ifndef UART_RX_IRQ
+    // The console owns its RX stream for good, mark it so nothing else takes it.
+    (void)claimDMAStream(DMA_CONSOLE_RX);
+#endif
     
     print_logo();
 
+    // Watched pins' edges queue here until "events" reads them or "events clear".
+    extiSetup();
     BoardController *board = initBoard();
+#ifndef SNAPSHOT_NO_BOOT_RESTORE
+    // Put back whatever was last "save"d, before the first line is read.
+    snapshotBoot(board);
+#endif
     //createDigitalPin(board, BUILTIN_LD2_PORT, BUILTIN_LD2_PIN, RCC_GPIOA, TYPE_GPIO_OUTPUT, GPIO_PUPD_NONE);
     
     while (1)
     {
-        // Sit in the repl.
-        repl(board);
+        // Sit in the repl, or pass bytes straight through while bridged.
+        if (bridgeActive())
+        {
+            bridgeService(board);
+        }
+        else
+        {
+            repl(board);
+        }
+        adcStreamService();
+        i2cService();
+        captureService();
+        BENCH_SERVICE(board);
+        schedulerService(board);
+        // Nothing left to do until an interrupt: console bytes, DMA blocks, an I2C batch finishing
+        // or the next tick.
+        coreSystemSleep(workPending);
     }
 
     deinitBoard(board);
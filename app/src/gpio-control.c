@@ -31,5 +31,6 @@ GPIOPinController createGPIOPin(uint32_t port, uint32_t pin,
                                .clock = clock,
                                .mode = mode,
                                .af_mode = af_mode,
-                               .pupd_resistor = pupd_resistor};
+                               .pupd_resistor = pupd_resistor,
+                               .exti_edges = 0};
 }
\ No newline at end of file
@@ -0,0 +1,807 @@
+/**
+ * @file i2c-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Contains all logic for low level I2C master control. A batch of transactions is queued,
+ * then run start to finish from the event and error interrupts without the main loop. Once the
+ * last one is done, i2cService() sends the whole batch back as one reply.
+ * @version 0.1
+ * @date 2025-03-29
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "i2c-control.h"
+#include "libopencm3/cm3/cortex.h"
+#include "libopencm3/cm3/nvic.h"
+#include <string.h>
+
+#include "core/system.h"
+#include "protocol.h"
+#include "response.h"
+
+#define I2C_PORT_COUNT (3)
+
+/**
+ * @brief One transaction of a batch: an optional write, then an optional read after a repeated
+ * start. With neither it just checks that the address is acknowledged.
+ * @param address 7 bit address
+ * @param write_offset first byte in write_bytes
+ * @param write_length bytes to write
+ * @param read_offset first byte in read_bytes
+ * @param read_length bytes to read
+ * @param status how it ended, written by the ISRs
+ */
+typedef struct I2CTransaction {
+    uint8_t            address;
+    uint8_t            write_offset;
+    uint8_t            write_length;
+    uint8_t            read_offset;
+    uint8_t            read_length;
+    volatile I2CStatus status;
+} I2CTransaction;
+
+/**
+ * @brief Where a bus's batch is up to.
+ *
+ */
+typedef enum I2CBatchState
+{
+    I2C_BATCH_IDLE,    // nothing queued, a new batch can be started
+    I2C_BATCH_RUNNING, // owned by the ISRs
+    I2C_BATCH_DONE,    // finished, waiting for i2cService() to reply
+} I2CBatchState;
+
+/**
+ * @brief Batch and bookkeeping for one I2C. One per peripheral so each bus runs on its own.
+ * @param handle i2c handle this state belongs to
+ * @param ev_irq event interrupt
+ * @param er_irq error interrupt
+ * @param speed_khz bus speed, kept for a reset after a timeout
+ * @param transactions queued batch
+ * @param count transactions queued
+ * @param write_bytes bytes the batch writes, copied as the chunk may run again before it is done
+ * @param write_used bytes of write_bytes queued
+ * @param read_bytes bytes the batch has read
+ * @param read_used bytes of read_bytes queued
+ * @param current transaction running
+ * @param reading in the read half of the current transaction
+ * @param addressed the current half's address has been acknowledged
+ * @param position bytes of the current half done
+ * @param scanning the batch is a scan, transactions[0] is moved along the addresses
+ * @param found addresses acknowledged by a scan, one bit each
+ * @param batch where the batch is up to
+ * @param started ticks the batch started at
+ */
+typedef struct I2CPortState {
+    uint32_t               handle;
+    uint8_t                ev_irq;
+    uint8_t                er_irq;
+    uint16_t               speed_khz;
+    I2CTransaction         transactions[I2C_MAX_TRANSACTIONS];
+    uint8_t                count;
+    uint8_t                write_bytes[I2C_MAX_WRITE];
+    uint8_t                write_used;
+    uint8_t                read_bytes[I2C_MAX_READ];
+    uint8_t                read_used;
+    uint8_t                current;
+    bool                   reading;
+    bool                   addressed;
+    uint8_t                position;
+    bool                   scanning;
+    uint32_t               found[4];
+    volatile I2CBatchState batch;
+    uint64_t               started;
+} I2CPortState;
+
+static I2CPortState i2c_ports[I2C_PORT_COUNT] = {
+    {.handle = I2C1, .ev_irq = NVIC_I2C1_EV_IRQ, .er_irq = NVIC_I2C1_ER_IRQ},
+    {.handle = I2C2, .ev_irq = NVIC_I2C2_EV_IRQ, .er_irq = NVIC_I2C2_ER_IRQ},
+    {.handle = I2C3, .ev_irq = NVIC_I2C3_EV_IRQ, .er_irq = NVIC_I2C3_ER_IRQ},
+};
+
+/**
+ * @brief Returns the state for an I2C handle.
+ *
+ * @param handle i2c handle
+ * @return I2CPortState* state, NULL if the handle isn't an I2C.
+ */
+static I2CPortState *getI2CPortState(uint32_t handle)
+{
+    for (size_t i = 0; i < I2C_PORT_COUNT; i++)
+    {
+        if (i2c_ports[i].handle == handle)
+        {
+            return &i2c_ports[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create an I2C master controller.
+ *
+ * @param handle I2C handle (I2C1-I2C3)
+ * @param i2c_clock RCC clock of the I2C
+ * @param speed_khz bus speed, I2C_STANDARD_KHZ or I2C_FAST_KHZ
+ * @param scl clock pin, alternate function open drain
+ * @param sda data pin, alternate function open drain
+ * @return I2CController
+ */
+I2CController createI2CPeripheral(uint32_t handle, enum rcc_periph_clken i2c_clock,
+                                  uint16_t speed_khz, GPIOPinController scl,
+                                  GPIOPinController sda)
+{
+    I2CController i2c;
+    i2c.handle = handle;
+    i2c.i2c_clock = i2c_clock;
+    i2c.speed_khz = speed_khz;
+    i2c.SCL = scl;
+    i2c.SDA = sda;
+    return i2c;
+}
+
+/**
+ * @brief Resets the I2C and sets its timing from the APB1 clock it is on now.
+ *
+ * @param state port to configure
+ */
+static void i2cConfigure(const I2CPortState *state)
+{
+    // The software reset clears a bus the peripheral still thinks is busy; CCR needs PE low.
+    I2C_CR1(state->handle) = I2C_CR1_SWRST;
+    I2C_CR1(state->handle) = 0;
+    i2c_set_speed(state->handle,
+                  state->speed_khz == I2C_FAST_KHZ ? i2c_speed_fm_400k : i2c_speed_sm_100k,
+                  rcc_apb1_frequency / 1000000);
+    i2c_peripheral_enable(state->handle);
+}
+
+/**
+ * @brief Stops the ISRs working on a batch and forgets it.
+ *
+ * @param state port to abort
+ */
+static void i2cAbort(I2CPortState *state)
+{
+    i2c_disable_interrupt(state->handle, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    state->batch = I2C_BATCH_IDLE;
+}
+
+/**
+ * @brief Sets up and enables a master. Anything still running on the bus is abandoned, this is
+ * also how a clock change retimes it.
+ *
+ * @param i2c I2C to set up, pins already in their alternate function
+ */
+void currentI2CSetup(I2CController *i2c)
+{
+    I2CPortState *state = getI2CPortState(i2c->handle);
+    if (state == NULL)
+    {
+        return;
+    }
+    i2cAbort(state);
+    state->speed_khz = i2c->speed_khz;
+    i2cConfigure(state);
+    nvic_enable_irq(state->ev_irq);
+    nvic_enable_irq(state->er_irq);
+}
+
+/**
+ * @brief Abandons any batch and disables the I2C.
+ *
+ * @param i2c I2C to stop
+ */
+void currentI2CStop(I2CController *i2c)
+{
+    I2CPortState *state = getI2CPortState(i2c->handle);
+    if (state == NULL)
+    {
+        return;
+    }
+    i2cAbort(state);
+    nvic_disable_irq(state->ev_irq);
+    nvic_disable_irq(state->er_irq);
+    i2c_peripheral_disable(i2c->handle);
+}
+
+/**
+ * @brief Generates the start for the current transaction.
+ *
+ * @param state port running a batch
+ */
+static void transactionStart(I2CPortState *state)
+{
+    const I2CTransaction *transaction = &state->transactions[state->current];
+    state->reading = transaction->write_length == 0 && transaction->read_length > 0;
+    state->addressed = false;
+    state->position = 0;
+    // A stop only just asked for is still on the bus, a start now would be lost. A bit time.
+    while (I2C_CR1(state->handle) & I2C_CR1_STOP)
+    {
+    }
+    I2C_CR1(state->handle) &= ~I2C_CR1_POS;
+    I2C_CR1(state->handle) |= I2C_CR1_START;
+}
+
+/**
+ * @brief Records how the current transaction ended and starts the next, or ends the batch. A
+ * scan instead moves on to the next address.
+ *
+ * @param state port running a batch
+ * @param status how the transaction ended
+ */
+static void transactionDone(I2CPortState *state, I2CStatus status)
+{
+    I2CTransaction *transaction = &state->transactions[state->current];
+    if (state->scanning)
+    {
+        if (status == I2C_STATUS_ACK)
+        {
+            state->found[transaction->address >> 5] |= 1UL << (transaction->address & 0x1F);
+        }
+        if (transaction->address < I2C_SCAN_LAST)
+        {
+            transaction->address++;
+            transactionStart(state);
+            return;
+        }
+    }
+    else
+    {
+        transaction->status = status;
+        if (++state->current < state->count)
+        {
+            transactionStart(state);
+            return;
+        }
+    }
+    i2c_disable_interrupt(state->handle, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    state->batch = I2C_BATCH_DONE;
+}
+
+/**
+ * @brief Handles an acknowledged address. Reads are set up here: the last byte has to be NACKed,
+ * so for 1 and 2 bytes ACK and STOP are set before ADDR is cleared, RM0383 18.3.3.
+ *
+ * @param state port running a batch
+ * @param transaction current transaction
+ */
+static void i2cAddressed(I2CPortState *state, const I2CTransaction *transaction)
+{
+    uint32_t handle = state->handle;
+    state->addressed = true;
+    if (!state->reading)
+    {
+        (void)I2C_SR2(handle);
+        if (transaction->write_length == 0)
+        {
+            // Address only, a scan probe.
+            I2C_CR1(handle) |= I2C_CR1_STOP;
+            transactionDone(state, I2C_STATUS_ACK);
+            return;
+        }
+        i2c_enable_interrupt(handle, I2C_CR2_ITBUFEN);
+        return;
+    }
+
+    switch (transaction->read_length)
+    {
+    case 1:
+        I2C_CR1(handle) &= ~I2C_CR1_ACK;
+        (void)I2C_SR2(handle);
+        I2C_CR1(handle) |= I2C_CR1_STOP;
+        i2c_enable_interrupt(handle, I2C_CR2_ITBUFEN);
+        break;
+    case 2:
+        // NACK goes on the byte after the one being received, both are read on BTF.
+        I2C_CR1(handle) |= I2C_CR1_POS;
+        I2C_CR1(handle) &= ~I2C_CR1_ACK;
+        (void)I2C_SR2(handle);
+        i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+        break;
+    default:
+        I2C_CR1(handle) |= I2C_CR1_ACK;
+        (void)I2C_SR2(handle);
+        if (transaction->read_length == 3)
+        {
+            i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+        }
+        else
+        {
+            i2c_enable_interrupt(handle, I2C_CR2_ITBUFEN);
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Moves the write half of a transaction along, then repeats the start for the read half
+ * or stops.
+ *
+ * @param state port running a batch
+ * @param transaction current transaction
+ * @param sr1 status flags
+ */
+static void i2cWriteEvent(I2CPortState *state, const I2CTransaction *transaction, uint32_t sr1)
+{
+    uint32_t handle = state->handle;
+    if (state->position < transaction->write_length)
+    {
+        if (sr1 & I2C_SR1_TxE)
+        {
+            I2C_DR(handle) = state->write_bytes[transaction->write_offset + state->position++];
+            if (state->position == transaction->write_length)
+            {
+                i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+            }
+        }
+        return;
+    }
+    if (!(sr1 & I2C_SR1_BTF))
+    {
+        return;
+    }
+
+    if (transaction->read_length > 0)
+    {
+        state->reading = true;
+        state->addressed = false;
+        state->position = 0;
+        I2C_CR1(handle) |= I2C_CR1_START;
+        return;
+    }
+    I2C_CR1(handle) |= I2C_CR1_STOP;
+    transactionDone(state, I2C_STATUS_ACK);
+}
+
+/**
+ * @brief Moves the read half of a transaction along. Bytes are read on RXNE until three are
+ * left, the rest on BTF so ACK and STOP land on the right bytes, RM0383 18.3.3.
+ *
+ * @param state port running a batch
+ * @param transaction current transaction
+ * @param sr1 status flags
+ */
+static void i2cReadEvent(I2CPortState *state, const I2CTransaction *transaction, uint32_t sr1)
+{
+    uint32_t handle = state->handle;
+    uint8_t *bytes = &state->read_bytes[transaction->read_offset];
+    uint8_t  remaining = (uint8_t)(transaction->read_length - state->position);
+    if (remaining > 3)
+    {
+        if (sr1 & I2C_SR1_RxNE)
+        {
+            bytes[state->position++] = (uint8_t)I2C_DR(handle);
+            if (remaining == 4)
+            {
+                i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+            }
+        }
+        return;
+    }
+    if (remaining == 1)
+    {
+        if (sr1 & I2C_SR1_RxNE)
+        {
+            bytes[state->position++] = (uint8_t)I2C_DR(handle);
+            transactionDone(state, I2C_STATUS_ACK);
+        }
+        return;
+    }
+    if (!(sr1 & I2C_SR1_BTF))
+    {
+        return;
+    }
+
+    if (remaining == 3)
+    {
+        I2C_CR1(handle) &= ~I2C_CR1_ACK;
+        bytes[state->position++] = (uint8_t)I2C_DR(handle);
+        return;
+    }
+    I2C_CR1(handle) |= I2C_CR1_STOP;
+    bytes[state->position++] = (uint8_t)I2C_DR(handle);
+    bytes[state->position++] = (uint8_t)I2C_DR(handle);
+    I2C_CR1(handle) &= ~I2C_CR1_POS;
+    transactionDone(state, I2C_STATUS_ACK);
+}
+
+/**
+ * @brief Event interrupt, one step of the current transaction.
+ *
+ * @param state port the interrupt belongs to
+ */
+static void i2c_ev_isr(I2CPortState *state)
+{
+    uint32_t sr1 = I2C_SR1(state->handle);
+    if (state->batch != I2C_BATCH_RUNNING)
+    {
+        i2c_disable_interrupt(state->handle, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+        return;
+    }
+
+    const I2CTransaction *transaction = &state->transactions[state->current];
+    if (sr1 & I2C_SR1_SB)
+    {
+        I2C_DR(state->handle) = (uint32_t)(transaction->address << 1) | (state->reading ? 1 : 0);
+        return;
+    }
+    if (sr1 & I2C_SR1_ADDR)
+    {
+        i2cAddressed(state, transaction);
+        return;
+    }
+    if (!state->addressed)
+    {
+        // BTF from the write half lingers until the repeated start is on the bus.
+        return;
+    }
+    if (state->reading)
+    {
+        i2cReadEvent(state, transaction, sr1);
+    }
+    else
+    {
+        i2cWriteEvent(state, transaction, sr1);
+    }
+}
+
+/**
+ * @brief Error interrupt. A NACK ends the transaction and the batch carries on, a bus error or
+ * lost arbitration ends it as an error.
+ *
+ * @param state port the interrupt belongs to
+ */
+static void i2c_er_isr(I2CPortState *state)
+{
+    uint32_t handle = state->handle;
+    uint32_t sr1 = I2C_SR1(handle);
+    I2C_SR1(handle) = sr1 & ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR |
+                              I2C_SR1_TIMEOUT);
+    if (state->batch != I2C_BATCH_RUNNING)
+    {
+        return;
+    }
+
+    if (sr1 & I2C_SR1_AF)
+    {
+        I2C_CR1(handle) |= I2C_CR1_STOP;
+        i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+        transactionDone(state, I2C_STATUS_NACK);
+    }
+    else if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO))
+    {
+        // Lost arbitration leaves master mode by itself, a misplaced start or stop doesn't.
+        if (!(sr1 & I2C_SR1_ARLO))
+        {
+            I2C_CR1(handle) |= I2C_CR1_STOP;
+        }
+        i2c_disable_interrupt(handle, I2C_CR2_ITBUFEN);
+        transactionDone(state, I2C_STATUS_ERROR);
+    }
+}
+
+void i2c1_ev_isr(void) { i2c_ev_isr(&i2c_ports[0]); }
+void i2c1_er_isr(void) { i2c_er_isr(&i2c_ports[0]); }
+void i2c2_ev_isr(void) { i2c_ev_isr(&i2c_ports[1]); }
+void i2c2_er_isr(void) { i2c_er_isr(&i2c_ports[1]); }
+void i2c3_ev_isr(void) { i2c_ev_isr(&i2c_ports[2]); }
+void i2c3_er_isr(void) { i2c_er_isr(&i2c_ports[2]); }
+
+/**
+ * @brief Writes a byte as two hex digits.
+ *
+ * @param out destination, at least 2 bytes
+ * @param value byte
+ * @return size_t characters written
+ */
+static size_t formatHex(char *out, uint8_t value)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    out[0] = digits[value >> 4];
+    out[1] = digits[value & 0xF];
+    return 2;
+}
+
+/**
+ * @brief Sends back everything a scan found, as hex addresses 16 to a line.
+ *
+ * @param state port that finished a scan
+ */
+static void replyScan(const I2CPortState *state)
+{
+    int     number = currentI2CNumber(state->handle);
+    uint8_t found[1 + I2C_SCAN_LAST - I2C_SCAN_FIRST + 1];
+    size_t  count = 0;
+    for (uint8_t address = I2C_SCAN_FIRST; address <= I2C_SCAN_LAST; address++)
+    {
+        if (state->found[address >> 5] & (1UL << (address & 0x1F)))
+        {
+            found[1 + count++] = address;
+        }
+    }
+    if (protocolBinaryMode())
+    {
+        found[0] = (uint8_t)number;
+        protocolSendFrame(FRAME_I2C_SCAN, found, (uint16_t)(count + 1));
+        return;
+    }
+
+    size_t start = 0;
+    do
+    {
+        char   row[16 * 3];
+        size_t length = 0;
+        for (size_t i = start; i < count && i < start + 16; i++)
+        {
+            length += formatHex(&row[length], found[1 + i]);
+            row[length++] = ' ';
+        }
+        responseBegin();
+        if (responseVerbosity() == VERBOSITY_FULL)
+        {
+            char name[] = "> I2Cn scan: ";
+            name[5] = (char)('0' + number);
+            responseString(name);
+        }
+        if (length == 0)
+        {
+            responseString("none");
+        }
+        else
+        {
+            responseChars(row, length - 1);
+        }
+        responseEnd();
+        start += 16;
+    } while (start < count);
+}
+
+/**
+ * @brief Sends back a finished batch on one line: each write as ack or nack, each read as its
+ * bytes in hex, or why it has none.
+ *
+ * @param state port that finished a batch
+ */
+static void replyBatch(const I2CPortState *state)
+{
+    static const char *const status_names[] = {
+        [I2C_STATUS_PENDING] = "timeout", [I2C_STATUS_ACK] = "ack",
+        [I2C_STATUS_NACK] = "nack",       [I2C_STATUS_ERROR] = "error",
+        [I2C_STATUS_TIMEOUT] = "timeout",
+    };
+    int number = currentI2CNumber(state->handle);
+    if (protocolBinaryMode())
+    {
+        // number, then {status, count, bytes} for each transaction.
+        uint8_t payload[1 + I2C_MAX_TRANSACTIONS * 2 + I2C_MAX_READ];
+        size_t  length = 0;
+        payload[length++] = (uint8_t)number;
+        for (uint8_t i = 0; i < state->count; i++)
+        {
+            const I2CTransaction *transaction = &state->transactions[i];
+            uint8_t count = transaction->status == I2C_STATUS_ACK ? transaction->read_length : 0;
+            payload[length++] = (uint8_t)transaction->status;
+            payload[length++] = count;
+            memcpy(&payload[length], &state->read_bytes[transaction->read_offset], count);
+            length += count;
+        }
+        protocolSendFrame(FRAME_I2C_DATA, payload, (uint16_t)length);
+        return;
+    }
+
+    responseBegin();
+    if (responseVerbosity() == VERBOSITY_FULL)
+    {
+        char name[] = "> I2Cn: ";
+        name[5] = (char)('0' + number);
+        responseString(name);
+    }
+    for (uint8_t i = 0; i < state->count; i++)
+    {
+        const I2CTransaction *transaction = &state->transactions[i];
+        if (i != 0)
+        {
+            responseChars(" ", 1);
+        }
+        if (transaction->status != I2C_STATUS_ACK || transaction->read_length == 0)
+        {
+            responseString(status_names[transaction->status]);
+            continue;
+        }
+        char   hex[I2C_MAX_READ * 2];
+        size_t length = 0;
+        for (uint8_t byte = 0; byte < transaction->read_length; byte++)
+        {
+            length += formatHex(&hex[length],
+                                state->read_bytes[transaction->read_offset + byte]);
+        }
+        responseChars(hex, length);
+    }
+    responseEnd();
+}
+
+/**
+ * @brief Sends back a finished batch or scan and frees the bus for the next one.
+ *
+ * @param state port with a finished batch
+ */
+static void i2cReply(I2CPortState *state)
+{
+    if (state->scanning)
+    {
+        replyScan(state);
+    }
+    else
+    {
+        replyBatch(state);
+    }
+    state->batch = I2C_BATCH_IDLE;
+}
+
+/**
+ * @brief Starts queuing a new batch. A finished batch that hasn't been sent back yet is sent
+ * first, so back to back lines in a script don't have to wait for the main loop.
+ *
+ * @param i2c I2C to queue on
+ * @return true ready to queue
+ * @return false the last batch is still running
+ */
+bool currentI2CBegin(const I2CController *i2c)
+{
+    I2CPortState *state = getI2CPortState(i2c->handle);
+    if (state == NULL || state->batch == I2C_BATCH_RUNNING)
+    {
+        return false;
+    }
+    if (state->batch == I2C_BATCH_DONE)
+    {
+        i2cReply(state);
+    }
+    state->count = 0;
+    state->write_used = 0;
+    state->read_used = 0;
+    return true;
+}
+
+/**
+ * @brief Adds a transaction to the batch being queued.
+ *
+ * @param i2c I2C to queue on, after currentI2CBegin()
+ * @param address 7 bit address
+ * @param write bytes to write, copied
+ * @param write_length bytes to write, can be 0
+ * @param read_length bytes to read after a repeated start, can be 0
+ * @return true queued
+ * @return false the batch is full
+ */
+bool currentI2CQueue(const I2CController *i2c, uint8_t address, const uint8_t *write,
+                     uint8_t write_length, uint8_t read_length)
+{
+    I2CPortState *state = getI2CPortState(i2c->handle);
+    if (state == NULL || state->batch != I2C_BATCH_IDLE || state->count >= I2C_MAX_TRANSACTIONS ||
+        state->write_used + write_length > I2C_MAX_WRITE ||
+        state->read_used + read_length > I2C_MAX_READ)
+    {
+        return false;
+    }
+
+    I2CTransaction *transaction = &state->transactions[state->count++];
+    transaction->address = address;
+    transaction->write_offset = state->write_used;
+    transaction->write_length = write_length;
+    transaction->read_offset = state->read_used;
+    transaction->read_length = read_length;
+    transaction->status = I2C_STATUS_PENDING;
+    memcpy(&state->write_bytes[state->write_used], write, write_length);
+    state->write_used = (uint8_t)(state->write_used + write_length);
+    state->read_used = (uint8_t)(state->read_used + read_length);
+    return true;
+}
+
+/**
+ * @brief Hands the queued batch to the ISRs and returns straight away. A scan replaces the
+ * batch with an address only probe of every address.
+ *
+ * @param i2c I2C to run on, after currentI2CBegin()
+ * @param scan probe the bus instead of running the queued transactions
+ */
+void currentI2CStart(const I2CController *i2c, bool scan)
+{
+    I2CPortState *state = getI2CPortState(i2c->handle);
+    if (state == NULL || state->batch != I2C_BATCH_IDLE)
+    {
+        return;
+    }
+    state->scanning = scan;
+    if (scan)
+    {
+        memset(state->found, 0, sizeof(state->found));
+        state->count = 0;
+        (void)currentI2CQueue(i2c, I2C_SCAN_FIRST, NULL, 0, 0);
+    }
+    if (state->count == 0)
+    {
+        return;
+    }
+
+    state->current = 0;
+    state->started = coreGetTicks();
+    state->batch = I2C_BATCH_RUNNING;
+    i2c_enable_interrupt(state->handle, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    uint32_t masked = cm_mask_interrupts(1);
+    transactionStart(state);
+    cm_mask_interrupts(masked);
+}
+
+/**
+ * @brief Returns the number an I2C is selected by.
+ *
+ * @param handle I2C handle
+ * @return int 1-3, 0 if not an I2C
+ */
+int currentI2CNumber(uint32_t handle)
+{
+    switch (handle)
+    {
+    case I2C1:
+        return 1;
+    case I2C2:
+        return 2;
+    case I2C3:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Tells the main loop's sleep that i2cService() has something to do. A batch that times
+ * out is found on a tick, which wakes the core anyway.
+ *
+ * @return true a batch has finished
+ */
+bool i2cPending(void)
+{
+    for (size_t i = 0; i < I2C_PORT_COUNT; i++)
+    {
+        if (i2c_ports[i].batch == I2C_BATCH_DONE)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Called from the main loop. Sends back finished batches, and abandons ones that have run
+ * too long: the bus is reset and whatever hadn't finished is reported as a timeout.
+ *
+ */
+void i2cService(void)
+{
+    uint64_t now = coreGetTicks();
+    for (size_t i = 0; i < I2C_PORT_COUNT; i++)
+    {
+        I2CPortState *state = &i2c_ports[i];
+        if (state->batch == I2C_BATCH_RUNNING && now - state->started >= I2C_BATCH_TIMEOUT_MS)
+        {
+            i2c_disable_interrupt(state->handle,
+                                  I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+            if (state->batch == I2C_BATCH_RUNNING)
+            {
+                for (uint8_t t = state->current; t < state->count && !state->scanning; t++)
+                {
+                    state->transactions[t].status = I2C_STATUS_TIMEOUT;
+                }
+                i2cConfigure(state);
+                state->batch = I2C_BATCH_DONE;
+            }
+        }
+        if (state->batch == I2C_BATCH_DONE)
+        {
+            i2cReply(state);
+        }
+    }
+}
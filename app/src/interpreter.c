@@ -10,7 +10,11 @@
  */
 #include "interpreter.h"
 #include "token.h"
+#include "keyword-hash.h"
 #include "debug.h"
+#include "latency-control.h"
+#include "script-control.h"
+#include "vm.h"
 
 /**
  * @brief Looks at the current character in a string.
@@ -121,18 +125,14 @@ static Token makeToken(Scanner *scanner, TokenType type)
 }
 
 /**
- * @brief Similar to isAlpha(), but only between the first and last letter that indicates a port.
- *        for example on the STM32F411RE the first port is A, the last port is C.
+ * @brief Similar to isAlpha(), but only the letters of the board's ports, either case. For
+ *        example on the STM32F411RE the first port is A, the last port is E.
  *
  * @param c character to check
  * @return true character is valid port identifier
  * @return false character is not valid port identifier
  */
-static bool isValidPortPinStartingChar(char c)
-{
-    return (c >= PORTa_STM32F411RE && c <= PORTe_STM32F411RE) ||
-           (c >= PORTA_STM32F411RE && c <= PORTE_STM32F411RE);
-}
+static bool isValidPortPinStartingChar(char c) { return BOARD_PORT_INDEX(c) < BOARD_PORT_COUNT; }
 
 /**
  * @brief Function to check whether an indeterminate string is a port-pin identifier (e.g., A10 or
@@ -166,113 +166,39 @@ static TokenType isValidPortPin(Scanner *scanner)
 }
 
 /**
- * @brief Checks whether the current token in scanner matches the provided "rest of string". For
- * example, if Scanner's current string starts with "i", and rest is given as "nput", if the rest of
- * Scanner's string is "input", this function returns the "input" token. If it does not match, it
- * returns the "identifier" token.
+ * @brief Matches the current string against the keyword table, then against a port/pin
+ * identifier. Constant time whatever the number of keywords: one slot is compared.
  *
  * @param scanner the scanner to check.
- * @param start From which character we are starting from (0 indexed)
- * @param length the length of the remaining string.
- * @param rest the rest of the string
- * @param type the type to be checked against.
- * @return TokenType
+ * @param hash KEYWORD_HASH_STEP() of every character of the string, from KEYWORD_HASH_SEED
+ * @return TokenType the matched token, TOKEN_ERROR if it's neither.
  */
-static TokenType checkKeyword(Scanner *scanner, int start, int length, const char *rest,
-                              TokenType type)
+static TokenType identifierType(Scanner *scanner, uint32_t hash)
 {
-    // Ensure that the provided "rest of string" is both the same length and matches the text.
-    if (scanner->current - scanner->start == start + length &&
-        memcmp(scanner->start + start, rest, length) == 0)
+    int            length = (int)(scanner->current - scanner->start);
+    const Keyword *keyword = &keyword_table[KEYWORD_HASH_SLOT(hash, KEYWORD_HASH_SIZE)];
+    if (keyword->length == length && memcmp(scanner->start, keyword->text, length) == 0)
     {
-        return type;
+        return keyword->type;
     }
 
-    return isValidPortPin(scanner);
+    // A port/pin is always three characters, e.g. A05.
+    return length == 3 ? isValidPortPin(scanner) : TOKEN_ERROR;
 }
 
 /**
- * @brief Checks what the current string starts with and matches that to a token.
- *
- * @param scanner scanner to be checked
- * @return TokenType the matched token
- */
-static TokenType identifierType(Scanner *scanner)
-{
-    // Switch on first character in string.
-    switch (scanner->start[0])
-    {
-    case 'a':
-        return checkKeyword(scanner, 1, 2, "dc", TOKEN_ADC);
-    case 'i':
-        return checkKeyword(scanner, 1, 4, "nput", TOKEN_GPIO_INPUT);
-    case 'n':
-        return checkKeyword(scanner, 1, 3, "one", TOKEN_GPIO_NORESISTOR);
-    case 'o':
-        return checkKeyword(scanner, 1, 5, "utput", TOKEN_GPIO_OUTPUT);
-    case 's':
-        return checkKeyword(scanner, 1, 2, "et", TOKEN_GPIO_SET);
-    case 'r':
-    { // This is all a bit silly but it keeps in theme with the rest of the code.
-        if (scanner->current - scanner->start > 1)
-        {
-            switch (scanner->start[1])
-            {
-            case 'e':
-            {
-                if (scanner->current - scanner->start > 2)
-                {
-                    switch (scanner->start[2])
-                    {
-                    case 'a':
-                        return checkKeyword(scanner, 3, 1, "d", TOKEN_GPIO_READ);
-                    case 's':
-                        return checkKeyword(scanner, 3, 2, "et", TOKEN_GPIO_RESET);
-                    }
-                }
-            }
-            }
-        }
-        break;
-    }
-    case 'p':
-    {
-        if (scanner->current - scanner->start > 1)
-        {
-            switch (scanner->start[1])
-            {
-            case 'u':
-                return checkKeyword(scanner, 2, 1, "p", TOKEN_GPIO_PULLUP);
-            case 'd':
-                return checkKeyword(scanner, 2, 3, "own", TOKEN_GPIO_PULLDOWN);
-            }
-        }
-        break;
-    }
-    case 't':
-        return checkKeyword(scanner, 1, 5, "oggle", TOKEN_GPIO_TOGGLE);
-    case 'u':
-        return checkKeyword(scanner,  1, 3, "art", TOKEN_UART);
-    case 'w':
-        return checkKeyword(scanner, 1, 4, "rite", TOKEN_WRITE);
-    }
-
-
-    return isValidPortPin(scanner);
-}
-
-/**
- * @brief Advances through current string until it encounters something that isn't a token.
- * Then analyses that string and returns the matching token.
+ * @brief Advances through current string until it encounters something that isn't a token,
+ * hashing it on the way. Then analyses that string and returns the matching token.
  *
  * @param scanner scanner to be checked
  * @return Token created token.
  */
 static Token identifier(Scanner *scanner)
 {
+    uint32_t hash = KEYWORD_HASH_STEP(KEYWORD_HASH_SEED, scanner->start[0]);
     while (isAlpha(peek(scanner)) || isDigit(peek(scanner)))
-        advance_scanner(scanner);
-    return makeToken(scanner, identifierType(scanner));
+        hash = KEYWORD_HASH_STEP(hash, advance_scanner(scanner));
+    return makeToken(scanner, identifierType(scanner, hash));
 }
 
 /**
@@ -387,6 +313,230 @@ static char *get_token_type_name(TokenType token)
     {
         return "TOKEN_WRITE";
     }
+    case TOKEN_STATS:
+    {
+        return "TOKEN_STATS";
+    }
+    case TOKEN_STREAM:
+    {
+        return "TOKEN_STREAM";
+    }
+    case TOKEN_STOP:
+    {
+        return "TOKEN_STOP";
+    }
+    case TOKEN_MODE:
+    {
+        return "TOKEN_MODE";
+    }
+    case TOKEN_BINARY:
+    {
+        return "TOKEN_BINARY";
+    }
+    case TOKEN_TEXT:
+    {
+        return "TOKEN_TEXT";
+    }
+    case TOKEN_PWM:
+    {
+        return "TOKEN_PWM";
+    }
+    case TOKEN_PATTERN:
+    {
+        return "TOKEN_PATTERN";
+    }
+    case TOKEN_RUN:
+    {
+        return "TOKEN_RUN";
+    }
+    case TOKEN_LOOP:
+    {
+        return "TOKEN_LOOP";
+    }
+    case TOKEN_CLEAR:
+    {
+        return "TOKEN_CLEAR";
+    }
+    case TOKEN_EVERY:
+    {
+        return "TOKEN_EVERY";
+    }
+    case TOKEN_AFTER:
+    {
+        return "TOKEN_AFTER";
+    }
+    case TOKEN_TASKS:
+    {
+        return "TOKEN_TASKS";
+    }
+    case TOKEN_LIST:
+    {
+        return "TOKEN_LIST";
+    }
+    case TOKEN_KILL:
+    {
+        return "TOKEN_KILL";
+    }
+    case TOKEN_IDLE:
+    {
+        return "TOKEN_IDLE";
+    }
+    case TOKEN_WATCH:
+    {
+        return "TOKEN_WATCH";
+    }
+    case TOKEN_EVENTS:
+    {
+        return "TOKEN_EVENTS";
+    }
+    case TOKEN_RISING:
+    {
+        return "TOKEN_RISING";
+    }
+    case TOKEN_FALLING:
+    {
+        return "TOKEN_FALLING";
+    }
+    case TOKEN_BOTH:
+    {
+        return "TOKEN_BOTH";
+    }
+    case TOKEN_MEASURE:
+    {
+        return "TOKEN_MEASURE";
+    }
+    case TOKEN_DEF:
+    {
+        return "TOKEN_DEF";
+    }
+    case TOKEN_END:
+    {
+        return "TOKEN_END";
+    }
+    case TOKEN_DEL:
+    {
+        return "TOKEN_DEL";
+    }
+    case TOKEN_IDENTIFIER:
+    {
+        return "TOKEN_IDENTIFIER";
+    }
+    case TOKEN_SEMICOLON:
+    {
+        return "TOKEN_SEMICOLON";
+    }
+    case TOKEN_FLOW:
+    {
+        return "TOKEN_FLOW";
+    }
+    case TOKEN_XONXOFF:
+    {
+        return "TOKEN_XONXOFF";
+    }
+    case TOKEN_RTSCTS:
+    {
+        return "TOKEN_RTSCTS";
+    }
+    case TOKEN_VERBOSITY:
+    {
+        return "TOKEN_VERBOSITY";
+    }
+    case TOKEN_FULL:
+    {
+        return "TOKEN_FULL";
+    }
+    case TOKEN_TERSE:
+    {
+        return "TOKEN_TERSE";
+    }
+    case TOKEN_SILENT:
+    {
+        return "TOKEN_SILENT";
+    }
+    case TOKEN_UPDATE:
+    {
+        return "TOKEN_UPDATE";
+    }
+    case TOKEN_SAVE:
+    {
+        return "TOKEN_SAVE";
+    }
+    case TOKEN_RESTORE:
+    {
+        return "TOKEN_RESTORE";
+    }
+    case TOKEN_CLOCK:
+    {
+        return "TOKEN_CLOCK";
+    }
+    case TOKEN_CLOCKS:
+    {
+        return "TOKEN_CLOCKS";
+    }
+    case TOKEN_AVERAGE:
+    {
+        return "TOKEN_AVERAGE";
+    }
+    case TOKEN_BITS:
+    {
+        return "TOKEN_BITS";
+    }
+    case TOKEN_SAMPLE:
+    {
+        return "TOKEN_SAMPLE";
+    }
+    case TOKEN_BRIDGE:
+    {
+        return "TOKEN_BRIDGE";
+    }
+    case TOKEN_SPI:
+    {
+        return "TOKEN_SPI";
+    }
+    case TOKEN_XFER:
+    {
+        return "TOKEN_XFER";
+    }
+    case TOKEN_I2C:
+    {
+        return "TOKEN_I2C";
+    }
+    case TOKEN_SCAN:
+    {
+        return "TOKEN_SCAN";
+    }
+    case TOKEN_CAPTURE:
+    {
+        return "TOKEN_CAPTURE";
+    }
+    case TOKEN_TRIGGER:
+    {
+        return "TOKEN_TRIGGER";
+    }
+    case TOKEN_MEM:
+    {
+        return "TOKEN_MEM";
+    }
+    case TOKEN_REPEAT:
+    {
+        return "TOKEN_REPEAT";
+    }
+    case TOKEN_DELAY:
+    {
+        return "TOKEN_DELAY";
+    }
+    case TOKEN_US:
+    {
+        return "TOKEN_US";
+    }
+    case TOKEN_MS:
+    {
+        return "TOKEN_MS";
+    }
+    case TOKEN_BENCH:
+    {
+        return "TOKEN_BENCH";
+    }
     }
     return "UNKNOWN_TOKEN";
 }
@@ -412,15 +562,14 @@ static void print_token(Token token)
 }
 
 /**
- * @brief Interprets a given line.
+ * @brief Scans a line and compiles it into a chunk.
  *
- * @param bc the board controller struct.
- * @param source the line to be interpetered.
- * @param length length of the line, unused.
- * @return true successful interpretation
- * @return false unsuccessful interpretation.
+ * @param source the line to be compiled.
+ * @param chunk chunk to compile into.
+ * @return true successful compilation
+ * @return false unsuccessful compilation.
  */
-bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
+bool compileLine(const char *source, Chunk *chunk)
 {
     // initialise scanner obj
     Scanner scanner;
@@ -428,6 +577,10 @@ bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
 
     // Initialise token vector
     TokenVector *tokvec = initTokenVector();
+    if (tokvec == NULL)
+    {
+        return false;
+    }
 
     while (true)
     {
@@ -437,7 +590,13 @@ bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
         if (is_at_end(&scanner)) // When finished...
         {
             // Debugging stuff.
-            appendTokenVector(tokvec, makeToken(&scanner, TOKEN_EOL));
+            if (!appendTokenVector(tokvec, makeToken(&scanner, TOKEN_EOL)))
+            {
+                printf("> Parse Error: Too many tokens in line (max %d).\r\n",
+                       LINE_MAX_TOKENS - 1);
+                deinitTokenVector(tokvec);
+                return false;
+            }
             break;
         }
 
@@ -448,6 +607,18 @@ bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
         if (isAlpha(c)) // If its a letter start checking
         {
             token = identifier(&scanner);
+            // Any other word is a script name straight after def, run or del, or a port straight
+            // after capture. Anywhere else it stays an error, so typos are still caught.
+            size_t used = sizeTokenVector(tokvec);
+            if (token.type == TOKEN_ERROR && used > 0)
+            {
+                TokenType previous = getTokenVector(tokvec, used - 1).type;
+                if (previous == TOKEN_DEF || previous == TOKEN_RUN || previous == TOKEN_DEL ||
+                    previous == TOKEN_CAPTURE)
+                {
+                    token.type = TOKEN_IDENTIFIER;
+                }
+            }
         }
         else if (isDigit(c)) // If it's a number parse it as an int.
         {
@@ -457,12 +628,21 @@ bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
         {
             token = string(&scanner);
         }
+        else if (c == ';') // Statement separator, the parser splits the line on these.
+        {
+            token = makeToken(&scanner, TOKEN_SEMICOLON);
+        }
         else
         {
             token = makeToken(&scanner, TOKEN_ERROR); // Otherwise stop
         }
 
-        appendTokenVector(tokvec, token);
+        if (!appendTokenVector(tokvec, token))
+        {
+            printf("> Parse Error: Too many tokens in line (max %d).\r\n", LINE_MAX_TOKENS - 1);
+            deinitTokenVector(tokvec);
+            return false;
+        }
 
         if (token.type == TOKEN_ERROR)
         {
@@ -480,8 +660,91 @@ bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
         print_token(getTokenVector(tokvec, i));
     }
 #endif
-    // Check interpretation and parsing.
-    bool return_value = parseTokensAndExecute(bc, tokvec);
+    LATENCY_MARK(LATENCY_SCAN);
+    // Check parsing.
+    bool return_value = compileTokens(tokvec, chunk);
     deinitTokenVector(tokvec);
+    LATENCY_MARK(LATENCY_PARSE);
     return return_value;
 }
+
+/**
+ * @brief FNV-1a hash of a line, used to pick its cache slot.
+ *
+ * @param source line to hash
+ * @return uint32_t hash
+ */
+static uint32_t hashLine(const char *source)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = source; *c != '\0'; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Interprets a given line. Lines are compiled once and kept in a small direct mapped
+ * cache, so repeating a line skips scanning and parsing entirely. While a script is being
+ * defined the compiled line is recorded instead of run.
+ *
+ * @param bc the board controller struct.
+ * @param source the line to be interpetered.
+ * @param length length of the line, unused.
+ * @return true successful interpretation
+ * @return false unsuccessful interpretation.
+ */
+bool interpret(BoardController *bc, char *source, size_t /*unused*/ length)
+{
+    static LineCacheEntry line_cache[LINE_CACHE_SIZE];
+    static Chunk          scratch;
+
+    // Nothing from the previous line is still in use.
+    resetLineArena();
+
+    LineCacheEntry *entry = &line_cache[hashLine(source) % LINE_CACHE_SIZE];
+    size_t          source_length = strlen(source);
+    Chunk          *chunk;
+
+    if (entry->valid && strcmp(entry->text, source) == 0)
+    {
+        // Cache hit, run the already compiled line.
+        chunk = &entry->chunk;
+        LATENCY_MARK(LATENCY_SCAN);
+    }
+    else if (source_length < LINE_CACHE_TEXT_SIZE)
+    {
+        entry->valid = false;
+        if (!compileLine(source, &entry->chunk))
+        {
+            return false;
+        }
+        memcpy(entry->text, source, source_length + 1);
+        entry->valid = true;
+        chunk = &entry->chunk;
+    }
+    else
+    {
+        // Too long to cache, compile into the scratch chunk.
+        if (!compileLine(source, &scratch))
+        {
+            return false;
+        }
+        chunk = &scratch;
+    }
+
+    bool result;
+    if (scriptRecording() && chunk->count > 0 && chunk->code[0].op != OP_SCRIPT_END)
+    {
+        // Between "def" and "end" lines are kept for the script, not run.
+        result = scriptRecord(chunk);
+    }
+    else
+    {
+        result = runChunk(bc, chunk);
+    }
+    LATENCY_MARK(LATENCY_ACTION);
+    return result;
+}
@@ -0,0 +1,247 @@
+/**
+ * @file latency-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Times each phase of a console line with the DWT cycle counter and keeps min/mean/max and
+ * a histogram per command keyword, for "stats".
+ * @version 0.1
+ * @date 2025-03-19
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "latency-control.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LATENCY_STATS
+#include "libopencm3/cm3/dwt.h"
+
+#include "core/system.h"
+#include "core/uart.h"
+#include "keyword-hash.h"
+
+// Room for the longest keyword in KEYWORD_LIST, so it follows the list.
+#define LATENCY_KEYWORD_SIZE (KEYWORD_HASH_LONGEST + 1)
+
+/**
+ * @brief Latency record of one command keyword.
+ * @param keyword first word of the line
+ * @param lines lines recorded
+ * @param phases spread of each phase
+ * @param histogram lines per total time bucket
+ */
+typedef struct LatencyRecord
+{
+    char          keyword[LATENCY_KEYWORD_SIZE];
+    uint32_t      lines;
+    LatencySpread phases[LATENCY_PHASE_COUNT];
+    uint32_t      histogram[LATENCY_BUCKETS];
+} LatencyRecord;
+
+static LatencyRecord records[LATENCY_MAX_KEYWORDS];
+static size_t        records_count = 0;
+static uint32_t      lines_untracked = 0; // lines whose keyword didn't fit in the table
+
+// The line being timed. Phases only ever move forward, so a line compiled while another runs
+// (a scheduled task being added) doesn't reset the running line's phases.
+static bool     line_open = false;
+static int      line_phase = -1; // last phase marked
+static uint32_t line_start = 0;
+static uint32_t mark_cycles = 0;
+static uint64_t mark_writes = 0;
+static uint64_t line_writes = 0;
+static uint32_t line_phases[LATENCY_PHASE_COUNT];
+
+/**
+ * @brief Starts timing a line. Call as soon as its '\r' arrives.
+ *
+ */
+void latencyLineBegin(void)
+{
+    memset(line_phases, 0, sizeof(line_phases));
+    line_start = dwt_read_cycle_counter();
+    mark_cycles = line_start;
+    mark_writes = coreUartWriteCycles();
+    line_writes = mark_writes;
+    line_phase = -1;
+    line_open = true;
+}
+
+/**
+ * @brief Puts the time since the last mark, less any console output, down to a phase. Marks for
+ * a phase already passed are ignored.
+ *
+ * @param phase phase that has just finished
+ */
+void latencyMark(LatencyPhase phase)
+{
+    if (!line_open || (int)phase <= line_phase)
+    {
+        return;
+    }
+    uint32_t now = dwt_read_cycle_counter();
+    uint64_t writes = coreUartWriteCycles();
+    line_phases[phase] += (now - mark_cycles) - (uint32_t)(writes - mark_writes);
+    mark_cycles = now;
+    mark_writes = writes;
+    line_phase = (int)phase;
+}
+
+/**
+ * @brief Finds the record of a line's keyword, making one if there's room.
+ *
+ * @param line console line
+ * @return LatencyRecord* record, NULL for an empty line or a full table
+ */
+static LatencyRecord *findRecord(const char *line)
+{
+    char   keyword[LATENCY_KEYWORD_SIZE] = {0};
+    size_t length = 0;
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    while (length < LATENCY_KEYWORD_SIZE - 1 &&
+           ((line[length] >= 'a' && line[length] <= 'z') ||
+            (line[length] >= 'A' && line[length] <= 'Z')))
+    {
+        keyword[length] = line[length];
+        length++;
+    }
+    if (length == 0)
+    {
+        return NULL;
+    }
+
+    for (size_t record = 0; record < records_count; record++)
+    {
+        if (strcmp(records[record].keyword, keyword) == 0)
+        {
+            return &records[record];
+        }
+    }
+    if (records_count == LATENCY_MAX_KEYWORDS)
+    {
+        lines_untracked++;
+        return NULL;
+    }
+    LatencyRecord *record = &records[records_count++];
+    memset(record, 0, sizeof(*record));
+    memcpy(record->keyword, keyword, sizeof(keyword));
+    return record;
+}
+
+/**
+ * @brief Stops timing a line and adds it to its keyword's record. Anything since the last mark is
+ * the response going out.
+ *
+ * @param line console line, its first word is the keyword
+ */
+void latencyLineEnd(const char *line)
+{
+    if (!line_open)
+    {
+        return;
+    }
+    latencyMark(LATENCY_OUTPUT);
+    line_open = false;
+    uint32_t now = dwt_read_cycle_counter();
+    line_phases[LATENCY_OUTPUT] += (uint32_t)(coreUartWriteCycles() - line_writes);
+    line_phases[LATENCY_TOTAL] = now - line_start;
+
+    LatencyRecord *record = findRecord(line);
+    if (record == NULL)
+    {
+        return;
+    }
+    for (size_t phase = 0; phase < LATENCY_PHASE_COUNT; phase++)
+    {
+        LatencySpread *spread = &record->phases[phase];
+        uint32_t       cycles = line_phases[phase];
+        spread->min = (record->lines == 0 || cycles < spread->min) ? cycles : spread->min;
+        spread->max = cycles > spread->max ? cycles : spread->max;
+        spread->sum += cycles;
+    }
+    uint32_t us = line_phases[LATENCY_TOTAL] / (coreSystemCpuFrequency() / 1000000);
+    size_t   bucket = 0;
+    for (uint32_t limit = 4; bucket < LATENCY_BUCKETS - 1 && us >= limit; limit *= 4)
+    {
+        bucket++;
+    }
+    record->histogram[bucket]++;
+    record->lines++;
+}
+
+/**
+ * @brief Prints a cycle count in microseconds, to a tenth.
+ *
+ * @param cycles CPU cycles
+ */
+static void printMicroseconds(uint64_t cycles)
+{
+    uint32_t tenths = (uint32_t)((cycles * 10) / (coreSystemCpuFrequency() / 1000000));
+    printf("%lu.%lu", tenths / 10, tenths % 10);
+}
+
+/**
+ * @brief Prints the record of every keyword: min/mean/max of each phase in microseconds and the
+ * histogram of total times.
+ *
+ */
+void latencyPrint(void)
+{
+    static const char *const phase_names[LATENCY_PHASE_COUNT] = {"scan", "parse", "action",
+                                                                 "output", "total"};
+    if (records_count == 0)
+    {
+        printf("> No lines timed yet.\r\n");
+        return;
+    }
+    for (size_t index = 0; index < records_count; index++)
+    {
+        const LatencyRecord *record = &records[index];
+        printf("> STATS %s: %lu lines, min/mean/max us\r\n", record->keyword, record->lines);
+        for (size_t phase = 0; phase < LATENCY_PHASE_COUNT; phase++)
+        {
+            const LatencySpread *spread = &record->phases[phase];
+            printf(">   %-6s ", phase_names[phase]);
+            printMicroseconds(spread->min);
+            printf("/");
+            printMicroseconds(spread->sum / record->lines);
+            printf("/");
+            printMicroseconds(spread->max);
+            printf("\r\n");
+        }
+        printf(">   histogram");
+        uint32_t limit = 4;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++, limit *= 4)
+        {
+            if (bucket < LATENCY_BUCKETS - 1)
+            {
+                printf(" <%lu:%lu", limit, record->histogram[bucket]);
+            }
+            else
+            {
+                printf(" more:%lu", record->histogram[bucket]);
+            }
+        }
+        printf("\r\n");
+    }
+    if (lines_untracked > 0)
+    {
+        printf("> %lu lines not timed, keyword table full (%d keywords).\r\n", lines_untracked,
+               LATENCY_MAX_KEYWORDS);
+    }
+}
+
+/**
+ * @brief Forgets every record.
+ *
+ */
+void latencyReset(void)
+{
+    records_count = 0;
+    lines_untracked = 0;
+}
+#endif
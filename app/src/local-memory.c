@@ -9,24 +9,190 @@
  * 
  */
 #include "local-memory.h"
+#include <string.h>
+
+// Statically allocated arena for per-line state, reset at the start of every line.
+static uint8_t line_arena[LINE_ARENA_SIZE] __attribute__((aligned(LINE_ARENA_ALIGN)));
+static size_t  line_arena_used = 0;
+
+#ifdef MEM_STATS
+static MemHeapStats heap_stats;
+
+/**
+ * @brief Finds the record of a call site, making one if there's room.
+ *
+ * @param site "file:line" of the call
+ * @return MemSiteRecord* record, NULL for a full table
+ */
+static MemSiteRecord *findSite(const char *site)
+{
+    for (size_t index = 0; index < heap_stats.sites_count; index++)
+    {
+        // Identical literals aren't always merged, so compare the text too.
+        if (heap_stats.sites[index].site == site || strcmp(heap_stats.sites[index].site, site) == 0)
+        {
+            return &heap_stats.sites[index];
+        }
+    }
+    if (heap_stats.sites_count == MEM_MAX_SITES)
+    {
+        heap_stats.untracked++;
+        return NULL;
+    }
+    MemSiteRecord *record = &heap_stats.sites[heap_stats.sites_count++];
+    memset(record, 0, sizeof(*record));
+    record->site = site;
+    return record;
+}
+
+/**
+ * @brief Counts one reallocate() call against the totals and its call site.
+ *
+ * @param pointer block passed in
+ * @param oldSize size it had
+ * @param newSize size asked for
+ * @param site "file:line" of the call
+ * @param result block handed back
+ */
+static void countCall(void *pointer, size_t oldSize, size_t newSize, const char *site,
+                      void *result)
+{
+    MemSiteRecord *record = findSite(site);
+    if (newSize != 0 && result == NULL)
+    {
+        if (record != NULL)
+        {
+            record->failures++;
+        }
+        return;
+    }
+    if (pointer == NULL && newSize == 0)
+    {
+        return;
+    }
+
+    heap_stats.live = heap_stats.live - (pointer != NULL ? oldSize : 0) + newSize;
+    if (pointer == NULL)
+    {
+        heap_stats.blocks++;
+    }
+    else if (newSize == 0)
+    {
+        heap_stats.blocks--;
+    }
+    heap_stats.peak = heap_stats.live > heap_stats.peak ? heap_stats.live : heap_stats.peak;
+    heap_stats.peak_blocks =
+        heap_stats.blocks > heap_stats.peak_blocks ? heap_stats.blocks : heap_stats.peak_blocks;
+
+    if (record == NULL)
+    {
+        return;
+    }
+    if (pointer == NULL)
+    {
+        record->allocs++;
+    }
+    else if (newSize == 0)
+    {
+        record->frees++;
+    }
+    else
+    {
+        record->resizes++;
+    }
+    record->largest = newSize > record->largest ? newSize : record->largest;
+}
+
+/**
+ * @brief Returns what reallocate() has counted so far.
+ *
+ * @return const MemHeapStats* heap totals and call sites
+ */
+const MemHeapStats *memHeapStats(void)
+{
+    return &heap_stats;
+}
 
 /**
- * @brief reallocs memory. 
+ * @brief Forgets every call site and brings the peaks down to what is allocated now.
+ *
+ */
+void memHeapReset(void)
+{
+    heap_stats.peak = heap_stats.live;
+    heap_stats.peak_blocks = heap_stats.blocks;
+    heap_stats.sites_count = 0;
+    heap_stats.untracked = 0;
+}
+#endif
+
+/**
+ * @brief reallocs memory. Every heap block the firmware uses comes from here, so with MEM_STATS
+ * defined this is where live/peak bytes and per call site counts are kept.
  * 
  * @param pointer pointer to reallocate
  * @param oldSize old size of pointer
  * @param newSize new size of pointer
+ * @param site "file:line" of the caller (MEM_SITE), NULL when MEM_STATS is off
  * @return void* realloced mem
  */
-void *reallocate(void *pointer, size_t oldSize, size_t newSize)
+void *reallocate(void *pointer, size_t oldSize, size_t newSize, const char *site)
 {
+    void *result = NULL;
     if (newSize == 0)
     {
         free(pointer);
+    }
+    else
+    {
+        result = realloc(pointer, newSize);
+        if (result == NULL) printf("Something has gone wrong:(\r\n");
+    }
+#ifdef MEM_STATS
+    countCall(pointer, oldSize, newSize, site, result);
+#else
+    (void)oldSize;
+    (void)site;
+#endif
+    return result;
+}
+
+/**
+ * @brief Releases everything allocated from the line arena in one go.
+ *
+ */
+void resetLineArena(void)
+{
+    line_arena_used = 0;
+}
+
+/**
+ * @brief Bump allocates from the line arena. Memory is only released by resetLineArena().
+ *
+ * @param size bytes to allocate
+ * @return void* allocated memory, NULL if the arena is exhausted.
+ */
+void *allocateLineArena(size_t size)
+{
+    size_t aligned = (size + LINE_ARENA_ALIGN - 1) & ~(size_t)(LINE_ARENA_ALIGN - 1);
+    if (aligned > LINE_ARENA_SIZE - line_arena_used)
+    {
+        printf("> Error: Line arena exhausted (%u of %u bytes used).\r\n",
+               (unsigned int)line_arena_used, (unsigned int)LINE_ARENA_SIZE);
         return NULL;
     }
 
-    void *result = realloc(pointer, newSize);
-    if (result == NULL) printf("Something has gone wrong:(\r\n");
+    void *result = &line_arena[line_arena_used];
+    line_arena_used += aligned;
     return result;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Returns how much of the line arena is currently allocated.
+ *
+ * @return size_t bytes used
+ */
+size_t usedLineArena(void)
+{
+    return line_arena_used;
+}
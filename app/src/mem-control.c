@@ -0,0 +1,157 @@
+/**
+ * @file mem-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Reports RAM use for "mem": what reallocate() has counted, what malloc holds, and how deep
+ * the stack has been, from the paint left in the stack region.
+ * @version 0.1
+ * @date 2025-04-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "mem-control.h"
+#include <stdio.h>
+
+#ifdef MEM_STATS
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+
+#include "local-memory.h"
+
+// Bytes below the stack pointer left unpainted, for whatever the paint loop itself pushes.
+#define MEM_PAINT_GUARD (64)
+
+// Linker script symbols, only their addresses mean anything.
+extern uint8_t _data;
+extern uint8_t _ebss;
+extern uint8_t end;
+extern uint8_t _stack;
+extern uint8_t _stack_bottom;
+
+static uint8_t *heap_top = &end;
+
+void *_sbrk(ptrdiff_t increment);
+
+/**
+ * @brief Moves the top of the heap for malloc, in place of libnosys' version. The heap stops at the
+ * bottom of the stack region, so only the stack ever overwrites the paint and malloc fails rather
+ * than running into the stack.
+ *
+ * @param increment bytes to add to the heap
+ * @return void* old top of the heap, (void *)-1 if there isn't room
+ */
+void *_sbrk(ptrdiff_t increment)
+{
+    if (increment > &_stack_bottom - heap_top)
+    {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    uint8_t *previous = heap_top;
+    heap_top += increment;
+    return previous;
+}
+
+/**
+ * @brief Reads the stack pointer.
+ *
+ * @return uint8_t* current stack pointer
+ */
+static inline uint8_t *stackPointer(void)
+{
+    uint8_t *sp;
+    __asm__ volatile("mov %0, sp" : "=r"(sp));
+    return sp;
+}
+
+/**
+ * @brief Paints the stack region from its bottom up to just under the stack pointer. Anything the
+ * stack goes on to use overwrites the paint. Called first thing in main(), and again by "mem
+ * clear" to measure from there on.
+ *
+ */
+__attribute__((noinline)) void memStackPaint(void)
+{
+    // volatile so the loop isn't turned into a memset call, whose frame would be painted over.
+    volatile uint32_t *word = (volatile uint32_t *)&_stack_bottom;
+    uint32_t          *limit = (uint32_t *)(stackPointer() - MEM_PAINT_GUARD);
+    while (word < limit)
+    {
+        *word++ = MEM_STACK_PAINT;
+    }
+}
+
+/**
+ * @brief Finds the deepest the stack has been since it was painted, from the lowest word the
+ * paint is gone from.
+ *
+ * @return size_t bytes of stack used at the peak, the whole region if none of the paint is left
+ */
+static size_t stackPeak(void)
+{
+    const uint32_t *word = (const uint32_t *)&_stack_bottom;
+    while (word < (const uint32_t *)&_stack && *word == MEM_STACK_PAINT)
+    {
+        word++;
+    }
+    return (size_t)(&_stack - (const uint8_t *)word);
+}
+
+/**
+ * @brief Prints the heap totals and call sites reallocate() has counted, malloc's view of the heap
+ * (which also holds newlib's own stdio buffers), and the stack's peak and current depth.
+ *
+ */
+void memPrint(void)
+{
+    const MemHeapStats *heap = memHeapStats();
+    printf("> MEM heap: %u bytes in %lu blocks, peak %u bytes in %lu blocks\r\n",
+           (unsigned int)heap->live, heap->blocks, (unsigned int)heap->peak, heap->peak_blocks);
+
+    // Free chunks malloc keeps inside the heap are what fragmentation costs: memory taken from
+    // sbrk that can only be reused by requests that fit in them.
+    struct mallinfo info = mallinfo();
+    unsigned int    arena = (unsigned int)info.arena;
+    printf("> MEM malloc: %u bytes from sbrk, %u in use, %u free inside (%u%% fragmented), "
+           "%u left to the stack\r\n",
+           arena, (unsigned int)info.uordblks, (unsigned int)info.fordblks,
+           arena == 0 ? 0 : (unsigned int)(info.fordblks * 100U / arena),
+           (unsigned int)(&_stack_bottom - heap_top));
+
+    size_t region = (size_t)(&_stack - &_stack_bottom);
+    size_t peak = stackPeak();
+    printf("> MEM stack: peak %u of %u bytes%s, %u now\r\n", (unsigned int)peak,
+           (unsigned int)region, peak == region ? " (paint gone, may have overflowed)" : "",
+           (unsigned int)(&_stack - stackPointer()));
+    printf("> MEM static: %u bytes of .data/.bss\r\n", (unsigned int)(&_ebss - &_data));
+
+    if (heap->sites_count == 0)
+    {
+        return;
+    }
+    printf("> MEM sites: allocs/resizes/frees/failures, largest bytes\r\n");
+    for (size_t index = 0; index < heap->sites_count; index++)
+    {
+        const MemSiteRecord *record = &heap->sites[index];
+        printf(">   %s %lu/%lu/%lu/%lu %u\r\n", record->site, record->allocs, record->resizes,
+               record->frees, record->failures, (unsigned int)record->largest);
+    }
+    if (heap->untracked > 0)
+    {
+        printf("> %lu calls not counted, site table full (%d sites).\r\n", heap->untracked,
+               MEM_MAX_SITES);
+    }
+}
+
+/**
+ * @brief Forgets the call sites, brings the heap peaks down to now and repaints the stack below
+ * the current line, so the next "mem" shows the peaks from here on.
+ *
+ */
+void memReset(void)
+{
+    memHeapReset();
+    memStackPaint();
+}
+#endif
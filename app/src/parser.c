@@ -1,7 +1,7 @@
 /**
  * @file parser.c
  * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
- * @brief Contains logic for parsing and executing token vectors.
+ * @brief Contains logic for parsing token vectors and compiling them into chunks.
  * @version 0.1
  * @date 2024-11-20
  *
@@ -10,6 +10,13 @@
  */
 #include "parser.h"
 #include "board-control.h"
+#include "capture-control.h"
+#include "core/system.h"
+#include "exti-control.h"
+#include "pattern-control.h"
+#include "response.h"
+#include "scheduler.h"
+#include "script-control.h"
 #include "libopencm3/stm32/f4/adc.h"
 #include "libopencm3/stm32/f4/gpio.h"
 #include "libopencm3/stm32/f4/nvic.h"
@@ -22,52 +29,44 @@
 #include <stdlib.h>
 
 /**
- * @brief Get the Clock that matches the port provided.
- *        This could be done with maths but honestly, this is far simpler.
+ * @brief Get the Clock that matches the port provided, from the board's port table.
+ *
  * @param port port to get clock of
  * @return enum rcc_periph_clken
  */
 static enum rcc_periph_clken getClockFromPort(uint32_t port)
 {
-    switch (port)
-    {
-    case GPIOA:
-    {
-        return RCC_GPIOA;
-    }
-    case GPIOB:
-    {
-        return RCC_GPIOB;
-    }
-    case GPIOC:
-    {
-        return RCC_GPIOC;
-    }
-    case GPIOD:
-    {
-        return RCC_GPIOD;
-    }
-    case GPIOE:
-    {
-        return RCC_GPIOE;
-    }
-    default:
+    uint32_t port_index = (port - GPIOA) / PORT_SIZE;
+    if (port < GPIOA || port_index >= BOARD_PORT_COUNT)
     {
         // Bit of a crap way of doing this, but this clock is out of bounds.
         return CLOCK_OUT_OF_BOUNDS;
     }
+    return boardPorts[port_index].clock;
+}
+
+/**
+ * @brief Looks up what a pin can be used as in the board's generated table.
+ *
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @return const BoardPin* table entry, NULL if the pin isn't on the board.
+ */
+static const BoardPin *getBoardPin(uint32_t port, uint32_t pin)
+{
+    uint32_t port_index = (port - GPIOA) / PORT_SIZE;
+    if (port < GPIOA || port_index >= BOARD_PORT_COUNT || pin == 0 ||
+        pin >= (1U << BOARD_PINS_PER_PORT))
+    {
+        return NULL;
     }
+    return &boardPins[port_index][__builtin_ctz(pin)];
 }
 
 /**
- * @brief Parses a GPIO pin from a given token. Some notes on execution (also
- * covered in code below): Ports are calculated as some offset from the
- * peripheral base. For example, GPIOA is
- *        (((0x40000000U) + 0x20000) + 0x0000), where 0x0000 is the offset. The
- * offset value is 0x400, Which is saved as PORT_SIZE. We multiply this by the
- * current character minus the first character (subtracter). Each pin is indexed
- * in a port by a bit shift along. E.g. GPIO0 = (1 << 0), GPIO1 = (1 << 1),
- * GPIO2 = (1 << 2), etc.
+ * @brief Parses a GPIO pin from a given token. The port letter, either case, indexes the board's
+ * port table. Each pin is indexed in a port by a bit shift along. E.g. GPIO0 = (1 << 0),
+ * GPIO1 = (1 << 1), GPIO2 = (1 << 2), etc.
  *
  * @param token Token to be parsed.
  * @param port Pointer to uint32_t value where selected port is stored
@@ -81,35 +80,12 @@ static bool parsePortPin(Token token, uint32_t *port, uint32_t *pin)
     bool parsed_port = false;
     bool parsed_pin = false;
 
-    // Variable that modifies what value we're using.
-    uint32_t subtractor = (uint32_t)PORTA_STM32F411RE;
-
-    // Initialise port to first port
-    *port = GPIOA;
-
-    // Loop over all possible port characters
-    for (char port_char = PORTA_STM32F411RE; port_char < (PORTe_STM32F411RE + 1); port_char++)
+    // The scanner only lets port letters through, but better safe than sorry.
+    uint8_t port_index = BOARD_PORT_INDEX(token.start[0]);
+    if (port_index < BOARD_PORT_COUNT)
     {
-        // Check port character
-        if (token.start[0] == port_char)
-        {
-            // Ports are calculated as some offset from the peripheral base. For
-            // example, GPIOA is
-            // (((0x40000000U) + 0x20000) + 0x0000), where 0x0000 is the offset.
-            // The offset value is 0x400, Which is saved as PORT_SIZE. We
-            // multiply this by the current character minus the first character
-            // (subtracter).
-            *port += PORT_SIZE * ((uint32_t)port_char - subtractor);
-            parsed_port = true;
-            break;
-        }
-        // If we hit 'E', we jump to 'a'. We then update subtractor to
-        // essentially loop back to the start, as a10 == A10.
-        if (port_char == PORTE_STM32F411RE)
-        {
-            port_char += JUMP_TO_LOWERCASE;
-            subtractor = (uint32_t)PORTa_STM32F411RE;
-        }
+        *port = boardPorts[port_index].base;
+        parsed_port = true;
     }
 
     // Increment away from the port identifier
@@ -121,7 +97,7 @@ static bool parsePortPin(Token token, uint32_t *port, uint32_t *pin)
 
     // This should never be outside of this range as it's checked in the scanner
     // but better safe than sorry.
-    if (pin_val <= 15)
+    if (pin_val < BOARD_PINS_PER_PORT)
     {
         // Calculate pin value mathematically
         // Each pin is indexed in a port by a bit shift along. E.g. GPIO0 = (1
@@ -133,15 +109,14 @@ static bool parsePortPin(Token token, uint32_t *port, uint32_t *pin)
 }
 
 /**
- * @brief Returns ADC1. Other hardware will need to implement a whole shebang for this
+ * @brief Returns the board's ADC, BOARD_ADC_BASE.
  *
  * @return uint32_t ADC base channel
  */
-static uint32_t getADCBase(void) { return ADC1; }
+static uint32_t getADCBase(void) { return BOARD_ADC_BASE; }
 
 /**
- * @brief Returns the channel from the port/pin identifier. Developed based on stm32-nucleoF411RE
- * datasheets.
+ * @brief Returns the channel from the port/pin identifier, from the board's pin table.
  *
  * @param port port to identify
  * @param pin pin to identify
@@ -149,27 +124,39 @@ static uint32_t getADCBase(void) { return ADC1; }
  */
 static int getADCChannelFromPortPin(uint32_t port, uint32_t pin)
 {
-    for (size_t i = 0; i < ADC_PIN_MAP_SIZE; i++)
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    if (board_pin != NULL && board_pin->adc != 0)
     {
-        if (adcPinMappings[i].port == port && adcPinMappings[i].pin == pin)
-        {
-            return adcPinMappings[i].adc_channel;
-        }
+        return adcPinMappings[board_pin->adc - 1].adc_channel;
     }
     printf("Error: This pin is not usable for ADC.\r\n");
     return ADC_OUT_OF_BOUNDS;
 }
 
 /**
- * @brief Creates an input or output object in board controller based on input.
+ * @brief Writes the flags that let the VM echo a pin identifier back the way it was typed.
+ *
+ * @param instruction instruction to flag
+ * @param token port/pin token the instruction was compiled from
+ */
+static void flagPinCase(Instruction *instruction, Token token)
+{
+    if (token.start[0] >= 'a')
+    {
+        instruction->flags |= INSTR_FLAG_LOWERCASE;
+    }
+}
+
+/**
+ * @brief Compiles an input or output line.
  *
- * @param bc board controller object to create input/output on.
  * @param vec vector of tokens to parse
+ * @param chunk chunk to compile into
  * @param input_output is it input or output.
  * @return true parsed successfully.
  * @return false parsed unsuccessfully.
  */
-static bool inputOutput(BoardController *bc, TokenVector *vec, OpCode input_output)
+static bool inputOutput(TokenVector *vec, Chunk *chunk, OpCode input_output)
 {
     size_t vec_size = sizeTokenVector(vec);
     // Ignore end of line token.
@@ -254,63 +241,21 @@ static bool inputOutput(BoardController *bc, TokenVector *vec, OpCode input_outp
     // If we've gotten this far we know we've succeeded.
     if (port_pin_set && pupd_set)
     {
-        // Translate opcode into peripheral type.
-        PeripheralType type_input_output =
-            input_output == OP_MAKE_INPUT ? TYPE_GPIO_INPUT : TYPE_GPIO_OUTPUT;
-        // If the pin doesn't exist make a new one, else just change the current
-        // one.
-        PeripheralType pin_exists = pinExists(bc, port, pin);
-        if (pin_exists == TYPE_NONE)
-        {
-            // Get correct clock
-            enum rcc_periph_clken clock = getClockFromPort(port);
-            if (clock == CLOCK_OUT_OF_BOUNDS)
-            {
-                // This really shouldn't happen.
-                printf("> Parse Error: Incorrect port clock identified.\r\n");
-                return false;
-            }
-            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
-            printf("> created new pin.\r\n");
-        }
-        else if (pin_exists == TYPE_GPIO_INPUT || pin_exists == TYPE_GPIO_OUTPUT)
-        {
-            // This pin exists so just update it.
-            mutateDigitalPin(bc, port, pin, type_input_output, pupd);
-            printf("> modified existing pin.\r\n");
-        }
-        else
+        // Get correct clock
+        enum rcc_periph_clken clock = getClockFromPort(port);
+        if (clock == CLOCK_OUT_OF_BOUNDS)
         {
-            switch (pin_exists)
-            {
-            case TYPE_ADC:
-            {
-                // Don't need to check if clock is valid because it should be already
-                enum rcc_periph_clken clock = getClockFromPort(port);
-                mutateADCToDigital(bc, port, pin, clock, type_input_output, pupd);
-                printf("> Modified ADC to GPIO pin.\r\n");
-                break;
-            }
-            case TYPE_UART:
-            {
-                // Kill entire UART peripheral
-                printf("> Warning: Disabling entire UART port to convert to GPIO...\r\n");
-                killPeripheralOrPin(bc, port, pin);
-                // Don't need to check if clock is valid because it should be already
-                enum rcc_periph_clken clock = getClockFromPort(port);
-                // Recreate GPIO from scratch.
-                createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
-                printf("> Modified UART to GPIO pin.\r\n");
-                break;
-            }
-            default:
-            {
-                printf("> Failed to modify pin. You shouldn't have ended up here!\r\n");
-                return false;
-            }
-            }
+            // This really shouldn't happen.
+            printf("> Parse Error: Incorrect port clock identified.\r\n");
+            return false;
         }
-        return true;
+
+        uint32_t constants[DIGITAL_CONST_COUNT];
+        constants[DIGITAL_CONST_CLOCK] = (uint32_t)clock;
+        constants[DIGITAL_CONST_PUPD] = pupd;
+        int index = addConstants(chunk, constants, DIGITAL_CONST_COUNT);
+        return index >= 0 &&
+               writeChunk(chunk, input_output, port, (uint16_t)pin, (uint32_t)index) != NULL;
     }
     else
     {
@@ -320,15 +265,17 @@ static bool inputOutput(BoardController *bc, TokenVector *vec, OpCode input_outp
 }
 
 /**
- * @brief Set, reset, read, or toggle the selected pin(s).
+ * @brief Compiles a set, reset, read, or toggle line. Pins are collected into one mask per port
+ * so the VM applies each port with a single register access. Acknowledgements (and reads) are
+ * emitted afterwards in the order the user gave the pins.
  *
- * @param bc board control object
  * @param vec vector of tokens
+ * @param chunk chunk to compile into
  * @param operation What operation the user has selected
- * @return true executed correctly
- * @return false executed incorrectly.
+ * @return true compiled correctly
+ * @return false compiled incorrectly.
  */
-static bool setResetToggleRead(BoardController *bc, TokenVector *vec, OpCode operation)
+static bool setResetToggleRead(TokenVector *vec, Chunk *chunk, OpCode operation)
 {
     // We don't need to do a check on this as we allow users to input as many
     // pins as they want.
@@ -338,12 +285,13 @@ static bool setResetToggleRead(BoardController *bc, TokenVector *vec, OpCode ope
     uint32_t port = 0;
     uint32_t pin = 0;
 
-    // Loop through vector, ignoring first token.
+    // One mask per port.
+    uint16_t port_masks[BOARD_PORT_COUNT] = {0};
+
+    // Decode every pin and build the port masks.
     for (size_t i = 1; i < vec_size; i++)
     {
-        Token    current_token = getTokenVector(vec, i);
-        uint16_t read_response = 0;          // response if the user wants to read the
-                                             // pin. Will be zero if the pin is output.
+        Token current_token = getTokenVector(vec, i);
         if (current_token.type == TOKEN_EOL) // Ignore EOL token.
         {
             continue;
@@ -357,75 +305,7 @@ static bool setResetToggleRead(BoardController *bc, TokenVector *vec, OpCode ope
                        current_token.start);
                 return false;
             }
-
-            // If the pin already exists execute command.
-            if (pinExists(bc, port, pin) == TYPE_GPIO_INPUT ||
-                pinExists(bc, port, pin) == TYPE_GPIO_OUTPUT)
-            {
-                switch (operation)
-                {
-                case OP_SET:
-                {
-                    read_response = actionDigitalPin(bc, port, pin, GPIO_SET);
-                    printf("> SET %.*s\r\n", current_token.length, current_token.start);
-                    break;
-                }
-                case OP_RESET:
-                {
-                    read_response = actionDigitalPin(bc, port, pin, GPIO_CLEAR);
-                    printf("> RESET %.*s\r\n", current_token.length, current_token.start);
-                    break;
-                }
-                case OP_TOGGLE:
-                {
-                    read_response = actionDigitalPin(bc, port, pin, GPIO_TOGGLE);
-                    printf("> TOGGLE %.*s\r\n", current_token.length, current_token.start);
-                    break;
-                }
-                case OP_READ:
-                {
-                    read_response = actionDigitalPin(bc, port, pin, GPIO_READ);
-                    printf("> READ %.*s = %u\r\n", current_token.length, current_token.start,
-                           read_response);
-                    break;
-                }
-                default:
-                {
-                    // Should never get here.
-                    printf("> Parse Error: Incorrect op code provided.\r\n");
-                    return false;
-                }
-                }
-            }
-            else if (pinExists(bc, port, pin) == TYPE_ADC)
-            {
-                switch (operation)
-                {
-                case OP_READ:
-                {
-                    read_response = actionAnalogPin(bc, port, pin);
-                    printf("> READ %.*s (ADC) = %u\r\n", current_token.length, current_token.start,
-                           read_response);
-                    break;
-                }
-                default:
-                {
-                    printf("> Parse Error: this operation is unavailable for this pin "
-                           "configuration (ADC).\r\n");
-                    return false;
-                }
-                }
-            }
-            else
-            {
-                // This pin does not exist, stop execution.
-                printf("> Parse Error: Port Pin identifer \"%.*s\" is not "
-                       "initialised and cannot be operated on.\r\n",
-                       current_token.length, current_token.start);
-                return false;
-            }
-            // Reset port and pin for safety.
-            port = pin = 0;
+            port_masks[(port - GPIOA) / PORT_SIZE] |= (uint16_t)pin;
         }
         else
         {
@@ -436,230 +316,195 @@ static bool setResetToggleRead(BoardController *bc, TokenVector *vec, OpCode ope
         }
     }
 
-    // Execution was succesful.
+    // One port wide operation per port. Reads sample the port once, then report each pin.
+    OpCode port_op = operation == OP_READ ? OP_READ_PORT : operation;
+    for (size_t port_index = 0; port_index < BOARD_PORT_COUNT; port_index++)
+    {
+        if (port_masks[port_index] != 0 &&
+            writeChunk(chunk, port_op, GPIOA + PORT_SIZE * port_index, port_masks[port_index],
+                       0) == NULL)
+        {
+            return false;
+        }
+    }
+
+    // Report back in the order the user gave the pins.
+    OpCode report_op = operation == OP_READ ? OP_READ : OP_ECHO;
+    for (size_t i = 1; i < vec_size; i++)
+    {
+        Token current_token = getTokenVector(vec, i);
+        if (current_token.type != TOKEN_PORT_PIN)
+        {
+            continue;
+        }
+        // Already validated above.
+        (void)parsePortPin(current_token, &port, &pin);
+
+        Instruction *instruction =
+            writeChunk(chunk, report_op, port, (uint16_t)pin, (uint32_t)operation);
+        if (instruction == NULL)
+        {
+            return false;
+        }
+        flagPinCase(instruction, current_token);
+    }
+
     return true;
 }
 
 /**
- * @brief Function for defining ADC peripherals.
+ * @brief Returns the ADC_SMPR_SMP_* setting for a sample time in ADC clock cycles.
+ *
+ * @param cycles sample time as typed
+ * @return int sample time setting, -1 if ADC1 has no such sample time
+ */
+static int getADCSampleTime(uint32_t cycles)
+{
+    for (size_t i = 0; i < ADC_SAMPLE_TIME_MAP_SIZE; i++)
+    {
+        if (adcSampleTimeMappings[i].cycles == cycles)
+        {
+            return (int)adcSampleTimeMappings[i].sample_time;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Compiles a line defining an ADC peripheral, with optional resolution, sample time and
+ * number of scanned frames each read averages.
  *
- * @param bc Board Controller object
  * @param vec vector of tokens
- * @return true ADC successfully initialised
- * @return false ADC not initialised
+ * @param chunk chunk to compile into
+ * @return true ADC successfully compiled
+ * @return false ADC not compiled
  */
-static bool adc(BoardController *bc, TokenVector *vec)
+static bool adc(TokenVector *vec, Chunk *chunk)
 {
     size_t vec_size = sizeTokenVector(vec);
-    // Ignore end of line token.
-    if (vec_size - 1 != ADC_MAX_ARGS)
+    // Ignore end of line token, options come in pairs after the pin.
+    if (vec_size - 1 > ADC_MAX_ARGS || (vec_size - 1) % 2 != 0)
     {
-        printf("> Parse Error: Invalid input format, use \"adc <port pin>\". See documentation for "
-               "more information.\r\n");
+        printf("> Parse Error: Invalid input format, use \"adc <port pin> [bits <6|8|10|12>] "
+               "[sample <cycles>] [average <1-%d>]\". See documentation for more "
+               "information.\r\n",
+               ADC_MAX_AVERAGE);
         return false;
     }
 
+    Token    pin_token = getTokenVector(vec, 1);
     uint32_t port = 0;
     uint32_t pin = 0;
-    bool     port_pin_set = false;
-
-    // Ignore the initial token - we've already parsed this.
-    for (size_t i = 1; i < vec_size; i++)
+    if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &port, &pin))
     {
-        Token current_token = getTokenVector(vec, i);
-        switch (current_token.type)
-        {
-        case TOKEN_EOL:
-        {
-            // ignore
-            break;
-        }
-        case TOKEN_PORT_PIN:
-        {
-            // If we haven't already assigned the port and pin
-            if (!port_pin_set)
-            {
-                if (!parsePortPin(current_token, &port, &pin))
-                {
-                    printf("> Parse Error: Unable to parse ADC identifer "
-                           "\"%.*s\".",
-                           current_token.length, current_token.start);
-                    return false;
-                }
-                port_pin_set = true;
-            }
-            else
-            {
-                printf("> Parse Error: Multiple ADC pins provided.\r\n");
-                return false;
-            }
-
-            break;
-        }
-        default:
-        {
-            printf("> Parse Error: Unrecognised token while parsing: "
-                   "\"%.*s\".\r\n",
-                   current_token.length, current_token.start);
-            return false;
-        }
-        }
+        printf("> Parse Error: Unable to parse ADC identifer \"%.*s\".\r\n", pin_token.length,
+               pin_token.start);
+        return false;
     }
-    if (port_pin_set)
+
+    uint32_t bits = ADC_DEFAULT_BITS;
+    uint32_t sample_time = ADC_SMPR_SMP_3CYC;
+    uint32_t average = 1;
+    for (size_t i = 2; i + 1 < vec_size; i += 2)
     {
-        // If the pin already exists... See if we can mutate it.
-        PeripheralType pin_exists = pinExists(bc, port, pin);
-        switch (pin_exists)
+        Token    option_token = getTokenVector(vec, i);
+        Token    value_token = getTokenVector(vec, i + 1);
+        uint32_t value =
+            value_token.type == TOKEN_NUMBER ? strtoul(value_token.start, NULL, 10) : 0;
+        switch (option_token.type)
         {
-        case TYPE_GPIO_INPUT:
-        case TYPE_GPIO_OUTPUT:
+        case TOKEN_BITS:
         {
-            enum rcc_periph_clken clock = getClockFromPort(port);
-            uint32_t              base = getADCBase();
-            int                   channel = getADCChannelFromPortPin(port, pin);
-            int                   sample_time = ADC_SMPR_SMP_3CYC;
-            if (channel == ADC_OUT_OF_BOUNDS)
+            if (value < ADC_MIN_BITS || value > ADC_DEFAULT_BITS || value % 2 != 0)
             {
-                printf("> Error: Pin is not available for use as ADC.\r\n");
+                printf("> Parse Error: ADC resolution must be 6, 8, 10 or 12 bits, not "
+                       "\"%.*s\".\r\n",
+                       value_token.length, value_token.start);
                 return false;
             }
-            mutateDigitalToADC(bc, port, pin, clock, sample_time, base, channel);
-            printf("> Modified GPIO to ADC pin.\r\n");
+            bits = value;
             break;
         }
-        case TYPE_UART:
+        case TOKEN_SAMPLE:
         {
-            // Only difference with UART is the whole peripheral gets turned off.
-
-            // Turn off the whole UART port
-            printf("> Warning: Disabling entire UART port to convert to ADC...\r\n");
-            killPeripheralOrPin(bc, port, pin);
-            enum rcc_periph_clken clock = getClockFromPort(port);
-            uint32_t              base = getADCBase();
-            int                   channel = getADCChannelFromPortPin(port, pin);
-            int                   sample_time = ADC_SMPR_SMP_3CYC;
-            if (channel == ADC_OUT_OF_BOUNDS)
+            int setting = getADCSampleTime(value);
+            if (setting < 0)
             {
-                printf("> Error: Pin is not available for use as ADC.\r\n");
+                printf("> Parse Error: ADC sample time must be 3, 15, 28, 56, 84, 112, 144 or 480 "
+                       "cycles, not \"%.*s\".\r\n",
+                       value_token.length, value_token.start);
                 return false;
             }
-            createAnalogPin(bc, port, pin, clock, sample_time, base, channel);
-            printf("> created new ADC pin.\r\n");
+            sample_time = (uint32_t)setting;
             break;
         }
-        case TYPE_ADC:
-        {
-            return true; // Do nothing.
-        }
-        case TYPE_NONE:
+        case TOKEN_AVERAGE:
         {
-            enum rcc_periph_clken clock = getClockFromPort(port);
-            uint32_t              base = getADCBase();
-            int                   channel = getADCChannelFromPortPin(port, pin);
-            int                   sample_time = ADC_SMPR_SMP_3CYC;
-            if (channel == ADC_OUT_OF_BOUNDS)
+            if (value < 1 || value > ADC_MAX_AVERAGE)
             {
-                printf("> Error: Pin is not available for use as ADC.\r\n");
+                printf("> Parse Error: Samples to average must be 1 to %d, not \"%.*s\".\r\n",
+                       ADC_MAX_AVERAGE, value_token.length, value_token.start);
                 return false;
             }
-            createAnalogPin(bc, port, pin, clock, sample_time, base, channel);
-            printf("> created new ADC pin.\r\n");
+            average = value;
             break;
         }
         default:
         {
-            printf("Not implemented yet!\r\n");
+            printf("> Parse Error: Unrecognised token while parsing: "
+                   "\"%.*s\".\r\n",
+                   option_token.length, option_token.start);
             return false;
         }
         }
-        return true;
     }
-    else
+
+    int channel = getADCChannelFromPortPin(port, pin);
+    if (channel == ADC_OUT_OF_BOUNDS)
     {
-        printf("> Parse Error: Unrecognised pin.\r\n");
+        printf("> Error: Pin is not available for use as ADC.\r\n");
         return false;
     }
+
+    uint32_t constants[ADC_CONST_COUNT];
+    constants[ADC_CONST_CLOCK] = (uint32_t)getClockFromPort(port);
+    constants[ADC_CONST_BASE] = getADCBase();
+    constants[ADC_CONST_CHANNEL] = (uint32_t)channel;
+    constants[ADC_CONST_SAMPLE_TIME] = sample_time;
+    constants[ADC_CONST_BITS] = bits;
+    constants[ADC_CONST_AVERAGE] = average;
+    int index = addConstants(chunk, constants, ADC_CONST_COUNT);
+    return index >= 0 &&
+           writeChunk(chunk, OP_MAKE_ADC, port, (uint16_t)pin, (uint32_t)index) != NULL;
 }
 
 /**
- * @brief Returns the uart handle for the provided pin. This could be done more effectively with a
- * lookup table, but for time's sakes I'm doing it dumb.
+ * @brief Looks up a UART pin in the board's pin table.
  *
  * @param port to check
  * @param pin to check
- * @return UARTValidPin a struct containing info about that pin's possible config.
+ * @return const UARTPinMapping* mapping for the pin, NULL if it isn't on a UART.
  */
-static UARTValidPin getUARTInfo(uint32_t port, uint32_t pin)
+static const UARTPinMapping *getUARTInfo(uint32_t port, uint32_t pin)
 {
-    for (size_t i = 0; i < UART_PIN_MAP_SIZE; i++)
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    if (board_pin == NULL || board_pin->uart == 0)
     {
-        if (uartPinMappings[i].port == port && uartPinMappings[i].pin == pin)
-        {
-            return uartPinMappings[i].uartPin;
-        }
+        return NULL;
     }
-    return UART_INVALID_PIN;
+    return &uartPinMappings[board_pin->uart - 1];
 }
 
 /**
- * @brief Returns the clock corresponding to the uart handle
+ * @brief Parse a UART command and compiles the initialisation of a UART peripheral. Pin
+ * validity is checked here, the VM only has to (re)claim the pins.
  *
- * @param handle handle to get clock for
- * @return enum rcc_periph_clken identified
- */
-static enum rcc_periph_clken getUARTclock(uint32_t handle)
-{
-    switch (handle)
-    {
-    case USART1:
-    {
-        return RCC_USART1;
-    }
-    case USART6:
-    {
-        return RCC_USART6;
-    }
-    default:
-    {
-        return CLOCK_OUT_OF_BOUNDS;
-    }
-    }
-}
-
-/**
- * @brief Gets the NVIC table entry for the specified UART
- * 
- * @param handle UART handle
- * @return int NVIC table entry
- */
-static int getUARTNVICEntry(uint32_t handle)
-{
-    switch (handle)
-    {
-    case USART1:
-    {
-        return NVIC_USART1_IRQ;
-    }
-    case USART6:
-    {
-        return NVIC_USART6_IRQ;
-    }
-    default:
-    {
-        return 0;
-    }
-    }
-}
-
-/**
- * @brief Parse a UART command and initialises a UART peripheral from scratch.
- * 
- * @param bc board controller object
  * @param vec vector of tokens
- * @return true set up successfully
- * @return false set up unsuccessful 
+ * @param chunk chunk to compile into
+ * @return true compiled successfully
+ * @return false compile unsuccessful
  */
-static bool uartInitialise(BoardController *bc, TokenVector *vec)
+static bool uartInitialise(TokenVector *vec, Chunk *chunk)
 {
     size_t vec_size = sizeTokenVector(vec);
     if (vec_size - 1 != UART_INIT_MAX_ARGS)
@@ -723,13 +568,15 @@ static bool uartInitialise(BoardController *bc, TokenVector *vec)
             {
                 baud_rate = strtoul(current_token.start, NULL, 10);
                 // This is for debugging, I will refactor it before finishing
-                if ((baud_rate == 9600) || (baud_rate == 57600) || (baud_rate == 115200))
+                if ((baud_rate == 9600) || (baud_rate == 57600) || (baud_rate == 115200) ||
+                    (baud_rate == 230400) || (baud_rate == 460800) || (baud_rate == 921600))
                 {
                     printf("> Baud rate selected: %lu\r\n", baud_rate);
                 }
                 else
                 {    
-                    printf("Error: Baud rate must be either 9600, 57600, or 115200.\r\n");
+                    printf("Error: Baud rate must be either 9600, 57600, 115200, 230400, 460800, "
+                           "or 921600.\r\n");
                     return false;
                 }
                 baud_rate_set = true;
@@ -753,11 +600,11 @@ static bool uartInitialise(BoardController *bc, TokenVector *vec)
     if (rx_port_pin_set && tx_port_pin_set && baud_rate_set)
     {
 
-        UARTValidPin rx_validity = getUARTInfo(rx_port, rx_pin);
-        UARTValidPin tx_validity = getUARTInfo(tx_port, tx_pin);
+        const UARTPinMapping *rx_validity = getUARTInfo(rx_port, rx_pin);
+        const UARTPinMapping *tx_validity = getUARTInfo(tx_port, tx_pin);
 
         // Check they're both valid UART pins
-        if (!rx_validity.isValid || !tx_validity.isValid)
+        if (rx_validity == NULL || tx_validity == NULL)
         {
             printf("Error: one or both of the pins provided are not available as UART. Please "
                    "consult datasheet.\r\n");
@@ -765,7 +612,7 @@ static bool uartInitialise(BoardController *bc, TokenVector *vec)
         }
 
         // Check both can be in the right config.
-        if (!rx_validity.isRx || !tx_validity.isTx)
+        if (rx_validity->role != UART_PIN_RX || tx_validity->role != UART_PIN_TX)
         {
             printf("Error: one or both of the pins provided cannot be used as TX/RX. Please "
                    "consult datasheet.\r\n");
@@ -774,66 +621,30 @@ static bool uartInitialise(BoardController *bc, TokenVector *vec)
 
         // Check they're part of the same UART handle
 
-        if (!(rx_validity.handle == tx_validity.handle))
+        if (!(rx_validity->handle == tx_validity->handle))
         {
             printf("Error: Pins are available as UART but not for the same UART peripheral. "
                    "Consult datasheet.\r\n");
             return false;
         }
 
+        uint32_t constants[UART_CONST_COUNT];
         // Either will do at this point.
-        uint32_t              handle = rx_validity.handle;
-        enum rcc_periph_clken uart_clock = getUARTclock(handle);
-
+        constants[UART_CONST_HANDLE] = rx_validity->handle;
+        constants[UART_CONST_CLOCK] = (uint32_t)rx_validity->uart_clock;
+        constants[UART_CONST_BAUDRATE] = baud_rate;
+        constants[UART_CONST_RX_PORT] = rx_port;
+        constants[UART_CONST_TX_PORT] = tx_port;
+        constants[UART_CONST_RX_PIN] = rx_pin;
+        constants[UART_CONST_TX_PIN] = tx_pin;
         // These two should be the same
-        enum rcc_periph_clken rx_clock = getClockFromPort(rx_port);
-        enum rcc_periph_clken tx_clock = getClockFromPort(tx_port);
-
-        // As we have to check 2 different pins, I decided it was best to get all the peripheral
-        // info (clock, handle, etc) first and then check that each pin is mutatable.
-        PeripheralType rx_exists = pinExists(bc, rx_port, rx_pin);
-        PeripheralType tx_exists = pinExists(bc, tx_port, tx_pin);
-
-        // Get the NVIC entry for this specific UART
-        int            nvic_entry = getUARTNVICEntry(handle);
-        if (nvic_entry == 0)
-        {
-            printf("Error: Could not find NVIC entry for that UART port.\r\n");
-            return false;
-        }
-
-        // Here's where we actually build the UART peripheral
-        // First option if both pins are free
-        if (rx_exists == TYPE_NONE && tx_exists == TYPE_NONE)
-        {
-            // This means neither pin was already set up. We can set up normally.
-            createUART(bc, handle, uart_clock, baud_rate, rx_port, tx_port, rx_pin, tx_pin,
-                       rx_clock, tx_clock, rx_validity.af_mode, tx_validity.af_mode, nvic_entry);
-            printf("> Created new UART peripheral.\r\n");
-        }
-        else
-        {
-            // If one or both pins are already initialised, this gets executed.
-            if (rx_exists != TYPE_NONE && tx_exists == TYPE_NONE)
-            {
-                killPeripheralOrPin(bc, rx_port, rx_pin);
-            }
-            else if (rx_exists == TYPE_NONE && tx_exists != TYPE_NONE)
-            {
-                killPeripheralOrPin(bc, tx_port, tx_pin);
-            }
-            else
-            {
-                killPeripheralOrPin(bc, rx_port, rx_pin);
-                killPeripheralOrPin(bc, tx_port, tx_pin);
-            }
-
-            // After all those peripherals are killed, we just build the UART as normal.
-            createUART(bc, handle, uart_clock, baud_rate, rx_port, tx_port, rx_pin, tx_pin,
-                       rx_clock, tx_clock, rx_validity.af_mode, tx_validity.af_mode, nvic_entry);
-            printf("> Created new UART peripheral.\r\n");
-        }
-        return true;
+        constants[UART_CONST_RX_CLOCK] = (uint32_t)getClockFromPort(rx_port);
+        constants[UART_CONST_TX_CLOCK] = (uint32_t)getClockFromPort(tx_port);
+        constants[UART_CONST_RX_AF] = rx_validity->af_mode;
+        constants[UART_CONST_TX_AF] = tx_validity->af_mode;
+        constants[UART_CONST_NVIC] = rx_validity->nvic_entry;
+        int index = addConstants(chunk, constants, UART_CONST_COUNT);
+        return index >= 0 && writeChunk(chunk, OP_UART_INIT, 0, 0, (uint32_t)index) != NULL;
     }
     else
     {
@@ -843,94 +654,1815 @@ static bool uartInitialise(BoardController *bc, TokenVector *vec)
 }
 
 /**
- * @brief UART function. Decides what to do when a UART keyword is detected.
+ * @brief Decodes an optional UART selector ("1" or "6", or "2" for the console).
+ *
+ * @param token number token
+ * @param handle returned uart handle
+ * @return true valid selector
+ * @return false not a UART
+ */
+static bool parseUARTSelector(Token token, uint32_t *handle)
+{
+    uint32_t selector = strtoul(token.start, NULL, 10);
+    switch (selector)
+    {
+    case 1:
+        *handle = USART1;
+        return true;
+    case 2:
+        *handle = USART2;
+        return true;
+    case 6:
+        *handle = USART6;
+        return true;
+    default:
+        printf("> Parse Error: UART selector must be 1, 6 or 2 (console), not \"%.*s\".\r\n",
+               token.length, token.start);
+        return false;
+    }
+}
+
+/**
+ * @brief Compiles "uart [selector] flow none|xonxoff|rtscts".
  *
- * @param bc Board controller object
  * @param vec vector of tokens
- * @return true if uart function was successful
- * @return false if uart function was unsuccesful
+ * @param chunk chunk to compile into
+ * @param index index of the "flow" token
+ * @param handle selected uart, USART2 for the console
+ * @return true if flow line compiled
+ * @return false if flow line did not compile
  */
-static bool uart(BoardController *bc, TokenVector *vec)
+static bool uartFlow(TokenVector *vec, Chunk *chunk, size_t index, uint32_t handle)
 {
-    Token next_token = getTokenVector(vec, 1);
-    if (next_token.type == TOKEN_PORT_PIN)
+    Token           next_token = getTokenVector(vec, index + 1);
+    UartFlowControl flow;
+    switch (next_token.type)
     {
-        // initialise UART
-        return uartInitialise(bc, vec);
+    case TOKEN_GPIO_NORESISTOR:
+        flow = UART_FLOW_NONE;
+        break;
+    case TOKEN_XONXOFF:
+        flow = UART_FLOW_XONXOFF;
+        break;
+    case TOKEN_RTSCTS:
+        flow = UART_FLOW_RTSCTS;
+        break;
+    default:
+        printf("> Parse Error: \"uart flow\" must be followed by \"none\", \"xonxoff\" or "
+               "\"rtscts\", not \"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
     }
-    else if (next_token.type == TOKEN_GPIO_READ)
+
+    if (handle == USART2 && flow == UART_FLOW_RTSCTS)
     {
-        // Read UART
-        char read_buffer[UART_MAX_READ];
-        uint32_t read_size = readUARTPort(bc, read_buffer, (size_t)UART_MAX_READ);
-        if (read_size > 0)
+        printf("> Parse Error: The console has no RTS/CTS lines, use \"xonxoff\".\r\n");
+        return false;
+    }
+    return writeChunk(chunk, OP_UART_FLOW, handle, 0, (uint32_t)flow) != NULL;
+}
+
+/**
+ * @brief UART function. Decides what to compile when a UART keyword is detected. read, write,
+ * stats and bridge can be given a selector ("uart 6 read") when more than one UART is running.
+ * "flow" also takes "2" for the console.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if uart line compiled
+ * @return false if uart line did not compile
+ */
+static bool uart(TokenVector *vec, Chunk *chunk)
+{
+    size_t   index = 1;
+    uint32_t handle = UART_ANY;
+    Token    next_token = getTokenVector(vec, index);
+    if (next_token.type == TOKEN_NUMBER)
+    {
+        if (!parseUARTSelector(next_token, &handle))
         {
-            printf("> UART READ = \"%s\" (%lu bytes)\r\n", read_buffer, read_size);
-            return true;
-        }
-        else {
-            printf("> Error: UART buffer empty.\r\n");
             return false;
         }
+        next_token = getTokenVector(vec, ++index);
     }
-    else if (next_token.type == TOKEN_WRITE)
+
+    if (next_token.type == TOKEN_FLOW)
+    {
+        return uartFlow(vec, chunk, index, handle);
+    }
+    else if (handle == USART2)
+    {
+        printf("> Parse Error: UART 2 is the console, only \"uart 2 flow\" applies to it.\r\n");
+        return false;
+    }
+    else if (next_token.type == TOKEN_PORT_PIN && handle == UART_ANY)
+    {
+        // initialise UART
+        return uartInitialise(vec, chunk);
+    }
+    else if (next_token.type == TOKEN_GPIO_READ)
+    {
+        // Read UART
+        return writeChunk(chunk, OP_UART_READ, handle, 0, 0) != NULL;
+    }
+    else if (next_token.type == TOKEN_STATS)
+    {
+        // Receive error counters
+        return writeChunk(chunk, OP_UART_STATS, handle, 0, 0) != NULL;
+    }
+    else if (next_token.type == TOKEN_BRIDGE)
+    {
+        // Pass console bytes straight through until the escape sequence
+        return writeChunk(chunk, OP_UART_BRIDGE, handle, 0, 0) != NULL;
+    }
+    else if (next_token.type == TOKEN_WRITE)
+    {
+        // Write UART
+        next_token = getTokenVector(vec, index + 1);
+        if (next_token.type == TOKEN_STRING)
+        {
+            int offset = addString(chunk, next_token.start, (size_t)next_token.length);
+            return offset >= 0 &&
+                   writeChunk(chunk, OP_UART_WRITE, handle, 0,
+                              ((uint32_t)offset << 16) | (uint32_t)next_token.length) != NULL;
+        }
+        else {
+            printf("> Error: \"uart write\" function must be followed by string enclosed in qoutes (\").\r\n");
+            return false;
+        }
+    }
+    else
+    {
+        printf("> Parse Error: \"uart\" keyword must be followed by either port pin "
+               "identifier, \"read\", \"stats\", \"bridge\", \"flow <mode>\" or "
+               "\"write <string>\", not \"%.*s\".",
+               next_token.length, next_token.start);
+        return false;
+    }
+}
+
+/**
+ * @brief Looks up a pin's mapping on one SPI.
+ *
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param handle SPI the pin has to be on
+ * @param role what the pin has to carry
+ * @return const SPIPinMapping* mapping for the pin, NULL if it can't be that pin of that SPI.
+ */
+static const SPIPinMapping *getSPIInfo(uint32_t port, uint32_t pin, uint32_t handle,
+                                       SPIPinRole role)
+{
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    for (uint32_t entries = board_pin != NULL ? board_pin->spi : 0; entries != 0;
+         entries &= entries - 1)
+    {
+        const SPIPinMapping *mapping = &spiPinMappings[__builtin_ctz(entries)];
+        if (mapping->handle == handle && mapping->role == role)
+        {
+            return mapping;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fills in the constants for one SPI pin.
+ *
+ * @param constants constants group being built
+ * @param first the pin's SPI_CONST_*_PORT entry, PIN, CLOCK and AF follow it
+ * @param mapping mapping of the pin
+ */
+static void spiPinConstants(uint32_t *constants, SPIConstant first, const SPIPinMapping *mapping)
+{
+    constants[first] = mapping->port;
+    constants[first + 1] = mapping->pin;
+    constants[first + 2] = (uint32_t)getClockFromPort(mapping->port);
+    constants[first + 3] = mapping->af_mode;
+}
+
+/**
+ * @brief Parses an SPI creation line, "spi <sck> <miso> <mosi> [divider] [mode <0-3>]". The SPI
+ * is whichever one has all three pins.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true compiled successfully
+ * @return false compile unsuccessful
+ */
+static bool spiInitialise(TokenVector *vec, Chunk *chunk)
+{
+    size_t vec_size = sizeTokenVector(vec);
+    // Ignore end of line token.
+    if (vec_size - 1 < SPI_INIT_MIN_ARGS || vec_size - 1 > SPI_INIT_MAX_ARGS)
+    {
+        printf("> Parse Error: Invalid input format, use \"spi <sck> <miso> <mosi> [divider] "
+               "[mode <0-3>]\". See documentation for more information.\r\n");
+        return false;
+    }
+
+    uint32_t ports[3];
+    uint32_t pins[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        Token pin_token = getTokenVector(vec, i + 1);
+        if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &ports[i], &pins[i]))
+        {
+            printf("> Parse Error: Unable to parse SPI pin \"%.*s\".\r\n", pin_token.length,
+                   pin_token.start);
+            return false;
+        }
+    }
+
+    uint32_t divider = SPI_DEFAULT_DIVIDER;
+    uint32_t spi_mode = 0;
+    for (size_t i = 4; i < vec_size - 1; i++)
+    {
+        Token current_token = getTokenVector(vec, i);
+        if (current_token.type == TOKEN_NUMBER && i == 4)
+        {
+            divider = strtoul(current_token.start, NULL, 10);
+            if (divider < SPI_MIN_DIVIDER || divider > SPI_MAX_DIVIDER ||
+                (divider & (divider - 1)) != 0)
+            {
+                printf("> Parse Error: SPI divider must be 2, 4, 8, 16, 32, 64, 128 or 256, not "
+                       "\"%.*s\".\r\n",
+                       current_token.length, current_token.start);
+                return false;
+            }
+        }
+        else if (current_token.type == TOKEN_MODE && i + 1 < vec_size - 1)
+        {
+            Token value_token = getTokenVector(vec, ++i);
+            spi_mode = value_token.type == TOKEN_NUMBER ? strtoul(value_token.start, NULL, 10)
+                                                        : SPI_MAX_MODE + 1;
+            if (spi_mode > SPI_MAX_MODE)
+            {
+                printf("> Parse Error: SPI mode must be 0 to %d, not \"%.*s\".\r\n", SPI_MAX_MODE,
+                       value_token.length, value_token.start);
+                return false;
+            }
+        }
+        else
+        {
+            printf("> Parse Error: Unrecognised token while parsing: \"%.*s\".\r\n",
+                   current_token.length, current_token.start);
+            return false;
+        }
+    }
+
+    // Every SPI the clock pin is on, until one has the other two as well.
+    const SPIPinMapping *sck = NULL;
+    const SPIPinMapping *miso = NULL;
+    const SPIPinMapping *mosi = NULL;
+    const BoardPin      *sck_pin = getBoardPin(ports[0], pins[0]);
+    for (uint32_t entries = sck_pin != NULL ? sck_pin->spi : 0; entries != 0 && mosi == NULL;
+         entries &= entries - 1)
+    {
+        uint32_t handle = spiPinMappings[__builtin_ctz(entries)].handle;
+        sck = getSPIInfo(ports[0], pins[0], handle, SPI_PIN_SCK);
+        miso = getSPIInfo(ports[1], pins[1], handle, SPI_PIN_MISO);
+        if (sck != NULL && miso != NULL)
+        {
+            mosi = getSPIInfo(ports[2], pins[2], handle, SPI_PIN_MOSI);
+        }
+    }
+    if (mosi == NULL)
+    {
+        printf("> Error: Pins are not the SCK, MISO and MOSI of one SPI. Please consult "
+               "datasheet.\r\n");
+        return false;
+    }
+
+    uint32_t constants[SPI_CONST_COUNT];
+    constants[SPI_CONST_HANDLE] = sck->handle;
+    constants[SPI_CONST_CLOCK] = (uint32_t)sck->spi_clock;
+    constants[SPI_CONST_DIVIDER] = divider;
+    constants[SPI_CONST_MODE] = spi_mode;
+    spiPinConstants(constants, SPI_CONST_SCK_PORT, sck);
+    spiPinConstants(constants, SPI_CONST_MISO_PORT, miso);
+    spiPinConstants(constants, SPI_CONST_MOSI_PORT, mosi);
+    int index = addConstants(chunk, constants, SPI_CONST_COUNT);
+    return index >= 0 && writeChunk(chunk, OP_SPI_INIT, 0, 0, (uint32_t)index) != NULL;
+}
+
+/**
+ * @brief Returns the value of a hex digit.
+ *
+ * @param digit character to decode
+ * @return int 0-15, -1 if not a hex digit
+ */
+static int hexDigit(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+    {
+        return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f')
+    {
+        return digit - 'a' + 10;
+    }
+    if (digit >= 'A' && digit <= 'F')
+    {
+        return digit - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Decodes a string of hex bytes, two digits each and optionally spaced, e.g. "9f 00 00".
+ *
+ * @param token string token
+ * @param bytes returned bytes
+ * @param max room in bytes
+ * @param count returned number of bytes
+ * @return true decoded
+ * @return false not hex bytes, or too many
+ */
+static bool parseHexBytes(Token token, uint8_t *bytes, size_t max, size_t *count)
+{
+    *count = 0;
+    for (int i = 0; i < token.length; i++)
+    {
+        if (token.start[i] == ' ')
+        {
+            continue;
+        }
+        int high = hexDigit(token.start[i]);
+        int low = i + 1 < token.length ? hexDigit(token.start[i + 1]) : -1;
+        if (high < 0 || low < 0 || *count == max)
+        {
+            return false;
+        }
+        bytes[(*count)++] = (uint8_t)((high << 4) | low);
+        i++;
+    }
+    return *count > 0;
+}
+
+/**
+ * @brief Decodes an optional SPI selector, "1" to "5".
+ *
+ * @param token number token
+ * @param handle returned SPI handle
+ * @return true valid selector
+ * @return false not an SPI
+ */
+static bool parseSPISelector(Token token, uint32_t *handle)
+{
+    static const uint32_t handles[] = {SPI1, SPI2, SPI3, SPI4, SPI5};
+    uint32_t              selector = strtoul(token.start, NULL, 10);
+    if (selector < 1 || selector > sizeof(handles) / sizeof(handles[0]))
+    {
+        printf("> Parse Error: SPI selector must be 1 to 5, not \"%.*s\".\r\n", token.length,
+               token.start);
+        return false;
+    }
+    *handle = handles[selector - 1];
+    return true;
+}
+
+/**
+ * @brief SPI function. Decides what to compile when an SPI keyword is detected. xfer and read can
+ * be given a selector ("spi 2 read 4") when more than one SPI is running.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if spi line compiled
+ * @return false if spi line did not compile
+ */
+static bool spi(TokenVector *vec, Chunk *chunk)
+{
+    size_t   index = 1;
+    uint32_t handle = SPI_ANY;
+    Token    next_token = getTokenVector(vec, index);
+    if (next_token.type == TOKEN_NUMBER)
+    {
+        if (!parseSPISelector(next_token, &handle))
+        {
+            return false;
+        }
+        next_token = getTokenVector(vec, ++index);
+    }
+
+    if (next_token.type == TOKEN_PORT_PIN && handle == SPI_ANY)
+    {
+        return spiInitialise(vec, chunk);
+    }
+    else if (next_token.type == TOKEN_XFER)
+    {
+        // Send bytes, the ones clocked in are printed
+        next_token = getTokenVector(vec, index + 1);
+        uint8_t bytes[CHUNK_MAX_STRINGS];
+        size_t  count = 0;
+        if (next_token.type != TOKEN_STRING ||
+            !parseHexBytes(next_token, bytes, sizeof(bytes), &count))
+        {
+            printf("> Parse Error: \"spi xfer\" must be followed by hex bytes enclosed in quotes, "
+                   "e.g. \"9f 00 00\", up to %d bytes.\r\n",
+                   CHUNK_MAX_STRINGS);
+            return false;
+        }
+        int offset = addString(chunk, (const char *)bytes, count);
+        return offset >= 0 && writeChunk(chunk, OP_SPI_XFER, handle, 0,
+                                         ((uint32_t)offset << 16) | (uint32_t)count) != NULL;
+    }
+    else if (next_token.type == TOKEN_GPIO_READ)
+    {
+        // Clock in bytes, sending 0xFF
+        next_token = getTokenVector(vec, index + 1);
+        uint32_t count =
+            next_token.type == TOKEN_NUMBER ? strtoul(next_token.start, NULL, 10) : 0;
+        if (count < 1 || count > SPI_MAX_TRANSFER)
+        {
+            printf("> Parse Error: \"spi read\" must be followed by a byte count, 1 to %d.\r\n",
+                   SPI_MAX_TRANSFER);
+            return false;
+        }
+        return writeChunk(chunk, OP_SPI_READ, handle, 0, count) != NULL;
+    }
+    else
+    {
+        printf("> Parse Error: \"spi\" keyword must be followed by either SCK, MISO and MOSI "
+               "port pin identifiers, \"xfer <hex bytes>\" or \"read <count>\", not \"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+}
+
+/**
+ * @brief Looks up a pin's mapping on one I2C.
+ *
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param handle I2C the pin has to be on
+ * @param role what the pin has to carry
+ * @return const I2CPinMapping* mapping for the pin, NULL if it can't be that pin of that I2C.
+ */
+static const I2CPinMapping *getI2CInfo(uint32_t port, uint32_t pin, uint32_t handle,
+                                       I2CPinRole role)
+{
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    for (uint32_t entries = board_pin != NULL ? board_pin->i2c : 0; entries != 0;
+         entries &= entries - 1)
+    {
+        const I2CPinMapping *mapping = &i2cPinMappings[__builtin_ctz(entries)];
+        if (mapping->handle == handle && mapping->role == role)
+        {
+            return mapping;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fills in the constants for one I2C pin.
+ *
+ * @param constants constants group being built
+ * @param first the pin's I2C_CONST_*_PORT entry, PIN, CLOCK and AF follow it
+ * @param mapping mapping of the pin
+ */
+static void i2cPinConstants(uint32_t *constants, I2CInitConstant first,
+                            const I2CPinMapping *mapping)
+{
+    constants[first] = mapping->port;
+    constants[first + 1] = mapping->pin;
+    constants[first + 2] = (uint32_t)getClockFromPort(mapping->port);
+    constants[first + 3] = mapping->af_mode;
+}
+
+/**
+ * @brief Parses an I2C creation line, "i2c <scl> <sda> [100|400]". The I2C is whichever one has
+ * both pins.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true compiled successfully
+ * @return false compile unsuccessful
+ */
+static bool i2cInitialise(TokenVector *vec, Chunk *chunk)
+{
+    size_t vec_size = sizeTokenVector(vec);
+    // Ignore end of line token.
+    if (vec_size - 1 < I2C_INIT_MIN_ARGS || vec_size - 1 > I2C_INIT_MAX_ARGS)
+    {
+        printf("> Parse Error: Invalid input format, use \"i2c <scl> <sda> [100|400]\". See "
+               "documentation for more information.\r\n");
+        return false;
+    }
+
+    uint32_t ports[2];
+    uint32_t pins[2];
+    for (size_t i = 0; i < 2; i++)
+    {
+        Token pin_token = getTokenVector(vec, i + 1);
+        if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &ports[i], &pins[i]))
+        {
+            printf("> Parse Error: Unable to parse I2C pin \"%.*s\".\r\n", pin_token.length,
+                   pin_token.start);
+            return false;
+        }
+    }
+
+    uint32_t speed_khz = I2C_STANDARD_KHZ;
+    if (vec_size - 1 == I2C_INIT_MAX_ARGS)
+    {
+        Token speed_token = getTokenVector(vec, 3);
+        speed_khz = speed_token.type == TOKEN_NUMBER ? strtoul(speed_token.start, NULL, 10) : 0;
+        if (speed_khz != I2C_STANDARD_KHZ && speed_khz != I2C_FAST_KHZ)
+        {
+            printf("> Parse Error: I2C speed must be %d or %d kHz, not \"%.*s\".\r\n",
+                   I2C_STANDARD_KHZ, I2C_FAST_KHZ, speed_token.length, speed_token.start);
+            return false;
+        }
+    }
+
+    // Every I2C the clock pin is on, until one has the data pin as well.
+    const I2CPinMapping *scl = NULL;
+    const I2CPinMapping *sda = NULL;
+    const BoardPin      *scl_pin = getBoardPin(ports[0], pins[0]);
+    for (uint32_t entries = scl_pin != NULL ? scl_pin->i2c : 0; entries != 0 && sda == NULL;
+         entries &= entries - 1)
+    {
+        uint32_t handle = i2cPinMappings[__builtin_ctz(entries)].handle;
+        scl = getI2CInfo(ports[0], pins[0], handle, I2C_PIN_SCL);
+        if (scl != NULL)
+        {
+            sda = getI2CInfo(ports[1], pins[1], handle, I2C_PIN_SDA);
+        }
+    }
+    if (sda == NULL)
+    {
+        printf("> Error: Pins are not the SCL and SDA of one I2C. Please consult "
+               "datasheet.\r\n");
+        return false;
+    }
+
+    uint32_t constants[I2C_CONST_COUNT];
+    constants[I2C_CONST_HANDLE] = scl->handle;
+    constants[I2C_CONST_CLOCK] = (uint32_t)scl->i2c_clock;
+    constants[I2C_CONST_SPEED] = speed_khz;
+    i2cPinConstants(constants, I2C_CONST_SCL_PORT, scl);
+    i2cPinConstants(constants, I2C_CONST_SDA_PORT, sda);
+    int index = addConstants(chunk, constants, I2C_CONST_COUNT);
+    return index >= 0 && writeChunk(chunk, OP_I2C_INIT, 0, 0, (uint32_t)index) != NULL;
+}
+
+/**
+ * @brief Decodes an optional I2C selector, "1" to "3".
+ *
+ * @param token number token
+ * @param handle returned I2C handle
+ * @return true valid selector
+ * @return false not an I2C
+ */
+static bool parseI2CSelector(Token token, uint32_t *handle)
+{
+    static const uint32_t handles[] = {I2C1, I2C2, I2C3};
+    uint32_t              selector = strtoul(token.start, NULL, 10);
+    if (selector < 1 || selector > sizeof(handles) / sizeof(handles[0]))
+    {
+        printf("> Parse Error: I2C selector must be 1 to 3, not \"%.*s\".\r\n", token.length,
+               token.start);
+        return false;
+    }
+    *handle = handles[selector - 1];
+    return true;
+}
+
+/**
+ * @brief Parses a batch of I2C transactions, each "write \"<addr> <bytes>\"", "read \"<addr>\"
+ * <count>" or "xfer \"<addr> <bytes>\" <count>", into one instruction. The address is the first
+ * hex byte and is stored with the bytes written.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @param index token of the first transaction
+ * @param handle I2C to run on, I2C_ANY for the first one set up
+ * @return true compiled successfully
+ * @return false compile unsuccessful
+ */
+static bool i2cBatch(TokenVector *vec, Chunk *chunk, size_t index, uint32_t handle)
+{
+    size_t   vec_size = sizeTokenVector(vec);
+    uint32_t constants[I2C_MAX_TRANSACTIONS * I2C_CONST_PER_TRANSACTION];
+    size_t   count = 0;
+    size_t   written = 0;
+    size_t   read = 0;
+    while (index < vec_size - 1)
+    {
+        Token kind_token = getTokenVector(vec, index);
+        if (kind_token.type != TOKEN_WRITE && kind_token.type != TOKEN_GPIO_READ &&
+            kind_token.type != TOKEN_XFER)
+        {
+            printf("> Parse Error: Unrecognised token while parsing: \"%.*s\".\r\n",
+                   kind_token.length, kind_token.start);
+            return false;
+        }
+        if (count == I2C_MAX_TRANSACTIONS)
+        {
+            printf("> Parse Error: An I2C batch has at most %d transactions.\r\n",
+                   I2C_MAX_TRANSACTIONS);
+            return false;
+        }
+
+        Token   bytes_token = getTokenVector(vec, index + 1);
+        uint8_t bytes[1 + I2C_MAX_WRITE];
+        size_t  length = 0;
+        if (bytes_token.type != TOKEN_STRING ||
+            !parseHexBytes(bytes_token, bytes, sizeof(bytes), &length) ||
+            bytes[0] > I2C_ADDRESS_MAX || (kind_token.type == TOKEN_GPIO_READ && length != 1))
+        {
+            printf("> Parse Error: \"i2c %.*s\" must be followed by a 7 bit address%s in hex "
+                   "enclosed in quotes, e.g. \"%s\".\r\n",
+                   kind_token.length, kind_token.start,
+                   kind_token.type == TOKEN_GPIO_READ ? "" : " and the bytes to write",
+                   kind_token.type == TOKEN_GPIO_READ ? "68" : "68 75");
+            return false;
+        }
+        index += 2;
+
+        uint32_t read_length = 0;
+        if (kind_token.type != TOKEN_WRITE)
+        {
+            Token count_token = getTokenVector(vec, index++);
+            read_length =
+                count_token.type == TOKEN_NUMBER ? strtoul(count_token.start, NULL, 10) : 0;
+            if (read_length < 1 || read_length > I2C_MAX_READ)
+            {
+                printf("> Parse Error: \"i2c %.*s\" needs a byte count to read, 1 to %d.\r\n",
+                       kind_token.length, kind_token.start, I2C_MAX_READ);
+                return false;
+            }
+        }
+
+        written += length - 1;
+        read += read_length;
+        if (written > I2C_MAX_WRITE || read > I2C_MAX_READ)
+        {
+            printf("> Parse Error: An I2C batch writes at most %d bytes and reads at most %d.\r\n",
+                   I2C_MAX_WRITE, I2C_MAX_READ);
+            return false;
+        }
+        int offset = addString(chunk, (const char *)bytes, length);
+        if (offset < 0)
+        {
+            return false;
+        }
+        constants[count * I2C_CONST_PER_TRANSACTION + I2C_CONST_WRITE] =
+            ((uint32_t)offset << 16) | (uint32_t)length;
+        constants[count * I2C_CONST_PER_TRANSACTION + I2C_CONST_READ] = read_length;
+        count++;
+    }
+
+    int constants_index = addConstants(chunk, constants, count * I2C_CONST_PER_TRANSACTION);
+    return constants_index >= 0 && writeChunk(chunk, OP_I2C_BATCH, handle, (uint16_t)count,
+                                              (uint32_t)constants_index) != NULL;
+}
+
+/**
+ * @brief I2C function. Decides what to compile when an I2C keyword is detected. Transactions and
+ * scans can be given a selector ("i2c 2 scan") when more than one I2C is running.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if i2c line compiled
+ * @return false if i2c line did not compile
+ */
+static bool i2c(TokenVector *vec, Chunk *chunk)
+{
+    size_t   vec_size = sizeTokenVector(vec);
+    size_t   index = 1;
+    uint32_t handle = I2C_ANY;
+    Token    next_token = getTokenVector(vec, index);
+    if (next_token.type == TOKEN_NUMBER)
+    {
+        if (!parseI2CSelector(next_token, &handle))
+        {
+            return false;
+        }
+        next_token = getTokenVector(vec, ++index);
+    }
+
+    if (next_token.type == TOKEN_PORT_PIN && handle == I2C_ANY)
+    {
+        return i2cInitialise(vec, chunk);
+    }
+    else if (next_token.type == TOKEN_SCAN && index + 1 == vec_size - 1)
+    {
+        return writeChunk(chunk, OP_I2C_SCAN, handle, 0, 0) != NULL;
+    }
+    else if (next_token.type == TOKEN_WRITE || next_token.type == TOKEN_GPIO_READ ||
+             next_token.type == TOKEN_XFER)
+    {
+        return i2cBatch(vec, chunk, index, handle);
+    }
+    else
+    {
+        printf("> Parse Error: \"i2c\" keyword must be followed by either SCL and SDA port pin "
+               "identifiers, \"scan\" or transactions (\"write\", \"read\" or \"xfer\"), not "
+               "\"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+}
+
+/**
+ * @brief Parses a port given on its own as a letter, A-E in either case.
+ *
+ * @param token identifier token
+ * @param port returned GPIO port
+ * @return true parsed
+ * @return false not a port letter
+ */
+static bool parsePortLetter(Token token, uint32_t *port)
+{
+    if (token.type != TOKEN_IDENTIFIER || token.length != 1)
+    {
+        return false;
+    }
+    uint8_t port_index = BOARD_PORT_INDEX(token.start[0]);
+    if (port_index >= BOARD_PORT_COUNT)
+    {
+        return false;
+    }
+    *port = boardPorts[port_index].base;
+    return true;
+}
+
+/**
+ * @brief capture function. "capture <port> <rate> <samples> [trigger [set <pins>] [reset <pins>]]"
+ * samples a port's input pins, from the first sample where the "set" pins are high and the
+ * "reset" pins low when a trigger is given. "capture stop" abandons it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if capture line compiled
+ * @return false if capture line did not compile
+ */
+static bool capture(TokenVector *vec, Chunk *chunk)
+{
+    size_t vec_size = sizeTokenVector(vec);
+    Token  next_token = getTokenVector(vec, 1);
+    if (next_token.type == TOKEN_STOP && vec_size - 1 == 2)
+    {
+        return writeChunk(chunk, OP_CAPTURE_STOP, 0, 0, 0) != NULL;
+    }
+    // Ignore end of line token.
+    if (vec_size - 1 < CAPTURE_MIN_ARGS)
+    {
+        printf("> Parse Error: Invalid input format, use \"capture <port> <rate> <samples> "
+               "[trigger [set <pins>] [reset <pins>]]\" or \"capture stop\".\r\n");
+        return false;
+    }
+
+    uint32_t port = 0;
+    if (!parsePortLetter(next_token, &port))
+    {
+        printf("> Parse Error: Capture port must be a letter A to E, not \"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+
+    Token    rate_token = getTokenVector(vec, 2);
+    uint32_t rate_hz = rate_token.type == TOKEN_NUMBER ? strtoul(rate_token.start, NULL, 10) : 0;
+    if (rate_hz < CAPTURE_MIN_HZ || rate_hz > CAPTURE_MAX_HZ)
+    {
+        printf("> Parse Error: Capture rate must be %d to %d Hz, not \"%.*s\".\r\n",
+               CAPTURE_MIN_HZ, CAPTURE_MAX_HZ, rate_token.length, rate_token.start);
+        return false;
+    }
+
+    // A triggered capture is searched a half at a time, so the count has to split in two.
+    Token    samples_token = getTokenVector(vec, 3);
+    uint32_t samples =
+        samples_token.type == TOKEN_NUMBER ? strtoul(samples_token.start, NULL, 10) : 0;
+    if (samples < CAPTURE_MIN_SAMPLES || samples > CAPTURE_MAX_SAMPLES || (samples & 1) != 0)
+    {
+        printf("> Parse Error: Capture samples must be even and %d to %d, not \"%.*s\".\r\n",
+               CAPTURE_MIN_SAMPLES, CAPTURE_MAX_SAMPLES, samples_token.length,
+               samples_token.start);
+        return false;
+    }
+
+    uint16_t  set_mask = 0;
+    uint16_t  clear_mask = 0;
+    uint16_t *current_mask = NULL;
+    size_t    index = CAPTURE_MIN_ARGS;
+    if (getTokenVector(vec, index).type == TOKEN_TRIGGER)
+    {
+        for (index++; index < vec_size - 1; index++)
+        {
+            Token    current_token = getTokenVector(vec, index);
+            uint32_t pin_port = 0;
+            uint32_t pin = 0;
+            if (current_token.type == TOKEN_GPIO_SET)
+            {
+                current_mask = &set_mask;
+            }
+            else if (current_token.type == TOKEN_GPIO_RESET)
+            {
+                current_mask = &clear_mask;
+            }
+            else if (current_token.type == TOKEN_PORT_PIN && current_mask != NULL &&
+                     parsePortPin(current_token, &pin_port, &pin))
+            {
+                if (pin_port != port)
+                {
+                    printf("> Parse Error: Trigger pins must be on the captured port.\r\n");
+                    return false;
+                }
+                *current_mask |= (uint16_t)pin;
+            }
+            else
+            {
+                printf("> Parse Error: Trigger pins must follow \"set\" or \"reset\", not "
+                       "\"%.*s\".\r\n",
+                       current_token.length, current_token.start);
+                return false;
+            }
+        }
+        if ((set_mask | clear_mask) == 0 || (set_mask & clear_mask) != 0)
+        {
+            printf("> Parse Error: A trigger needs at least one pin, and no pin both \"set\" and "
+                   "\"reset\".\r\n");
+            return false;
+        }
+    }
+    else if (index != vec_size - 1)
+    {
+        Token extra = getTokenVector(vec, index);
+        printf("> Parse Error: Expected \"trigger\" after the sample count, not \"%.*s\".\r\n",
+               extra.length, extra.start);
+        return false;
+    }
+
+    uint32_t constants[CAPTURE_CONST_COUNT];
+    constants[CAPTURE_CONST_RATE] = rate_hz;
+    constants[CAPTURE_CONST_SAMPLES] = samples;
+    constants[CAPTURE_CONST_TRIGGER_VALUE] = set_mask;
+    int constant_index = addConstants(chunk, constants, CAPTURE_CONST_COUNT);
+    if (constant_index < 0)
+    {
+        return false;
+    }
+    return writeChunk(chunk, OP_CAPTURE, port, set_mask | clear_mask, (uint32_t)constant_index) !=
+           NULL;
+}
+
+/**
+ * @brief stream function. "stream [rate]" starts sending every ADC scan frame to the console,
+ * "stream stop" ends it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if stream line compiled
+ * @return false if stream line did not compile
+ */
+static bool stream(TokenVector *vec, Chunk *chunk)
+{
+    Token    next_token = getTokenVector(vec, 1);
+    uint32_t rate_hz = ADC_STREAM_DEFAULT_HZ;
+    if (next_token.type == TOKEN_STOP)
+    {
+        rate_hz = 0;
+    }
+    else if (next_token.type == TOKEN_NUMBER)
+    {
+        rate_hz = strtoul(next_token.start, NULL, 10);
+        if (rate_hz < ADC_SCAN_MIN_HZ || rate_hz > ADC_SCAN_MAX_HZ)
+        {
+            printf("> Parse Error: Stream rate must be %d to %d Hz, not \"%.*s\".\r\n",
+                   ADC_SCAN_MIN_HZ, ADC_SCAN_MAX_HZ, next_token.length, next_token.start);
+            return false;
+        }
+    }
+    else if (next_token.type != TOKEN_EOL)
+    {
+        printf("> Parse Error: \"stream\" keyword must be followed by a rate in Hz or \"stop\", "
+               "not \"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+
+    return writeChunk(chunk, OP_STREAM, 0, 0, rate_hz) != NULL;
+}
+
+/**
+ * @brief clockSpeed function. "clock <mhz>" moves the CPU to a new clock, "clock" prints it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if clock line compiled
+ * @return false if clock line did not compile
+ */
+static bool clockSpeed(TokenVector *vec, Chunk *chunk)
+{
+    Token    next_token = getTokenVector(vec, 1);
+    uint32_t mhz = 0;
+    if (next_token.type == TOKEN_NUMBER)
+    {
+        mhz = strtoul(next_token.start, NULL, 10);
+        if (mhz < SYSTEM_CLOCK_MIN_MHZ || mhz > SYSTEM_CLOCK_MAX_MHZ)
+        {
+            printf("> Parse Error: Clock must be %d to %d MHz, not \"%.*s\".\r\n",
+                   SYSTEM_CLOCK_MIN_MHZ, SYSTEM_CLOCK_MAX_MHZ, next_token.length,
+                   next_token.start);
+            return false;
+        }
+    }
+    else if (next_token.type != TOKEN_EOL)
+    {
+        printf("> Parse Error: \"clock\" keyword must be followed by a frequency in MHz, not "
+               "\"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+
+    return writeChunk(chunk, OP_CLOCK, 0, 0, mhz) != NULL;
+}
+
+/**
+ * @brief mode function. "mode binary" switches the console to framed output, "mode text" back.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if mode line compiled
+ * @return false if mode line did not compile
+ */
+static bool mode(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    if (next_token.type != TOKEN_BINARY && next_token.type != TOKEN_TEXT)
+    {
+        printf("> Parse Error: \"mode\" keyword must be followed by \"binary\" or \"text\", not "
+               "\"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+    return writeChunk(chunk, OP_MODE, 0, 0, next_token.type == TOKEN_BINARY ? 1 : 0) != NULL;
+}
+
+/**
+ * @brief verbosity function. "verbosity full|terse|silent" sets how much the console replies.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if verbosity line compiled
+ * @return false if verbosity line did not compile
+ */
+static bool verbosity(TokenVector *vec, Chunk *chunk)
+{
+    Token     next_token = getTokenVector(vec, 1);
+    Verbosity level;
+    switch (next_token.type)
+    {
+    case TOKEN_FULL:
+        level = VERBOSITY_FULL;
+        break;
+    case TOKEN_TERSE:
+        level = VERBOSITY_TERSE;
+        break;
+    case TOKEN_SILENT:
+        level = VERBOSITY_SILENT;
+        break;
+    default:
+        printf("> Parse Error: \"verbosity\" keyword must be followed by \"full\", \"terse\" or "
+               "\"silent\", not \"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+    return writeChunk(chunk, OP_VERBOSITY, 0, 0, (uint32_t)level) != NULL;
+}
+
+/**
+ * @brief snapshot function. "save" keeps the board configuration in flash for "restore" and the
+ * next boot, "save clear" forgets it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @param keyword TOKEN_SAVE or TOKEN_RESTORE
+ * @return true if snapshot line compiled
+ * @return false if snapshot line did not compile
+ */
+static bool snapshot(TokenVector *vec, Chunk *chunk, TokenType keyword)
+{
+    Token next_token = getTokenVector(vec, 1);
+    bool  clear = keyword == TOKEN_SAVE && next_token.type == TOKEN_CLEAR;
+    if (clear)
+    {
+        next_token = getTokenVector(vec, 2);
+    }
+    if (next_token.type != TOKEN_EOL)
+    {
+        printf("> Parse Error: Expected \"save\", \"save clear\" or \"restore\", got \"%.*s\" "
+               "after it.\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+    return writeChunk(chunk, keyword == TOKEN_SAVE ? OP_SAVE : OP_RESTORE, 0, 0, clear ? 1 : 0) !=
+           NULL;
+}
+
+/**
+ * @brief Looks up which timer channel drives a pin.
+ *
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @return const PWMPinMapping* mapping for the pin, NULL if it has no PWM channel.
+ */
+static const PWMPinMapping *getPWMInfo(uint32_t port, uint32_t pin)
+{
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    if (board_pin == NULL || board_pin->pwm == 0)
+    {
+        return NULL;
+    }
+    return &pwmPinMappings[board_pin->pwm - 1];
+}
+
+/**
+ * @brief pwm function. "pwm <port pin> <frequency> <duty>" drives a pin from its timer channel.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if pwm line compiled
+ * @return false if pwm line did not compile
+ */
+static bool pwm(TokenVector *vec, Chunk *chunk)
+{
+    size_t vec_size = sizeTokenVector(vec);
+    // Ignore end of line token.
+    if (vec_size - 1 != PWM_MAX_ARGS)
+    {
+        printf("> Parse Error: Invalid input format, use \"pwm <port pin> <frequency> <duty>\". "
+               "See documentation for more information.\r\n");
+        return false;
+    }
+
+    Token pin_token = getTokenVector(vec, 1);
+    Token frequency_token = getTokenVector(vec, 2);
+    Token duty_token = getTokenVector(vec, 3);
+
+    uint32_t port = 0;
+    uint32_t pin = 0;
+    if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &port, &pin))
+    {
+        printf("> Parse Error: Unable to parse PWM identifier \"%.*s\".\r\n", pin_token.length,
+               pin_token.start);
+        return false;
+    }
+
+    const PWMPinMapping *mapping = getPWMInfo(port, pin);
+    if (mapping == NULL)
+    {
+        printf("> Error: Pin is not available for use as PWM.\r\n");
+        return false;
+    }
+
+    if (frequency_token.type != TOKEN_NUMBER || duty_token.type != TOKEN_NUMBER)
+    {
+        printf("> Parse Error: \"pwm\" pin must be followed by a frequency and a duty cycle.\r\n");
+        return false;
+    }
+
+    uint32_t frequency = strtoul(frequency_token.start, NULL, 10);
+    if (frequency < PWM_MIN_HZ || frequency > PWM_MAX_HZ)
+    {
+        printf("> Parse Error: PWM frequency must be %d to %d Hz, not \"%.*s\".\r\n", PWM_MIN_HZ,
+               PWM_MAX_HZ, frequency_token.length, frequency_token.start);
+        return false;
+    }
+
+    uint32_t duty = strtoul(duty_token.start, NULL, 10);
+    if (duty > PWM_MAX_DUTY)
+    {
+        printf("> Parse Error: PWM duty cycle must be 0 to %d%%, not \"%.*s\".\r\n",
+               PWM_MAX_DUTY, duty_token.length, duty_token.start);
+        return false;
+    }
+
+    uint32_t constants[PWM_CONST_COUNT];
+    constants[PWM_CONST_CLOCK] = (uint32_t)getClockFromPort(port);
+    constants[PWM_CONST_TIMER] = mapping->timer;
+    constants[PWM_CONST_TIMER_CLOCK] = (uint32_t)mapping->timer_clock;
+    constants[PWM_CONST_CHANNEL] = (uint32_t)mapping->channel;
+    constants[PWM_CONST_AF] = mapping->af_mode;
+    constants[PWM_CONST_FREQUENCY] = frequency;
+    constants[PWM_CONST_DUTY] = duty;
+    int index = addConstants(chunk, constants, PWM_CONST_COUNT);
+    if (index < 0)
+    {
+        return false;
+    }
+
+    Instruction *instruction =
+        writeChunk(chunk, OP_MAKE_PWM, port, (uint16_t)pin, (uint32_t)index);
+    if (instruction == NULL)
+    {
+        return false;
+    }
+    flagPinCase(instruction, pin_token);
+    return true;
+}
+
+/**
+ * @brief Looks up which timer input capture channel a pin can be measured on.
+ *
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @return const MeasurePinMapping* mapping for the pin, NULL if it can't be measured.
+ */
+static const MeasurePinMapping *getMeasureInfo(uint32_t port, uint32_t pin)
+{
+    const BoardPin *board_pin = getBoardPin(port, pin);
+    if (board_pin == NULL || board_pin->measure == 0)
+    {
+        return NULL;
+    }
+    return &measurePinMappings[board_pin->measure - 1];
+}
+
+/**
+ * @brief measure function. "measure <port pin> [periods]" times a signal on a pin in hardware,
+ * "read <port pin>" then reports it averaged over that many periods.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if measure line compiled
+ * @return false if measure line did not compile
+ */
+static bool measure(TokenVector *vec, Chunk *chunk)
+{
+    size_t vec_size = sizeTokenVector(vec);
+    // Ignore end of line token.
+    if (vec_size - 1 < MEASURE_MIN_ARGS || vec_size - 1 > MEASURE_MAX_ARGS)
+    {
+        printf("> Parse Error: Invalid input format, use \"measure <port pin> [periods]\". See "
+               "documentation for more information.\r\n");
+        return false;
+    }
+
+    Token    pin_token = getTokenVector(vec, 1);
+    uint32_t port = 0;
+    uint32_t pin = 0;
+    if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &port, &pin))
+    {
+        printf("> Parse Error: Unable to parse measure identifier \"%.*s\".\r\n",
+               pin_token.length, pin_token.start);
+        return false;
+    }
+
+    const MeasurePinMapping *mapping = getMeasureInfo(port, pin);
+    if (mapping == NULL)
+    {
+        printf("> Error: Pin is not available for measuring, use A00, A01, A05, A15 or B03.\r\n");
+        return false;
+    }
+
+    uint32_t periods = 1;
+    if (vec_size - 1 == MEASURE_MAX_ARGS)
+    {
+        Token periods_token = getTokenVector(vec, 2);
+        periods = periods_token.type == TOKEN_NUMBER ? strtoul(periods_token.start, NULL, 10) : 0;
+        if (periods < 1 || periods > MEASURE_MAX_PERIODS)
+        {
+            printf("> Parse Error: Periods to average must be 1 to %d, not \"%.*s\".\r\n",
+                   MEASURE_MAX_PERIODS, periods_token.length, periods_token.start);
+            return false;
+        }
+    }
+
+    uint32_t constants[MEASURE_CONST_COUNT];
+    constants[MEASURE_CONST_CLOCK] = (uint32_t)getClockFromPort(port);
+    constants[MEASURE_CONST_TIMER] = mapping->timer;
+    constants[MEASURE_CONST_TIMER_CLOCK] = (uint32_t)mapping->timer_clock;
+    constants[MEASURE_CONST_CHANNEL] = (uint32_t)mapping->channel;
+    constants[MEASURE_CONST_AF] = mapping->af_mode;
+    constants[MEASURE_CONST_PERIODS] = periods;
+    int index = addConstants(chunk, constants, MEASURE_CONST_COUNT);
+    if (index < 0)
+    {
+        return false;
+    }
+
+    Instruction *instruction =
+        writeChunk(chunk, OP_MAKE_MEASURE, port, (uint16_t)pin, (uint32_t)index);
+    if (instruction == NULL)
+    {
+        return false;
+    }
+    flagPinCase(instruction, pin_token);
+    return true;
+}
+
+/**
+ * @brief pattern function. "pattern run|loop|stop|clear" controls the pattern engine, and
+ * "pattern [set <pins>] [reset <pins>] <delay ns>" appends a step to it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if pattern line compiled
+ * @return false if pattern line did not compile
+ */
+static bool pattern(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    switch (next_token.type)
+    {
+    case TOKEN_RUN:
+        return writeChunk(chunk, OP_PATTERN, 0, 0, PATTERN_RUN) != NULL;
+    case TOKEN_LOOP:
+        return writeChunk(chunk, OP_PATTERN, 0, 0, PATTERN_LOOP) != NULL;
+    case TOKEN_STOP:
+        return writeChunk(chunk, OP_PATTERN, 0, 0, PATTERN_STOP) != NULL;
+    case TOKEN_CLEAR:
+        return writeChunk(chunk, OP_PATTERN, 0, 0, PATTERN_CLEAR) != NULL;
+    default:
+        break;
+    }
+
+    size_t   vec_size = sizeTokenVector(vec);
+    uint32_t step_port = 0;
+    uint16_t set_mask = 0;
+    uint16_t clear_mask = 0;
+    uint16_t *current_mask = NULL;
+    bool     delay_set = false;
+    uint32_t delay_ns = 0;
+
+    for (size_t i = 1; i < vec_size; i++)
+    {
+        Token current_token = getTokenVector(vec, i);
+        switch (current_token.type)
+        {
+        case TOKEN_EOL:
+        {
+            // ignore
+            break;
+        }
+        case TOKEN_GPIO_SET:
+        {
+            current_mask = &set_mask;
+            break;
+        }
+        case TOKEN_GPIO_RESET:
+        {
+            current_mask = &clear_mask;
+            break;
+        }
+        case TOKEN_PORT_PIN:
+        {
+            uint32_t port = 0;
+            uint32_t pin = 0;
+            if (current_mask == NULL || delay_set)
+            {
+                printf("> Parse Error: Pattern pins must follow \"set\" or \"reset\" and come "
+                       "before the delay.\r\n");
+                return false;
+            }
+            if (!parsePortPin(current_token, &port, &pin))
+            {
+                printf("> Parse Error: Unrecognised port pin: \"%.*s\".\r\n",
+                       current_token.length, current_token.start);
+                return false;
+            }
+            if (step_port != 0 && step_port != port)
+            {
+                printf("> Parse Error: Every pin in a pattern step must be on the same port.\r\n");
+                return false;
+            }
+            step_port = port;
+            *current_mask |= (uint16_t)pin;
+            break;
+        }
+        case TOKEN_NUMBER:
+        {
+            if (delay_set)
+            {
+                printf("> Parse Error: Multiple pattern delays provided.\r\n");
+                return false;
+            }
+            delay_ns = strtoul(current_token.start, NULL, 10);
+            if (delay_ns < PATTERN_MIN_NS || delay_ns > PATTERN_MAX_NS)
+            {
+                printf("> Parse Error: Pattern delay must be %d to %d ns, not \"%.*s\".\r\n",
+                       PATTERN_MIN_NS, PATTERN_MAX_NS, current_token.length,
+                       current_token.start);
+                return false;
+            }
+            delay_set = true;
+            break;
+        }
+        default:
+        {
+            printf("> Parse Error: \"pattern\" keyword must be followed by run, loop, stop, "
+                   "clear or a step, not \"%.*s\".\r\n",
+                   current_token.length, current_token.start);
+            return false;
+        }
+        }
+    }
+
+    if (!delay_set)
     {
-        // Write UART
-        next_token = getTokenVector(vec, 2);
-        if (next_token.type == TOKEN_STRING)
+        printf("> Parse Error: Pattern step needs a delay in ns, use \"pattern [set <pins>] "
+               "[reset <pins>] <delay>\".\r\n");
+        return false;
+    }
+    if (set_mask & clear_mask)
+    {
+        printf("> Parse Error: A pattern step can't set and reset the same pin.\r\n");
+        return false;
+    }
+
+    uint32_t constants[PATTERN_CONST_COUNT];
+    constants[PATTERN_CONST_CLEAR_MASK] = clear_mask;
+    constants[PATTERN_CONST_DELAY] = delay_ns;
+    int index = addConstants(chunk, constants, PATTERN_CONST_COUNT);
+    return index >= 0 &&
+           writeChunk(chunk, OP_PATTERN_STEP, step_port, set_mask, (uint32_t)index) != NULL;
+}
+
+/**
+ * @brief schedule function. "every <ms> <line>" runs line every ms, "after <ms> <line>" runs it
+ * once. The line is kept as text here and compiled by the scheduler when it is added.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @param repeat true for "every", false for "after"
+ * @return true if schedule line compiled
+ * @return false if schedule line did not compile
+ */
+static bool schedule(TokenVector *vec, Chunk *chunk, bool repeat)
+{
+    const char *keyword = repeat ? "every" : "after";
+    Token       period_token = getTokenVector(vec, 1);
+    if (period_token.type != TOKEN_NUMBER)
+    {
+        printf("> Parse Error: \"%s\" keyword must be followed by a time in ms, not "
+               "\"%.*s\".\r\n",
+               keyword, period_token.length, period_token.start);
+        return false;
+    }
+
+    uint32_t period_ms = strtoul(period_token.start, NULL, 10);
+    if (period_ms < 1 || period_ms > SCHEDULER_MAX_MS)
+    {
+        printf("> Parse Error: Task time must be 1 to %d ms, not \"%.*s\".\r\n",
+               SCHEDULER_MAX_MS, period_token.length, period_token.start);
+        return false;
+    }
+
+    // Everything after the time is the line to run, up to the end of line token.
+    Token line_token = getTokenVector(vec, 2);
+    Token eol_token = getTokenVector(vec, sizeTokenVector(vec) - 1);
+    if (line_token.type == TOKEN_EOL)
+    {
+        printf("> Parse Error: Use \"%s <ms> <line>\", the line to run is missing.\r\n",
+               keyword);
+        return false;
+    }
+
+    size_t length = (size_t)(eol_token.start - line_token.start);
+    int    offset = addString(chunk, line_token.start, length);
+    return offset >= 0 &&
+           writeChunk(chunk, OP_SCHEDULE, period_ms, repeat ? 1 : 0,
+                      ((uint32_t)offset << 16) | (uint32_t)length) != NULL;
+}
+
+/**
+ * @brief tasks function. "tasks list" prints the scheduled tasks, "tasks kill [id]" removes one
+ * or, with no id, all of them.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if tasks line compiled
+ * @return false if tasks line did not compile
+ */
+static bool tasks(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    if (next_token.type == TOKEN_LIST || next_token.type == TOKEN_EOL)
+    {
+        return writeChunk(chunk, OP_TASKS_LIST, 0, 0, 0) != NULL;
+    }
+    if (next_token.type == TOKEN_KILL)
+    {
+        Token id_token = getTokenVector(vec, 2);
+        if (id_token.type == TOKEN_EOL)
         {
-            // const char *string_to_send = next_token.start;
-            // size_t length = (size_t)next_token.length;
-            printf("> Sending: \"%.*s\"\r\n", next_token.length, next_token.start);
-            uint32_t size_written = writeUARTPort(bc, next_token.start, next_token.length);
-            printf("> UART WROTE %lu BYTES.\r\n", size_written);
-            return true;
+            return writeChunk(chunk, OP_TASKS_KILL, 0, 0, 0) != NULL;
         }
-        else {
-            printf("> Error: \"uart write\" function must be followed by string enclosed in qoutes (\").\r\n");
+        uint32_t id = id_token.type == TOKEN_NUMBER ? strtoul(id_token.start, NULL, 10) : 0;
+        if (id < 1 || id > SCHEDULER_MAX_TASKS)
+        {
+            printf("> Parse Error: Task id must be 1 to %d, not \"%.*s\".\r\n",
+                   SCHEDULER_MAX_TASKS, id_token.length, id_token.start);
             return false;
         }
+        return writeChunk(chunk, OP_TASKS_KILL, 0, 0, id) != NULL;
     }
-    else
+
+    printf("> Parse Error: \"tasks\" keyword must be followed by \"list\" or \"kill\", not "
+           "\"%.*s\".\r\n",
+           next_token.length, next_token.start);
+    return false;
+}
+
+/**
+ * @brief stats function. "stats" prints per command latency, "stats clear" forgets it.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if stats line compiled
+ * @return false if stats line did not compile
+ */
+static bool stats(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    if (next_token.type != TOKEN_EOL && next_token.type != TOKEN_CLEAR)
     {
-        printf("> Parse Error: \"uart\" keyword must be followed by either port pin "
-               "identifier, \"read\", or \"write <string>\", not \"%.*s\".",
+        printf("> Parse Error: \"stats\" keyword can only be followed by \"clear\", not "
+               "\"%.*s\".\r\n",
                next_token.length, next_token.start);
         return false;
     }
+    return writeChunk(chunk, OP_STATS, 0, 0, next_token.type == TOKEN_CLEAR ? 1 : 0) != NULL;
 }
 
 /**
- * @brief Parses the token vector returned by interpret(). Executes any commands
- * interpreted.
+ * @brief events function. "events" prints the recorded edges, "events clear" forgets them.
  *
- * @param bc board controller object to execute commands on.
- * @param vec vector of tokens to parse
- * @return true parsing successful
- * @return false parsing unsuccessful
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if events line compiled
+ * @return false if events line did not compile
+ */
+static bool events(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    if (next_token.type != TOKEN_EOL && next_token.type != TOKEN_CLEAR)
+    {
+        printf("> Parse Error: \"events\" keyword can only be followed by \"clear\", not "
+               "\"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+    return writeChunk(chunk, OP_EVENTS, 0, 0, next_token.type == TOKEN_CLEAR ? 1 : 0) != NULL;
+}
+
+/**
+ * @brief mem function. "mem" prints heap and stack use, "mem clear" starts the peaks again.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if mem line compiled
+ * @return false if mem line did not compile
+ */
+static bool mem(TokenVector *vec, Chunk *chunk)
+{
+    Token next_token = getTokenVector(vec, 1);
+    if (next_token.type != TOKEN_EOL && next_token.type != TOKEN_CLEAR)
+    {
+        printf("> Parse Error: \"mem\" keyword can only be followed by \"clear\", not "
+               "\"%.*s\".\r\n",
+               next_token.length, next_token.start);
+        return false;
+    }
+    return writeChunk(chunk, OP_MEM, 0, 0, next_token.type == TOKEN_CLEAR ? 1 : 0) != NULL;
+}
+
+/**
+ * @brief script function. "def <name>", "run <name>" and "del <name>" start recording, run and
+ * delete a script, "end" and "list" take no name.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @param op OP_SCRIPT_* op the line compiles to
+ * @return true if script line compiled
+ * @return false if script line did not compile
+ */
+static bool script(TokenVector *vec, Chunk *chunk, OpCode op)
+{
+    Token keyword_token = getTokenVector(vec, 0);
+    if (op == OP_SCRIPT_END || op == OP_SCRIPT_LIST)
+    {
+        Token next_token = getTokenVector(vec, 1);
+        if (next_token.type != TOKEN_EOL)
+        {
+            printf("> Parse Error: \"%.*s\" keyword takes nothing after it, not \"%.*s\".\r\n",
+                   keyword_token.length, keyword_token.start, next_token.length,
+                   next_token.start);
+            return false;
+        }
+        return writeChunk(chunk, op, 0, 0, 0) != NULL;
+    }
+
+    Token name_token = getTokenVector(vec, 1);
+    if (name_token.type != TOKEN_IDENTIFIER || getTokenVector(vec, 2).type != TOKEN_EOL)
+    {
+        printf("> Parse Error: Use \"%.*s <name>\". Names can't be keywords or port pins.\r\n",
+               keyword_token.length, keyword_token.start);
+        return false;
+    }
+    if (name_token.length >= SCRIPT_NAME_SIZE)
+    {
+        printf("> Parse Error: Script name \"%.*s\" is too long (max %d characters).\r\n",
+               name_token.length, name_token.start, SCRIPT_NAME_SIZE - 1);
+        return false;
+    }
+
+    size_t length = (size_t)name_token.length;
+    int    offset = addString(chunk, name_token.start, length);
+    return offset >= 0 &&
+           writeChunk(chunk, op, 0, 0, ((uint32_t)offset << 16) | (uint32_t)length) != NULL;
+}
+
+/**
+ * @brief watch function. "watch <port pin> rising|falling|both" records edges on an input pin,
+ * "watch <port pin> stop" stops.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if watch line compiled
+ * @return false if watch line did not compile
+ */
+static bool watch(TokenVector *vec, Chunk *chunk)
+{
+    Token    pin_token = getTokenVector(vec, 1);
+    Token    edge_token = getTokenVector(vec, 2);
+    uint32_t port = 0;
+    uint32_t pin = 0;
+    if (pin_token.type != TOKEN_PORT_PIN || !parsePortPin(pin_token, &port, &pin))
+    {
+        printf("> Parse Error: Invalid input format, use \"watch <port pin> "
+               "rising|falling|both|stop\".\r\n");
+        return false;
+    }
+
+    uint32_t edges;
+    switch (edge_token.type)
+    {
+    case TOKEN_RISING:
+        edges = EXTI_EDGE_RISING;
+        break;
+    case TOKEN_FALLING:
+        edges = EXTI_EDGE_FALLING;
+        break;
+    case TOKEN_BOTH:
+        edges = EXTI_EDGE_BOTH;
+        break;
+    case TOKEN_STOP:
+        edges = EXTI_EDGE_NONE;
+        break;
+    default:
+        printf("> Parse Error: \"watch\" pin must be followed by rising, falling, both or stop, "
+               "not \"%.*s\".\r\n",
+               edge_token.length, edge_token.start);
+        return false;
+    }
+
+    Instruction *instruction = writeChunk(chunk, OP_WATCH, port, (uint16_t)pin, edges);
+    if (instruction == NULL)
+    {
+        return false;
+    }
+    flagPinCase(instruction, pin_token);
+    return true;
+}
+
+/**
+ * @brief delay function. "delay <time> us|ms" busy waits, to space out the steps of a line or a
+ * repeat.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if delay line compiled
+ * @return false if delay line did not compile
+ */
+static bool delay(TokenVector *vec, Chunk *chunk)
+{
+    Token time_token = getTokenVector(vec, 1);
+    Token unit_token = getTokenVector(vec, 2);
+    if (sizeTokenVector(vec) != DELAY_ARGS + 1 || time_token.type != TOKEN_NUMBER ||
+        (unit_token.type != TOKEN_US && unit_token.type != TOKEN_MS))
+    {
+        printf("> Parse Error: Invalid input format, use \"delay <time> us|ms\".\r\n");
+        return false;
+    }
+
+    uint32_t time = strtoul(time_token.start, NULL, 10);
+    if (time < 1 || time > DELAY_MAX_US ||
+        (unit_token.type == TOKEN_MS && time > DELAY_MAX_US / 1000))
+    {
+        printf("> Parse Error: Delay must be 1 us to %d ms, not \"%.*s %.*s\".\r\n",
+               DELAY_MAX_US / 1000, time_token.length, time_token.start, unit_token.length,
+               unit_token.start);
+        return false;
+    }
+    uint32_t us = unit_token.type == TOKEN_MS ? time * 1000 : time;
+    return writeChunk(chunk, OP_DELAY, 0, 0, us) != NULL;
+}
+
+static bool compileStatement(TokenVector *vec, Chunk *chunk);
+
+/**
+ * @brief repeat function. "repeat <count> <statement>" runs the statement count times in a
+ * tight loop on the board. Statements after it on the line, separated by ";", are repeated with
+ * it, so "repeat 1000 set a05; delay 5 us; reset a05; delay 5 us" is one loop.
+ *
+ * @param vec vector of tokens
+ * @param chunk chunk to compile into
+ * @return true if repeat line compiled
+ * @return false if repeat line did not compile
+ */
+static bool repeatLine(TokenVector *vec, Chunk *chunk)
+{
+    Token    count_token = getTokenVector(vec, 1);
+    uint32_t count = count_token.type == TOKEN_NUMBER ? strtoul(count_token.start, NULL, 10) : 0;
+    if (count < 1 || count > REPEAT_MAX_COUNT)
+    {
+        printf("> Parse Error: \"repeat\" keyword must be followed by a count of 1 to %d, not "
+               "\"%.*s\".\r\n",
+               REPEAT_MAX_COUNT, count_token.length, count_token.start);
+        return false;
+    }
+    if (writeChunk(chunk, OP_REPEAT, 0, 0, count) == NULL)
+    {
+        return false;
+    }
+
+    // The first statement of the loop can follow on straight after the count.
+    if (getTokenVector(vec, 2).type == TOKEN_EOL)
+    {
+        return true;
+    }
+    TokenVector body = {
+        .used = sizeTokenVector(vec) - 2,
+        .capacity = sizeTokenVector(vec) - 2,
+        .tokens = &vec->tokens[2],
+    };
+    return compileStatement(&body, chunk);
+}
+
+/**
+ * @brief Checks what a repeat runs, once the whole line is compiled. Only one repeat per line,
+ * and everything after it must be a pin or delay step, so the loop never reconfigures the board
+ * or stops to wait on a peripheral.
+ *
+ * @param chunk compiled line
+ * @return true no repeat, or a repeat that can run
+ * @return false the repeat can't run
+ */
+static bool checkRepeat(const Chunk *chunk)
+{
+    size_t start = chunk->count;
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        if (chunk->code[i].op == OP_REPEAT && start != chunk->count)
+        {
+            printf("> Parse Error: Only one \"repeat\" per line.\r\n");
+            return false;
+        }
+        start = chunk->code[i].op == OP_REPEAT ? i : start;
+    }
+    if (start == chunk->count)
+    {
+        return true;
+    }
+    if (start == chunk->count - 1U)
+    {
+        printf("> Parse Error: Nothing to repeat, use e.g. \"repeat 1000 toggle a05\".\r\n");
+        return false;
+    }
+
+    size_t   reads = 0;
+    uint64_t pass_us = 0;
+    for (size_t i = start + 1; i < chunk->count; i++)
+    {
+        switch (chunk->code[i].op)
+        {
+        case OP_SET:
+        case OP_RESET:
+        case OP_TOGGLE:
+        case OP_READ_PORT:
+        case OP_ECHO:
+            break;
+        case OP_READ:
+            reads++;
+            break;
+        case OP_DELAY:
+            pass_us += chunk->code[i].operand;
+            break;
+        default:
+            printf("> Parse Error: Only set, reset, toggle, read and delay can be repeated.\r\n");
+            return false;
+        }
+    }
+    if (reads > REPEAT_MAX_READS)
+    {
+        printf("> Parse Error: A repeat can read at most %d pins, not %u.\r\n", REPEAT_MAX_READS,
+               (unsigned int)reads);
+        return false;
+    }
+    if (pass_us * chunk->code[start].operand > REPEAT_MAX_DELAY_US)
+    {
+        printf("> Parse Error: Repeat would delay for over %d s, use \"every\" instead.\r\n",
+               REPEAT_MAX_DELAY_US / 1000000);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compiles one statement onto the end of a chunk.
+ *
+ * @param vec tokens of the statement, ending in an end of line token
+ * @param chunk chunk to compile into
+ * @return true compile successful
+ * @return false compile unsuccessful
  */
-bool parseTokensAndExecute(BoardController *bc, TokenVector *vec)
+static bool compileStatement(TokenVector *vec, Chunk *chunk)
 {
     // First token is always the function type identifier
     Token first_token = getTokenVector(vec, 0);
     switch (first_token.type)
     {
     case TOKEN_GPIO_INPUT:
-        return inputOutput(bc, vec, OP_MAKE_INPUT);
+        return inputOutput(vec, chunk, OP_MAKE_INPUT);
     case TOKEN_GPIO_OUTPUT:
-        return inputOutput(bc, vec, OP_MAKE_OUTPUT);
+        return inputOutput(vec, chunk, OP_MAKE_OUTPUT);
     case TOKEN_GPIO_SET:
-        return setResetToggleRead(bc, vec, OP_SET);
+        return setResetToggleRead(vec, chunk, OP_SET);
     case TOKEN_GPIO_RESET:
-        return setResetToggleRead(bc, vec, OP_RESET);
+        return setResetToggleRead(vec, chunk, OP_RESET);
     case TOKEN_GPIO_TOGGLE:
-        return setResetToggleRead(bc, vec, OP_TOGGLE);
+        return setResetToggleRead(vec, chunk, OP_TOGGLE);
     case TOKEN_GPIO_READ:
-        return setResetToggleRead(bc, vec, OP_READ);
+        return setResetToggleRead(vec, chunk, OP_READ);
     case TOKEN_ADC:
-        return adc(bc, vec);
+        return adc(vec, chunk);
     case TOKEN_UART:
-        return uart(bc, vec);
+        return uart(vec, chunk);
+    case TOKEN_SPI:
+        return spi(vec, chunk);
+    case TOKEN_I2C:
+        return i2c(vec, chunk);
+    case TOKEN_CAPTURE:
+        return capture(vec, chunk);
+    case TOKEN_STREAM:
+        return stream(vec, chunk);
+    case TOKEN_MODE:
+        return mode(vec, chunk);
+    case TOKEN_VERBOSITY:
+        return verbosity(vec, chunk);
+    case TOKEN_PWM:
+        return pwm(vec, chunk);
+    case TOKEN_MEASURE:
+        return measure(vec, chunk);
+    case TOKEN_PATTERN:
+        return pattern(vec, chunk);
+    case TOKEN_EVERY:
+        return schedule(vec, chunk, true);
+    case TOKEN_AFTER:
+        return schedule(vec, chunk, false);
+    case TOKEN_TASKS:
+        return tasks(vec, chunk);
+    case TOKEN_IDLE:
+        return writeChunk(chunk, OP_IDLE, 0, 0, 0) != NULL;
+    case TOKEN_WATCH:
+        return watch(vec, chunk);
+    case TOKEN_EVENTS:
+        return events(vec, chunk);
+    case TOKEN_UPDATE:
+        return writeChunk(chunk, OP_UPDATE, 0, 0, 0) != NULL;
+    case TOKEN_SAVE:
+    case TOKEN_RESTORE:
+        return snapshot(vec, chunk, first_token.type);
+    case TOKEN_CLOCK:
+        return clockSpeed(vec, chunk);
+    case TOKEN_CLOCKS:
+        return writeChunk(chunk, OP_CLOCKS, 0, 0, 0) != NULL;
+    case TOKEN_STATS:
+        return stats(vec, chunk);
+    case TOKEN_MEM:
+        return mem(vec, chunk);
+    case TOKEN_REPEAT:
+        return repeatLine(vec, chunk);
+    case TOKEN_DELAY:
+        return delay(vec, chunk);
+    case TOKEN_BENCH:
+        return writeChunk(chunk, OP_BENCH, 0, 0, 0) != NULL;
+    case TOKEN_DEF:
+        return script(vec, chunk, OP_SCRIPT_DEF);
+    case TOKEN_END:
+        return script(vec, chunk, OP_SCRIPT_END);
+    case TOKEN_RUN:
+        return script(vec, chunk, OP_SCRIPT_RUN);
+    case TOKEN_LIST:
+        return script(vec, chunk, OP_SCRIPT_LIST);
+    case TOKEN_DEL:
+        return script(vec, chunk, OP_SCRIPT_DEL);
     default:
     {
         printf("> Parse Error: Invalid line logic. Token \"%.*s\" is not a "
@@ -939,4 +2471,63 @@ bool parseTokensAndExecute(BoardController *bc, TokenVector *vec)
         return false;
     }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Compiles the token vector returned by the scanner into a chunk. Nothing on the board is
+ * touched, board state is only looked at when the VM binds and runs the chunk. Statements
+ * separated by ";" compile into the one chunk and run back to back.
+ *
+ * @param vec vector of tokens to parse
+ * @param chunk chunk to compile into, initialised by this function.
+ * @return true compile successful
+ * @return false compile unsuccessful
+ */
+bool compileTokens(TokenVector *vec, Chunk *chunk)
+{
+    initChunk(chunk);
+
+    // Each statement is compiled from a view of the line ending at its separator, which becomes
+    // an end of line token, so the statement parsers can't tell it from a line of its own.
+    size_t statements = 0;
+    size_t start = 0;
+    for (size_t index = 0; index < sizeTokenVector(vec); index++)
+    {
+        Token *token = &vec->tokens[index];
+        if (token->type != TOKEN_SEMICOLON && token->type != TOKEN_EOL)
+        {
+            continue;
+        }
+        token->type = TOKEN_EOL;
+        if (index > start)
+        {
+            TokenVector statement = {
+                .used = index - start + 1,
+                .capacity = index - start + 1,
+                .tokens = &vec->tokens[start],
+            };
+            if (!compileStatement(&statement, chunk))
+            {
+                return false;
+            }
+            statements++;
+        }
+        start = index + 1;
+    }
+    if (statements == 0)
+    {
+        // Nothing but separators, let the statement parser report it.
+        return compileStatement(vec, chunk);
+    }
+
+    // Recording starts and stops between lines, so "def" and "end" can't share one.
+    for (size_t i = 0; statements > 1 && i < chunk->count; i++)
+    {
+        if (chunk->code[i].op == OP_SCRIPT_DEF || chunk->code[i].op == OP_SCRIPT_END)
+        {
+            printf("> Parse Error: \"def\" and \"end\" must be on a line of their own.\r\n");
+            return false;
+        }
+    }
+    return checkRepeat(chunk);
+}
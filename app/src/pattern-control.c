@@ -0,0 +1,279 @@
+/**
+ * @file pattern-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief GPIO pattern engine. Steps are played straight from memory into a port's BSRR by
+ * timer triggered DMA, so they land microseconds apart with no help from the CPU.
+ * @version 0.1
+ * @date 2025-03-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "pattern-control.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/timer.h"
+
+#include "dma-control.h"
+#include "sys_timer.h"
+
+// TIM1 has a 16 bit period, longer delays come from the prescaler.
+#define PATTERN_MAX_PERIOD (0x10000)
+
+// One BSRR word (set mask low, clear mask high) and delay per step, as uploaded.
+static uint32_t pattern_bsrr[PATTERN_MAX_STEPS];
+static uint32_t pattern_delay_ns[PATTERN_MAX_STEPS];
+// ARR values stream 3 loads, pattern_periods[k] is the gap after step k + 1.
+static uint32_t pattern_periods[PATTERN_MAX_STEPS];
+static size_t   pattern_count = 0;
+static uint32_t pattern_port = 0; // 0 until a step names a pin
+
+static bool              pattern_armed = false; // streams and TIM1 claimed
+static bool              pattern_looping = false;
+static volatile bool     pattern_running = false;
+static volatile uint32_t pattern_passes = 0;
+
+/**
+ * @brief DMA ISR for the BSRR stream. One interrupt per pass over the steps, a single shot
+ * pattern stops the timer here so nothing runs past the end.
+ *
+ */
+void dma2_stream5_isr(void)
+{
+    if (dma_get_interrupt_flag(DMA2, DMA_STREAM5, DMA_TCIF))
+    {
+        dma_clear_interrupt_flags(DMA2, DMA_STREAM5, DMA_TCIF);
+        pattern_passes++;
+        if (!pattern_looping)
+        {
+            timer_disable_counter(TIM1);
+            pattern_running = false;
+        }
+    }
+}
+
+/**
+ * @brief Converts a delay into TIM1 ticks at a prescaler.
+ *
+ * @param delay_ns delay in nanoseconds
+ * @param prescaler timer divider
+ * @return uint32_t ticks, at least 1
+ */
+static uint32_t delayTicks(uint32_t delay_ns, uint32_t prescaler)
+{
+    uint64_t ticks =
+        ((uint64_t)delay_ns * coreTimerClockFrequency(TIM1)) / (1000000000ULL * prescaler);
+    return ticks == 0 ? 1 : (uint32_t)ticks;
+}
+
+/**
+ * @brief Appends a step to the pattern. A step sets then clears its pins with one BSRR write, then
+ * waits before the next step. All steps must be on the same port.
+ *
+ * @param port GPIO port of the pins, ignored if both masks are empty
+ * @param set_mask pins driven high
+ * @param clear_mask pins driven low
+ * @param delay_ns time until the next step, PATTERN_MIN_NS to PATTERN_MAX_NS
+ * @return true step added
+ * @return false pattern full, running, or on another port
+ */
+bool patternAddStep(uint32_t port, uint16_t set_mask, uint16_t clear_mask, uint32_t delay_ns)
+{
+    if (pattern_running)
+    {
+        printf("> Error: Stop the pattern before changing it.\r\n");
+        return false;
+    }
+    if (pattern_count == PATTERN_MAX_STEPS)
+    {
+        printf("> Error: Pattern is full (max %d steps).\r\n", PATTERN_MAX_STEPS);
+        return false;
+    }
+    if ((set_mask | clear_mask) != 0)
+    {
+        if (pattern_port != 0 && pattern_port != port)
+        {
+            printf("> Error: Every pattern step must be on the same port.\r\n");
+            return false;
+        }
+        pattern_port = port;
+    }
+
+    pattern_bsrr[pattern_count] = (uint32_t)set_mask | ((uint32_t)clear_mask << 16);
+    pattern_delay_ns[pattern_count] = delay_ns;
+    pattern_count++;
+    return true;
+}
+
+/**
+ * @brief Stops the pattern and forgets every step.
+ *
+ */
+void patternClear(void)
+{
+    patternStop();
+    pattern_count = 0;
+    pattern_port = 0;
+}
+
+/**
+ * @brief Starts playing the pattern from the first step, which goes out straight away.
+ *
+ * @param loop true to repeat until stopped, false for a single pass
+ * @return true pattern running
+ * @return false nothing to play or a DMA stream is in use
+ */
+bool patternStart(bool loop)
+{
+    if (pattern_count == 0 || pattern_port == 0)
+    {
+        printf("> Error: Pattern has no pin steps.\r\n");
+        return false;
+    }
+
+    patternStop();
+    if (!claimDMAStream(DMA_TIM1_UP))
+    {
+        return false;
+    }
+    if (!claimDMAStream(DMA_TIM1_CH1))
+    {
+        releaseDMAStream(DMA_TIM1_UP);
+        return false;
+    }
+    rcc_periph_clock_enable(RCC_TIM1);
+    rcc_periph_reset_pulse(RST_TIM1);
+    pattern_armed = true;
+
+    // One prescaler for the whole pattern, just big enough for its longest delay.
+    uint32_t longest = 0;
+    for (size_t step = 0; step < pattern_count; step++)
+    {
+        uint32_t ticks = delayTicks(pattern_delay_ns[step], 1);
+        longest = ticks > longest ? ticks : longest;
+    }
+    uint32_t prescaler = longest / PATTERN_MAX_PERIOD + 1;
+
+    // Each period is loaded while the one before it runs, so the table is one step ahead.
+    for (size_t step = 0; step < pattern_count; step++)
+    {
+        uint32_t next = pattern_delay_ns[(step + 1) % pattern_count];
+        pattern_periods[step] = delayTicks(next, prescaler) - 1;
+    }
+
+    timer_set_mode(TIM1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM1, prescaler - 1);
+    timer_set_period(TIM1, delayTicks(pattern_delay_ns[0], prescaler) - 1);
+    timer_enable_preload(TIM1);
+    timer_set_oc_mode(TIM1, TIM_OC1, TIM_OCM_FROZEN);
+    timer_set_oc_value(TIM1, TIM_OC1, 0);
+    // Load the prescaler and period, then sit one tick before the first update.
+    timer_generate_event(TIM1, TIM_EGR_UG);
+    timer_set_counter(TIM1, delayTicks(pattern_delay_ns[0], prescaler) - 1);
+    timer_clear_flag(TIM1, TIM_SR_UIF | TIM_SR_CC1IF);
+
+    pattern_looping = loop;
+    pattern_passes = 0;
+    setupDMAMemoryToPeripheral32(DMA_TIM1_UP, (uint32_t)&GPIO_BSRR(pattern_port), pattern_bsrr,
+                                 (uint16_t)pattern_count, loop);
+    setupDMAMemoryToPeripheral32(DMA_TIM1_CH1, (uint32_t)&TIM_ARR(TIM1), pattern_periods,
+                                 (uint16_t)pattern_count, loop);
+    dma_enable_transfer_complete_interrupt(DMA2, DMA_STREAM5);
+    nvic_enable_irq(DMA_TIM1_UP.nvic_entry);
+    dma_enable_stream(DMA2, DMA_STREAM5);
+    dma_enable_stream(DMA2, DMA_STREAM3);
+
+    pattern_running = true;
+    timer_enable_irq(TIM1, TIM_DIER_UDE | TIM_DIER_CC1DE);
+    timer_enable_counter(TIM1);
+    return true;
+}
+
+/**
+ * @brief Stops the pattern and frees TIM1 and its DMA streams. Pins keep their last level.
+ *
+ * @return uint32_t number of completed passes over the steps
+ */
+uint32_t patternStop(void)
+{
+    if (!pattern_armed)
+    {
+        return 0;
+    }
+
+    timer_disable_counter(TIM1);
+    timer_disable_irq(TIM1, TIM_DIER_UDE | TIM_DIER_CC1DE);
+    releaseDMAStream(DMA_TIM1_UP);
+    releaseDMAStream(DMA_TIM1_CH1);
+    rcc_periph_clock_disable(RCC_TIM1);
+    pattern_running = false;
+    pattern_armed = false;
+    return pattern_passes;
+}
+
+/**
+ * @brief Follows a CPU clock change. Step delays were worked out for the old TIM1 clock, so a
+ * looping pattern is started again from its first step and a single pass is stopped.
+ *
+ */
+void patternClockChanged(void)
+{
+    if (!pattern_armed)
+    {
+        return;
+    }
+    bool loop = pattern_running && pattern_looping;
+    (void)patternStop();
+    if (loop)
+    {
+        (void)patternStart(true);
+    }
+}
+
+/**
+ * @brief Tells whether the pattern is playing.
+ *
+ * @return true steps are going out
+ * @return false stopped, or a single pass has finished
+ */
+bool patternRunning(void)
+{
+    return pattern_running;
+}
+
+/**
+ * @brief Returns how many steps the pattern has.
+ *
+ * @return size_t step count
+ */
+size_t patternLength(void)
+{
+    return pattern_count;
+}
+
+/**
+ * @brief Returns the port the pattern drives.
+ *
+ * @return uint32_t GPIO port, 0 if no step names a pin yet
+ */
+uint32_t patternPort(void)
+{
+    return pattern_port;
+}
+
+/**
+ * @brief Returns every pin any step sets or clears.
+ *
+ * @return uint16_t pin mask
+ */
+uint16_t patternPins(void)
+{
+    uint16_t pins = 0;
+    for (size_t step = 0; step < pattern_count; step++)
+    {
+        pins |= (uint16_t)(pattern_bsrr[step] | (pattern_bsrr[step] >> 16));
+    }
+    return pins;
+}
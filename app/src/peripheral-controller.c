@@ -9,6 +9,7 @@
  *
  */
 #include "peripheral-controller.h"
+#include "exti-control.h"
 #include "libopencm3/cm3/nvic.h"
 #include "libopencm3/stm32/f4/adc.h"
 #include "libopencm3/stm32/f4/gpio.h"
@@ -31,14 +32,19 @@ static void enableStandardGPIO(PeripheralController *periph)
 }
 
 /**
- * @brief function to disable standard gpios. Doesn't actually do anything
+ * @brief function to disable standard gpios. Only a watched input has anything to undo, its EXTI
+ * line.
  *
  * @param periph peripheral to be disabled.
  */
 static void disableStandardGPIO(PeripheralController *periph)
 {
-    // Placeholder, doesn't actually need to do anything as turning of the RCC
-    // surfices
+    if (periph->peripheral.gpio.exti_edges != EXTI_EDGE_NONE)
+    {
+        extiUnwatch(periph->peripheral.gpio.port, (uint16_t)periph->peripheral.gpio.pin);
+        periph->peripheral.gpio.exti_edges = EXTI_EDGE_NONE;
+    }
+    // Otherwise turning off the RCC surfices
     periph->status = false;
 }
 
@@ -74,10 +80,10 @@ static void enableADCPin(PeripheralController *periph)
 {
     gpio_mode_setup(periph->peripheral.adc.port, periph->peripheral.adc.mode, GPIO_PUPD_NONE,
                     periph->peripheral.adc.pin);
-    adc_power_off(periph->peripheral.adc.adc_port);
-    adc_disable_scan_mode(periph->peripheral.adc.adc_port);
+    // Scan sequence and triggering belong to the scan, rebuilt by the board once this is live.
     adc_set_sample_time(periph->peripheral.adc.adc_port, periph->peripheral.adc.adc_channel,
                         periph->peripheral.adc.sample_time);
+    adcSetPrescaler();
     adc_power_on(periph->peripheral.adc.adc_port);
     periph->status = true;
 }
@@ -87,7 +93,7 @@ static void enableADCPin(PeripheralController *periph)
  *
  * @param periph controller for adc pin
  */
-static void disableADCPin(PeripheralController *periph) { periph->status = true; }
+static void disableADCPin(PeripheralController *periph) { periph->status = false; }
 
 /**
  * @brief Function to create ADC peripheral controller
@@ -99,17 +105,20 @@ static void disableADCPin(PeripheralController *periph) { periph->status = true;
  * @param adc_port ADC peripheral num, on STM32F411RE its always ADC
  * @param adc_channel ADC channel out of 16.
  * @param adc_clock ADC peripheral clock.
+ * @param bits resolution of reads
+ * @param average frames each read averages
  * @return PeripheralController
  */
 PeripheralController createStandardADCPin(uint32_t port, uint32_t pin, enum rcc_periph_clken clock,
                                           enum rcc_periph_clken adc_clock, uint32_t sample_time,
-                                          uint32_t adc_port, uint8_t adc_channel)
+                                          uint32_t adc_port, uint8_t adc_channel, uint8_t bits,
+                                          uint8_t average)
 {
     uint8_t              mode = GPIO_MODE_ANALOG;
     PeripheralController pc;
     pc.type = TYPE_ADC;
-    pc.peripheral.adc =
-        createADCPin(port, pin, clock, adc_clock, sample_time, mode, adc_port, adc_channel);
+    pc.peripheral.adc = createADCPin(port, pin, clock, adc_clock, sample_time, mode, adc_port,
+                                     adc_channel, bits, average);
     pc.enablePeripheral = enableADCPin;
     pc.disablePeripheral = disableADCPin;
     pc.status = false;
@@ -144,15 +153,15 @@ static void enableUART(PeripheralController *periph)
     usart_set_mode(periph->peripheral.uart.handle,
                    USART_MODE_TX_RX); // Make sure we're Rxing and Txing.
 
-    usart_set_flow_control(periph->peripheral.uart.handle,
-                           USART_FLOWCONTROL_NONE); // exclude the rest of RS232.
+    // RTS/CTS pins, or XON/XOFF, only if asked for with "uart flow".
+    currentUartSetFlowControl(&periph->peripheral.uart, periph->peripheral.uart.flow);
     usart_set_databits(periph->peripheral.uart.handle, 8);
     usart_set_baudrate(periph->peripheral.uart.handle,
                        periph->peripheral.uart.baudrate); // Set to user defined baudrate.
     usart_set_parity(periph->peripheral.uart.handle, 0);
     usart_set_stopbits(periph->peripheral.uart.handle, 1);
 
-    usart_enable_rx_interrupt(periph->peripheral.uart.handle); // Enable specific Rx interrupt
+    currentUartStartRx(&periph->peripheral.uart);               // DMA or RXNE receive
     nvic_enable_irq(periph->peripheral.uart.nvic_entry);       // Enable interrupts for USART2
 
     periph->status = true;
@@ -168,7 +177,8 @@ static void disableUART(PeripheralController *periph)
 {
     usart_disable(periph->peripheral.uart.handle);
     nvic_disable_irq(periph->peripheral.uart.nvic_entry);
-    usart_disable_rx_interrupt(periph->peripheral.uart.handle);
+    currentUartStopRx(&periph->peripheral.uart);
+    usart_disable_tx_interrupt(periph->peripheral.uart.handle);
     periph->status = false;
 }
 
@@ -205,4 +215,273 @@ PeripheralController createStandardUARTUSART(uint32_t uart_handle, enum rcc_peri
     pc.disablePeripheral = disableUART;
     pc.status = false;
     return pc;
-}
\ No newline at end of file
+}
+
+/* PWM */
+
+/**
+ * @brief Enable function for PWM pins. Connects the pin to its timer channel and starts it.
+ *
+ * @param periph peripheral to enable
+ */
+static void enablePWM(PeripheralController *periph)
+{
+    PWMPeripheral *pwm = &periph->peripheral.pwm;
+    gpio_mode_setup(pwm->port, GPIO_MODE_AF, GPIO_PUPD_NONE, pwm->pin);
+    gpio_set_output_options(pwm->port, GPIO_OTYPE_PP, GPIO_OSPEED_50MHZ, pwm->pin);
+    gpio_set_af(pwm->port, pwm->af_mode, pwm->pin);
+    coreTimerSetup(pwm);
+    periph->status = true;
+}
+
+/**
+ * @brief Disable function for PWM pins. Only the channel stops, the board stops the counter once
+ * no channel of the timer is left.
+ *
+ * @param periph peripheral to disable
+ */
+static void disablePWM(PeripheralController *periph)
+{
+    PWMPeripheral *pwm = &periph->peripheral.pwm;
+    timer_disable_oc_output(pwm->timer, pwm->channel);
+    gpio_mode_setup(pwm->port, GPIO_MODE_INPUT, GPIO_PUPD_NONE, pwm->pin);
+    periph->status = false;
+}
+
+/**
+ * @brief Create a PWM peripheral controller
+ *
+ * @param pwm PWM output, see createPWMPeripheral()
+ * @return PeripheralController
+ */
+PeripheralController createStandardPWMPin(PWMPeripheral pwm)
+{
+    PeripheralController pc;
+    pc.type = TYPE_PWM;
+    pc.peripheral.pwm = pwm;
+    pc.enablePeripheral = enablePWM;
+    pc.disablePeripheral = disablePWM;
+    pc.status = false;
+    return pc;
+}
+
+/* Measure */
+
+/**
+ * @brief Enable function for measured pins. Connects the pin to its timer and starts capturing.
+ *
+ * @param periph peripheral to enable
+ */
+static void enableMeasure(PeripheralController *periph)
+{
+    MeasurePeripheral *measure = &periph->peripheral.measure;
+    gpio_mode_setup(measure->port, GPIO_MODE_AF, GPIO_PUPD_NONE, measure->pin);
+    gpio_set_af(measure->port, measure->af_mode, measure->pin);
+    coreMeasureSetup(measure);
+    periph->status = true;
+}
+
+/**
+ * @brief Disable function for measured pins. The measurement owns the whole timer, so the timer
+ * stops with it.
+ *
+ * @param periph peripheral to disable
+ */
+static void disableMeasure(PeripheralController *periph)
+{
+    MeasurePeripheral *measure = &periph->peripheral.measure;
+    coreMeasureStop(measure);
+    gpio_mode_setup(measure->port, GPIO_MODE_INPUT, GPIO_PUPD_NONE, measure->pin);
+    periph->status = false;
+}
+
+/**
+ * @brief Create a measured pin peripheral controller
+ *
+ * @param measure measured input, see createMeasurePeripheral()
+ * @return PeripheralController
+ */
+PeripheralController createStandardMeasurePin(MeasurePeripheral measure)
+{
+    PeripheralController pc;
+    pc.type = TYPE_MEASURE;
+    pc.peripheral.measure = measure;
+    pc.enablePeripheral = enableMeasure;
+    pc.disablePeripheral = disableMeasure;
+    pc.status = false;
+    return pc;
+}
+
+/* SPI */
+
+/**
+ * @brief Enable function for SPI masters. Connects the pins to the SPI and starts it.
+ *
+ * @param periph peripheral to enable
+ */
+static void enableSPI(PeripheralController *periph)
+{
+    SPIController           *spi = &periph->peripheral.spi;
+    const GPIOPinController *pins[] = {&spi->SCK, &spi->MISO, &spi->MOSI};
+    for (size_t pin = 0; pin < sizeof(pins) / sizeof(pins[0]); pin++)
+    {
+        gpio_mode_setup(pins[pin]->port, pins[pin]->mode, pins[pin]->pupd_resistor,
+                        pins[pin]->pin);
+        gpio_set_output_options(pins[pin]->port, GPIO_OTYPE_PP, GPIO_OSPEED_50MHZ,
+                                pins[pin]->pin);
+        gpio_set_af(pins[pin]->port, pins[pin]->af_mode, pins[pin]->pin);
+    }
+    currentSPISetup(spi);
+    periph->status = true;
+}
+
+/**
+ * @brief Disable function for SPI masters. The pins are left to whatever takes them next.
+ *
+ * @param periph peripheral to disable
+ */
+static void disableSPI(PeripheralController *periph)
+{
+    currentSPIStop(&periph->peripheral.spi);
+    periph->status = false;
+}
+
+/**
+ * @brief Create an SPI master peripheral controller
+ *
+ * @param spi SPI master, see createSPIPeripheral()
+ * @return PeripheralController
+ */
+PeripheralController createStandardSPI(SPIController spi)
+{
+    PeripheralController pc;
+    pc.type = TYPE_SPI;
+    pc.peripheral.spi = spi;
+    pc.enablePeripheral = enableSPI;
+    pc.disablePeripheral = disableSPI;
+    pc.status = false;
+    return pc;
+}
+
+/* I2C */
+
+/**
+ * @brief Enable function for I2C masters. Connects the pins open drain with the pull-ups on, for
+ * a bus without its own, and starts the I2C.
+ *
+ * @param periph peripheral to enable
+ */
+static void enableI2C(PeripheralController *periph)
+{
+    I2CController           *i2c = &periph->peripheral.i2c;
+    const GPIOPinController *pins[] = {&i2c->SCL, &i2c->SDA};
+    for (size_t pin = 0; pin < sizeof(pins) / sizeof(pins[0]); pin++)
+    {
+        gpio_mode_setup(pins[pin]->port, pins[pin]->mode, pins[pin]->pupd_resistor,
+                        pins[pin]->pin);
+        gpio_set_output_options(pins[pin]->port, GPIO_OTYPE_OD, GPIO_OSPEED_50MHZ,
+                                pins[pin]->pin);
+        gpio_set_af(pins[pin]->port, pins[pin]->af_mode, pins[pin]->pin);
+    }
+    currentI2CSetup(i2c);
+    periph->status = true;
+}
+
+/**
+ * @brief Disable function for I2C masters. A batch still running is abandoned without a reply.
+ *
+ * @param periph peripheral to disable
+ */
+static void disableI2C(PeripheralController *periph)
+{
+    currentI2CStop(&periph->peripheral.i2c);
+    periph->status = false;
+}
+
+/**
+ * @brief Create an I2C master peripheral controller
+ *
+ * @param i2c I2C master, see createI2CPeripheral()
+ * @return PeripheralController
+ */
+PeripheralController createStandardI2C(I2CController i2c)
+{
+    PeripheralController pc;
+    pc.type = TYPE_I2C;
+    pc.peripheral.i2c = i2c;
+    pc.enablePeripheral = enableI2C;
+    pc.disablePeripheral = disableI2C;
+    pc.status = false;
+    return pc;
+}
+
+/* Restore */
+
+/**
+ * @brief Rebuilds a peripheral from the settings of a saved one (see snapshot-control.h) through
+ * the same constructors as a new one, so callbacks and UART buffers are fresh. PWM periods and SPI
+ * dividers are worked out again from the frequencies asked for, as the snapshot doesn't hold the
+ * clock they were saved at. Left disabled.
+ *
+ * @param type type of the saved peripheral
+ * @param saved its settings, the member of PeripheralController.peripheral for type
+ * @return PeripheralController peripheral, type TYPE_NONE if type can't be restored
+ */
+PeripheralController rebuildStandardPeripheral(PeripheralType type, const void *saved)
+{
+    PeripheralController pc = {.type = TYPE_NONE, .status = false};
+    switch (type)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+    {
+        const GPIOPinController *gpio = (const GPIOPinController *)saved;
+        pc = createStandardGPIO(gpio->port, gpio->pin, gpio->clock, type, gpio->pupd_resistor);
+        break;
+    }
+    case TYPE_ADC:
+    {
+        const ADCPinController *adc = (const ADCPinController *)saved;
+        pc = createStandardADCPin(adc->port, adc->pin, adc->clock, adc->adc_clock,
+                                  adc->sample_time, adc->adc_port, adc->adc_channel, adc->bits,
+                                  adc->average);
+        break;
+    }
+    case TYPE_UART:
+    {
+        const UARTController *uart = (const UARTController *)saved;
+        pc = createStandardUARTUSART(uart->handle, uart->uart_clock, uart->baudrate,
+                                     uart->RX.port, uart->TX.port, uart->RX.pin, uart->TX.pin,
+                                     uart->RX.clock, uart->TX.clock, uart->RX.af_mode,
+                                     uart->TX.af_mode, uart->nvic_entry);
+        // Applied by enableUART().
+        pc.peripheral.uart.flow = uart->flow;
+        break;
+    }
+    case TYPE_PWM:
+    {
+        // Saved periods were worked out for the clock at save time, the board boots at another.
+        PWMPeripheral pwm = *(const PWMPeripheral *)saved;
+        (void)coreTimerComputePeriod(pwm.timer, pwm.frequency, &pwm.prescaler, &pwm.arr_val);
+        pc = createStandardPWMPin(pwm);
+        break;
+    }
+    case TYPE_MEASURE:
+        pc = createStandardMeasurePin(*(const MeasurePeripheral *)saved);
+        break;
+    case TYPE_SPI:
+    {
+        // As for PWM, the divider is picked again for the clock in force now.
+        SPIController spi = *(const SPIController *)saved;
+        spi.divider = currentSPIDivider(&spi);
+        pc = createStandardSPI(spi);
+        break;
+    }
+    case TYPE_I2C:
+        pc = createStandardI2C(*(const I2CController *)saved);
+        break;
+    default:
+        break;
+    }
+    return pc;
+}
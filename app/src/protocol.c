@@ -0,0 +1,147 @@
+/**
+ * @file protocol.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Builds and sends binary console frames.
+ * @version 0.1
+ * @date 2025-03-10
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core/system.h"
+#include "core/uart.h"
+
+#include "response.h"
+
+#define CRC16_INIT (0xFFFF)
+
+// A frame has to fit the TX ring buffer whole (it holds one byte less than its size), or the drop
+// policy would discard every frame longer than it.
+#if FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE > UART_TX_BUFFER_SIZE - 1
+#error "FRAME_MAX_PAYLOAD is too long for UART_TX_BUFFER_SIZE"
+#endif
+
+static bool    binary_mode = false;
+// Frames are assembled here and queued with coreUartWriteWhole(), so whatever the TX policy a
+// frame goes out whole or not at all.
+static uint8_t frame_buffer[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE];
+
+// CRC-16/CCITT-FALSE (poly 0x1021) a nibble at a time: 32 bytes of table instead of 512.
+static const uint16_t crc16_nibble_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+/**
+ * @brief Continues a CRC-16/CCITT-FALSE over more data.
+ *
+ * @param crc CRC so far, 0xFFFF to start
+ * @param data bytes to add
+ * @param length number of bytes
+ * @return uint16_t updated CRC
+ */
+uint16_t protocolCrc16(uint16_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = (uint16_t)((crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+/**
+ * @brief stdout hook while in binary mode, sends whatever would have been printed as a text
+ * frame.
+ *
+ * @param ptr text
+ * @param len length of text
+ * @return int len, all of it is always consumed
+ */
+static int textFrameHook(const char *ptr, int len)
+{
+    int sent = 0;
+    while (sent < len)
+    {
+        int chunk = len - sent > FRAME_MAX_PAYLOAD ? FRAME_MAX_PAYLOAD : len - sent;
+        protocolSendFrame(FRAME_TEXT, (const uint8_t *)&ptr[sent], (uint16_t)chunk);
+        sent += chunk;
+    }
+    return len;
+}
+
+/**
+ * @brief Switches the console between text and binary frames. printf output is wrapped in text
+ * frames while binary, and back under the verbosity's control in text mode.
+ *
+ * @param binary true for frames, false for plain text
+ */
+void protocolSetBinaryMode(bool binary)
+{
+    // Anything already printed goes out in the old format.
+    fflush(stdout);
+    binary_mode = binary;
+    coreUartSetWriteHook(binary ? textFrameHook : responseTextHook());
+}
+
+/**
+ * @brief Tells whether the console is framed.
+ *
+ * @return true binary frames
+ * @return false plain text
+ */
+bool protocolBinaryMode(void)
+{
+    return binary_mode;
+}
+
+/**
+ * @brief Sends a frame stamped with the current time.
+ *
+ * @param id what the payload is
+ * @param payload payload bytes
+ * @param length payload length, up to FRAME_MAX_PAYLOAD
+ */
+void protocolSendFrame(FrameID id, const uint8_t *payload, uint16_t length)
+{
+    protocolSendTimedFrame(id, (uint32_t)coreGetTicks(), payload, length);
+}
+
+/**
+ * @brief Sends a frame with an explicit timestamp, for data captured before it is sent.
+ *
+ * @param id what the payload is
+ * @param timestamp milliseconds since power on
+ * @param payload payload bytes
+ * @param length payload length, longer payloads are cut to FRAME_MAX_PAYLOAD
+ */
+void protocolSendTimedFrame(FrameID id, uint32_t timestamp, const uint8_t *payload,
+                            uint16_t length)
+{
+    if (length > FRAME_MAX_PAYLOAD)
+    {
+        length = FRAME_MAX_PAYLOAD;
+    }
+
+    frame_buffer[0] = FRAME_START;
+    frame_buffer[1] = (uint8_t)length;
+    frame_buffer[2] = (uint8_t)(length >> 8);
+    frame_buffer[3] = (uint8_t)id;
+    frame_buffer[4] = (uint8_t)timestamp;
+    frame_buffer[5] = (uint8_t)(timestamp >> 8);
+    frame_buffer[6] = (uint8_t)(timestamp >> 16);
+    frame_buffer[7] = (uint8_t)(timestamp >> 24);
+    memcpy(&frame_buffer[FRAME_HEADER_SIZE], payload, length);
+
+    size_t   crc_offset = FRAME_HEADER_SIZE + length;
+    uint16_t crc = protocolCrc16(CRC16_INIT, &frame_buffer[1], crc_offset - 1);
+    frame_buffer[crc_offset] = (uint8_t)crc;
+    frame_buffer[crc_offset + 1] = (uint8_t)(crc >> 8);
+
+    (void)coreUartWriteWhole(frame_buffer, (uint32_t)(crc_offset + FRAME_CRC_SIZE));
+}
@@ -0,0 +1,179 @@
+/**
+ * @file response.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Console verbosity and the reply formatter. Replies are built in one buffer with plain
+ * digit loops, no varargs and no vfprintf.
+ * @version 0.1
+ * @date 2025-03-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "response.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+static Verbosity verbosity = VERBOSITY_FULL;
+static char      line[RESPONSE_LINE_SIZE];
+static size_t    line_length = 0;
+
+/**
+ * @brief stdout hook for the terse and silent modes, printf output goes nowhere.
+ *
+ * @param ptr unused
+ * @param len length of text
+ * @return int len, all of it is always consumed
+ */
+static int discardHook(const char *ptr, int len)
+{
+    (void)ptr;
+    return len;
+}
+
+/**
+ * @brief Sets how much the console says back. Takes effect from the next line of output.
+ *
+ * @param new_verbosity full, terse or silent
+ */
+void responseSetVerbosity(Verbosity new_verbosity)
+{
+    // Anything already printed goes out under the old verbosity.
+    fflush(stdout);
+    verbosity = new_verbosity;
+    if (!protocolBinaryMode())
+    {
+        coreUartSetWriteHook(responseTextHook());
+    }
+}
+
+/**
+ * @brief Returns the verbosity in force. Always full in binary mode.
+ *
+ * @return Verbosity current verbosity
+ */
+Verbosity responseVerbosity(void)
+{
+    return protocolBinaryMode() ? VERBOSITY_FULL : verbosity;
+}
+
+/**
+ * @brief Returns the stdout hook text mode needs for the current verbosity.
+ *
+ * @return UartWriteHook hook, NULL for plain printf output
+ */
+UartWriteHook responseTextHook(void)
+{
+    return verbosity == VERBOSITY_FULL ? NULL : discardHook;
+}
+
+/**
+ * @brief Starts a new reply.
+ *
+ */
+void responseBegin(void)
+{
+    line_length = 0;
+}
+
+/**
+ * @brief Adds characters to the reply. Room is always kept for the line ending.
+ *
+ * @param text characters to add
+ * @param length number of characters
+ */
+void responseChars(const char *text, size_t length)
+{
+    size_t room = RESPONSE_LINE_SIZE - 2 - line_length;
+    if (length > room)
+    {
+        length = room;
+    }
+    memcpy(&line[line_length], text, length);
+    line_length += length;
+}
+
+/**
+ * @brief Adds a null terminated string to the reply.
+ *
+ * @param text string to add
+ */
+void responseString(const char *text)
+{
+    responseChars(text, strlen(text));
+}
+
+/**
+ * @brief Adds a number to the reply in decimal.
+ *
+ * @param value number to add
+ * @param width least number of digits, zero padded (0 or 1 for none)
+ */
+void responseUnsigned(uint32_t value, uint8_t width)
+{
+    char   digits[10];
+    size_t count = 0;
+    do
+    {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0 && count < sizeof(digits));
+    while (count < width && count < sizeof(digits))
+    {
+        digits[sizeof(digits) - 1 - count++] = '0';
+    }
+    responseChars(&digits[sizeof(digits) - count], count);
+}
+
+/**
+ * @brief Adds a port/pin identifier to the reply, e.g. A05.
+ *
+ * @param letter port letter, in the case it was typed
+ * @param number pin number
+ */
+void responsePin(char letter, unsigned int number)
+{
+    responseChars(&letter, 1);
+    responseUnsigned(number, 2);
+}
+
+/**
+ * @brief Ends the reply and sends it with one write. In full mode it takes the same path as
+ * printf, so it is framed in binary mode. Terse replies skip the discarding stdout hook. Nothing
+ * is sent when silent.
+ *
+ */
+void responseEnd(void)
+{
+    switch (responseVerbosity())
+    {
+    case VERBOSITY_FULL:
+        line[line_length++] = '\n'; // _write() sends CRLF
+        (void)_write(STDOUT_FILENO, line, (int)line_length);
+        break;
+    case VERBOSITY_TERSE:
+        line[line_length++] = '\r';
+        line[line_length++] = '\n';
+        coreUartWrite((uint8_t *)line, (uint32_t)line_length);
+        break;
+    default:
+        break;
+    }
+    line_length = 0;
+}
+
+/**
+ * @brief Ends a console line's replies: ACK or NAK when terse, nothing otherwise.
+ *
+ * @param result true if the line ran
+ */
+void responseLineResult(bool result)
+{
+    if (responseVerbosity() == VERBOSITY_TERSE)
+    {
+        coreUartWriteByte(result ? RESPONSE_ACK : RESPONSE_NAK);
+    }
+}
@@ -0,0 +1,214 @@
+/**
+ * @file scheduler.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Cooperative task scheduler. Tasks are precompiled lines run off the systick time base
+ * whenever the main loop is not busy with console input.
+ * @version 0.1
+ * @date 2025-03-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "scheduler.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "core/system.h"
+#include "interpreter.h"
+#include "local-memory.h"
+#include "vm.h"
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+
+/**
+ * @brief Returns true if a compiled line tries to schedule or manage tasks itself.
+ *
+ * @param chunk compiled line
+ * @return true chunk uses a scheduler op
+ * @return false chunk is safe to run as a task
+ */
+static bool usesScheduler(const Chunk *chunk)
+{
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        uint8_t op = chunk->code[i].op;
+        if (op == OP_SCHEDULE || op == OP_TASKS_LIST || op == OP_TASKS_KILL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Compiles a line into a free task slot.
+ *
+ * @param text line to run, not null terminated
+ * @param length length of text
+ * @param period_ms delay before the first run, and period if repeating
+ * @param repeat run every period_ms until killed
+ * @return int task id (1 up), 0 if the line could not be scheduled
+ */
+int schedulerAdd(const char *text, size_t length, uint32_t period_ms, bool repeat)
+{
+    if (length >= SCHEDULER_TEXT_SIZE)
+    {
+        printf("> Error: Task line is too long (max %d characters).\r\n",
+               SCHEDULER_TEXT_SIZE - 1);
+        return 0;
+    }
+
+    Task *task = NULL;
+    int   id = 0;
+    for (size_t slot = 0; slot < SCHEDULER_MAX_TASKS; slot++)
+    {
+        if (!tasks[slot].active)
+        {
+            task = &tasks[slot];
+            id = (int)slot + 1;
+            break;
+        }
+    }
+    if (task == NULL)
+    {
+        printf("> Error: No free task slots (max %d tasks).\r\n", SCHEDULER_MAX_TASKS);
+        return 0;
+    }
+
+    memcpy(task->text, text, length);
+    task->text[length] = '\0';
+    // The line that scheduled this task has finished with the arena.
+    resetLineArena();
+    if (!compileLine(task->text, &task->chunk))
+    {
+        return 0;
+    }
+    if (usesScheduler(&task->chunk))
+    {
+        printf("> Error: Tasks can't schedule or kill other tasks.\r\n");
+        return 0;
+    }
+
+    task->repeat = repeat;
+    task->period_ms = period_ms;
+    task->due = coreGetTicks() + period_ms;
+    task->runs = 0;
+    task->active = true;
+    return id;
+}
+
+/**
+ * @brief Removes a task.
+ *
+ * @param id task id from schedulerAdd()
+ * @return true task killed
+ * @return false no such task
+ */
+bool schedulerKill(int id)
+{
+    if (id < 1 || id > SCHEDULER_MAX_TASKS || !tasks[id - 1].active)
+    {
+        return false;
+    }
+    tasks[id - 1].active = false;
+    return true;
+}
+
+/**
+ * @brief Removes every task.
+ *
+ */
+void schedulerKillAll(void)
+{
+    for (size_t slot = 0; slot < SCHEDULER_MAX_TASKS; slot++)
+    {
+        tasks[slot].active = false;
+    }
+}
+
+/**
+ * @brief Prints every task and when it next runs.
+ *
+ */
+void schedulerList(void)
+{
+    uint64_t now = coreGetTicks();
+    bool     any = false;
+    for (size_t slot = 0; slot < SCHEDULER_MAX_TASKS; slot++)
+    {
+        const Task *task = &tasks[slot];
+        if (!task->active)
+        {
+            continue;
+        }
+        uint32_t next = task->due > now ? (uint32_t)(task->due - now) : 0;
+        printf("> TASK %u: %s %lu ms \"%s\", next in %lu ms, run %lu times\r\n",
+               (unsigned int)slot + 1, task->repeat ? "every" : "after", task->period_ms,
+               task->text, next, task->runs);
+        any = true;
+    }
+    if (!any)
+    {
+        printf("> No tasks.\r\n");
+    }
+}
+
+/**
+ * @brief Tells the main loop's sleep that schedulerService() has something to do, a task that
+ * fell due on a tick after it last looked.
+ *
+ * @return true a task is due
+ */
+bool schedulerPending(void)
+{
+    uint64_t now = coreGetTicks();
+    for (size_t slot = 0; slot < SCHEDULER_MAX_TASKS; slot++)
+    {
+        if (tasks[slot].active && now >= tasks[slot].due)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Runs every task that is due. Call from the main loop. A task whose line fails is killed
+ * so it doesn't fail again every period.
+ *
+ * @param bc board controller object
+ */
+void schedulerService(BoardController *bc)
+{
+    uint64_t now = coreGetTicks();
+    for (size_t slot = 0; slot < SCHEDULER_MAX_TASKS; slot++)
+    {
+        Task *task = &tasks[slot];
+        if (!task->active || now < task->due)
+        {
+            continue;
+        }
+
+        task->runs++;
+        if (task->repeat)
+        {
+            // Keep to the original grid, unless we've fallen a whole period behind.
+            task->due += task->period_ms;
+            if (task->due <= now)
+            {
+                task->due = now + task->period_ms;
+            }
+        }
+        else
+        {
+            task->active = false;
+        }
+
+        if (!runChunk(bc, &task->chunk))
+        {
+            printf("> Task %u failed and was killed: \"%s\".\r\n", (unsigned int)slot + 1,
+                   task->text);
+            task->active = false;
+        }
+    }
+}
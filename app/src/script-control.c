@@ -0,0 +1,663 @@
+/**
+ * @file script-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Named scripts. Lines typed between "def" and "end" are recorded already compiled, saved
+ * to flash and run back to back by "run" without going through the scanner or parser again.
+ * @note Flash is only erased a sector at a time, so scripts are appended to the active bank and
+ *       "del" just marks them. When the active bank fills up the live scripts are compacted into
+ *       the other bank, which becomes active once it is complete.
+ * @version 0.1
+ * @date 2025-03-21
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "script-control.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "libopencm3/stm32/flash.h"
+
+#include "vm.h"
+
+// Value of an erased flash word.
+#define SCRIPT_ERASED (0xFFFFFFFFU)
+
+// The script being recorded, lines packed the way they are stored.
+static bool     recording = false;
+static char     record_name[SCRIPT_NAME_SIZE];
+static uint8_t  record_data[SCRIPT_RECORD_SIZE] __attribute__((aligned(4)));
+static size_t   record_used = 0;
+static uint16_t record_lines = 0;
+
+// Line being run. Stored lines are copied out a line at a time so they can be bound to the board.
+static Chunk run_chunk;
+
+/**
+ * @brief Returns the first address of a bank.
+ *
+ * @param bank bank 0 or 1
+ * @return uint32_t address
+ */
+static uint32_t bankAddress(size_t bank)
+{
+    return SCRIPT_BANK_ADDRESS + (uint32_t)bank * SCRIPT_BANK_SIZE;
+}
+
+/**
+ * @brief Returns the bank new scripts go in: the complete bank of this format with the highest
+ * sequence.
+ *
+ * @return int bank, -1 if no bank holds scripts yet
+ */
+static int activeBank(void)
+{
+    int      active = -1;
+    uint32_t sequence = 0;
+    for (size_t bank = 0; bank < SCRIPT_BANK_COUNT; bank++)
+    {
+        const ScriptBankHeader *header = (const ScriptBankHeader *)bankAddress(bank);
+        if (header->magic == SCRIPT_MAGIC && header->format == SCRIPT_FORMAT &&
+            (active < 0 || header->sequence > sequence))
+        {
+            active = (int)bank;
+            sequence = header->sequence;
+        }
+    }
+    return active;
+}
+
+/**
+ * @brief Steps through the scripts in a bank, including deleted ones and ones cut short.
+ *
+ * @param bank bank to walk
+ * @param slot script returned last time, NULL for the first
+ * @return const ScriptHeader* next script, NULL at the free space or anything unreadable
+ */
+static const ScriptHeader *nextSlot(size_t bank, const ScriptHeader *slot)
+{
+    uint32_t address = slot == NULL ? bankAddress(bank) + sizeof(ScriptBankHeader)
+                                    : (uint32_t)slot + sizeof(ScriptHeader) + slot->size;
+    uint32_t end = bankAddress(bank) + SCRIPT_BANK_SIZE;
+    if (address + sizeof(ScriptHeader) > end)
+    {
+        return NULL;
+    }
+    const ScriptHeader *next = (const ScriptHeader *)address;
+    if (next->size % 4 != 0 || next->size > end - address - sizeof(ScriptHeader))
+    {
+        return NULL;
+    }
+    return next;
+}
+
+/**
+ * @brief Returns where the next script in a bank goes.
+ *
+ * @param bank bank to check
+ * @return uint32_t free address, the end of the bank if the space after the last script isn't
+ * erased
+ */
+static uint32_t freeAddress(size_t bank)
+{
+    const ScriptHeader *last = NULL;
+    for (const ScriptHeader *slot = nextSlot(bank, NULL); slot != NULL;
+         slot = nextSlot(bank, slot))
+    {
+        last = slot;
+    }
+    uint32_t address = last == NULL ? bankAddress(bank) + sizeof(ScriptBankHeader)
+                                    : (uint32_t)last + sizeof(ScriptHeader) + last->size;
+    uint32_t end = bankAddress(bank) + SCRIPT_BANK_SIZE;
+    if (address + sizeof(ScriptHeader) > end)
+    {
+        return end;
+    }
+    const uint32_t *words = (const uint32_t *)address;
+    for (size_t word = 0; word < sizeof(ScriptHeader) / 4; word++)
+    {
+        if (words[word] != SCRIPT_ERASED)
+        {
+            return end;
+        }
+    }
+    return address;
+}
+
+/**
+ * @brief Returns true if a script is complete and not deleted.
+ *
+ * @param slot script to check
+ * @return true script is live
+ * @return false script is deleted or was cut short
+ */
+static bool isLive(const ScriptHeader *slot)
+{
+    return slot->magic == SCRIPT_MAGIC && slot->deleted == SCRIPT_ERASED;
+}
+
+/**
+ * @brief Finds a live script by name. If a save was cut short after the new copy went in, the
+ * newest copy wins.
+ *
+ * @param bank bank to search
+ * @param name script name, not null terminated
+ * @param length length of name
+ * @return const ScriptHeader* script, NULL if there is none
+ */
+static const ScriptHeader *findScript(size_t bank, const char *name, size_t length)
+{
+    const ScriptHeader *found = NULL;
+    for (const ScriptHeader *slot = nextSlot(bank, NULL); slot != NULL;
+         slot = nextSlot(bank, slot))
+    {
+        if (isLive(slot) && strncmp(slot->name, name, length) == 0 && slot->name[length] == '\0')
+        {
+            found = slot;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Programs words into erased flash and checks they read back. Flash must be unlocked.
+ *
+ * @param address word aligned flash address
+ * @param data words to program
+ * @param size bytes, a multiple of 4
+ * @return true programmed
+ * @return false flash didn't read back as written
+ */
+static bool programWords(uint32_t address, const void *data, size_t size)
+{
+    const uint32_t *words = (const uint32_t *)data;
+    for (size_t word = 0; word < size / 4; word++)
+    {
+        flash_program_word(address + word * 4, words[word]);
+    }
+    if (memcmp((const void *)address, data, size) != 0)
+    {
+        printf("> Error: Flash write failed near 0x%08lx.\r\n", address);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Erases a bank and starts it as the successor of another. Live scripts from the old bank,
+ * except one being replaced, are copied across. The new bank's magic is left for the caller, so
+ * the old bank stays active until the new one is complete. Flash must be unlocked.
+ *
+ * @param from active bank, -1 for none
+ * @param skip name of the script being replaced
+ * @param to bank to erase and fill
+ * @return uint32_t free address in the new bank, 0 if a write failed
+ */
+static uint32_t compactBank(int from, const char *skip, size_t to)
+{
+    // Stalls anything running from flash for as long as the sector takes to erase, 1-2 s.
+    flash_erase_sector((uint8_t)(SCRIPT_BANK_FIRST_SECTOR + to), FLASH_CR_PROGRAM_X32);
+    flash_dcache_disable();
+    flash_dcache_reset();
+    flash_dcache_enable();
+
+    ScriptBankHeader header = {
+        .magic = SCRIPT_ERASED,
+        .sequence = from < 0 ? 1 : ((const ScriptBankHeader *)bankAddress(from))->sequence + 1,
+        .format = SCRIPT_FORMAT,
+        .reserved = 0xFFFF,
+    };
+    uint32_t address = bankAddress(to);
+    if (!programWords(address, &header, sizeof(header)))
+    {
+        return 0;
+    }
+    address += sizeof(header);
+    if (from < 0)
+    {
+        return address;
+    }
+
+    for (const ScriptHeader *slot = nextSlot(from, NULL); slot != NULL;
+         slot = nextSlot(from, slot))
+    {
+        if (!isLive(slot) || strcmp(slot->name, skip) == 0)
+        {
+            continue;
+        }
+        size_t size = sizeof(ScriptHeader) + slot->size;
+        if (!programWords(address, slot, size))
+        {
+            return 0;
+        }
+        address += size;
+    }
+    return address;
+}
+
+/**
+ * @brief Returns bytes taken by live scripts in a bank, except one being replaced.
+ *
+ * @param bank bank to check
+ * @param skip name of the script being replaced
+ * @return size_t bytes, headers included
+ */
+static size_t liveBytes(size_t bank, const char *skip)
+{
+    size_t bytes = 0;
+    for (const ScriptHeader *slot = nextSlot(bank, NULL); slot != NULL;
+         slot = nextSlot(bank, slot))
+    {
+        if (isLive(slot) && strcmp(slot->name, skip) != 0)
+        {
+            bytes += sizeof(ScriptHeader) + slot->size;
+        }
+    }
+    return bytes;
+}
+
+/**
+ * @brief Writes a record to flash, replacing any record of the same name. Flash must be unlocked.
+ *
+ * @param name record name, null terminated
+ * @param data record contents
+ * @param size bytes of data, a multiple of 4
+ * @param lines lines in a script, 0 for other records
+ * @return true saved
+ * @return false no room, or a write failed
+ */
+static bool saveRecord(const char *name, const void *data, size_t size, uint16_t lines)
+{
+    ScriptHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    memset(header.name, 0, sizeof(header.name));
+    memcpy(header.name, name, strlen(name));
+    header.size = (uint32_t)size;
+    header.lines = lines;
+    size_t needed = sizeof(header) + size;
+
+    int                 bank = activeBank();
+    const ScriptHeader *replaced = NULL;
+    uint32_t            address = 0;
+    size_t              target = 0;
+    if (bank >= 0)
+    {
+        replaced = findScript((size_t)bank, name, strlen(name));
+        address = freeAddress((size_t)bank);
+        target = (size_t)bank;
+    }
+
+    bool compacted = bank < 0 || bankAddress((size_t)bank) + SCRIPT_BANK_SIZE - address < needed;
+    if (compacted)
+    {
+        size_t capacity = SCRIPT_BANK_SIZE - sizeof(ScriptBankHeader);
+        size_t live = bank < 0 ? 0 : liveBytes((size_t)bank, name);
+        if (live + needed > capacity)
+        {
+            printf("> Error: Script storage is full (%u of %u bytes free), \"del\" some "
+                   "scripts.\r\n",
+                   (unsigned int)(capacity - live), (unsigned int)capacity);
+            return false;
+        }
+        target = bank < 0 ? 0 : (size_t)(1 - bank);
+        address = compactBank(bank, name, target);
+        if (address == 0)
+        {
+            return false;
+        }
+    }
+
+    // Magic goes in last, until then the script is skipped.
+    uint32_t magic = SCRIPT_MAGIC;
+    if (!programWords(address, &header, sizeof(header)) ||
+        !programWords(address + sizeof(header), data, size) ||
+        !programWords(address, &magic, sizeof(magic)))
+    {
+        return false;
+    }
+
+    if (compacted)
+    {
+        return programWords(bankAddress(target), &magic, sizeof(magic));
+    }
+    if (replaced != NULL)
+    {
+        uint32_t deleted = 0;
+        return programWords((uint32_t)&replaced->deleted, &deleted, sizeof(deleted));
+    }
+    return true;
+}
+
+/**
+ * @brief Returns true between "def" and "end", while console lines are recorded instead of run.
+ *
+ * @return true recording
+ * @return false not recording
+ */
+bool scriptRecording(void)
+{
+    return recording;
+}
+
+/**
+ * @brief Starts recording a script. Every console line up to "end" is compiled and kept, not run.
+ *
+ * @param name script name, not null terminated
+ * @param length length of name, under SCRIPT_NAME_SIZE
+ * @return true recording
+ * @return false already recording
+ */
+bool scriptDefine(const char *name, size_t length)
+{
+    if (recording)
+    {
+        printf("> Error: Already recording \"%s\", finish it with \"end\" first.\r\n",
+               record_name);
+        return false;
+    }
+    memcpy(record_name, name, length);
+    record_name[length] = '\0';
+    record_used = 0;
+    record_lines = 0;
+    recording = true;
+    printf("> Recording \"%s\", finish with \"end\".\r\n", record_name);
+    return true;
+}
+
+/**
+ * @brief Adds a compiled console line to the script being recorded.
+ *
+ * @param chunk compiled line
+ * @return true line recorded
+ * @return false line manages scripts itself, or the script is full
+ */
+bool scriptRecord(const Chunk *chunk)
+{
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        uint8_t op = chunk->code[i].op;
+        if (op == OP_SCRIPT_DEF || op == OP_SCRIPT_RUN || op == OP_SCRIPT_DEL)
+        {
+            printf("> Error: Scripts can't define, run or delete scripts, line not "
+                   "recorded.\r\n");
+            return false;
+        }
+    }
+
+    ScriptLine line = {
+        .count = chunk->count,
+        .constants_count = chunk->constants_count,
+        .strings_length = chunk->strings_length,
+    };
+    size_t size = sizeof(line) + chunk->count * sizeof(ScriptInstruction) +
+                  chunk->constants_count * sizeof(uint32_t) +
+                  ((chunk->strings_length + 3U) & ~3U);
+    if (size > SCRIPT_RECORD_SIZE - record_used)
+    {
+        printf("> Error: Script is full (max %d bytes), line not recorded.\r\n",
+               SCRIPT_RECORD_SIZE);
+        return false;
+    }
+    line.size = (uint16_t)size;
+
+    uint8_t *out = &record_data[record_used];
+    memset(out, 0, size);
+    memcpy(out, &line, sizeof(line));
+    out += sizeof(line);
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        const Instruction *instruction = &chunk->code[i];
+        ScriptInstruction  stored = {
+            .op = instruction->op,
+            .flags = instruction->flags,
+            .mask = instruction->mask,
+            .port = instruction->port,
+            .operand = instruction->operand,
+        };
+        memcpy(out, &stored, sizeof(stored));
+        out += sizeof(stored);
+    }
+    memcpy(out, chunk->constants, chunk->constants_count * sizeof(uint32_t));
+    out += chunk->constants_count * sizeof(uint32_t);
+    memcpy(out, chunk->strings, chunk->strings_length);
+
+    record_used += size;
+    record_lines++;
+    return true;
+}
+
+/**
+ * @brief Stops recording and saves the script to flash.
+ *
+ * @return true saved
+ * @return false not recording, nothing recorded or flash full
+ */
+bool scriptEnd(void)
+{
+    if (!recording)
+    {
+        printf("> Error: \"end\" without \"def\".\r\n");
+        return false;
+    }
+    recording = false;
+    if (record_lines == 0)
+    {
+        printf("> Error: Script \"%s\" is empty, nothing saved.\r\n", record_name);
+        return false;
+    }
+
+    flash_unlock();
+    flash_clear_status_flags();
+    bool saved = saveRecord(record_name, record_data, record_used, record_lines);
+    flash_lock();
+    if (!saved)
+    {
+        printf("> Error: Script \"%s\" not saved.\r\n", record_name);
+        return false;
+    }
+    printf("> Saved script \"%s\", %u lines, %u bytes.\r\n", record_name,
+           (unsigned int)record_lines, (unsigned int)record_used);
+    return true;
+}
+
+/**
+ * @brief Copies a stored line into a chunk, unbound.
+ *
+ * @param line stored line
+ * @param chunk chunk to fill
+ * @return true copied
+ * @return false line doesn't fit a chunk, the script is corrupt
+ */
+static bool loadLine(const ScriptLine *line, Chunk *chunk)
+{
+    if (line->count > CHUNK_MAX_INSTRUCTIONS || line->constants_count > CHUNK_MAX_CONSTANTS ||
+        line->strings_length > CHUNK_MAX_STRINGS)
+    {
+        return false;
+    }
+
+    const ScriptInstruction *code = (const ScriptInstruction *)(line + 1);
+    const uint32_t          *constants = (const uint32_t *)(code + line->count);
+    chunk->count = line->count;
+    chunk->constants_count = line->constants_count;
+    chunk->strings_length = line->strings_length;
+    chunk->bound_generation = CHUNK_UNBOUND;
+    for (size_t i = 0; i < line->count; i++)
+    {
+        Instruction *instruction = &chunk->code[i];
+        instruction->op = code[i].op;
+        instruction->flags = code[i].flags;
+        instruction->mask = code[i].mask;
+        instruction->port = code[i].port;
+        instruction->operand = code[i].operand;
+        instruction->bound_mask = 0;
+        instruction->periph = NULL;
+    }
+    memcpy(chunk->constants, constants, line->constants_count * sizeof(uint32_t));
+    memcpy(chunk->strings, constants + line->constants_count, line->strings_length);
+    return true;
+}
+
+/**
+ * @brief Runs every line of a script in order, stopping at the first that fails.
+ *
+ * @param bc board controller object
+ * @param name script name, not null terminated
+ * @param length length of name
+ * @return true every line ran
+ * @return false no such script, or a line failed
+ */
+bool scriptRun(BoardController *bc, const char *name, size_t length)
+{
+    int                 bank = activeBank();
+    const ScriptHeader *script = bank < 0 ? NULL : findScript((size_t)bank, name, length);
+    if (script == NULL)
+    {
+        printf("> Error: No script called \"%.*s\".\r\n", (int)length, name);
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t *)(script + 1);
+    for (unsigned int number = 1; number <= script->lines; number++)
+    {
+        const ScriptLine *line = (const ScriptLine *)data;
+        if (!loadLine(line, &run_chunk))
+        {
+            printf("> Error: Script \"%s\" is corrupt at line %u.\r\n", script->name, number);
+            return false;
+        }
+        if (!runChunk(bc, &run_chunk))
+        {
+            printf("> Error: Script \"%s\" stopped at line %u.\r\n", script->name, number);
+            return false;
+        }
+        data += line->size;
+    }
+    return true;
+}
+
+/**
+ * @brief Marks a record deleted.
+ *
+ * @param record live record
+ * @return true deleted
+ * @return false the write failed
+ */
+static bool deleteRecord(const ScriptHeader *record)
+{
+    uint32_t deleted = 0;
+    flash_unlock();
+    flash_clear_status_flags();
+    bool result = programWords((uint32_t)&record->deleted, &deleted, sizeof(deleted));
+    flash_lock();
+    return result;
+}
+
+/**
+ * @brief Deletes a script. The flash it used is only reclaimed when the bank is next compacted.
+ *
+ * @param name script name, not null terminated
+ * @param length length of name
+ * @return true deleted
+ * @return false no such script, or the write failed
+ */
+bool scriptDelete(const char *name, size_t length)
+{
+    int                 bank = activeBank();
+    const ScriptHeader *script = bank < 0 ? NULL : findScript((size_t)bank, name, length);
+    if (script == NULL)
+    {
+        printf("> Error: No script called \"%.*s\".\r\n", (int)length, name);
+        return false;
+    }
+
+    bool result = deleteRecord(script);
+    if (result)
+    {
+        printf("> Deleted script \"%.*s\".\r\n", (int)length, name);
+    }
+    return result;
+}
+
+/**
+ * @brief Prints every stored script and how full the active bank is.
+ *
+ */
+void scriptList(void)
+{
+    int bank = activeBank();
+    if (bank < 0)
+    {
+        printf("> No scripts.\r\n");
+        return;
+    }
+
+    unsigned int count = 0;
+    for (const ScriptHeader *slot = nextSlot((size_t)bank, NULL); slot != NULL;
+         slot = nextSlot((size_t)bank, slot))
+    {
+        if (!isLive(slot) || slot->name[0] == SCRIPT_HIDDEN_PREFIX)
+        {
+            continue;
+        }
+        printf("> SCRIPT %s: %u lines, %lu bytes\r\n", slot->name, (unsigned int)slot->lines,
+               slot->size);
+        count++;
+    }
+    uint32_t start = bankAddress((size_t)bank) + sizeof(ScriptBankHeader);
+    printf("> %u scripts, %lu of %lu bytes of flash used.\r\n", count,
+           freeAddress((size_t)bank) - start, SCRIPT_BANK_SIZE - sizeof(ScriptBankHeader));
+}
+
+/**
+ * @brief Saves a hidden record (name starting with SCRIPT_HIDDEN_PREFIX) alongside the scripts,
+ * replacing any with the same name. It shares their flash and compaction but "list" and "run"
+ * never see it.
+ *
+ * @param name record name, null terminated, under SCRIPT_NAME_SIZE
+ * @param data record contents
+ * @param size bytes of data, a multiple of 4 up to SCRIPT_RECORD_SIZE
+ * @return true saved
+ * @return false no room, or a write failed
+ */
+bool scriptSaveData(const char *name, const void *data, size_t size)
+{
+    flash_unlock();
+    flash_clear_status_flags();
+    bool saved = saveRecord(name, data, size, 0);
+    flash_lock();
+    return saved;
+}
+
+/**
+ * @brief Finds a hidden record saved by scriptSaveData().
+ *
+ * @param name record name, null terminated
+ * @param size returned bytes of data
+ * @return const void* data in flash, NULL if there is no such record
+ */
+const void *scriptFindData(const char *name, size_t *size)
+{
+    int                 bank = activeBank();
+    const ScriptHeader *record = bank < 0 ? NULL : findScript((size_t)bank, name, strlen(name));
+    if (record == NULL)
+    {
+        return NULL;
+    }
+    *size = record->size;
+    return record + 1;
+}
+
+/**
+ * @brief Deletes a hidden record saved by scriptSaveData().
+ *
+ * @param name record name, null terminated
+ * @return true deleted
+ * @return false no such record, or the write failed
+ */
+bool scriptDeleteData(const char *name)
+{
+    int                 bank = activeBank();
+    const ScriptHeader *record = bank < 0 ? NULL : findScript((size_t)bank, name, strlen(name));
+    return record != NULL && deleteRecord(record);
+}
@@ -0,0 +1,191 @@
+/**
+ * @file snapshot-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Board configuration snapshots. Peripherals are stored as their settings structs and
+ * rebuilt through the createStandard*() constructors, so a restore is a handful of register
+ * writes per peripheral rather than a script of commands.
+ * @version 0.1
+ * @date 2025-03-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "snapshot-control.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "exti-control.h"
+#include "peripheral-controller.h"
+#include "script-control.h"
+
+#define SNAPSHOT_ALIGN(size) (((size) + 3U) & ~(size_t)3U)
+
+// A snapshot is built here before it is written to flash.
+static uint8_t snapshot_data[SNAPSHOT_SIZE] __attribute__((aligned(4)));
+
+/**
+ * @brief Size of the settings struct saved for a peripheral type.
+ *
+ * @param type peripheral type
+ * @return size_t bytes, 0 for types that aren't saved
+ */
+static size_t settingsSize(PeripheralType type)
+{
+    switch (type)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+        return sizeof(GPIOPinController);
+    case TYPE_ADC:
+        return sizeof(ADCPinController);
+    case TYPE_UART:
+        return sizeof(UARTController);
+    case TYPE_PWM:
+        return sizeof(PWMPeripheral);
+    case TYPE_MEASURE:
+        return sizeof(MeasurePeripheral);
+    case TYPE_SPI:
+        return sizeof(SPIController);
+    case TYPE_I2C:
+        return sizeof(I2CController);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Saves the live peripherals to flash, replacing any earlier snapshot.
+ *
+ * @param bc Board controller
+ * @return true saved
+ * @return false too big, or the flash write failed
+ */
+bool snapshotSave(BoardController *bc)
+{
+    SnapshotHeader header = {.format = SNAPSHOT_FORMAT, .peripherals = 0};
+    size_t         used = sizeof(header);
+
+    for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+    {
+        const PeripheralController *current = &bc->peripherals[periph];
+        size_t                      settings = settingsSize(current->type);
+        if (!current->status || settings == 0)
+        {
+            continue;
+        }
+        SnapshotRecord record = {.type = (uint8_t)current->type,
+                                 .reserved = 0,
+                                 .size = (uint16_t)SNAPSHOT_ALIGN(settings)};
+        if (used + sizeof(record) + record.size > SNAPSHOT_SIZE)
+        {
+            printf("> Error: Configuration is too big to save (%d bytes max).\r\n", SNAPSHOT_SIZE);
+            return false;
+        }
+        memcpy(&snapshot_data[used], &record, sizeof(record));
+        used += sizeof(record);
+        memset(&snapshot_data[used], 0, record.size);
+        memcpy(&snapshot_data[used], &current->peripheral, settings);
+        used += record.size;
+        header.peripherals++;
+    }
+    memcpy(snapshot_data, &header, sizeof(header));
+
+    if (!scriptSaveData(SNAPSHOT_NAME, snapshot_data, used))
+    {
+        printf("> Error: Couldn't write the configuration to flash.\r\n");
+        return false;
+    }
+    printf("> Saved %u peripherals (%u bytes), restored at boot.\r\n", header.peripherals,
+           (unsigned int)used);
+    return true;
+}
+
+/**
+ * @brief Deletes the saved snapshot, so the board boots with nothing set up.
+ *
+ * @return true deleted
+ * @return false there wasn't one
+ */
+bool snapshotClear(void)
+{
+    if (!scriptDeleteData(SNAPSHOT_NAME))
+    {
+        printf("> Error: No saved configuration to clear.\r\n");
+        return false;
+    }
+    printf("> Saved configuration cleared.\r\n");
+    return true;
+}
+
+/**
+ * @brief Kills everything on the board and puts the saved snapshot back.
+ *
+ * @param bc Board controller
+ * @return true restored
+ * @return false no snapshot, or one this firmware can't read. The board is left alone.
+ */
+bool snapshotRestore(BoardController *bc)
+{
+    size_t         size = 0;
+    const uint8_t *data = scriptFindData(SNAPSHOT_NAME, &size);
+    if (data == NULL)
+    {
+        printf("> Error: No saved configuration, \"save\" one first.\r\n");
+        return false;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *)data;
+    if (size < sizeof(*header) || header->format != SNAPSHOT_FORMAT)
+    {
+        printf("> Error: Saved configuration is from another firmware, \"save\" it again.\r\n");
+        return false;
+    }
+
+    clearBoard(bc);
+    size_t       offset = sizeof(*header);
+    unsigned int restored = 0;
+    for (size_t periph = 0; periph < header->peripherals; periph++)
+    {
+        if (offset + sizeof(SnapshotRecord) > size)
+        {
+            break;
+        }
+        const SnapshotRecord *record = (const SnapshotRecord *)&data[offset];
+        offset += sizeof(*record) + record->size;
+        // A struct that changed size means a layout this firmware doesn't share, skip it.
+        if (offset > size || record->size != SNAPSHOT_ALIGN(settingsSize(record->type)) ||
+            record->size == 0)
+        {
+            continue;
+        }
+
+        PeripheralController *pc =
+            restorePeripheral(bc, rebuildStandardPeripheral(record->type, record + 1));
+        if (pc == NULL)
+        {
+            continue;
+        }
+        restored++;
+        const GPIOPinController *gpio = (const GPIOPinController *)(record + 1);
+        if (record->type == TYPE_GPIO_INPUT && gpio->exti_edges != EXTI_EDGE_NONE)
+        {
+            watchDigitalPin(bc, gpio->port, gpio->pin, gpio->exti_edges);
+        }
+    }
+    printf("> Restored %u of %u peripherals.\r\n", restored, header->peripherals);
+    return restored == header->peripherals;
+}
+
+/**
+ * @brief Restores the saved snapshot at boot, if there is one.
+ *
+ * @param bc Board controller, just initialised
+ */
+void snapshotBoot(BoardController *bc)
+{
+    size_t size = 0;
+    if (scriptFindData(SNAPSHOT_NAME, &size) != NULL)
+    {
+        snapshotRestore(bc);
+    }
+}
@@ -0,0 +1,262 @@
+/**
+ * @file spi-control.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Contains all logic for low level SPI master control. Transfers are full duplex and in
+ * place, long ones go over a pair of DMA streams when both are free and are polled otherwise.
+ * @version 0.1
+ * @date 2025-03-28
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "spi-control.h"
+
+/**
+ * @brief Returns the DMA streams an SPI transfers over, see RM0383 table 27/28.
+ *
+ * @param handle SPI handle
+ * @param rx returned receive stream
+ * @param tx returned transmit stream
+ * @return true streams found
+ * @return false not an SPI on this part
+ */
+static bool spiStreams(uint32_t handle, DMAStream *rx, DMAStream *tx)
+{
+    switch (handle)
+    {
+    case SPI1:
+        *rx = DMA_SPI1_RX;
+        *tx = DMA_SPI1_TX;
+        return true;
+    case SPI2:
+        *rx = DMA_SPI2_RX;
+        *tx = DMA_SPI2_TX;
+        return true;
+    case SPI3:
+        *rx = DMA_SPI3_RX;
+        *tx = DMA_SPI3_TX;
+        return true;
+    case SPI4:
+        *rx = DMA_SPI4_RX;
+        *tx = DMA_SPI4_TX;
+        return true;
+    case SPI5:
+        *rx = DMA_SPI5_RX;
+        *tx = DMA_SPI5_TX;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Returns the clock an SPI's divider divides. SPI2 and SPI3 are on APB1, the rest APB2.
+ *
+ * @param handle SPI handle
+ * @return uint32_t bus clock in Hz
+ */
+static uint32_t spiBusFrequency(uint32_t handle)
+{
+    return handle == SPI2 || handle == SPI3 ? rcc_apb1_frequency : rcc_apb2_frequency;
+}
+
+/**
+ * @brief Create an SPI master controller.
+ *
+ * @param handle SPI handle (SPI1-SPI5)
+ * @param spi_clock RCC clock of the SPI
+ * @param divider bus clock divider, a power of two from 2 to 256
+ * @param mode SPI mode 0-3
+ * @param sck clock pin, alternate function
+ * @param miso data in pin, alternate function
+ * @param mosi data out pin, alternate function
+ * @return SPIController
+ */
+SPIController createSPIPeripheral(uint32_t handle, enum rcc_periph_clken spi_clock,
+                                  uint16_t divider, uint8_t mode, GPIOPinController sck,
+                                  GPIOPinController miso, GPIOPinController mosi)
+{
+    SPIController spi;
+    spi.handle = handle;
+    spi.spi_clock = spi_clock;
+    spi.divider = divider;
+    spi.frequency = spiBusFrequency(handle) / divider;
+    spi.mode = mode;
+    spi.SCK = sck;
+    spi.MISO = miso;
+    spi.MOSI = mosi;
+    return spi;
+}
+
+/**
+ * @brief Sets up and enables a master with 8 bit frames, MSB first. NSS is managed in software
+ * and held high so the SPI never drops out of master mode.
+ *
+ * @param spi SPI to set up, pins already in their alternate function
+ */
+void currentSPISetup(SPIController *spi)
+{
+    // BR field: divider = 2^(BR + 1)
+    uint32_t baudrate = (uint32_t)(__builtin_ctz(spi->divider) - 1) << 3;
+    spi_disable(spi->handle);
+    spi_init_master(spi->handle, baudrate,
+                    (spi->mode & 0x2) ? SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE
+                                      : SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+                    (spi->mode & 0x1) ? SPI_CR1_CPHA_CLK_TRANSITION_2
+                                      : SPI_CR1_CPHA_CLK_TRANSITION_1,
+                    SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
+    spi_enable_software_slave_management(spi->handle);
+    spi_set_nss_high(spi->handle);
+    spi_enable(spi->handle);
+}
+
+/**
+ * @brief Waits for the last frame to finish and disables the SPI.
+ *
+ * @param spi SPI to stop
+ */
+void currentSPIStop(SPIController *spi)
+{
+    while (SPI_SR(spi->handle) & SPI_SR_BSY)
+    {
+    }
+    spi_disable(spi->handle);
+}
+
+/**
+ * @brief Picks the divider for the bus clock in force now, the smallest that keeps SCK at or
+ * under the frequency the SPI was created at. A slave that only copes with the original speed
+ * never gets a faster clock, at the bottom of the range SCK can come out slower.
+ *
+ * @param spi SPI, frequency set
+ * @return uint16_t bus clock divider, a power of two from 2 to 256
+ */
+uint16_t currentSPIDivider(const SPIController *spi)
+{
+    uint32_t bus = spiBusFrequency(spi->handle);
+    uint16_t divider = SPI_MIN_DIVIDER;
+    while (divider < SPI_MAX_DIVIDER && bus / divider > spi->frequency)
+    {
+        divider *= 2;
+    }
+    return divider;
+}
+
+/**
+ * @brief Restarts an SPI on the divider currentSPIDivider() picks after the bus clock changed.
+ *
+ * @param spi SPI to retune, set up and idle between transfers
+ */
+void currentSPIClockChanged(SPIController *spi)
+{
+    spi->divider = currentSPIDivider(spi);
+    currentSPIStop(spi);
+    currentSPISetup(spi);
+}
+
+/**
+ * @brief Transfers a buffer over both DMA streams. The buffer is sent and received into at once:
+ * the TX stream always reads a byte before the RX stream overwrites it.
+ *
+ * @param spi SPI to transfer on
+ * @param rx receive stream, claimed
+ * @param tx transmit stream, claimed
+ * @param data bytes to send, replaced by the bytes received
+ * @param len number of bytes
+ */
+static void transferDMA(const SPIController *spi, DMAStream rx, DMAStream tx, uint8_t *data,
+                        uint16_t len)
+{
+    uint32_t data_register = (uint32_t)&SPI_DR(spi->handle);
+    // Anything left from a polled transfer would be the first byte received.
+    while (SPI_SR(spi->handle) & SPI_SR_RXNE)
+    {
+        (void)SPI_DR(spi->handle);
+    }
+    setupDMAPeripheralToMemory(rx, data_register, data, len, false);
+    setupDMAMemoryToPeripheral(tx, data_register, data, len, false);
+
+    // RM0383 28.3.9: RX requests first, then both streams, then TX requests start it.
+    spi_enable_rx_dma(spi->handle);
+    dma_enable_stream(rx.dma, rx.stream);
+    dma_enable_stream(tx.dma, tx.stream);
+    spi_enable_tx_dma(spi->handle);
+
+    // The master clocks every byte itself, so this always finishes.
+    while (!dma_get_interrupt_flag(rx.dma, rx.stream, DMA_TCIF))
+    {
+    }
+    while (SPI_SR(spi->handle) & SPI_SR_BSY)
+    {
+    }
+    spi_disable_tx_dma(spi->handle);
+    spi_disable_rx_dma(spi->handle);
+}
+
+/**
+ * @brief Full duplex transfer. Long transfers go over DMA when both of the SPI's streams are
+ * free, anything else is polled a byte at a time.
+ *
+ * @param spi SPI to transfer on
+ * @param data bytes to send, replaced by the bytes received
+ * @param len number of bytes, SPI_MAX_TRANSFER at most
+ * @return uint32_t number of bytes transferred
+ */
+uint32_t currentSPITransfer(const SPIController *spi, uint8_t *data, uint32_t len)
+{
+    DMAStream rx;
+    DMAStream tx;
+    if (len >= SPI_DMA_MIN_BYTES && spiStreams(spi->handle, &rx, &tx) &&
+        !isDMAStreamClaimed(rx) && !isDMAStreamClaimed(tx))
+    {
+        // Claimed for the transfer only, the streams can be shared with a pattern or a UART.
+        (void)claimDMAStream(rx);
+        (void)claimDMAStream(tx);
+        transferDMA(spi, rx, tx, data, (uint16_t)len);
+        releaseDMAStream(tx);
+        releaseDMAStream(rx);
+        return len;
+    }
+
+    for (uint32_t byte = 0; byte < len; byte++)
+    {
+        data[byte] = (uint8_t)spi_xfer(spi->handle, data[byte]);
+    }
+    return len;
+}
+
+/**
+ * @brief Returns the SCK frequency an SPI runs at, from the bus clock it is on now.
+ *
+ * @param spi SPI
+ * @return uint32_t SCK frequency in Hz
+ */
+uint32_t currentSPIFrequency(const SPIController *spi)
+{
+    return spiBusFrequency(spi->handle) / spi->divider;
+}
+
+/**
+ * @brief Returns the number an SPI is selected by.
+ *
+ * @param handle SPI handle
+ * @return int 1-5, 0 if not an SPI
+ */
+int currentSPINumber(uint32_t handle)
+{
+    switch (handle)
+    {
+    case SPI1:
+        return 1;
+    case SPI2:
+        return 2;
+    case SPI3:
+        return 3;
+    case SPI4:
+        return 4;
+    case SPI5:
+        return 5;
+    default:
+        return 0;
+    }
+}
@@ -1,7 +1,7 @@
 /**
  * @file timer.c
  * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
- * @brief Functions to set up timers.
+ * @brief Functions to set up timers, as PWM outputs or as PWM input measurement.
  * @version 0.1
  * @date 2024-11-21
  * 
@@ -10,45 +10,337 @@
  */
 #include "sys_timer.h"
 
+#include "libopencm3/cm3/cortex.h"
+#include "libopencm3/cm3/nvic.h"
 #include "libopencm3/stm32/rcc.h"
 
-#define PRESCALER (84)
-#define ARR_VALUE (1000)
+#include "core/system.h"
+
+// Prescaler register is 16 bits on every timer.
+#define PRESCALER_MAX (0x10000U)
 
 /**
- * @brief Sets up timer for PWM. Initially at 84_000_000 Hz. 
- * 
- * @param prescaler how much to scale the inital frequency at. Recommended 84. Actual 
- * calculation: sysfreq / ((prescaler - 1) * (arr_val - 1))
- * @param arr_val the value at which the register reloads (Auto Reload Register). Recommended 1000
- * @return a pointer to a struct that contains information about the PWM peripheral
- */
-void coreTimerSetup(void)
-{
-    // Enable clock to TIM2
-    rcc_periph_clock_enable(RCC_TIM2);
-    // set mode:   timer2, no clock div,     edge aligned,     count up
-    timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
-    // set mode to pwm on channel 1
-    timer_set_oc_mode(TIM2, TIM_OC1 /* channel 1 */, TIM_OCM_PWM1);
-    // Setup PWM output compare and enable counter
-    timer_enable_counter(TIM2);
-    timer_enable_oc_output(TIM2, TIM_OC1);
+ * @brief Capture state of a measuring timer, shared with its interrupt. The interrupt sums
+ * periods into the running window and publishes it whole once it has enough.
+ * @param active timer is measuring
+ * @param primed first capture thrown away, it only timed the wait for an edge
+ * @param period_on_ic1 pin is on channel 1, so CCR1 holds the period and CCR2 the high time
+ * @param periods window length
+ * @param count periods so far in the running window
+ * @param period_sum ticks so far in the running window
+ * @param high_sum high ticks so far in the running window
+ * @param result last complete window
+ * @param result_tick systick time the last window completed, 0 for none yet
+ */
+typedef struct MeasureState
+{
+    volatile bool active;
+    bool          primed;
+    bool          period_on_ic1;
+    uint16_t      periods;
+    uint16_t      count;
+    uint64_t      period_sum;
+    uint64_t      high_sum;
+    MeasureResult result;
+    uint64_t      result_tick;
+} MeasureState;
+
+// One measurement per 32 bit timer, TIM2 then TIM5.
+static MeasureState measure_states[2];
+
+/**
+ * @brief Returns the capture state of a measuring timer.
+ *
+ * @param timer TIM2 or TIM5
+ * @return MeasureState* state
+ */
+static MeasureState *measureState(uint32_t timer)
+{
+    return &measure_states[timer == TIM5 ? 1 : 0];
+}
+
+/**
+ * @brief Handles a rising edge capture. Reading the period capture clears its flag.
+ *
+ * @param timer timer that captured
+ */
+static void measureCapture(uint32_t timer)
+{
+    MeasureState  *state = measureState(timer);
+    const uint32_t period = state->period_on_ic1 ? TIM_CCR1(timer) : TIM_CCR2(timer);
+    const uint32_t high = state->period_on_ic1 ? TIM_CCR2(timer) : TIM_CCR1(timer);
+    if (!state->active)
+    {
+        return;
+    }
+    if (!state->primed)
+    {
+        state->primed = true;
+        return;
+    }
+
+    state->period_sum += period;
+    state->high_sum += high;
+    if (++state->count < state->periods)
+    {
+        return;
+    }
+    state->result.periods = state->count;
+    state->result.period_ticks = state->period_sum;
+    state->result.high_ticks = state->high_sum;
+    state->result_tick = coreGetTicks();
+    state->count = 0;
+    state->period_sum = 0;
+    state->high_sum = 0;
+}
+
+void tim2_isr(void) { measureCapture(TIM2); }
+void tim5_isr(void) { measureCapture(TIM5); }
+
+/**
+ * @brief Creates a PWM output. The period is worked out from the frequency here, the hardware is
+ * only touched by coreTimerSetup().
+ *
+ * @param timer timer peripheral
+ * @param timer_clock RCC clock of the timer
+ * @param channel output compare channel
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param clock GPIO port clock
+ * @param af_mode alternate function of the pin for this timer
+ * @param frequency frequency in Hz, PWM_MIN_HZ to PWM_MAX_HZ
+ * @param duty_cycle percent high
+ * @return PWMPeripheral
+ */
+PWMPeripheral createPWMPeripheral(uint32_t timer, enum rcc_periph_clken timer_clock,
+                                  enum tim_oc_id channel, uint32_t port, uint32_t pin,
+                                  enum rcc_periph_clken clock, uint8_t af_mode,
+                                  uint32_t frequency, float duty_cycle)
+{
+    PWMPeripheral pwm = {.timer = timer,
+                         .timer_clock = timer_clock,
+                         .channel = channel,
+                         .port = port,
+                         .pin = pin,
+                         .clock = clock,
+                         .af_mode = af_mode,
+                         .frequency = frequency,
+                         .prescaler = 1,
+                         .arr_val = 1,
+                         .duty_cycle = duty_cycle};
+    (void)coreTimerComputePeriod(timer, frequency, &pwm.prescaler, &pwm.arr_val);
+    return pwm;
+}
+
+/**
+ * @brief Returns the clock a timer counts at. Timers run at twice their bus clock whenever the
+ * bus is divided down, which on this board is APB1 (42MHz bus, 84MHz timers).
+ *
+ * @param timer timer peripheral
+ * @return uint32_t timer clock in Hz
+ */
+uint32_t coreTimerClockFrequency(uint32_t timer)
+{
+    bool     apb2 = timer == TIM1 || timer == TIM9 || timer == TIM10 || timer == TIM11;
+    uint32_t bus = apb2 ? rcc_apb2_frequency : rcc_apb1_frequency;
+    return bus == rcc_ahb_frequency ? bus : bus * 2;
+}
+
+/**
+ * @brief Picks the smallest prescaler that lets the period fit in the auto reload register, so
+ * the duty cycle gets as many steps as possible at any frequency.
+ *
+ * @param timer timer peripheral, TIM2 and TIM5 have 32 bit counters
+ * @param frequency frequency in Hz
+ * @param prescaler returned divider (program prescaler - 1)
+ * @param arr_val returned period in ticks (program arr_val - 1)
+ * @return true period found
+ * @return false frequency out of reach of this timer
+ */
+bool coreTimerComputePeriod(uint32_t timer, uint32_t frequency, uint32_t *prescaler,
+                            uint32_t *arr_val)
+{
+    if (frequency == 0)
+    {
+        return false;
+    }
+
+    const uint64_t max_period = (timer == TIM2 || timer == TIM5) ? 0x100000000ULL : 0x10000ULL;
+    const uint64_t ticks = coreTimerClockFrequency(timer) / frequency;
+    const uint64_t divider = (ticks + max_period - 1) / max_period;
+    if (ticks < 2 || divider > PRESCALER_MAX)
+    {
+        return false;
+    }
+
+    *prescaler = (uint32_t)divider;
+    // Round to the nearest period rather than always running fast.
+    uint64_t base = coreTimerClockFrequency(timer) / *prescaler;
+    *arr_val = (uint32_t)((base + frequency / 2) / frequency);
+    if (*arr_val > max_period)
+    {
+        *arr_val = (uint32_t)max_period;
+    }
+    return true;
+}
 
+/**
+ * @brief Sets up a timer channel for PWM and starts the counter. Other channels of the same timer
+ * share its period, so this also retunes them.
+ *
+ * @param pwm PWM output, prescaler and arr_val already computed
+ */
+void coreTimerSetup(PWMPeripheral *pwm)
+{
+    // set mode:   no clock div,     edge aligned,     count up
+    timer_set_mode(pwm->timer, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
     // Set the prescaler and auto reload register (resolution and frequency)
-    timer_set_prescaler(TIM2, PRESCALER - 1);
-    timer_set_period(TIM2, ARR_VALUE - 1);
+    timer_set_prescaler(pwm->timer, pwm->prescaler - 1);
+    timer_enable_preload(pwm->timer);
+    timer_set_period(pwm->timer, pwm->arr_val - 1);
+    // set mode to pwm on the channel, preloaded so duty changes land at the end of a period
+    timer_set_oc_mode(pwm->timer, pwm->channel, TIM_OCM_PWM1);
+    timer_enable_oc_preload(pwm->timer, pwm->channel);
+    corePWMSetDutyCycle(pwm, pwm->duty_cycle);
+    // Load the preloaded prescaler, period and compare value now rather than at the next
+    // overflow, which on a fresh 32 bit timer is most of a minute away.
+    timer_generate_event(pwm->timer, TIM_EGR_UG);
+    timer_enable_oc_output(pwm->timer, pwm->channel);
+    // Setup PWM output compare and enable counter
+    timer_enable_counter(pwm->timer);
 }
 
 
 /**
  * @brief Coverts a floating point number into a CCR value for PWM.
  * 
- * @param duty_cycle 
+ * @param pwm PWM output
+ * @param duty_cycle percent high, 0-100
+ */
+void corePWMSetDutyCycle(PWMPeripheral *pwm, float duty_cycle)
+{
+    pwm->duty_cycle = duty_cycle;
+    const float raw_val = (float)pwm->arr_val * (duty_cycle / 100.0f);
+    timer_set_oc_value(pwm->timer, pwm->channel, (uint32_t)(raw_val + 0.5f));
+}
+
+/**
+ * @brief Returns the frequency the timer really runs at, after rounding to whole ticks.
+ *
+ * @param pwm PWM output
+ * @return uint32_t frequency in Hz
+ */
+uint32_t corePWMActualFrequency(const PWMPeripheral *pwm)
+{
+    return coreTimerClockFrequency(pwm->timer) / (pwm->prescaler * pwm->arr_val);
+}
+
+/**
+ * @brief Creates a measured input. The hardware is only touched by coreMeasureSetup().
+ *
+ * @param timer timer peripheral, TIM2 or TIM5
+ * @param timer_clock RCC clock of the timer
+ * @param channel input capture channel of the pin, TIM_IC1 or TIM_IC2
+ * @param port GPIO port
+ * @param pin GPIO pin
+ * @param clock GPIO port clock
+ * @param af_mode alternate function of the pin for this timer
+ * @param periods periods averaged into each result
+ * @return MeasurePeripheral
+ */
+MeasurePeripheral createMeasurePeripheral(uint32_t timer, enum rcc_periph_clken timer_clock,
+                                          enum tim_ic_id channel, uint32_t port, uint32_t pin,
+                                          enum rcc_periph_clken clock, uint8_t af_mode,
+                                          uint16_t periods)
+{
+    MeasurePeripheral measure = {.timer = timer,
+                                 .timer_clock = timer_clock,
+                                 .channel = channel,
+                                 .port = port,
+                                 .pin = pin,
+                                 .clock = clock,
+                                 .af_mode = af_mode,
+                                 .periods = periods};
+    return measure;
+}
+
+/**
+ * @brief Puts a timer in PWM input mode and starts it. The counter runs undivided so each period
+ * is timed to one tick (~12ns), and every rising edge fires one interrupt, so signals much above
+ * 100kHz start to cost real CPU time.
+ *
+ * @param measure measured input, the timer's clock already on
  */
-void corePWMSetDutyCycle(float duty_cycle)
+void coreMeasureSetup(const MeasurePeripheral *measure)
 {
-    const float raw_val = (float)ARR_VALUE * (duty_cycle / 100.0f);
-    timer_set_oc_value(TIM2, TIM_OC1, (uint32_t)raw_val);
+    const uint32_t         timer = measure->timer;
+    const bool             on_ic1 = measure->channel == TIM_IC1;
+    const enum tim_ic_id   high_channel = on_ic1 ? TIM_IC2 : TIM_IC1;
+    const enum tim_ic_input input = on_ic1 ? TIM_IC_IN_TI1 : TIM_IC_IN_TI2;
+
+    rcc_periph_reset_pulse(timer == TIM5 ? RST_TIM5 : RST_TIM2);
+    timer_set_mode(timer, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(timer, 0);
+    timer_set_period(timer, 0xFFFFFFFF);
+
+    // Both captures watch the pin's input, rising edges reset the counter.
+    timer_ic_set_input(timer, measure->channel, input);
+    timer_ic_set_polarity(timer, measure->channel, TIM_IC_RISING);
+    timer_ic_set_input(timer, high_channel, input);
+    timer_ic_set_polarity(timer, high_channel, TIM_IC_FALLING);
+    timer_slave_set_trigger(timer, on_ic1 ? TIM_SMCR_TS_TI1FP1 : TIM_SMCR_TS_TI2FP2);
+    timer_slave_set_mode(timer, TIM_SMCR_SMS_RM);
+    timer_ic_enable(timer, measure->channel);
+    timer_ic_enable(timer, high_channel);
+
+    MeasureState *state = measureState(timer);
+    MeasureState  fresh = {.period_on_ic1 = on_ic1, .periods = measure->periods};
+    *state = fresh;
+    state->active = true;
+
+    timer_clear_flag(timer, TIM_SR_CC1IF | TIM_SR_CC2IF);
+    timer_enable_irq(timer, on_ic1 ? TIM_DIER_CC1IE : TIM_DIER_CC2IE);
+    nvic_enable_irq(timer == TIM5 ? NVIC_TIM5_IRQ : NVIC_TIM2_IRQ);
+    timer_enable_counter(timer);
 }
 
+/**
+ * @brief Stops a measurement and puts the timer back to its reset state for whatever uses it
+ * next.
+ *
+ * @param measure measured input
+ */
+void coreMeasureStop(const MeasurePeripheral *measure)
+{
+    nvic_disable_irq(measure->timer == TIM5 ? NVIC_TIM5_IRQ : NVIC_TIM2_IRQ);
+    measureState(measure->timer)->active = false;
+    timer_disable_counter(measure->timer);
+    rcc_periph_reset_pulse(measure->timer == TIM5 ? RST_TIM5 : RST_TIM2);
+}
+
+/**
+ * @brief Copies out the last complete window of a measurement.
+ *
+ * @param measure measured input
+ * @param result returned window
+ * @return true window is recent
+ * @return false no edges yet, or none lately: the input is stuck high or low
+ */
+bool coreMeasureRead(const MeasurePeripheral *measure, MeasureResult *result)
+{
+    MeasureState *state = measureState(measure->timer);
+
+    // The interrupt writes the window in several stores, don't let it land half way through.
+    uint32_t masked = cm_mask_interrupts(1);
+    *result = state->result;
+    uint64_t result_tick = state->result_tick;
+    cm_mask_interrupts(masked);
+
+    if (result_tick == 0 || result->periods == 0)
+    {
+        return false;
+    }
+    uint64_t window_ms = (result->period_ticks * 1000) / coreTimerClockFrequency(measure->timer);
+    uint64_t stale_ms = window_ms * 2 > MEASURE_STALE_MS ? window_ms * 2 : MEASURE_STALE_MS;
+    return coreGetTicks() - result_tick <= stale_ms;
+}
@@ -11,30 +11,37 @@
 #include "token.h"
 
 /**
- * @brief Function that initialises a token vector.
+ * @brief Function that initialises a token vector in the line arena.
  * 
- * @return TokenVector* initialised token vector.
+ * @return TokenVector* initialised token vector, NULL if the arena is exhausted.
  */
 TokenVector *initTokenVector(void)
 {
-    TokenVector *vec = (TokenVector *)malloc(sizeof(TokenVector));
-    vec->capacity = 4;
+    TokenVector *vec = (TokenVector *)allocateLineArena(sizeof(TokenVector));
+    if (vec == NULL)
+    {
+        return NULL;
+    }
+    vec->tokens = (Token *)allocateLineArena(sizeof(Token) * LINE_MAX_TOKENS);
+    if (vec->tokens == NULL)
+    {
+        return NULL;
+    }
+    vec->capacity = LINE_MAX_TOKENS;
     vec->used = 0;
-    vec->tokens = (Token *)malloc(sizeof(Token) * vec->capacity);
     return vec;
 }
 
 /**
- * @brief function to deinit token vector
+ * @brief function to deinit token vector. The memory itself is released when the line arena is
+ * reset.
  * 
  * @param vec vector to be deinit.
  */
 void deinitTokenVector(TokenVector *vec)
 {
-    free(vec->tokens);
     vec->capacity = 0;
     vec->used = 0;
-    free(vec);
 }
 
 /**
@@ -42,17 +49,18 @@ void deinitTokenVector(TokenVector *vec)
  * 
  * @param vec vector to be appended to
  * @param tok token to append
+ * @return true token appended
+ * @return false vector is full (LINE_MAX_TOKENS)
  */
-void appendTokenVector(TokenVector *vec, Token tok)
+bool appendTokenVector(TokenVector *vec, Token tok)
 {
     if (vec->used == vec->capacity)
     {
-        size_t oldsize = vec->capacity;
-        vec->capacity = GROW_CAPACITY(oldsize);
-        vec->tokens = GROW_ARRAY(Token, vec->tokens, oldsize, vec->capacity);
+        return false;
     }
 
     vec->tokens[vec->used++] = tok;
+    return true;
 }
 
 /**
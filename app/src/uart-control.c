@@ -9,6 +9,7 @@
  *
  */
 #include "uart-control.h"
+#include "libopencm3/cm3/cortex.h"
 #include "libopencm3/stm32/f4/nvic.h"
 #include <stdint.h>
 
@@ -18,11 +19,169 @@
 #include <stdio.h>
 #endif
 
+/**
+ * @brief Buffers and bookkeeping for one user UART. One per USART so several can run at once.
+ * @param handle usart handle this state belongs to
+ * @param rx_rb receive ring buffer, written by the ISR or DMA
+ * @param rx_buffer storage for rx_rb
+ * @param tx_rb transmit ring buffer, drained by the ISR
+ * @param tx_buffer storage for tx_rb
+ * @param tx_policy what to do when tx_rb is full
+ * @param rx_stats receive error counters
+ * @param rx_flow receive flow control
+ * @param rx_paused the sender should be paused
+ * @param rx_paused_sent the sender has been paused: XOFF sent or RTS raised
+ * @param rts RTS pin, raised to pause the sender with UART_FLOW_RTSCTS
+ * @param rx_dma receive DMA stream, if rx_dma_active
+ * @param rx_dma_active receiving by DMA rather than RXNE interrupts
+ */
+struct UARTPortState {
+    uint32_t             handle;
+    ring_buffer_t        rx_rb;
+    uint8_t              rx_buffer[RING_BUFFER_SIZE];
+    ring_buffer_t        tx_rb;
+    uint8_t              tx_buffer[UART_PORT_TX_BUFFER_SIZE];
+    UartTxPolicy         tx_policy;
+    volatile UartRxStats rx_stats;
+    UartFlowControl      rx_flow;
+    volatile bool        rx_paused;
+    volatile bool        rx_paused_sent;
+    GPIOPinController    rts;
+#ifndef UART_RX_IRQ
+    DMAStream            rx_dma;
+    bool                 rx_dma_active;
+#endif
+};
+
+static UARTPortState uart_ports[UART_PORT_COUNT] = {
+    {.handle = USART1, .tx_policy = UART_TX_DEFAULT_POLICY},
+    {.handle = USART6, .tx_policy = UART_TX_DEFAULT_POLICY},
+};
+
+/**
+ * @brief Returns the state for a UART handle.
+ *
+ * @param handle uart handle
+ * @return UARTPortState* state, NULL if the handle isn't a user UART.
+ */
+static UARTPortState *getUARTPortState(uint32_t handle)
+{
+    for (size_t i = 0; i < UART_PORT_COUNT; i++)
+    {
+        if (uart_ports[i].handle == handle)
+        {
+            return &uart_ports[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Pauses or resumes the sender when the RX ring buffer crosses a watermark. XON/XOFF goes
+ * out from uart_isr ahead of the TX buffer, RTS is set straight away. Called from the receive
+ * ISRs, and from the reader with interrupts masked.
+ *
+ * @param state uart state
+ */
+static void rxFlowUpdate(UARTPortState *state)
+{
+    if (state->rx_flow == UART_FLOW_NONE)
+    {
+        return;
+    }
+
+    uint32_t used = coreRingBufferUsed(&state->rx_rb);
+    bool     paused = state->rx_paused;
+    if (!paused && used >= UART_FLOW_HIGH(RING_BUFFER_SIZE))
+    {
+        paused = true;
+    }
+    else if (paused && used <= UART_FLOW_LOW(RING_BUFFER_SIZE))
+    {
+        paused = false;
+    }
 
-//static volatile UARTController *currently_active_uart = NULL;
-static ring_buffer_t local_rb = {0U}; // the ringbuffer object
-static uint8_t local_data_buffer[RING_BUFFER_SIZE] = {0U}; // buffer in ring buffer.
-static uint32_t current_handle = 0;
+    if (paused == state->rx_paused)
+    {
+        return;
+    }
+    state->rx_paused = paused;
+    if (state->rx_flow == UART_FLOW_RTSCTS)
+    {
+        // RTS is active low, high asks the other end to stop.
+        if (paused)
+        {
+            gpio_set(state->rts.port, state->rts.pin);
+        }
+        else
+        {
+            gpio_clear(state->rts.port, state->rts.pin);
+        }
+        state->rx_paused_sent = paused;
+    }
+    else
+    {
+        usart_enable_tx_interrupt(state->handle);
+    }
+}
+
+#ifndef UART_RX_IRQ
+/**
+ * @brief Returns the RX DMA stream for a UART handle.
+ *
+ * @param handle uart handle
+ * @param stream returned stream
+ * @return true the UART has an RX stream
+ * @return false no stream, use RXNE interrupts
+ */
+static bool getRxDMAStream(uint32_t handle, DMAStream *stream)
+{
+    switch (handle)
+    {
+    case USART1:
+        *stream = DMA_USART1_RX;
+        return true;
+    case USART6:
+        *stream = DMA_USART6_RX;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Makes everything the DMA stream has written so far readable.
+ *
+ * @param state uart state
+ */
+static void rxDmaPublish(UARTPortState *state)
+{
+    uint32_t write_index =
+        (RING_BUFFER_SIZE - dma_get_number_of_data(state->rx_dma.dma, state->rx_dma.stream)) &
+        (RING_BUFFER_SIZE - 1);
+    state->rx_stats.dropped += coreRingBufferAdvanceWrite(&state->rx_rb, write_index);
+    rxFlowUpdate(state);
+}
+
+/**
+ * @brief RX DMA stream interrupt. Publishes at half and full so a long burst without an idle gap
+ * is still picked up in time.
+ *
+ * @param state uart state the stream belongs to
+ */
+static void uart_dma_isr(UARTPortState *state)
+{
+    if (state->rx_dma_active &&
+        dma_get_interrupt_flag(state->rx_dma.dma, state->rx_dma.stream, DMA_HTIF | DMA_TCIF))
+    {
+        dma_clear_interrupt_flags(state->rx_dma.dma, state->rx_dma.stream, DMA_HTIF | DMA_TCIF);
+        rxDmaPublish(state);
+    }
+}
+
+void dma2_stream1_isr(void) { uart_dma_isr(&uart_ports[UART_PORT_USART6]); }
+void dma2_stream2_isr(void) { uart_dma_isr(&uart_ports[UART_PORT_USART1]); }
+#endif
 
 /**
  * @brief Low level function to return UART controller
@@ -53,10 +212,18 @@ UARTController createUARTPeripheral(uint32_t uart_handle, enum rcc_periph_clken
     GPIOPinController tx =
         createGPIOPin(tx_port, tx_pin, tx_clock, mode, tx_af_mode, GPIO_PUPD_NONE);
 
-    //ring_buffer_t rb;
-    //uint8_t       data_buffer[RING_BUFFER_SIZE] = {0U};
-    coreRingBufferSetup(&local_rb, local_data_buffer, RING_BUFFER_SIZE);
-    current_handle = uart_handle;
+    // Only this UART's buffers are reset, the others keep running.
+    UARTPortState *state = getUARTPortState(uart_handle);
+    if (state != NULL)
+    {
+        coreRingBufferSetup(&state->rx_rb, state->rx_buffer, RING_BUFFER_SIZE);
+        coreRingBufferSetup(&state->tx_rb, state->tx_buffer, UART_PORT_TX_BUFFER_SIZE);
+        state->rx_stats.overruns = 0;
+        state->rx_stats.dropped = 0;
+        state->rx_flow = UART_FLOW_NONE;
+        state->rx_paused = false;
+        state->rx_paused_sent = false;
+    }
 
     UARTController uart = {
         .handle = uart_handle,
@@ -65,76 +232,177 @@ UARTController createUARTPeripheral(uint32_t uart_handle, enum rcc_periph_clken
         .nvic_entry = nvic_entry,
         .RX = rx,
         .TX = tx,
-        //.data_buffer = data_buffer,
-        //.rb = rb,
+        .flow = UART_FLOW_NONE,
+        .state = state,
     };
+    if (uart_handle == USART1)
+    {
+        // CTS pulled down so TX still runs with nothing plugged into it.
+        uart.CTS = createGPIOPin(UART1_CTS_PORT, UART1_CTS_PIN, RCC_GPIOA, mode, UART1_CTS_AF,
+                                 GPIO_PUPD_PULLDOWN);
+        uart.RTS = createGPIOPin(UART1_RTS_PORT, UART1_RTS_PIN, RCC_GPIOA, GPIO_MODE_OUTPUT, 0,
+                                 GPIO_PUPD_NONE);
+    }
 
     return uart;
 }
 
 /**
- * @brief Define all isrs. Most should be disabled when not in use.
+ * @brief Define all isrs. Each USART services its own buffers.
  * 
  */
-void usart1_isr(void) { general_uart_isr(); }
-void usart3_isr(void) { general_uart_isr(); }
-void uart4_isr(void) { general_uart_isr(); }
-void uart5_isr(void) { general_uart_isr(); }
-void usart6_isr(void) { general_uart_isr(); }
-void uart7_isr(void) { general_uart_isr(); }
-void uart8_isr(void) { general_uart_isr(); }
+void usart1_isr(void) { uart_isr(&uart_ports[UART_PORT_USART1]); }
+void usart6_isr(void) { uart_isr(&uart_ports[UART_PORT_USART6]); }
 
 /**
- * @brief General UART interrupt service routine for the currently active UART controller.
+ * @brief UART interrupt service routine, shared by every user UART.
  *
+ * @param state state of the UART that raised the interrupt
  */
-void general_uart_isr(void)
+void uart_isr(UARTPortState *state)
 {
-    const bool overrun_occured =
-        usart_get_flag(current_handle, USART_FLAG_ORE /* Overrun flag? */) == 1;
-    const bool received_data =
-        usart_get_flag(current_handle, USART_FLAG_RXNE /* Recieved data? */) == 1;
+    const uint32_t handle = state->handle;
+    const bool     overrun_occured =
+        usart_get_flag(handle, USART_FLAG_ORE /* Overrun flag? */) == 1;
 
-    if (overrun_occured || received_data)
+#ifndef UART_RX_IRQ
+    if (state->rx_dma_active)
     {
-        if (!coreRingBufferWrite(&local_rb,
-                                 (uint8_t)usart_recv(current_handle)))
+        const bool line_idle = usart_get_flag(handle, USART_FLAG_IDLE) == 1;
+        if (overrun_occured || line_idle)
         {
-            // Handle failure. Update buffer size.
+            if (overrun_occured)
+            {
+                state->rx_stats.overruns++;
+            }
+            // SR then DR read clears IDLE/ORE. The line is idle so there's no byte for DMA to miss.
+            (void)USART_DR(handle);
+            rxDmaPublish(state);
+        }
+    }
+    else
+#endif
+    {
+        const bool received_data =
+            usart_get_flag(handle, USART_FLAG_RXNE /* Recieved data? */) == 1;
+
+        if (overrun_occured)
+        {
+            state->rx_stats.overruns++;
+        }
+
+        if (overrun_occured || received_data)
+        {
+            if (!coreRingBufferWrite(&state->rx_rb, (uint8_t)usart_recv(handle)))
+            {
+                state->rx_stats.dropped++;
+            }
+            rxFlowUpdate(state);
+        }
+    }
+
+    // Data register empty: send a pending XOFF/XON first, then the next byte, or stop
+    // interrupting once drained.
+    if ((USART_CR1(handle) & USART_CR1_TXEIE) && usart_get_flag(handle, USART_FLAG_TXE) == 1)
+    {
+        uint8_t byte;
+        if (state->rx_flow == UART_FLOW_XONXOFF && state->rx_paused != state->rx_paused_sent)
+        {
+            state->rx_paused_sent = state->rx_paused;
+            usart_send(handle, state->rx_paused_sent ? UART_XOFF : UART_XON);
+        }
+        else if (coreRingBufferRead(&state->tx_rb, &byte))
+        {
+            usart_send(handle, (uint16_t)byte);
+        }
+        else
+        {
+            usart_disable_tx_interrupt(handle);
         }
     }
 }
 
 /**
- * @brief Writes a buffer of length `len` to USART2.
+ * @brief Queues a buffer of length `len` for a UART. Returns as soon as the data is queued, the
+ * full buffer policy decides what happens when it doesn't fit.
  *
+ * @param uart uart to write to
  * @param data buffer to be written
  * @param len length of data.
+ * @return uint32_t bytes queued
  */
-void currentUartWrite(UARTController uart, uint8_t *data, uint32_t len)
+uint32_t currentUartWrite(UARTController uart, uint8_t *data, uint32_t len)
 {
-    for (uint32_t i = 0; i < len; i++)
+    if (uart.state->tx_policy == UART_TX_DROP && len > coreRingBufferFree(&uart.state->tx_rb))
+    {
+        return 0;
+    }
+
+    UARTPortState *state = uart.state;
+    uint32_t       written = coreRingBufferWriteBulk(&state->tx_rb, data, len);
+    while (written < len && state->tx_policy == UART_TX_BLOCK)
+    {
+        usart_enable_tx_interrupt(uart.handle);
+        // The ISR can't drain while interrupts are masked, so send one byte by hand.
+        uint8_t pending;
+        if (cm_is_masked_interrupts() && coreRingBufferRead(&state->tx_rb, &pending))
+        {
+            usart_send_blocking(uart.handle, (uint16_t)pending);
+        }
+        written += coreRingBufferWriteBulk(&state->tx_rb, &data[written], len - written);
+    }
+    if (written > 0)
     {
-        currentUartWriteByte(uart, data[i]);
+        usart_enable_tx_interrupt(uart.handle);
     }
+    return written;
 }
 
 /**
- * @brief Writes an individual byte to USART2.
+ * @brief Queues an individual byte for a UART.
  *
+ * @param uart uart to write to
  * @param byte byte to be written.
+ * @return true byte queued
+ * @return false buffer full and the policy does not block
  */
-void currentUartWriteByte(UARTController uart, uint8_t byte)
+bool currentUartWriteByte(UARTController uart, uint8_t byte)
 {
     #ifdef UART_DEBUG
     printf("DEBUG: TXE = %u\r\n", (USART_SR(uart.handle) & USART_SR_TXE));
     #endif
-    usart_send_blocking(uart.handle, (uint16_t)byte);
+    while (!coreRingBufferWrite(&uart.state->tx_rb, byte))
+    {
+        if (uart.state->tx_policy != UART_TX_BLOCK)
+        {
+            return false;
+        }
+        // The ISR can't drain while interrupts are masked, so send one byte by hand.
+        uint8_t pending;
+        if (cm_is_masked_interrupts() && coreRingBufferRead(&uart.state->tx_rb, &pending))
+        {
+            usart_send_blocking(uart.handle, (uint16_t)pending);
+        }
+    }
+    usart_enable_tx_interrupt(uart.handle);
+    return true;
+}
+
+/**
+ * @brief Sets what happens when a UART's TX buffer is full.
+ *
+ * @param uart uart to configure
+ * @param policy block, drop, or truncate.
+ */
+void currentUartSetTxPolicy(UARTController uart, UartTxPolicy policy)
+{
+    uart.state->tx_policy = policy;
 }
 
 /**
  * @brief Reads `len` bytes into data if data is available in UART module.
  *
+ * @param uart uart to read from
  * @param data buffer to be written into
  * @param len length to read.
  * @return uint32_t the amount of bytes actually read. If it != len then something's gone wrong.
@@ -147,20 +415,70 @@ uint32_t currentUartRead(UARTController uart, uint8_t *data, uint32_t len)
         return 0;
     }
 
-    for (uint32_t num_bytes = 0; num_bytes < len; num_bytes++)
+    uint32_t read = coreRingBufferReadBulk(&uart.state->rx_rb, data, len);
+    if (uart.state->rx_paused)
     {
-        if (!coreRingBufferRead(&local_rb, &data[num_bytes]))
-        {
-            return num_bytes; // num_bytes is how many bytes we've read.
-        }
+        // The receive ISR updates the flow state too.
+        uint32_t masked = cm_mask_interrupts(1);
+        rxFlowUpdate(uart.state);
+        cm_mask_interrupts(masked);
+    }
+    return read;
+}
+
+/**
+ * @brief Gives direct access to the next run of received bytes, for passing them on without a
+ * copy in between. Nothing is consumed until currentUartCommitRead().
+ *
+ * @param uart uart to read from
+ * @param span returned start of the run
+ * @return uint32_t bytes in the run, 0 if nothing has been received
+ */
+uint32_t currentUartPeekRead(UARTController uart, const uint8_t **span)
+{
+    return coreRingBufferPeekRead(&uart.state->rx_rb, span);
+}
+
+/**
+ * @brief Consumes bytes returned by currentUartPeekRead(), resuming a paused sender once drained.
+ *
+ * @param uart uart to read from
+ * @param count bytes to consume, no more than the run returned
+ */
+void currentUartCommitRead(UARTController uart, uint32_t count)
+{
+    coreRingBufferCommitRead(&uart.state->rx_rb, count);
+    if (uart.state->rx_paused)
+    {
+        uint32_t masked = cm_mask_interrupts(1);
+        rxFlowUpdate(uart.state);
+        cm_mask_interrupts(masked);
     }
+}
 
-    return len; // we read all the bytes
+/**
+ * @brief Queues as much of a buffer as fits in a UART's TX buffer right now, whatever its TX
+ * policy.
+ *
+ * @param uart uart to write to
+ * @param data bytes to queue
+ * @param len number of bytes
+ * @return uint32_t bytes queued, the caller keeps the rest
+ */
+uint32_t currentUartWriteNoWait(UARTController uart, const uint8_t *data, uint32_t len)
+{
+    uint32_t written = coreRingBufferWriteBulk(&uart.state->tx_rb, data, len);
+    if (written > 0)
+    {
+        usart_enable_tx_interrupt(uart.handle);
+    }
+    return written;
 }
 
 /**
- * @brief Reads a single byte from USART2. User responsibility to check data is available.
+ * @brief Reads a single byte from a UART. User responsibility to check data is available.
  *
+ * @param uart uart to read from
  * @return uint8_t byte read.
  */
 uint8_t currentUartReadByte(UARTController uart)
@@ -173,7 +491,149 @@ uint8_t currentUartReadByte(UARTController uart)
 /**
  * @brief Gets data_available variable.
  *
+ * @param uart uart to check
  * @return true if USART buffer has data
  * @return false if USART buffer does not have data.
  */
-bool currentUartDataAvailable(UARTController uart) { return !coreRingBufferEmpty(&local_rb); }
\ No newline at end of file
+bool currentUartDataAvailable(UARTController uart)
+{
+    return !coreRingBufferEmpty(&uart.state->rx_rb);
+}
+
+/**
+ * @brief Starts receiving on a UART. Uses a circular DMA stream into the RX ring buffer with an
+ * idle line interrupt when the UART has a free stream, otherwise falls back to one RXNE
+ * interrupt per byte.
+ *
+ * @param uart uart to start
+ */
+void currentUartStartRx(UARTController *uart)
+{
+#ifndef UART_RX_IRQ
+    UARTPortState *state = uart->state;
+    DMAStream      stream;
+    if (getRxDMAStream(uart->handle, &stream) && claimDMAStream(stream))
+    {
+        state->rx_dma = stream;
+        setupDMAPeripheralToMemory(stream, (uint32_t)&USART_DR(uart->handle), state->rx_buffer,
+                                   RING_BUFFER_SIZE, true);
+        dma_enable_half_transfer_interrupt(stream.dma, stream.stream);
+        dma_enable_transfer_complete_interrupt(stream.dma, stream.stream);
+        nvic_enable_irq(stream.nvic_entry);
+        dma_enable_stream(stream.dma, stream.stream);
+        usart_enable_rx_dma(uart->handle);
+        USART_CR1(uart->handle) |= USART_CR1_IDLEIE; // Publish whenever the line goes quiet.
+        state->rx_dma_active = true;
+        return;
+    }
+#endif
+    usart_enable_rx_interrupt(uart->handle); // Enable specific Rx interrupt
+}
+
+/**
+ * @brief Stops receiving on a UART and gives back its DMA stream.
+ *
+ * @param uart uart to stop
+ */
+void currentUartStopRx(UARTController *uart)
+{
+    usart_disable_rx_interrupt(uart->handle);
+#ifndef UART_RX_IRQ
+    if (uart->state->rx_dma_active)
+    {
+        usart_disable_rx_dma(uart->handle);
+        USART_CR1(uart->handle) &= ~USART_CR1_IDLEIE;
+        releaseDMAStream(uart->state->rx_dma);
+        uart->state->rx_dma_active = false;
+    }
+#endif
+}
+
+/**
+ * @brief Returns a UART's receive error counters.
+ *
+ * @param uart uart to check
+ * @return UartRxStats counters since the UART was created.
+ */
+UartRxStats currentUartGetRxStats(UARTController uart)
+{
+    UartRxStats stats = {.overruns = uart.state->rx_stats.overruns,
+                         .dropped = uart.state->rx_stats.dropped};
+#ifdef RING_BUFFER_FREE_RUNNING
+    stats.high_water = coreRingBufferHighWater(&uart.state->rx_rb);
+#endif
+    return stats;
+}
+
+/**
+ * @brief Checks whether a UART can use a flow control mode. RTS/CTS needs the pins, which only
+ * USART1 has.
+ *
+ * @param handle uart handle
+ * @param flow flow control mode
+ * @return true available
+ * @return false not on this UART
+ */
+bool currentUartFlowAvailable(uint32_t handle, UartFlowControl flow)
+{
+    return flow != UART_FLOW_RTSCTS || handle == USART1;
+}
+
+/**
+ * @brief Sets a UART's receive flow control and sets up its pins. Safe on a running UART, the RX
+ * ring buffer and DMA stream carry on. A paused sender is resumed when its mode is left. Check
+ * currentUartFlowAvailable() first.
+ *
+ * @param uart uart to configure
+ * @param flow flow control mode
+ */
+void currentUartSetFlowControl(UARTController *uart, UartFlowControl flow)
+{
+    UARTPortState *state = uart->state;
+    uint32_t       masked = cm_mask_interrupts(1);
+
+    // Let go of whatever the old mode was holding back.
+    if (state->rx_paused_sent && state->rx_flow == UART_FLOW_XONXOFF && flow != UART_FLOW_XONXOFF)
+    {
+        usart_send_blocking(uart->handle, UART_XON);
+    }
+    state->rx_paused = false;
+    state->rx_paused_sent = false;
+
+    if (flow == UART_FLOW_RTSCTS)
+    {
+        gpio_mode_setup(uart->CTS.port, uart->CTS.mode, uart->CTS.pupd_resistor, uart->CTS.pin);
+        gpio_set_af(uart->CTS.port, uart->CTS.af_mode, uart->CTS.pin);
+        gpio_clear(uart->RTS.port, uart->RTS.pin);
+        gpio_mode_setup(uart->RTS.port, uart->RTS.mode, uart->RTS.pupd_resistor, uart->RTS.pin);
+        state->rts = uart->RTS;
+        // The USART only does CTS. It has no idea how full the ring buffer is, so RTS is ours.
+        usart_set_flow_control(uart->handle, USART_FLOWCONTROL_CTS);
+    }
+    else
+    {
+        usart_set_flow_control(uart->handle, USART_FLOWCONTROL_NONE);
+        if (uart->flow == UART_FLOW_RTSCTS)
+        {
+            gpio_mode_setup(uart->CTS.port, GPIO_MODE_INPUT, GPIO_PUPD_NONE, uart->CTS.pin);
+            gpio_mode_setup(uart->RTS.port, GPIO_MODE_INPUT, GPIO_PUPD_NONE, uart->RTS.pin);
+        }
+    }
+
+    uart->flow = flow;
+    state->rx_flow = flow;
+    rxFlowUpdate(state);
+    cm_mask_interrupts(masked);
+}
+
+/**
+ * @brief Checks whether a UART has paused its sender.
+ *
+ * @param uart uart to check
+ * @return true XOFF sent or RTS raised, and not yet released
+ * @return false sender is free to send
+ */
+bool currentUartRxPaused(UARTController uart)
+{
+    return uart.state->rx_paused_sent;
+}
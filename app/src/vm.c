@@ -0,0 +1,1804 @@
+/**
+ * @file vm.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Runs compiled lines (chunks) against the board controller.
+ * @note Instructions are bound to the board before they run: pin masks are filtered down to the
+ *       pins they may touch and peripherals are looked up once. Binding is kept until the board
+ *       generation changes, so a cached line runs with no lookups at all.
+ * @version 0.1
+ * @date 2025-03-03
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "vm.h"
+#include "bench-control.h"
+#include "bridge-control.h"
+#include "capture-control.h"
+#include "core/system.h"
+#include "core/uart.h"
+#include "exti-control.h"
+#include "latency-control.h"
+#include "mem-control.h"
+#include "libopencm3/stm32/f4/gpio.h"
+#include "libopencm3/stm32/f4/rcc.h"
+#include "libopencm3/stm32/f4/usart.h"
+#include "peripheral-controller.h"
+#include "parser.h"
+#include "pattern-control.h"
+#include "scheduler.h"
+#include "script-control.h"
+#include "snapshot-control.h"
+#include "protocol.h"
+#include "response.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bytes being sent or clocked in by OP_SPI_XFER and OP_SPI_READ.
+static uint8_t spi_buffer[SPI_MAX_TRANSFER];
+
+// Peripheral types a pin can be taken from, for warnings and errors.
+static const char *const type_names[] = {
+    [TYPE_GPIO_INPUT] = "input", [TYPE_GPIO_OUTPUT] = "output", [TYPE_UART] = "UART",
+    [TYPE_ADC] = "ADC",          [TYPE_PWM] = "PWM",            [TYPE_MEASURE] = "measure",
+    [TYPE_SPI] = "SPI",          [TYPE_I2C] = "I2C",
+};
+
+/**
+ * @brief Returns the port letter of an instruction, in the case it was typed.
+ *
+ * @param instruction instruction to check
+ * @return char port letter
+ */
+static char pinLetter(const Instruction *instruction)
+{
+    char base = (instruction->flags & INSTR_FLAG_LOWERCASE) ? 'a' : 'A';
+    return (char)(base + (instruction->port - GPIOA) / PORT_SIZE);
+}
+
+/**
+ * @brief Returns the pin number of a single pin instruction.
+ *
+ * @param instruction instruction to check
+ * @return unsigned int pin number 0-15
+ */
+static unsigned int pinNumber(const Instruction *instruction)
+{
+    return (unsigned int)__builtin_ctz(instruction->mask);
+}
+
+/**
+ * @brief Returns true if the op changes the board configuration.
+ *
+ * @param op op to check
+ * @return true op reconfigures the board
+ * @return false op only uses the board
+ */
+static bool isConfigOp(uint8_t op)
+{
+    return op == OP_MAKE_INPUT || op == OP_MAKE_OUTPUT || op == OP_MAKE_ADC ||
+           op == OP_UART_INIT || op == OP_MAKE_PWM || op == OP_MAKE_MEASURE ||
+           op == OP_UART_FLOW || op == OP_RESTORE || op == OP_SPI_INIT || op == OP_I2C_INIT;
+}
+
+/**
+ * @brief Returns the name of a flow control mode, as typed.
+ *
+ * @param flow flow control mode
+ * @return const char* name
+ */
+static const char *flowName(UartFlowControl flow)
+{
+    switch (flow)
+    {
+    case UART_FLOW_XONXOFF:
+        return "xonxoff";
+    case UART_FLOW_RTSCTS:
+        return "rtscts";
+    default:
+        return "none";
+    }
+}
+
+/**
+ * @brief Translates a set/reset/toggle/read OpCode into the GPIO action it performs.
+ *
+ * @param op op to translate
+ * @return GPIOAction action
+ */
+static GPIOAction gpioActionFromOp(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_SET:
+        return GPIO_SET;
+    case OP_RESET:
+        return GPIO_CLEAR;
+    case OP_TOGGLE:
+        return GPIO_TOGGLE;
+    default:
+        return GPIO_READ;
+    }
+}
+
+/**
+ * @brief Binds every instruction from start up to (not including) the next configuration op.
+ * Every pin is checked before anything runs so a bad pin stops the whole line, as before.
+ *
+ * @param bc board controller object
+ * @param chunk chunk to bind
+ * @param start first instruction to bind
+ * @return true bound successfully
+ * @return false a pin is not usable for its operation
+ */
+static bool bindChunk(BoardController *bc, Chunk *chunk, size_t start)
+{
+    for (size_t i = start; i < chunk->count && !isConfigOp(chunk->code[i].op); i++)
+    {
+        Instruction *instruction = &chunk->code[i];
+        switch (instruction->op)
+        {
+        case OP_SET:
+        case OP_RESET:
+        case OP_TOGGLE:
+        case OP_READ_PORT:
+        {
+            instruction->bound_mask =
+                getDigitalPortMask(bc, instruction->port, instruction->mask,
+                                   gpioActionFromOp(instruction->op));
+            break;
+        }
+        case OP_ECHO:
+        case OP_READ:
+        {
+            PeripheralType pin_type = pinExists(bc, instruction->port, instruction->mask);
+            instruction->periph = getPinPeripheral(bc, instruction->port, instruction->mask);
+            if (pin_type == TYPE_GPIO_INPUT || pin_type == TYPE_GPIO_OUTPUT)
+            {
+                break;
+            }
+            else if (pin_type == TYPE_ADC || pin_type == TYPE_MEASURE)
+            {
+                if (instruction->op != OP_READ)
+                {
+                    printf("> Parse Error: this operation is unavailable for this pin "
+                           "configuration (%s).\r\n",
+                           pin_type == TYPE_ADC ? "ADC" : "measure");
+                    return false;
+                }
+                break;
+            }
+            else if (pin_type == TYPE_PWM || pin_type == TYPE_SPI || pin_type == TYPE_I2C)
+            {
+                printf("> Parse Error: this operation is unavailable for this pin "
+                       "configuration (%s).\r\n",
+                       type_names[pin_type]);
+                return false;
+            }
+            // This pin does not exist, stop execution.
+            printf("> Parse Error: Port Pin identifer \"%c%02u\" is not "
+                   "initialised and cannot be operated on.\r\n",
+                   pinLetter(instruction), pinNumber(instruction));
+            return false;
+        }
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates or changes a digital pin.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_MAKE_INPUT or OP_MAKE_OUTPUT instruction
+ * @return true executed successfully
+ * @return false executed unsuccessfully
+ */
+static bool makeDigital(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    const uint32_t       *constants = &chunk->constants[instruction->operand];
+    uint32_t              port = instruction->port;
+    uint32_t              pin = instruction->mask;
+    enum rcc_periph_clken clock = (enum rcc_periph_clken)constants[DIGITAL_CONST_CLOCK];
+    uint8_t               pupd = (uint8_t)constants[DIGITAL_CONST_PUPD];
+
+    // Translate opcode into peripheral type.
+    PeripheralType type_input_output =
+        instruction->op == OP_MAKE_INPUT ? TYPE_GPIO_INPUT : TYPE_GPIO_OUTPUT;
+    // If the pin doesn't exist make a new one, else just change the current
+    // one.
+    PeripheralType pin_exists = pinExists(bc, port, pin);
+    if (pin_exists == TYPE_NONE)
+    {
+        createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+        printf("> created new pin.\r\n");
+    }
+    else if (pin_exists == TYPE_GPIO_INPUT || pin_exists == TYPE_GPIO_OUTPUT)
+    {
+        // This pin exists so just update it.
+        mutateDigitalPin(bc, port, pin, type_input_output, pupd);
+        printf("> modified existing pin.\r\n");
+    }
+    else
+    {
+        switch (pin_exists)
+        {
+        case TYPE_ADC:
+        {
+            mutateADCToDigital(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified ADC to GPIO pin.\r\n");
+            break;
+        }
+        case TYPE_UART:
+        {
+            // Kill entire UART peripheral
+            printf("> Warning: Disabling entire UART port to convert to GPIO...\r\n");
+            killPeripheralOrPin(bc, port, pin);
+            // Recreate GPIO from scratch.
+            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified UART to GPIO pin.\r\n");
+            break;
+        }
+        case TYPE_SPI:
+        {
+            printf("> Warning: Disabling entire SPI port to convert to GPIO...\r\n");
+            killPeripheralOrPin(bc, port, pin);
+            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified SPI to GPIO pin.\r\n");
+            break;
+        }
+        case TYPE_I2C:
+        {
+            printf("> Warning: Disabling entire I2C port to convert to GPIO...\r\n");
+            killPeripheralOrPin(bc, port, pin);
+            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified I2C to GPIO pin.\r\n");
+            break;
+        }
+        case TYPE_PWM:
+        {
+            killPeripheralOrPin(bc, port, pin);
+            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified PWM to GPIO pin.\r\n");
+            break;
+        }
+        case TYPE_MEASURE:
+        {
+            killPeripheralOrPin(bc, port, pin);
+            createDigitalPin(bc, port, pin, clock, type_input_output, pupd);
+            printf("> Modified measure to GPIO pin.\r\n");
+            break;
+        }
+        default:
+        {
+            printf("> Failed to modify pin. You shouldn't have ended up here!\r\n");
+            return false;
+        }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates an ADC pin, converting whatever was on the pin before.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_MAKE_ADC instruction
+ * @return true executed successfully
+ * @return false executed unsuccessfully
+ */
+static bool makeADC(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    const uint32_t       *constants = &chunk->constants[instruction->operand];
+    uint32_t              port = instruction->port;
+    uint32_t              pin = instruction->mask;
+    enum rcc_periph_clken clock = (enum rcc_periph_clken)constants[ADC_CONST_CLOCK];
+    uint32_t              base = constants[ADC_CONST_BASE];
+    uint8_t               channel = (uint8_t)constants[ADC_CONST_CHANNEL];
+    uint32_t              sample_time = constants[ADC_CONST_SAMPLE_TIME];
+    uint8_t               bits = (uint8_t)constants[ADC_CONST_BITS];
+    uint8_t               average = (uint8_t)constants[ADC_CONST_AVERAGE];
+
+    // If the pin already exists... See if we can mutate it.
+    PeripheralType pin_exists = pinExists(bc, port, pin);
+    switch (pin_exists)
+    {
+    case TYPE_GPIO_INPUT:
+    case TYPE_GPIO_OUTPUT:
+    {
+        mutateDigitalToADC(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> Modified GPIO to ADC pin.\r\n");
+        break;
+    }
+    case TYPE_UART:
+    {
+        // Only difference with UART is the whole peripheral gets turned off.
+
+        // Turn off the whole UART port
+        printf("> Warning: Disabling entire UART port to convert to ADC...\r\n");
+        killPeripheralOrPin(bc, port, pin);
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> created new ADC pin.\r\n");
+        break;
+    }
+    case TYPE_SPI:
+    {
+        printf("> Warning: Disabling entire SPI port to convert to ADC...\r\n");
+        killPeripheralOrPin(bc, port, pin);
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> Modified SPI to ADC pin.\r\n");
+        break;
+    }
+    case TYPE_I2C:
+    {
+        printf("> Warning: Disabling entire I2C port to convert to ADC...\r\n");
+        killPeripheralOrPin(bc, port, pin);
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> Modified I2C to ADC pin.\r\n");
+        break;
+    }
+    case TYPE_PWM:
+    {
+        killPeripheralOrPin(bc, port, pin);
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> Modified PWM to ADC pin.\r\n");
+        break;
+    }
+    case TYPE_MEASURE:
+    {
+        killPeripheralOrPin(bc, port, pin);
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> Modified measure to ADC pin.\r\n");
+        break;
+    }
+    case TYPE_ADC:
+    {
+        mutateADCSettings(bc, port, pin, sample_time, bits, average);
+        printf("> Modified ADC pin.\r\n");
+        break;
+    }
+    case TYPE_NONE:
+    {
+        createAnalogPin(bc, port, pin, clock, sample_time, base, channel, bits, average);
+        printf("> created new ADC pin.\r\n");
+        break;
+    }
+    default:
+    {
+        printf("Not implemented yet!\r\n");
+        return false;
+    }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates a UART peripheral, killing anything on either pin first.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_UART_INIT instruction
+ * @return true executed successfully
+ */
+static bool makeUART(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    const uint32_t *constants = &chunk->constants[instruction->operand];
+    uint32_t        rx_port = constants[UART_CONST_RX_PORT];
+    uint32_t        tx_port = constants[UART_CONST_TX_PORT];
+    uint32_t        rx_pin = constants[UART_CONST_RX_PIN];
+    uint32_t        tx_pin = constants[UART_CONST_TX_PIN];
+
+    // Only one instance of each USART, drop it from its old pins.
+    PeripheralController *existing = getUARTPeripheral(bc, constants[UART_CONST_HANDLE]);
+    if (existing != NULL)
+    {
+        killPeripheralOrPin(bc, existing->peripheral.uart.RX.port,
+                            existing->peripheral.uart.RX.pin);
+    }
+
+    // If one or both pins are already initialised, kill them first.
+    if (pinExists(bc, rx_port, rx_pin) != TYPE_NONE)
+    {
+        killPeripheralOrPin(bc, rx_port, rx_pin);
+    }
+    if (pinExists(bc, tx_port, tx_pin) != TYPE_NONE)
+    {
+        killPeripheralOrPin(bc, tx_port, tx_pin);
+    }
+
+    // After all those peripherals are killed, we just build the UART as normal.
+    createUART(bc, constants[UART_CONST_HANDLE],
+               (enum rcc_periph_clken)constants[UART_CONST_CLOCK], constants[UART_CONST_BAUDRATE],
+               rx_port, tx_port, rx_pin, tx_pin,
+               (enum rcc_periph_clken)constants[UART_CONST_RX_CLOCK],
+               (enum rcc_periph_clken)constants[UART_CONST_TX_CLOCK],
+               (uint8_t)constants[UART_CONST_RX_AF], (uint8_t)constants[UART_CONST_TX_AF],
+               (int)constants[UART_CONST_NVIC]);
+    printf("> Created new UART peripheral.\r\n");
+    return true;
+}
+
+/**
+ * @brief Creates an SPI master, killing anything on its pins first.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_SPI_INIT instruction
+ * @return true executed successfully
+ * @return false the peripheral pool is full
+ */
+static bool makeSPI(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    static const SPIConstant pins[] = {SPI_CONST_SCK_PORT, SPI_CONST_MISO_PORT,
+                                       SPI_CONST_MOSI_PORT};
+    const uint32_t          *constants = &chunk->constants[instruction->operand];
+    GPIOPinController        gpio[3];
+
+    // Only one instance of each SPI, drop it from its old pins.
+    PeripheralController *existing = getSPIPeripheral(bc, constants[SPI_CONST_HANDLE]);
+    if (existing != NULL)
+    {
+        killPeripheralOrPin(bc, existing->peripheral.spi.SCK.port,
+                            existing->peripheral.spi.SCK.pin);
+    }
+
+    for (size_t pin = 0; pin < sizeof(pins) / sizeof(pins[0]); pin++)
+    {
+        const uint32_t *pin_constants = &constants[pins[pin]];
+        if (pinExists(bc, pin_constants[0], pin_constants[1]) != TYPE_NONE)
+        {
+            killPeripheralOrPin(bc, pin_constants[0], pin_constants[1]);
+        }
+        // PORT, PIN, CLOCK, AF, see SPIConstant.
+        gpio[pin] = createGPIOPin(pin_constants[0], pin_constants[1],
+                                  (enum rcc_periph_clken)pin_constants[2], GPIO_MODE_AF,
+                                  (uint8_t)pin_constants[3], GPIO_PUPD_NONE);
+    }
+
+    createSPI(bc, createSPIPeripheral(constants[SPI_CONST_HANDLE],
+                                      (enum rcc_periph_clken)constants[SPI_CONST_CLOCK],
+                                      (uint16_t)constants[SPI_CONST_DIVIDER],
+                                      (uint8_t)constants[SPI_CONST_MODE], gpio[0], gpio[1],
+                                      gpio[2]));
+    PeripheralController *spi = getSPIPeripheral(bc, constants[SPI_CONST_HANDLE]);
+    if (spi == NULL)
+    {
+        // The peripheral pool was full, growPeripherals() has said so.
+        return false;
+    }
+    printf("> Created new SPI peripheral: SPI%d at %lu Hz, mode %lu.\r\n",
+           currentSPINumber(spi->peripheral.spi.handle),
+           currentSPIFrequency(&spi->peripheral.spi), constants[SPI_CONST_MODE]);
+    return true;
+}
+
+/**
+ * @brief Creates an I2C master, killing anything on its pins first. The pins are open drain with
+ * the internal pull-ups, which will do for short wires at 100 kHz.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_I2C_INIT instruction
+ * @return true executed successfully
+ * @return false the peripheral pool is full
+ */
+static bool makeI2C(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    static const I2CInitConstant pins[] = {I2C_CONST_SCL_PORT, I2C_CONST_SDA_PORT};
+    const uint32_t              *constants = &chunk->constants[instruction->operand];
+    GPIOPinController            gpio[2];
+
+    // Only one instance of each I2C, drop it from its old pins.
+    PeripheralController *existing = getI2CPeripheral(bc, constants[I2C_CONST_HANDLE]);
+    if (existing != NULL)
+    {
+        killPeripheralOrPin(bc, existing->peripheral.i2c.SCL.port,
+                            existing->peripheral.i2c.SCL.pin);
+    }
+
+    for (size_t pin = 0; pin < sizeof(pins) / sizeof(pins[0]); pin++)
+    {
+        const uint32_t *pin_constants = &constants[pins[pin]];
+        if (pinExists(bc, pin_constants[0], pin_constants[1]) != TYPE_NONE)
+        {
+            killPeripheralOrPin(bc, pin_constants[0], pin_constants[1]);
+        }
+        // PORT, PIN, CLOCK, AF, see I2CInitConstant.
+        gpio[pin] = createGPIOPin(pin_constants[0], pin_constants[1],
+                                  (enum rcc_periph_clken)pin_constants[2], GPIO_MODE_AF,
+                                  (uint8_t)pin_constants[3], GPIO_PUPD_PULLUP);
+    }
+
+    createI2C(bc, createI2CPeripheral(constants[I2C_CONST_HANDLE],
+                                      (enum rcc_periph_clken)constants[I2C_CONST_CLOCK],
+                                      (uint16_t)constants[I2C_CONST_SPEED], gpio[0], gpio[1]));
+    PeripheralController *i2c = getI2CPeripheral(bc, constants[I2C_CONST_HANDLE]);
+    if (i2c == NULL)
+    {
+        // The peripheral pool was full, growPeripherals() has said so.
+        return false;
+    }
+    printf("> Created new I2C peripheral: I2C%d at %lu kHz.\r\n",
+           currentI2CNumber(i2c->peripheral.i2c.handle), constants[I2C_CONST_SPEED]);
+    return true;
+}
+
+/**
+ * @brief Queues an I2C batch or scan and starts it. The reply comes from i2cService() once the
+ * bus is done, so the line returns straight away.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_I2C_BATCH or OP_I2C_SCAN instruction
+ * @return true started
+ * @return false no such I2C, or it is still busy
+ */
+static bool startI2C(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    PeripheralController *periph = getI2CPeripheral(bc, instruction->port);
+    if (periph == NULL)
+    {
+        printf("> Error: No I2C exists!\r\n");
+        return false;
+    }
+    const I2CController *i2c = &periph->peripheral.i2c;
+    if (!currentI2CBegin(i2c))
+    {
+        printf("> Error: I2C%d is still busy with the last batch.\r\n",
+               currentI2CNumber(i2c->handle));
+        return false;
+    }
+    if (instruction->op == OP_I2C_SCAN)
+    {
+        currentI2CStart(i2c, true);
+        return true;
+    }
+
+    const uint32_t *constants = &chunk->constants[instruction->operand];
+    for (uint16_t transaction = 0; transaction < instruction->mask; transaction++)
+    {
+        const uint32_t *entry = &constants[transaction * I2C_CONST_PER_TRANSACTION];
+        const uint8_t  *bytes = (const uint8_t *)&chunk->strings[entry[I2C_CONST_WRITE] >> 16];
+        uint32_t        length = entry[I2C_CONST_WRITE] & 0xFFFF;
+        // The address leads the bytes written.
+        (void)currentI2CQueue(i2c, bytes[0], &bytes[1], (uint8_t)(length - 1),
+                              (uint8_t)entry[I2C_CONST_READ]);
+    }
+    currentI2CStart(i2c, false);
+    return true;
+}
+
+/**
+ * @brief Replies with the bytes an SPI clocked in, as hex, sixteen to a line: "> SPI1 RX: 9F 00"
+ * when full, just the bytes when terse. Binary mode sends one FRAME_SPI_DATA.
+ *
+ * @param handle SPI they came from
+ * @param data bytes received
+ * @param count number of bytes
+ */
+static void replySPI(uint32_t handle, const uint8_t *data, uint32_t count)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    int               number = currentSPINumber(handle);
+    if (protocolBinaryMode())
+    {
+        uint8_t payload[SPI_MAX_TRANSFER + 1];
+        payload[0] = (uint8_t)number;
+        memcpy(&payload[1], data, count);
+        protocolSendFrame(FRAME_SPI_DATA, payload, (uint16_t)(count + 1));
+        return;
+    }
+
+    for (uint32_t start = 0; start < count; start += 16)
+    {
+        char   row[16 * 3];
+        size_t length = 0;
+        for (uint32_t byte = start; byte < count && byte < start + 16; byte++)
+        {
+            row[length++] = digits[data[byte] >> 4];
+            row[length++] = digits[data[byte] & 0xF];
+            row[length++] = ' ';
+        }
+        responseBegin();
+        if (responseVerbosity() == VERBOSITY_FULL)
+        {
+            char name[] = "> SPIn RX: ";
+            name[5] = (char)('0' + number);
+            responseString(name);
+        }
+        responseChars(row, length - 1);
+        responseEnd();
+    }
+}
+
+/**
+ * @brief Creates or changes a PWM pin. An existing PWM pin keeps running while its frequency and
+ * duty cycle change, anything else on the pin is killed first.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_MAKE_PWM instruction
+ * @return true executed successfully
+ */
+static bool makePWM(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    const uint32_t *constants = &chunk->constants[instruction->operand];
+    uint32_t        port = instruction->port;
+    uint32_t        pin = instruction->mask;
+    uint32_t        frequency = constants[PWM_CONST_FREQUENCY];
+    float           duty_cycle = (float)constants[PWM_CONST_DUTY];
+
+    if (getTimerUser(bc, constants[PWM_CONST_TIMER], TYPE_MEASURE, port, pin) != NULL)
+    {
+        printf("> Error: %c%02u's timer is busy measuring another pin.\r\n",
+               pinLetter(instruction), pinNumber(instruction));
+        return false;
+    }
+    PeripheralController *sharing =
+        getPWMChannelUser(bc, constants[PWM_CONST_TIMER],
+                          (enum tim_oc_id)constants[PWM_CONST_CHANNEL], port, pin);
+    if (sharing != NULL)
+    {
+        printf("> Error: %c%02u's timer channel is already driving %c%02u, kill it first.\r\n",
+               pinLetter(instruction), pinNumber(instruction),
+               (char)('A' + (sharing->peripheral.pwm.port - GPIOA) / PORT_SIZE),
+               (unsigned int)__builtin_ctz(sharing->peripheral.pwm.pin));
+        return false;
+    }
+
+    size_t                retuned = 0;
+    PeripheralController *existing = getPinPeripheral(bc, port, pin);
+    if (existing != NULL && existing->type == TYPE_PWM)
+    {
+        retuned = updatePWMPin(bc, existing, frequency, duty_cycle);
+        printf("> modified existing PWM pin.\r\n");
+    }
+    else
+    {
+        if (existing != NULL)
+        {
+            if (existing->type == TYPE_UART || existing->type == TYPE_SPI ||
+                existing->type == TYPE_I2C)
+            {
+                printf("> Warning: Disabling entire %s port to convert to PWM...\r\n",
+                       type_names[existing->type]);
+            }
+            killPeripheralOrPin(bc, port, pin);
+        }
+        PWMPeripheral pwm = createPWMPeripheral(
+            constants[PWM_CONST_TIMER], (enum rcc_periph_clken)constants[PWM_CONST_TIMER_CLOCK],
+            (enum tim_oc_id)constants[PWM_CONST_CHANNEL], port, pin,
+            (enum rcc_periph_clken)constants[PWM_CONST_CLOCK], (uint8_t)constants[PWM_CONST_AF],
+            frequency, duty_cycle);
+        retuned = createPWMPin(bc, pwm);
+        printf("> created new PWM pin.\r\n");
+    }
+
+    PeripheralController *pc = getPinPeripheral(bc, port, pin);
+    if (pc == NULL)
+    {
+        // The peripheral pool was full, growPeripherals() has said so.
+        return false;
+    }
+    if (retuned > 0)
+    {
+        printf("> Warning: %u other pin(s) on this timer now also run at %lu Hz.\r\n",
+               (unsigned int)retuned, frequency);
+    }
+    printf("> PWM %c%02u at %lu Hz, %lu%% duty.\r\n", pinLetter(instruction),
+           pinNumber(instruction), corePWMActualFrequency(&pc->peripheral.pwm),
+           constants[PWM_CONST_DUTY]);
+    return true;
+}
+
+/**
+ * @brief Starts measuring a pin, killing whatever was on it first. The timer must not be driving
+ * any other pin, as PWM input mode takes over its counter.
+ *
+ * @param bc board controller object
+ * @param chunk chunk the instruction belongs to
+ * @param instruction OP_MAKE_MEASURE instruction
+ * @return true executed successfully
+ * @return false timer busy, or the peripheral pool is full
+ */
+static bool makeMeasure(BoardController *bc, Chunk *chunk, const Instruction *instruction)
+{
+    const uint32_t *constants = &chunk->constants[instruction->operand];
+    uint32_t        port = instruction->port;
+    uint32_t        pin = instruction->mask;
+
+    if (getTimerUser(bc, constants[MEASURE_CONST_TIMER], TYPE_NONE, port, pin) != NULL)
+    {
+        printf("> Error: %c%02u's timer is in use by another PWM or measure pin, kill it "
+               "first.\r\n",
+               pinLetter(instruction), pinNumber(instruction));
+        return false;
+    }
+
+    PeripheralController *existing = getPinPeripheral(bc, port, pin);
+    if (existing != NULL)
+    {
+        if (existing->type == TYPE_UART || existing->type == TYPE_SPI || existing->type == TYPE_I2C)
+        {
+            printf("> Warning: Disabling entire %s port to convert to measure...\r\n",
+                   type_names[existing->type]);
+        }
+        killPeripheralOrPin(bc, port, pin);
+    }
+    MeasurePeripheral measure = createMeasurePeripheral(
+        constants[MEASURE_CONST_TIMER], (enum rcc_periph_clken)constants[MEASURE_CONST_TIMER_CLOCK],
+        (enum tim_ic_id)constants[MEASURE_CONST_CHANNEL], port, pin,
+        (enum rcc_periph_clken)constants[MEASURE_CONST_CLOCK],
+        (uint8_t)constants[MEASURE_CONST_AF], (uint16_t)constants[MEASURE_CONST_PERIODS]);
+    createMeasurePin(bc, measure);
+    if (getPinPeripheral(bc, port, pin) == NULL)
+    {
+        // The peripheral pool was full, growPeripherals() has said so.
+        return false;
+    }
+    printf("> Measuring %c%02u over %lu period(s), \"read %c%02u\" for results.\r\n",
+           pinLetter(instruction), pinNumber(instruction), constants[MEASURE_CONST_PERIODS],
+           pinLetter(instruction), pinNumber(instruction));
+    return true;
+}
+
+/**
+ * @brief Reports the last measurement of a measured pin: frequency, period and duty cycle.
+ *
+ * @param instruction OP_READ instruction, bound to a measured pin
+ */
+static void printMeasure(const Instruction *instruction)
+{
+    const MeasurePeripheral *measure = &instruction->periph->peripheral.measure;
+    const uint8_t            port_index = (uint8_t)((instruction->port - GPIOA) / PORT_SIZE);
+    MeasureResult            result;
+    bool                     signal = coreMeasureRead(measure, &result);
+
+    const uint64_t clock = coreTimerClockFrequency(measure->timer);
+    uint64_t       millihertz = 0;
+    uint64_t       period_ns = 0;
+    uint32_t       duty = 0; // hundredths of a percent
+    if (signal)
+    {
+        millihertz = ((uint64_t)result.periods * clock * 1000) / result.period_ticks;
+        period_ns = ((result.period_ticks / result.periods) * 1000000000ULL) / clock;
+        duty = (uint32_t)((result.high_ticks * 10000) / result.period_ticks);
+    }
+
+    if (protocolBinaryMode())
+    {
+        const uint32_t mhz = millihertz > UINT32_MAX ? UINT32_MAX : (uint32_t)millihertz;
+        const uint16_t periods = signal ? (uint16_t)result.periods : 0;
+        const uint8_t  payload[] = {port_index,           (uint8_t)pinNumber(instruction),
+                                    (uint8_t)periods,     (uint8_t)(periods >> 8),
+                                    (uint8_t)mhz,         (uint8_t)(mhz >> 8),
+                                    (uint8_t)(mhz >> 16), (uint8_t)(mhz >> 24),
+                                    (uint8_t)duty,        (uint8_t)(duty >> 8)};
+        protocolSendFrame(FRAME_MEASURE, payload, sizeof(payload));
+        return;
+    }
+    if (responseVerbosity() != VERBOSITY_FULL)
+    {
+        // Frequency in mHz and duty in hundredths of a percent, 0 0 for no signal.
+        responseBegin();
+        responseUnsigned(millihertz > UINT32_MAX ? UINT32_MAX : (uint32_t)millihertz, 0);
+        responseChars(" ", 1);
+        responseUnsigned(duty, 0);
+        responseEnd();
+        return;
+    }
+    if (!signal)
+    {
+        printf("> READ %c%02u (MEASURE) = no signal\r\n", pinLetter(instruction),
+               pinNumber(instruction));
+        return;
+    }
+    printf("> READ %c%02u (MEASURE) = %lu.%03lu Hz, period %lu.%03lu us, duty %lu.%02lu%% "
+           "(%lu periods)\r\n",
+           pinLetter(instruction), pinNumber(instruction), (uint32_t)(millihertz / 1000),
+           (uint32_t)(millihertz % 1000), (uint32_t)(period_ns / 1000),
+           (uint32_t)(period_ns % 1000), duty / 100, duty % 100, result.periods);
+}
+
+/**
+ * @brief Replies with a pin's value: "> READ A05 = 1" when full, just "1" when terse.
+ *
+ * @param instruction OP_READ instruction
+ * @param separator what goes between the pin and the value when full, e.g. " (ADC) = "
+ * @param value value read
+ */
+static void replyRead(const Instruction *instruction, const char *separator, uint32_t value)
+{
+    responseBegin();
+    if (responseVerbosity() == VERBOSITY_FULL)
+    {
+        responseString("> READ ");
+        responsePin(pinLetter(instruction), pinNumber(instruction));
+        responseString(separator);
+    }
+    responseUnsigned(value, 0);
+    responseEnd();
+}
+
+/**
+ * @brief Min, max and sum of the values one OP_READ gave over a repeat.
+ * @param instruction the OP_READ
+ * @param min lowest value
+ * @param max highest value
+ * @param sum total, for the mean
+ */
+typedef struct RepeatRead
+{
+    const Instruction *instruction;
+    uint16_t           min;
+    uint16_t           max;
+    uint64_t           sum;
+} RepeatRead;
+
+/**
+ * @brief Reports a finished repeat: how long it took, then min/mean/max of each read. Text is
+ * "> REPEAT 1000 passes in 812 us" and "> READ A05 min/mean/max = 0/0.50/1", terse is
+ * "min mean max" per read, binary is one FRAME_REPEAT. Outside of full text the mean is in
+ * hundredths.
+ *
+ * @param passes times the loop ran
+ * @param us how long it took
+ * @param reads summary of each read, in line order
+ * @param reads_count reads in the loop
+ */
+static void replyRepeat(uint32_t passes, uint32_t us, const RepeatRead *reads, size_t reads_count)
+{
+    if (protocolBinaryMode())
+    {
+        uint8_t payload[8 + REPEAT_MAX_READS * 10];
+        for (size_t byte = 0; byte < 4; byte++)
+        {
+            payload[byte] = (uint8_t)(passes >> (8 * byte));
+            payload[4 + byte] = (uint8_t)(us >> (8 * byte));
+        }
+        for (size_t read = 0; read < reads_count; read++)
+        {
+            const Instruction *instruction = reads[read].instruction;
+            const uint32_t     mean = (uint32_t)((reads[read].sum * 100) / passes);
+            uint8_t           *entry = &payload[8 + read * 10];
+            entry[0] = (uint8_t)((instruction->port - GPIOA) / PORT_SIZE);
+            entry[1] = (uint8_t)pinNumber(instruction);
+            entry[2] = (uint8_t)reads[read].min;
+            entry[3] = (uint8_t)(reads[read].min >> 8);
+            entry[4] = (uint8_t)reads[read].max;
+            entry[5] = (uint8_t)(reads[read].max >> 8);
+            for (size_t byte = 0; byte < 4; byte++)
+            {
+                entry[6 + byte] = (uint8_t)(mean >> (8 * byte));
+            }
+        }
+        protocolSendFrame(FRAME_REPEAT, payload, (uint16_t)(8 + reads_count * 10));
+        return;
+    }
+
+    bool full = responseVerbosity() == VERBOSITY_FULL;
+    if (full)
+    {
+        printf("> REPEAT %lu passes in %lu us\r\n", passes, us);
+    }
+    for (size_t read = 0; read < reads_count; read++)
+    {
+        const Instruction *instruction = reads[read].instruction;
+        uint32_t           mean = (uint32_t)((reads[read].sum * 100) / passes);
+        responseBegin();
+        if (full)
+        {
+            responseString("> READ ");
+            responsePin(pinLetter(instruction), pinNumber(instruction));
+            responseString(instruction->periph->type == TYPE_ADC ? " (ADC)" : "");
+            responseString(" min/mean/max = ");
+            responseUnsigned(reads[read].min, 0);
+            responseString("/");
+            responseUnsigned(mean / 100, 0);
+            responseString(".");
+            responseUnsigned(mean % 100, 2);
+            responseString("/");
+        }
+        else
+        {
+            responseUnsigned(reads[read].min, 0);
+            responseString(" ");
+            responseUnsigned(mean, 0);
+            responseString(" ");
+        }
+        responseUnsigned(reads[read].max, 0);
+        responseEnd();
+    }
+}
+
+/**
+ * @brief Runs every instruction after an OP_REPEAT, its operand times, in a tight loop. The
+ * compiler has checked they are only pin and delay steps, and they are bound already. Nothing is
+ * printed while looping, reads are summed up and reported once at the end.
+ *
+ * @param chunk chunk being run
+ * @param start index of the OP_REPEAT
+ * @param port_values port snapshots for OP_READ_PORT/OP_READ, shared with runInstructions()
+ * @return true ran
+ * @return false a read in the loop is on a pin that can't be repeated
+ */
+static bool runRepeat(Chunk *chunk, size_t start, uint16_t *port_values)
+{
+    const uint32_t passes = chunk->code[start].operand;
+    RepeatRead     reads[REPEAT_MAX_READS];
+    size_t         reads_count = 0;
+    for (size_t i = start + 1; i < chunk->count; i++)
+    {
+        const Instruction *instruction = &chunk->code[i];
+        if (instruction->op != OP_READ)
+        {
+            continue;
+        }
+        if (instruction->periph->type == TYPE_MEASURE)
+        {
+            printf("> Error: Measure pin %c%02u can't be read in a repeat, it already averages "
+                   "over its periods.\r\n",
+                   pinLetter(instruction), pinNumber(instruction));
+            return false;
+        }
+        reads[reads_count++] = (RepeatRead){.instruction = instruction, .min = UINT16_MAX};
+    }
+
+    const uint64_t begin = coreSystemCycles();
+    for (uint32_t pass = 0; pass < passes; pass++)
+    {
+        RepeatRead *read = reads;
+        for (size_t i = start + 1; i < chunk->count; i++)
+        {
+            const Instruction *instruction = &chunk->code[i];
+            switch (instruction->op)
+            {
+            case OP_SET:
+            case OP_RESET:
+            case OP_TOGGLE:
+            {
+                applyDigitalPort(instruction->port, instruction->bound_mask,
+                                 gpioActionFromOp(instruction->op));
+                break;
+            }
+            case OP_READ_PORT:
+            {
+                port_values[(instruction->port - GPIOA) / PORT_SIZE] =
+                    applyDigitalPort(instruction->port, instruction->bound_mask, GPIO_READ);
+                break;
+            }
+            case OP_READ:
+            {
+                uint16_t value;
+                if (instruction->periph->type == TYPE_ADC)
+                {
+                    value = actionAnalogPeripheral(instruction->periph);
+                }
+                else
+                {
+                    const size_t port_index = (instruction->port - GPIOA) / PORT_SIZE;
+                    value = (port_values[port_index] & instruction->mask) ? 1 : 0;
+                }
+                read->min = value < read->min ? value : read->min;
+                read->max = value > read->max ? value : read->max;
+                read->sum += value;
+                read++;
+                break;
+            }
+            case OP_DELAY:
+            {
+                coreSystemDelayMicros(instruction->operand);
+                break;
+            }
+            default:
+                // OP_ECHO: the summary is the acknowledgement.
+                break;
+            }
+        }
+    }
+    const uint64_t end = coreSystemCycles();
+
+    uint64_t us = coreSystemCyclesToMicros(end) - coreSystemCyclesToMicros(begin);
+    replyRepeat(passes, (uint32_t)us, reads, reads_count);
+    return true;
+}
+
+/**
+ * @brief Prints how much of the time the core has spent asleep, since the last "idle" and since
+ * power on.
+ *
+ */
+static void printIdle(void)
+{
+    static uint64_t last_ticks = 0;
+    static uint64_t last_idle = 0;
+    static uint64_t last_cycles = 0;
+
+    // Both sides in cycles, so "clock" changes don't skew the ratio.
+    uint64_t ticks = coreGetTicks();
+    uint64_t idle = coreSystemIdleCycles();
+    uint64_t total = coreSystemCycles();
+    uint64_t window = total - last_cycles;
+
+    // Tenths of a percent, in integer maths.
+    uint32_t window_idle = window ? (uint32_t)(((idle - last_idle) * 1000) / window) : 0;
+    uint32_t total_idle = total ? (uint32_t)((idle * 1000) / total) : 0;
+    printf("> IDLE: %lu.%lu%% over the last %lu ms, %lu.%lu%% since power on.\r\n",
+           window_idle / 10, window_idle % 10, (uint32_t)(ticks - last_ticks), total_idle / 10,
+           total_idle % 10);
+    last_ticks = ticks;
+    last_idle = idle;
+    last_cycles = total;
+}
+
+/**
+ * @brief Drains every recorded edge to the console, as text lines or FRAME_EVENTS frames.
+ *
+ */
+static void printEvents(void)
+{
+    // Time of the last event printed, so each line can show the gap since the one before.
+    static uint64_t last_us = 0;
+
+    ExtiEvent      events[16];
+    size_t         count;
+    size_t         total = 0;
+    while ((count = extiReadEvents(events, sizeof(events) / sizeof(events[0]))) > 0)
+    {
+        uint8_t payload[sizeof(events) / sizeof(events[0])][8];
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t us = coreSystemCyclesToMicros(events[i].cycles);
+            if (protocolBinaryMode())
+            {
+                uint32_t us32 = (uint32_t)us;
+                payload[i][0] = events[i].port_index;
+                payload[i][1] = events[i].pin_number;
+                payload[i][2] = events[i].level;
+                payload[i][3] = 0;
+                for (size_t byte = 0; byte < 4; byte++)
+                {
+                    payload[i][4 + byte] = (uint8_t)(us32 >> (8 * byte));
+                }
+            }
+            else
+            {
+                printf("> EVENT %c%02u %s at %lu us (+%lu us)\r\n",
+                       (char)('A' + events[i].port_index), events[i].pin_number,
+                       events[i].level ? "rising" : "falling", (uint32_t)us,
+                       (uint32_t)(us - last_us));
+            }
+            last_us = us;
+        }
+        if (protocolBinaryMode())
+        {
+            protocolSendFrame(FRAME_EVENTS, &payload[0][0], (uint16_t)(count * 8));
+        }
+        total += count;
+    }
+
+    uint32_t dropped = extiTakeDropped();
+    if (!protocolBinaryMode())
+    {
+        printf("> %u events", (unsigned int)total);
+        if (dropped > 0)
+        {
+            printf(", %lu dropped as the queue was full", dropped);
+        }
+        printf(".\r\n");
+    }
+}
+
+/**
+ * @brief Runs the instructions of a compiled line. Instructions are (re)bound whenever the board
+ * has changed since they were last bound, including part way through a line after a
+ * configuration op.
+ *
+ * @param bc board controller object
+ * @param chunk chunk to run
+ * @param part_way returned true if instructions were bound part way through the line
+ * @return true executed successfully
+ * @return false executed unsuccessfully
+ */
+static bool runInstructions(BoardController *bc, Chunk *chunk, bool *part_way)
+{
+    // Snapshot of each input port taken by OP_READ_PORT.
+    uint16_t port_values[BOARD_PORT_COUNT] = {0};
+
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        Instruction *instruction = &chunk->code[i];
+
+        if (!isConfigOp(instruction->op) && chunk->bound_generation != bc->generation)
+        {
+            if (!bindChunk(bc, chunk, i))
+            {
+                chunk->bound_generation = CHUNK_UNBOUND;
+                return false;
+            }
+            chunk->bound_generation = bc->generation;
+            *part_way |= i != 0;
+        }
+
+        switch (instruction->op)
+        {
+        case OP_SET:
+        case OP_RESET:
+        case OP_TOGGLE:
+        {
+            applyDigitalPort(instruction->port, instruction->bound_mask,
+                             gpioActionFromOp(instruction->op));
+            break;
+        }
+        case OP_READ_PORT:
+        {
+            port_values[(instruction->port - GPIOA) / PORT_SIZE] =
+                applyDigitalPort(instruction->port, instruction->bound_mask, GPIO_READ);
+            break;
+        }
+        case OP_ECHO:
+        {
+            if (protocolBinaryMode())
+            {
+                // The line's result frame is the acknowledgement.
+                break;
+            }
+            if (responseVerbosity() != VERBOSITY_FULL)
+            {
+                // The line's ACK is the acknowledgement.
+                break;
+            }
+            const char *name = instruction->operand == OP_SET     ? "> SET "
+                               : instruction->operand == OP_RESET ? "> RESET "
+                                                                  : "> TOGGLE ";
+            responseBegin();
+            responseString(name);
+            responsePin(pinLetter(instruction), pinNumber(instruction));
+            responseEnd();
+            break;
+        }
+        case OP_READ:
+        {
+            const uint8_t port_index = (uint8_t)((instruction->port - GPIOA) / PORT_SIZE);
+            if (instruction->periph->type == TYPE_MEASURE)
+            {
+                printMeasure(instruction);
+            }
+            else if (instruction->periph->type == TYPE_ADC)
+            {
+                uint16_t read_response = actionAnalogPeripheral(instruction->periph);
+                if (protocolBinaryMode())
+                {
+                    const uint8_t payload[] = {port_index, (uint8_t)pinNumber(instruction),
+                                               (uint8_t)read_response,
+                                               (uint8_t)(read_response >> 8)};
+                    protocolSendFrame(FRAME_ANALOG, payload, sizeof(payload));
+                    break;
+                }
+                replyRead(instruction, " (ADC) = ", read_response);
+            }
+            else
+            {
+                uint16_t read_response = (port_values[port_index] & instruction->mask) ? 1 : 0;
+                if (protocolBinaryMode())
+                {
+                    const uint8_t payload[] = {port_index, (uint8_t)pinNumber(instruction),
+                                               (uint8_t)read_response};
+                    protocolSendFrame(FRAME_DIGITAL, payload, sizeof(payload));
+                    break;
+                }
+                replyRead(instruction, " = ", read_response);
+            }
+            break;
+        }
+        case OP_MAKE_INPUT:
+        case OP_MAKE_OUTPUT:
+        {
+            if (!makeDigital(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_MAKE_ADC:
+        {
+            if (!makeADC(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_UART_INIT:
+        {
+            if (!makeUART(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_MAKE_PWM:
+        {
+            if (!makePWM(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_MAKE_MEASURE:
+        {
+            if (!makeMeasure(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_UART_READ:
+        {
+            // Leave room for the terminator, and the uart number in front when framed.
+            char     read_buffer[UART_MAX_READ + 2];
+            uint32_t read_size =
+                readUARTPort(bc, instruction->port, &read_buffer[1], (size_t)UART_MAX_READ);
+            read_buffer[read_size + 1] = '\0';
+            if (read_size > 0 && protocolBinaryMode())
+            {
+                PeripheralController *uart = getUARTPeripheral(bc, instruction->port);
+                read_buffer[0] = uart->peripheral.uart.handle == USART1 ? 1 : 6;
+                protocolSendFrame(FRAME_UART_DATA, (const uint8_t *)read_buffer,
+                                  (uint16_t)(read_size + 1));
+            }
+            else if (read_size > 0 && responseVerbosity() == VERBOSITY_FULL)
+            {
+                printf("> UART READ = \"%s\" (%lu bytes)\r\n", &read_buffer[1], read_size);
+            }
+            else if (read_size > 0)
+            {
+                responseBegin();
+                responseChars(&read_buffer[1], read_size);
+                responseEnd();
+            }
+            else
+            {
+                printf("> Error: UART buffer empty.\r\n");
+                return false;
+            }
+            break;
+        }
+        case OP_UART_WRITE:
+        {
+            const char *string = &chunk->strings[instruction->operand >> 16];
+            size_t      length = instruction->operand & 0xFFFF;
+            bool        full = responseVerbosity() == VERBOSITY_FULL;
+            if (full)
+            {
+                printf("> Sending: \"%.*s\"\r\n", (int)length, string);
+            }
+            uint32_t size_written = writeUARTPort(bc, instruction->port, string, length);
+            if (full)
+            {
+                responseBegin();
+                responseString("> UART WROTE ");
+                responseUnsigned(size_written, 0);
+                responseString(" BYTES.");
+                responseEnd();
+            }
+            break;
+        }
+        case OP_UART_STATS:
+        {
+            UartRxStats console = coreUartGetRxStats();
+            printf("> CONSOLE RX: overruns = %lu, dropped = %lu\r\n", console.overruns,
+                   console.dropped);
+#ifdef RING_BUFFER_FREE_RUNNING
+            printf("> CONSOLE RX: peak = %lu bytes\r\n", console.high_water);
+#endif
+            if (coreUartGetFlowControl() != UART_FLOW_NONE)
+            {
+                printf("> CONSOLE RX: flow = %s%s\r\n", flowName(coreUartGetFlowControl()),
+                       coreUartRxPaused() ? ", paused" : "");
+            }
+            const uint32_t handles[] = {USART1, USART6};
+            const int      numbers[] = {1, 6};
+            for (size_t port = 0; port < sizeof(handles) / sizeof(handles[0]); port++)
+            {
+                PeripheralController *uart = getUARTPeripheral(bc, handles[port]);
+                if (uart != NULL &&
+                    (instruction->port == UART_ANY || instruction->port == handles[port]))
+                {
+                    UartRxStats user = currentUartGetRxStats(uart->peripheral.uart);
+                    printf("> UART%d RX: overruns = %lu, dropped = %lu\r\n", numbers[port],
+                           user.overruns, user.dropped);
+#ifdef RING_BUFFER_FREE_RUNNING
+                    printf("> UART%d RX: peak = %lu/%d bytes\r\n", numbers[port], user.high_water,
+                           RING_BUFFER_SIZE);
+#endif
+                    if (uart->peripheral.uart.flow != UART_FLOW_NONE)
+                    {
+                        printf("> UART%d RX: flow = %s%s\r\n", numbers[port],
+                               flowName(uart->peripheral.uart.flow),
+                               currentUartRxPaused(uart->peripheral.uart) ? ", paused" : "");
+                    }
+                }
+            }
+            break;
+        }
+        case OP_STREAM:
+        {
+            if (instruction->operand == 0)
+            {
+                uint32_t dropped = adcStreamStop();
+                printf("> Stream stopped, %lu blocks dropped.\r\n", dropped);
+                break;
+            }
+            if (!adcScanRunning())
+            {
+                printf("> Error: No ADC pins to stream.\r\n");
+                return false;
+            }
+            // Columns come out in scan order, which is peripheral order.
+            printf("> Streaming");
+            char separator = ' ';
+            for (size_t periph = 0; periph < bc->peripherals_count; periph++)
+            {
+                PeripheralController *adc = &bc->peripherals[periph];
+                if (adc->type == TYPE_ADC && adc->status)
+                {
+                    printf("%c%c%02u", separator,
+                           (char)('A' + (adc->peripheral.adc.port - GPIOA) / PORT_SIZE),
+                           (unsigned int)__builtin_ctz(adc->peripheral.adc.pin));
+                    separator = ',';
+                }
+            }
+            printf(" at %lu Hz, \"stream stop\" to end.\r\n", instruction->operand);
+            adcStreamStart(instruction->operand);
+            break;
+        }
+        case OP_MODE:
+        {
+            if (instruction->operand)
+            {
+                // In-band XON/XOFF bytes would land in the middle of frames.
+                if (coreUartGetFlowControl() == UART_FLOW_XONXOFF)
+                {
+                    printf("> Error: binary mode needs the console's XON/XOFF off, \"uart 2 flow "
+                           "none\" first.\r\n");
+                    return false;
+                }
+                printf("> Binary mode, \"mode text\" to go back.\r\n");
+                protocolSetBinaryMode(true);
+            }
+            else
+            {
+                protocolSetBinaryMode(false);
+                printf("> Text mode.\r\n");
+            }
+            break;
+        }
+        case OP_VERBOSITY:
+        {
+            if (instruction->operand == VERBOSITY_FULL)
+            {
+                responseSetVerbosity(VERBOSITY_FULL);
+                printf("> Full replies.\r\n");
+            }
+            else
+            {
+                printf("> %s replies, \"verbosity full\" to go back.\r\n",
+                       instruction->operand == VERBOSITY_TERSE ? "Terse" : "Silent");
+                responseSetVerbosity((Verbosity)instruction->operand);
+            }
+            break;
+        }
+        case OP_PATTERN_STEP:
+        {
+            const uint32_t *constants = &chunk->constants[instruction->operand];
+            uint16_t        clear_mask = (uint16_t)constants[PATTERN_CONST_CLEAR_MASK];
+            uint16_t        pins = instruction->mask | clear_mask;
+            if (getDigitalPortMask(bc, instruction->port, pins, GPIO_SET) != pins)
+            {
+                printf("> Error: Pattern pins must be initialised as outputs.\r\n");
+                return false;
+            }
+            if (!patternAddStep(instruction->port, instruction->mask, clear_mask,
+                                constants[PATTERN_CONST_DELAY]))
+            {
+                return false;
+            }
+            printf("> Pattern step %u added.\r\n", (unsigned int)patternLength());
+            break;
+        }
+        case OP_PATTERN:
+        {
+            if (instruction->operand == PATTERN_STOP || instruction->operand == PATTERN_CLEAR)
+            {
+                uint32_t passes = patternStop();
+                if (instruction->operand == PATTERN_CLEAR)
+                {
+                    patternClear();
+                    printf("> Pattern cleared.\r\n");
+                }
+                else
+                {
+                    printf("> Pattern stopped after %lu pass(es).\r\n", passes);
+                }
+                break;
+            }
+            // Pins may have been reconfigured since the steps were added.
+            uint16_t pins = patternPins();
+            if (getDigitalPortMask(bc, patternPort(), pins, GPIO_SET) != pins)
+            {
+                printf("> Error: Pattern pins must be initialised as outputs.\r\n");
+                return false;
+            }
+            if (captureActive())
+            {
+                printf("> Error: TIM1 is busy with a capture, \"capture stop\" first.\r\n");
+                return false;
+            }
+            bool loop = instruction->operand == PATTERN_LOOP;
+            if (!patternStart(loop))
+            {
+                return false;
+            }
+            printf("> Pattern of %u steps %s.\r\n", (unsigned int)patternLength(),
+                   loop ? "looping, \"pattern stop\" to end" : "running once");
+            break;
+        }
+        case OP_SCHEDULE:
+        {
+            const char *line = &chunk->strings[instruction->operand >> 16];
+            size_t      length = instruction->operand & 0xFFFF;
+            int         id = schedulerAdd(line, length, instruction->port, instruction->mask != 0);
+            if (id == 0)
+            {
+                return false;
+            }
+            printf("> Task %d: \"%.*s\" %s %lu ms.\r\n", id, (int)length, line,
+                   instruction->mask ? "every" : "after", instruction->port);
+            break;
+        }
+        case OP_TASKS_LIST:
+        {
+            schedulerList();
+            break;
+        }
+        case OP_TASKS_KILL:
+        {
+            if (instruction->operand == 0)
+            {
+                schedulerKillAll();
+                printf("> Killed every task.\r\n");
+            }
+            else if (schedulerKill((int)instruction->operand))
+            {
+                printf("> Killed task %lu.\r\n", instruction->operand);
+            }
+            else
+            {
+                printf("> Error: No task %lu.\r\n", instruction->operand);
+                return false;
+            }
+            break;
+        }
+        case OP_IDLE:
+        {
+            printIdle();
+            break;
+        }
+        case OP_WATCH:
+        {
+            if (!watchDigitalPin(bc, instruction->port, instruction->mask,
+                                 (uint8_t)instruction->operand))
+            {
+                return false;
+            }
+            if (instruction->operand == EXTI_EDGE_NONE)
+            {
+                printf("> Stopped watching %c%02u.\r\n", pinLetter(instruction),
+                       pinNumber(instruction));
+                break;
+            }
+            printf("> Watching %c%02u, \"events\" to read.\r\n", pinLetter(instruction),
+                   pinNumber(instruction));
+            break;
+        }
+        case OP_EVENTS:
+        {
+            if (instruction->operand)
+            {
+                extiClearEvents();
+                printf("> Events cleared.\r\n");
+                break;
+            }
+            printEvents();
+            break;
+        }
+        case OP_UPDATE:
+        {
+            printf("> Rebooting into the bootloader, send the new image with "
+                   "bootloader/update.py.\r\n");
+            fflush(stdout);
+            coreUartFlush();
+            coreSystemEnterBootloader();
+            break;
+        }
+        case OP_CLOCK:
+        {
+            if (instruction->operand != 0)
+            {
+                if (!setBoardClock(bc, instruction->operand))
+                {
+                    return false;
+                }
+            }
+            printf("> CPU at %lu MHz from %s, APB1 %lu MHz, APB2 %lu MHz.\r\n",
+                   coreSystemCpuFrequency() / 1000000, coreSystemClockOnHse() ? "HSE" : "HSI",
+                   rcc_apb1_frequency / 1000000, rcc_apb2_frequency / 1000000);
+            break;
+        }
+        case OP_CLOCKS:
+        {
+            printClocks(bc);
+            break;
+        }
+        case OP_SAVE:
+        {
+            if (!(instruction->operand ? snapshotClear() : snapshotSave(bc)))
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_RESTORE:
+        {
+            if (!snapshotRestore(bc))
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_STATS:
+        {
+#ifdef LATENCY_STATS
+            if (instruction->operand)
+            {
+                latencyReset();
+                printf("> Latency stats cleared.\r\n");
+                break;
+            }
+            latencyPrint();
+            break;
+#else
+            printf("> Error: Latency stats are compiled out, build with -D LATENCY_STATS.\r\n");
+            return false;
+#endif
+        }
+        case OP_BENCH:
+        {
+#ifdef BOARD_BENCH
+            if (!benchStart())
+            {
+                return false;
+            }
+            break;
+#else
+            printf("> Error: The benchmark is compiled out, build with -D BOARD_BENCH.\r\n");
+            return false;
+#endif
+        }
+        case OP_MEM:
+        {
+#ifdef MEM_STATS
+            if (instruction->operand)
+            {
+                memReset();
+                printf("> Memory peaks cleared.\r\n");
+                break;
+            }
+            memPrint();
+            break;
+#else
+            printf("> Error: Memory stats are compiled out, build with -D MEM_STATS.\r\n");
+            return false;
+#endif
+        }
+        case OP_SCRIPT_DEF:
+        case OP_SCRIPT_RUN:
+        case OP_SCRIPT_DEL:
+        {
+            const char *name = &chunk->strings[instruction->operand >> 16];
+            size_t      length = instruction->operand & 0xFFFF;
+            bool        result;
+            if (instruction->op == OP_SCRIPT_DEF)
+            {
+                result = scriptDefine(name, length);
+            }
+            else if (instruction->op == OP_SCRIPT_RUN)
+            {
+                result = scriptRun(bc, name, length);
+            }
+            else
+            {
+                result = scriptDelete(name, length);
+            }
+            if (!result)
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_SCRIPT_END:
+        {
+            if (!scriptEnd())
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_SCRIPT_LIST:
+        {
+            scriptList();
+            break;
+        }
+        case OP_UART_BRIDGE:
+        {
+            if (!bridgeStart(bc, instruction->port))
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_SPI_INIT:
+        {
+            if (!makeSPI(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_SPI_XFER:
+        case OP_SPI_READ:
+        {
+            uint32_t length;
+            if (instruction->op == OP_SPI_XFER)
+            {
+                length = instruction->operand & 0xFFFF;
+                memcpy(spi_buffer, &chunk->strings[instruction->operand >> 16], length);
+            }
+            else
+            {
+                length = instruction->operand;
+                memset(spi_buffer, 0xFF, length);
+            }
+            if (transferSPIPort(bc, instruction->port, spi_buffer, length) == 0)
+            {
+                return false;
+            }
+            replySPI(getSPIPeripheral(bc, instruction->port)->peripheral.spi.handle, spi_buffer,
+                     length);
+            break;
+        }
+        case OP_I2C_INIT:
+        {
+            if (!makeI2C(bc, chunk, instruction))
+            {
+                return false;
+            }
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        case OP_I2C_BATCH:
+        case OP_I2C_SCAN:
+        {
+            if (!startI2C(bc, chunk, instruction))
+            {
+                return false;
+            }
+            break;
+        }
+        case OP_CAPTURE:
+        {
+            const uint32_t *constants = &chunk->constants[instruction->operand];
+            char            letter = (char)('A' + (instruction->port - GPIOA) / PORT_SIZE);
+            uint16_t pins = getDigitalPortMask(bc, instruction->port, 0xFFFF, GPIO_READ);
+            if (pins == 0)
+            {
+                printf("> Error: Capture needs at least one input on port %c.\r\n", letter);
+                return false;
+            }
+            if ((pins & instruction->mask) != instruction->mask)
+            {
+                printf("> Error: Trigger pins must be initialised as inputs.\r\n");
+                return false;
+            }
+            if (!captureStart(instruction->port, pins, constants[CAPTURE_CONST_RATE],
+                              constants[CAPTURE_CONST_SAMPLES], instruction->mask,
+                              (uint16_t)constants[CAPTURE_CONST_TRIGGER_VALUE]))
+            {
+                return false;
+            }
+            printf("> Capturing %lu samples of port %c at %lu Hz%s.\r\n",
+                   constants[CAPTURE_CONST_SAMPLES], letter, captureRate(),
+                   instruction->mask ? ", waiting for the trigger" : "");
+            break;
+        }
+        case OP_CAPTURE_STOP:
+        {
+            printf(captureStop() ? "> Capture stopped.\r\n" : "> No capture running.\r\n");
+            break;
+        }
+        case OP_REPEAT:
+        {
+            // The rest of the chunk is the loop.
+            return runRepeat(chunk, i, port_values);
+        }
+        case OP_DELAY:
+        {
+            coreSystemDelayMicros(instruction->operand);
+            break;
+        }
+        case OP_UART_FLOW:
+        {
+            UartFlowControl flow = (UartFlowControl)instruction->operand;
+            if (instruction->port == USART2)
+            {
+                if (flow == UART_FLOW_XONXOFF && protocolBinaryMode())
+                {
+                    printf("> Error: XON/XOFF would land in the middle of binary frames, "
+                           "\"mode text\" first.\r\n");
+                    return false;
+                }
+                (void)coreUartSetFlowControl(flow);
+                printf("> CONSOLE flow control: %s\r\n", flowName(flow));
+                break;
+            }
+            if (!setUARTFlowControl(bc, instruction->port, flow))
+            {
+                return false;
+            }
+            printf("> UART flow control: %s\r\n", flowName(flow));
+            chunk->bound_generation = CHUNK_UNBOUND;
+            break;
+        }
+        default:
+        {
+            // Should never get here.
+            printf("> Parse Error: Incorrect op code provided.\r\n");
+            return false;
+        }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Runs a compiled line. A line bound part way through has instructions before its
+ * configuration op bound against an older board, so it is left unbound and the next run binds it
+ * again from the start.
+ *
+ * @param bc board controller object
+ * @param chunk chunk to run
+ * @return true executed successfully
+ * @return false executed unsuccessfully
+ */
+bool runChunk(BoardController *bc, Chunk *chunk)
+{
+    bool part_way = false;
+    bool result = runInstructions(bc, chunk, &part_way);
+    if (part_way)
+    {
+        chunk->bound_generation = CHUNK_UNBOUND;
+    }
+    return result;
+}
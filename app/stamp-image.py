@@ -0,0 +1,63 @@
+import struct
+import sys
+
+# See shared/inc/core/update.h
+BOOTLOADER_SIZE = 0x8000
+BOOT_APP_MAX_SIZE = 0x08040000 - 0x08008000
+BOOT_IMAGE_HEADER_OFFSET = 0x200
+BOOT_IMAGE_MAGIC = 0x474D494E
+BINARY_FILE = "firmware.bin"
+
+
+def _crc_table() -> list:
+    table = []
+    for byte in range(256):
+        crc = byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+        table.append(crc & 0xFFFFFFFF)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc32_words(data: bytes) -> int:
+    """CRC-32/MPEG-2 over little endian words, the same sum as the STM32 CRC unit."""
+    crc = 0xFFFFFFFF
+    for offset in range(0, len(data), 4):
+        # The CRC unit takes each word most significant byte first.
+        for byte in reversed(data[offset:offset + 4]):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[(crc >> 24) ^ byte]
+    return crc
+
+
+def main() -> int:
+    binary_file_name = sys.argv[1] if len(sys.argv) > 1 else BINARY_FILE
+    with open(binary_file_name, "rb") as binary_file:
+        raw_file = binary_file.read()
+
+    # The binary starts with the bootloader, the image is everything after it.
+    image = bytearray(raw_file[BOOTLOADER_SIZE:])
+    image += bytes([0xff for _ in range(-len(image) % 4)])
+    if len(image) > BOOT_APP_MAX_SIZE:
+        print(f"Image is {len(image)} bytes, only {BOOT_APP_MAX_SIZE} fit below the scripts.")
+        return 1
+
+    header = BOOT_IMAGE_HEADER_OFFSET
+    (magic,) = struct.unpack_from("<I", image, header)
+    if magic != BOOT_IMAGE_MAGIC:
+        print(f"No image header 0x{header:x} into {binary_file_name}.")
+        return 1
+
+    # The CRC is over the image with the crc and checked words still erased.
+    struct.pack_into("<III", image, header + 4, len(image), 0xFFFFFFFF, 0xFFFFFFFF)
+    struct.pack_into("<I", image, header + 8, crc32_words(bytes(image)))
+
+    with open(binary_file_name, "wb") as binary_file:
+        binary_file.write(raw_file[:BOOTLOADER_SIZE] + image)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
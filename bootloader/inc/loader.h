@@ -0,0 +1,22 @@
+/**
+ * @file loader.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Checks the app image before it is booted, and receives a new one over the console UART
+ * when the app asks for it or there isn't a good one. Packets and the image header are described
+ * in shared/inc/core/update.h.
+ * @version 0.1
+ * @date 2025-03-25
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include "common-includes.h"
+
+bool loaderTakeRequest(void);
+bool loaderImageBootable(void);
+void loaderRun(void);
+
+#endif
@@ -1,7 +1,8 @@
 /**
  * @file bootloader.c
  * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
- * @brief Main functionality of the bootloader. Jumps to the main function in the firmware.
+ * @brief Main functionality of the bootloader. Jumps to the main function in the firmware, unless
+ * the firmware asked for an update or there isn't a good image to jump to.
  * @version 0.1
  * @date 2024-10-03
  * 
@@ -12,9 +13,10 @@
 #include "libopencm3/stm32/memorymap.h"
 #include "libopencm3/cm3/vector.h"
 
-// Bootloader is 32kB
-#define BOOTLOADER_SIZE (0x8000U)
-#define MAIN_APP_START_ADDR (FLASH_BASE + BOOTLOADER_SIZE)
+#include "core/update.h"
+#include "loader.h"
+
+#define MAIN_APP_START_ADDR (BOOT_APP_ADDRESS)
 
 /**
  * @brief Jumps to the main() function in app/src/firmware.c. Be careful when casting memory locations to structs. 
@@ -27,7 +29,11 @@ static void jump_to_main(void) {
 }
 
 int main(void) {
-    jump_to_main();
-    // We will never return as we will jump to a different point
+    // Nothing is set up on the way to the app, so a normal boot is as quick as it was.
+    if (!loaderTakeRequest() && loaderImageBootable()) {
+        jump_to_main();
+    }
+    // Only returns by resetting into the new image.
+    loaderRun();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,392 @@
+/**
+ * @file loader.c
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief Image checks and the UART update loop. Nothing here touches the clocks or peripherals
+ * until an update is actually needed, so a normal boot costs a few flash reads.
+ * @version 0.1
+ * @date 2025-03-25
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "loader.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "libopencm3/cm3/scb.h"
+#include "libopencm3/cm3/vector.h"
+#include "libopencm3/stm32/crc.h"
+#include "libopencm3/stm32/flash.h"
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/usart.h"
+
+#include "core/system.h"
+#include "core/update.h"
+
+#define LOADER_UART      (USART2)
+#define LOADER_UART_PORT (GPIOA)
+#define LOADER_UART_PINS (GPIO2 | GPIO3)
+#define LOADER_RAM_START (0x20000000U)
+#define LOADER_RAM_END   (0x20020000U)
+
+// A packet after its sync byte: header, payload and CRC.
+static uint32_t packet[(sizeof(BootPacketHeader) + BOOT_CHUNK_SIZE + 4) / 4];
+
+// End address of each app sector, BOOT_APP_FIRST_SECTOR first.
+static const uint32_t sector_ends[BOOT_APP_LAST_SECTOR - BOOT_APP_FIRST_SECTOR + 1] = {
+    0x0800C000U, // 2, 16kB
+    0x08010000U, // 3, 16kB
+    0x08020000U, // 4, 64kB
+    0x08040000U, // 5, 128kB
+};
+
+/**
+ * @brief Returns the header of the image in flash, whatever state it is in.
+ *
+ * @return const BootImageHeader* header
+ */
+static const BootImageHeader *imageHeader(void)
+{
+    return (const BootImageHeader *)(BOOT_APP_ADDRESS + BOOT_IMAGE_HEADER_OFFSET);
+}
+
+/**
+ * @brief Checks an image length is one the app region can hold and that covers the header.
+ *
+ * @param length bytes of image
+ * @return true length is usable
+ * @return false length is not
+ */
+static bool lengthValid(uint32_t length)
+{
+    return length >= BOOT_IMAGE_HEADER_OFFSET + sizeof(BootImageHeader) &&
+           length <= BOOT_APP_MAX_SIZE && length % 4 == 0;
+}
+
+/**
+ * @brief Checks the vector table points into RAM and the image, so a blank or half written app
+ * region is never jumped to.
+ *
+ * @param length bytes of image the reset vector must be in
+ * @return true vectors look sane
+ * @return false vectors are erased or garbage
+ */
+static bool vectorsValid(uint32_t length)
+{
+    const vector_table_t *vectors = (const vector_table_t *)BOOT_APP_ADDRESS;
+    uint32_t              stack = (uint32_t)vectors->initial_sp_value;
+    uint32_t              reset = (uint32_t)vectors->reset;
+    return stack > LOADER_RAM_START && stack <= LOADER_RAM_END && reset >= BOOT_APP_ADDRESS &&
+           reset < BOOT_APP_ADDRESS + length;
+}
+
+/**
+ * @brief Sums the image in flash with the CRC unit, which must be clocked. The header's crc and
+ * checked words are summed as erased, which is how they were when the image was stamped.
+ *
+ * @param length bytes of image
+ * @return uint32_t CRC
+ */
+static uint32_t imageCrc(uint32_t length)
+{
+    uint32_t *words = (uint32_t *)BOOT_APP_ADDRESS;
+    uint32_t  crc_word = (BOOT_IMAGE_HEADER_OFFSET + offsetof(BootImageHeader, crc)) / 4;
+
+    crc_reset();
+    (void)crc_calculate_block(words, (int)crc_word);
+    (void)crc_calculate(0xFFFFFFFFU);
+    (void)crc_calculate(0xFFFFFFFFU);
+    return crc_calculate_block(&words[crc_word + 2], (int)(length / 4 - crc_word - 2));
+}
+
+/**
+ * @brief Checks the whole image against its header and, if it matches, programs the checked word
+ * so later boots can skip the CRC.
+ *
+ * @param length bytes of image expected, 0 to take the header's word for it
+ * @return true image is good
+ * @return false image is missing, cut short or corrupt
+ */
+static bool checkImage(uint32_t length)
+{
+    const BootImageHeader *header = imageHeader();
+    if (header->magic != BOOT_IMAGE_MAGIC || !lengthValid(header->length) ||
+        (length != 0 && header->length != length) || !vectorsValid(header->length) ||
+        imageCrc(header->length) != header->crc)
+    {
+        return false;
+    }
+    flash_unlock();
+    flash_clear_status_flags();
+    flash_program_word((uint32_t)&header->checked, BOOT_IMAGE_CHECKED);
+    flash_lock();
+    return header->checked == BOOT_IMAGE_CHECKED;
+}
+
+/**
+ * @brief Reads and clears the app's update request, so the next reset boots normally.
+ *
+ * @return true the app asked for an update
+ * @return false it didn't, or the RAM is left over from power on
+ */
+bool loaderTakeRequest(void)
+{
+    bool requested = boot_request.magic == BOOT_REQUEST_UPDATE &&
+                     boot_request.inverse == ~BOOT_REQUEST_UPDATE;
+    boot_request.magic = 0;
+    boot_request.inverse = 0;
+    return requested;
+}
+
+/**
+ * @brief Decides whether the app can be jumped to. An image the loader has already checked only
+ * costs a look at its header. One written some other way (e.g. by an ST-Link) is checked in full
+ * the first time, at 16 MHz.
+ *
+ * @return true boot the app
+ * @return false stay in the loader
+ */
+bool loaderImageBootable(void)
+{
+    const BootImageHeader *header = imageHeader();
+    if (header->magic != BOOT_IMAGE_MAGIC || !lengthValid(header->length))
+    {
+#ifdef BOOT_UNCHECKED_IMAGES
+        return vectorsValid(BOOT_APP_MAX_SIZE);
+#else
+        return false;
+#endif
+    }
+    if (header->checked == BOOT_IMAGE_CHECKED)
+    {
+        return vectorsValid(header->length);
+    }
+    rcc_periph_clock_enable(RCC_CRC);
+    bool good = checkImage(0);
+    rcc_periph_clock_disable(RCC_CRC);
+    return good;
+}
+
+/**
+ * @brief Sets the console UART up for polled transfers at BOOT_UPDATE_BAUD.
+ *
+ */
+static void uartSetup(void)
+{
+    rcc_periph_clock_enable(RCC_GPIOA);
+    gpio_mode_setup(LOADER_UART_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, LOADER_UART_PINS);
+    gpio_set_af(LOADER_UART_PORT, GPIO_AF7, LOADER_UART_PINS);
+    rcc_periph_clock_enable(RCC_USART2);
+    usart_set_mode(LOADER_UART, USART_MODE_TX_RX);
+    usart_set_flow_control(LOADER_UART, USART_FLOWCONTROL_NONE);
+    usart_set_databits(LOADER_UART, 8);
+    usart_set_baudrate(LOADER_UART, BOOT_UPDATE_BAUD);
+    usart_set_parity(LOADER_UART, USART_PARITY_NONE);
+    usart_set_stopbits(LOADER_UART, USART_STOPBITS_1);
+    usart_enable(LOADER_UART);
+}
+
+/**
+ * @brief Waits for a byte from the UART. Reading DR also clears an overrun.
+ *
+ * @param byte where to put it
+ * @param timeout false to wait for as long as it takes
+ * @return true byte read
+ * @return false nothing came for BOOT_BYTE_TIMEOUT_MS
+ */
+static bool readByte(uint8_t *byte, bool timeout)
+{
+    uint64_t start = coreGetTicks();
+    while (!usart_get_flag(LOADER_UART, USART_FLAG_RXNE))
+    {
+        if (timeout && coreGetTicks() - start > BOOT_BYTE_TIMEOUT_MS)
+        {
+            return false;
+        }
+    }
+    *byte = (uint8_t)usart_recv(LOADER_UART);
+    return true;
+}
+
+/**
+ * @brief Waits for the next packet and checks it arrived whole.
+ *
+ * @return true packet[] holds a packet with a good CRC
+ * @return false a packet started but was cut short, too long or corrupt
+ */
+static bool receivePacket(void)
+{
+    const BootPacketHeader *header = (const BootPacketHeader *)packet;
+    uint8_t                *bytes = (uint8_t *)packet;
+    uint8_t                 byte = 0;
+    while (byte != BOOT_SYNC)
+    {
+        (void)readByte(&byte, false);
+    }
+
+    size_t size = sizeof(BootPacketHeader);
+    for (size_t index = 0; index < size; index++)
+    {
+        if (!readByte(&bytes[index], true))
+        {
+            return false;
+        }
+        if (index == sizeof(BootPacketHeader) - 1)
+        {
+            if (header->length > BOOT_CHUNK_SIZE || header->length % 4 != 0)
+            {
+                return false;
+            }
+            size += header->length + 4;
+        }
+    }
+    size_t words = (size - 4) / 4;
+    crc_reset();
+    return crc_calculate_block(packet, (int)words) == packet[words];
+}
+
+/**
+ * @brief Erases the sectors an image of length bytes needs, the first one always. The CPU stalls
+ * for up to a few seconds, nothing is received meanwhile.
+ *
+ * @param length bytes of image
+ */
+static void eraseImage(uint32_t length)
+{
+    flash_unlock();
+    flash_clear_status_flags();
+    for (size_t sector = 0; sector < sizeof(sector_ends) / sizeof(sector_ends[0]); sector++)
+    {
+        flash_erase_sector((uint8_t)(BOOT_APP_FIRST_SECTOR + sector), FLASH_CR_PROGRAM_X32);
+        if (sector_ends[sector] >= BOOT_APP_ADDRESS + length)
+        {
+            break;
+        }
+    }
+    flash_lock();
+    flash_dcache_disable();
+    flash_dcache_reset();
+    flash_dcache_enable();
+}
+
+/**
+ * @brief Programs a chunk of the image into erased flash and checks it reads back.
+ *
+ * @param offset bytes into the image, word aligned
+ * @param words data to program
+ * @param length bytes, a multiple of 4
+ * @return true programmed
+ * @return false flash didn't read back as written
+ */
+static bool programChunk(uint32_t offset, const uint32_t *words, uint32_t length)
+{
+    uint32_t address = BOOT_APP_ADDRESS + offset;
+    flash_unlock();
+    flash_clear_status_flags();
+    for (uint32_t word = 0; word < length / 4; word++)
+    {
+        flash_program_word(address + word * 4, words[word]);
+    }
+    flash_lock();
+    return memcmp((const void *)address, words, length) == 0;
+}
+
+/**
+ * @brief Answers a packet.
+ *
+ * @param byte BOOT_ACK or BOOT_NAK
+ */
+static void reply(uint8_t byte)
+{
+    usart_send_blocking(LOADER_UART, byte);
+}
+
+/**
+ * @brief Receives an image and boots it. Runs at 84 MHz with the UART polled, and only returns by
+ * resetting once an image has been written and checked. A chunk whose ACK was lost can be sent
+ * again, everything else out of order is NAKed.
+ *
+ */
+void loaderRun(void)
+{
+    coreSystemSetup();
+    uartSetup();
+    rcc_periph_clock_enable(RCC_CRC);
+
+    const BootPacketHeader *header = (const BootPacketHeader *)packet;
+    uint32_t                image_length = 0; // from BEGIN, 0 until one arrives
+    uint32_t                written = 0;      // bytes of image programmed
+    uint32_t                last_offset = 0;  // offset of the last chunk programmed
+    bool                    erased = false;   // nothing programmed since the last erase
+    while (1)
+    {
+        if (!receivePacket())
+        {
+            reply(BOOT_NAK);
+            continue;
+        }
+
+        bool acked = false;
+        switch (header->type)
+        {
+        case BOOT_PACKET_PING:
+            acked = true;
+            break;
+        case BOOT_PACKET_BEGIN:
+            if (!lengthValid(header->argument))
+            {
+                break;
+            }
+            // A BEGIN sent again because its ACK went missing doesn't need a second erase.
+            if (!erased || image_length != header->argument)
+            {
+                eraseImage(header->argument);
+            }
+            image_length = header->argument;
+            written = 0;
+            erased = true;
+            acked = true;
+            break;
+        case BOOT_PACKET_DATA:
+            if (image_length == 0 || header->length == 0)
+            {
+                break;
+            }
+            if (written != 0 && header->argument == last_offset &&
+                header->argument + header->length == written)
+            {
+                acked = true;
+            }
+            else if (header->argument == written &&
+                     header->argument + header->length <= image_length)
+            {
+                erased = false;
+                acked = programChunk(header->argument, &packet[2], header->length);
+                if (acked)
+                {
+                    last_offset = header->argument;
+                    written += header->length;
+                }
+            }
+            break;
+        case BOOT_PACKET_END:
+            acked = image_length != 0 && written == image_length && checkImage(image_length);
+            if (acked)
+            {
+                reply(BOOT_ACK);
+                while (!usart_get_flag(LOADER_UART, USART_FLAG_TC))
+                {
+                }
+                // Boot through the reset, so the app starts with the clocks as it expects.
+                scb_reset_system();
+            }
+            image_length = 0;
+            break;
+        default:
+            break;
+        }
+        reply(acked ? BOOT_ACK : BOOT_NAK);
+    }
+}
@@ -0,0 +1,138 @@
+"""Sends a new app image to the bootloader over the console UART.
+
+    python3 update.py <serial port> <firmware.bin>
+
+The app is asked to reboot into the bootloader with "update" first, so a running board needs
+nothing else. A board without a good image is already waiting in the bootloader. Needs pyserial.
+Packets, CRCs and the image header are described in shared/inc/core/update.h.
+"""
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+# See shared/inc/core/update.h
+BOOTLOADER_SIZE = 0x8000
+BOOT_IMAGE_HEADER_OFFSET = 0x200
+BOOT_IMAGE_MAGIC = 0x474D494E
+BOOT_UPDATE_BAUD = 921600
+BOOT_CHUNK_SIZE = 1024
+BOOT_SYNC = 0xA5
+BOOT_ACK = 0x06
+BOOT_NAK = 0x15
+BOOT_PACKET_PING = ord("P")
+BOOT_PACKET_BEGIN = ord("B")
+BOOT_PACKET_DATA = ord("D")
+BOOT_PACKET_END = ord("E")
+
+CONSOLE_BAUD = 115200
+RETRIES = 5
+
+
+def _crc_table() -> list:
+    table = []
+    for byte in range(256):
+        crc = byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+        table.append(crc & 0xFFFFFFFF)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc32_words(data: bytes) -> int:
+    """CRC-32/MPEG-2 over little endian words, the same sum as the STM32 CRC unit."""
+    crc = 0xFFFFFFFF
+    for offset in range(0, len(data), 4):
+        # The CRC unit takes each word most significant byte first.
+        for byte in reversed(data[offset:offset + 4]):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[(crc >> 24) ^ byte]
+    return crc
+
+
+def load_image(file_name: str) -> bytes:
+    """Returns the image from a firmware.bin (bootloader first) or a bare image, header checked."""
+    with open(file_name, "rb") as image_file:
+        raw_file = image_file.read()
+    for start in (BOOTLOADER_SIZE, 0):
+        image = raw_file[start:]
+        if len(image) < BOOT_IMAGE_HEADER_OFFSET + 16:
+            continue
+        magic, length, crc, _ = struct.unpack_from("<IIII", image, BOOT_IMAGE_HEADER_OFFSET)
+        if magic != BOOT_IMAGE_MAGIC:
+            continue
+        image = image[:length]
+        unstamped = bytearray(image)
+        struct.pack_into("<II", unstamped, BOOT_IMAGE_HEADER_OFFSET + 8, 0xFFFFFFFF, 0xFFFFFFFF)
+        if len(image) != length or crc32_words(bytes(unstamped)) != crc:
+            sys.exit(f"{file_name} doesn't match its header, was it built with app/stamp-image.py?")
+        return image
+    sys.exit(f"No image header in {file_name}.")
+
+
+def send_packet(port: serial.Serial, kind: int, argument: int, payload: bytes, timeout: float) -> bool:
+    """Sends a packet and waits for its answer. Returns True on ACK."""
+    body = struct.pack("<BBHI", kind, 0, len(payload), argument) + payload
+    port.reset_input_buffer()
+    port.timeout = timeout
+    port.write(bytes([BOOT_SYNC]) + body + struct.pack("<I", crc32_words(body)))
+    # Echo or leftovers from the app can come first, only ACK or NAK answer.
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        answer = port.read(1)
+        if answer and answer[0] in (BOOT_ACK, BOOT_NAK):
+            return answer[0] == BOOT_ACK
+    return False
+
+
+def send_with_retries(port: serial.Serial, kind: int, argument: int, payload: bytes,
+                      timeout: float) -> None:
+    for _ in range(RETRIES):
+        if send_packet(port, kind, argument, payload, timeout):
+            return
+    sys.exit(f"No ACK for packet {chr(kind)} 0x{argument:x} after {RETRIES} tries.")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Update NiTTY over its console UART.")
+    parser.add_argument("port", help="serial port, e.g. /dev/ttyACM0")
+    parser.add_argument("image", help="app/firmware.bin")
+    parser.add_argument("--console-baud", type=int, default=CONSOLE_BAUD)
+    parser.add_argument("--baud", type=int, default=BOOT_UPDATE_BAUD)
+    parser.add_argument("--no-reboot", action="store_true",
+                        help="the board is already in the bootloader, don't send \"update\"")
+    arguments = parser.parse_args()
+
+    image = load_image(arguments.image)
+    with serial.Serial(arguments.port, arguments.console_baud, timeout=0.1) as port:
+        if not arguments.no_reboot:
+            port.write(b"\rupdate\r")
+            port.flush()
+            time.sleep(0.2)
+        port.baudrate = arguments.baud
+
+        # The bootloader answers pings as soon as it is up.
+        deadline = time.monotonic() + 5.0
+        while not send_packet(port, BOOT_PACKET_PING, 0, b"", 0.05):
+            if time.monotonic() > deadline:
+                sys.exit("The bootloader isn't answering. Is the board in binary mode?")
+
+        start = time.monotonic()
+        # Erasing stalls the board for up to a few seconds before it answers.
+        send_with_retries(port, BOOT_PACKET_BEGIN, len(image), b"", 10.0)
+        for offset in range(0, len(image), BOOT_CHUNK_SIZE):
+            send_with_retries(port, BOOT_PACKET_DATA, offset,
+                              image[offset:offset + BOOT_CHUNK_SIZE], 0.5)
+            print(f"\r{offset * 100 // len(image):3d}%", end="", flush=True)
+        send_with_retries(port, BOOT_PACKET_END, 0, b"", 2.0)
+        elapsed = time.monotonic() - start
+    print(f"\r{len(image)} bytes in {elapsed:.1f} s, booting the new image.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,18 +6,57 @@
 /**
  * @brief Structure for ring buffer. Using binary masking.
  * 
+ * Lock free single producer, single consumer queue. Only the producer (e.g. an ISR or DMA
+ * publish) writes write_index and only the consumer writes read_index, so no locking is needed
+ * as long as each side sticks to its own functions:
+ *   producer: coreRingBufferWrite, PeekWrite/CommitWrite, WriteBulk, AdvanceWrite
+ *   consumer: coreRingBufferRead, PeekRead/CommitRead, ReadBulk
+ * Anything else may be called from either side and gives a snapshot. The one exception is an
+ * overrun in AdvanceWrite, which moves read_index past the bytes DMA wrote over.
+ * 
+ * The indices are volatile so every call reloads the other side's index, and a barrier orders
+ * the data copy against publishing the index, so this holds at any optimisation level or with
+ * LTO.
+ * 
+ * By default the indices wrap at the buffer size and one slot is left empty to tell full from
+ * empty. Define RING_BUFFER_FREE_RUNNING for indices that only wrap at 2^32, which lets the
+ * whole buffer be used and tracks the peak fill level in high_water.
  */
 typedef struct ring_buffer_t
 {
-    uint8_t *buffer;
-    uint32_t mask;
-    uint32_t read_index;
-    uint32_t write_index;
+    uint8_t          *buffer;
+    uint32_t          mask;
+    volatile uint32_t read_index;
+    volatile uint32_t write_index;
+#ifdef RING_BUFFER_FREE_RUNNING
+    volatile uint32_t high_water; // most bytes ever waiting at once, written by the producer
+#endif
 } ring_buffer_t;
 
+// Orders buffer accesses against the index update that publishes them. DMB on Cortex-M so it
+// also holds against DMA, a full barrier elsewhere.
+#if defined(__ARM_ARCH)
+#define RING_BUFFER_BARRIER() __asm__ volatile("dmb" ::: "memory")
+#else
+#define RING_BUFFER_BARRIER() __sync_synchronize()
+#endif
+
 void coreRingBufferSetup(ring_buffer_t *rb, uint8_t *buffer, uint32_t size);
 bool coreRingBufferEmpty(ring_buffer_t *rb);
 bool coreRingBufferWrite(ring_buffer_t *rb, uint8_t byte);
 bool coreRingBufferRead(ring_buffer_t *rb, uint8_t *byte);
+uint32_t coreRingBufferUsed(ring_buffer_t *rb);
+uint32_t coreRingBufferFree(ring_buffer_t *rb);
+uint32_t coreRingBufferCapacity(ring_buffer_t *rb);
+#ifdef RING_BUFFER_FREE_RUNNING
+uint32_t coreRingBufferHighWater(ring_buffer_t *rb);
+#endif
+uint32_t coreRingBufferAdvanceWrite(ring_buffer_t *rb, uint32_t write_index);
+uint32_t coreRingBufferPeekRead(ring_buffer_t *rb, const uint8_t **span);
+void coreRingBufferCommitRead(ring_buffer_t *rb, uint32_t count);
+uint32_t coreRingBufferPeekWrite(ring_buffer_t *rb, uint8_t **span);
+void coreRingBufferCommitWrite(ring_buffer_t *rb, uint32_t count);
+uint32_t coreRingBufferReadBulk(ring_buffer_t *rb, uint8_t *data, uint32_t len);
+uint32_t coreRingBufferWriteBulk(ring_buffer_t *rb, const uint8_t *data, uint32_t len);
 
-#endif
\ No newline at end of file
+#endif
@@ -3,11 +3,27 @@
 
 #include "common-includes.h"
 
-#define CPU_FREQ (84000000)
+#define CPU_FREQ (84000000) // at power on, "clock" can change it, see coreSystemCpuFrequency()
 #define SYSTICK_FREQ (1000)
 
+// coreSystemSetClock() range. The F411 tops out at 100MHz, the PLL can't go much under 16MHz.
+#define SYSTEM_CLOCK_MIN_MHZ (16)
+#define SYSTEM_CLOCK_MAX_MHZ (100)
+// HSE on the Nucleo is the ST-Link's 8MHz MCO output, a crystal of the same frequency also works.
+#define SYSTEM_HSE_MHZ       (8)
+#define SYSTEM_HSI_MHZ       (16)
+
 void coreSystemSetup(void);
 uint64_t coreGetTicks(void);
 void coreSystemDelay(uint64_t milliseconds);
+void coreSystemDelayMicros(uint32_t microseconds);
+void coreSystemSleep(bool (*work_pending)(void));
+uint64_t coreSystemIdleCycles(void);
+uint64_t coreSystemCycles(void);
+void coreSystemEnterBootloader(void);
+bool coreSystemSetClock(uint32_t mhz);
+uint32_t coreSystemCpuFrequency(void);
+bool coreSystemClockOnHse(void);
+uint64_t coreSystemCyclesToMicros(uint64_t cycles);
 
 #endif
\ No newline at end of file
@@ -11,6 +11,63 @@
 #define UART_TX_PIN         (GPIO2)
 #define UART_RX_PIN         (GPIO3)
 
+/**
+ * @brief What a TX write does when the TX ring buffer cannot hold all of it.
+ * 
+ */
+typedef enum UartTxPolicy {
+    UART_TX_BLOCK,    // wait for the TX interrupt to make room
+    UART_TX_DROP,     // discard the whole write
+    UART_TX_TRUNCATE, // write as much as fits, discard the rest
+} UartTxPolicy;
+
+/**
+ * @brief Receive error counters.
+ * @param overruns bytes lost in the USART itself (ORE), nobody read DR in time
+ * @param dropped bytes lost because the RX ring buffer was full
+ * @param high_water most bytes ever waiting in the RX ring buffer at once
+ */
+typedef struct UartRxStats {
+    uint32_t overruns;
+    uint32_t dropped;
+#ifdef RING_BUFFER_FREE_RUNNING
+    uint32_t high_water;
+#endif
+} UartRxStats;
+
+/**
+ * @brief Receive flow control: how the board tells the sender to pause while its RX ring buffer
+ * is nearly full.
+ *
+ */
+typedef enum UartFlowControl {
+    UART_FLOW_NONE,    // sender is never paused, a full buffer drops bytes
+    UART_FLOW_XONXOFF, // XOFF sent at the high watermark, XON once drained to the low one
+    UART_FLOW_RTSCTS,  // RTS raised at the high watermark, and TX waits while CTS is high
+} UartFlowControl;
+
+#define UART_XON  (0x11) // DC1
+#define UART_XOFF (0x13) // DC3
+
+// Flow control watermarks in bytes waiting. DMA only publishes every half buffer, so the sender
+// is paused with over a quarter of the buffer still free for what it sends before it stops.
+#define UART_FLOW_HIGH(size) ((size) / 4)
+#define UART_FLOW_LOW(size)  ((size) / 8)
+
+/**
+ * @brief Replacement for the console's stdout path, e.g. to wrap printf output in frames.
+ * Returns how many bytes it consumed.
+ */
+typedef int (*UartWriteHook)(const char *ptr, int len);
+
+#define UART_TX_BUFFER_SIZE (1024) // Must be a power of two! ~89ms of output at 115200, and
+                                   // holds the longest binary frame whole
+
+// Policy used until coreUartSetTxPolicy() is called. Override with -D.
+#ifndef UART_TX_DEFAULT_POLICY
+#define UART_TX_DEFAULT_POLICY (UART_TX_BLOCK)
+#endif
+
 int _write(int file, char *ptr, int len);
 
 void coreUartSetup(uint32_t baudrate);
@@ -18,6 +75,21 @@ void coreUartWrite(uint8_t *data, uint32_t len);
 void coreUartWriteByte(uint8_t byte);
 uint32_t coreUartRead(uint8_t *data, uint32_t len);
 uint8_t coreUartReadByte(void);
+uint32_t coreUartPeekRead(const uint8_t **span);
+void coreUartCommitRead(uint32_t count);
+uint32_t coreUartWriteNoWait(const uint8_t *data, uint32_t len);
+bool coreUartWriteWhole(const uint8_t *data, uint32_t len);
 bool coreUartDataAvailable(void);
+void coreUartSetTxPolicy(UartTxPolicy policy);
+UartRxStats coreUartGetRxStats(void);
+void coreUartFlush(void);
+void coreUartClockChanged(void);
+void coreUartSetWriteHook(UartWriteHook hook);
+bool coreUartSetFlowControl(UartFlowControl flow);
+UartFlowControl coreUartGetFlowControl(void);
+bool coreUartRxPaused(void);
+#ifdef LATENCY_STATS
+uint64_t coreUartWriteCycles(void);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+/**
+ * @file update.h
+ * @author Nicholas Fairburn (nicholas2.fairburn@live.uwe.ac.uk)
+ * @brief What the app and the bootloader agree on for firmware updates over the console UART: the
+ * flash layout, the header every app image carries, the RAM flag the app reboots with and the
+ * packets the bootloader receives an image in.
+ * @note Both CRCs are the STM32 CRC unit's: CRC-32/MPEG-2 (0x04C11DB7, init 0xFFFFFFFF, no
+ *       reflection, no final xor) over little endian words. bootloader/update.py does the same
+ *       sums on the host and app/stamp-image.py fills the header in after linking.
+ * @version 0.1
+ * @date 2025-03-25
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LOCAL_UPDATE_H_
+#define LOCAL_UPDATE_H_
+
+#include <stdint.h>
+
+// Flash layout. The app runs from sector 2 up to the script sectors (6 and 7, see
+// app/inc/script-control.h), which an update never touches.
+#define BOOTLOADER_SIZE          (0x8000U) // 32kB, sectors 0 and 1
+#define BOOT_APP_ADDRESS         (0x08000000U + BOOTLOADER_SIZE)
+#define BOOT_APP_END             (0x08040000U)
+#define BOOT_APP_MAX_SIZE        (BOOT_APP_END - BOOT_APP_ADDRESS)
+#define BOOT_APP_FIRST_SECTOR    (2)
+#define BOOT_APP_LAST_SECTOR     (5)
+
+// Image header, linked 0x200 into the app just past the vector table (app/linkerscript.ld).
+#define BOOT_IMAGE_HEADER_OFFSET (0x200U)
+#define BOOT_IMAGE_MAGIC         (0x474D494EU) // "NIMG"
+#define BOOT_IMAGE_UNCHECKED     (0xFFFFFFFFU) // as linked, the bootloader hasn't checked the CRC
+#define BOOT_IMAGE_CHECKED       (0x00000000U) // programmed over the above once the CRC matched
+
+// The app asks for an update by leaving this in boot_request and resetting.
+#define BOOT_REQUEST_UPDATE      (0x54445055U) // "UPDT"
+
+// Transfer. Packets are stop and wait, each is answered with BOOT_ACK or BOOT_NAK once the
+// bootloader has dealt with it, as nothing can be received while flash is erased or programmed.
+#define BOOT_UPDATE_BAUD         (921600)
+#define BOOT_CHUNK_SIZE          (1024) // most payload bytes in a packet, a multiple of 4
+#define BOOT_SYNC                (0xA5) // first byte of every packet
+#define BOOT_ACK                 (0x06)
+#define BOOT_NAK                 (0x15)
+#define BOOT_BYTE_TIMEOUT_MS     (100)  // a packet with a longer gap in it is dropped
+
+// Enum definitions
+/**
+ * @brief Packet types, in the order an update sends them.
+ *
+ */
+typedef enum BootPacketType
+{
+    BOOT_PACKET_PING = 'P',  // no payload, answered straight away so the host knows it's listening
+    BOOT_PACKET_BEGIN = 'B', // argument: image length, erases the sectors it needs
+    BOOT_PACKET_DATA = 'D',  // argument: offset into the image, payload: the next bytes of it
+    BOOT_PACKET_END = 'E',   // checks the image and, if it's good, boots it
+} BootPacketType;
+
+// Struct definitions
+/**
+ * @brief Header every app image carries at BOOT_IMAGE_HEADER_OFFSET.
+ * @param magic BOOT_IMAGE_MAGIC
+ * @param length bytes of image from BOOT_APP_ADDRESS, a multiple of 4
+ * @param crc CRC of the image words, with crc and checked read as 0xFFFFFFFF
+ * @param checked BOOT_IMAGE_UNCHECKED or BOOT_IMAGE_CHECKED
+ */
+typedef struct BootImageHeader
+{
+    uint32_t magic;
+    uint32_t length;
+    uint32_t crc;
+    uint32_t checked;
+} BootImageHeader;
+
+/**
+ * @brief Left in RAM across a reset, in the first bytes of .noinit in both images. The inverse
+ * makes a match out of whatever RAM powers up holding very unlikely.
+ * @param magic BOOT_REQUEST_UPDATE
+ * @param inverse ~BOOT_REQUEST_UPDATE
+ */
+typedef struct BootRequest
+{
+    uint32_t magic;
+    uint32_t inverse;
+} BootRequest;
+
+/**
+ * @brief Start of a packet, after BOOT_SYNC. Followed by length bytes of payload and the CRC of
+ * the header and payload words.
+ * @param type BootPacketType
+ * @param reserved 0
+ * @param length payload bytes, a multiple of 4 up to BOOT_CHUNK_SIZE
+ * @param argument depends on type
+ */
+typedef struct BootPacketHeader
+{
+    uint8_t  type;
+    uint8_t  reserved;
+    uint16_t length;
+    uint32_t argument;
+} BootPacketHeader;
+
+// Variable declarations
+// The app sets it before resetting into the bootloader, defined once in core/update.c.
+extern BootRequest boot_request;
+
+#endif
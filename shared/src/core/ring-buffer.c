@@ -1,5 +1,39 @@
 #include "core/ring-buffer.h"
 
+#include <string.h>
+
+#ifdef RING_BUFFER_FREE_RUNNING
+// Indices count forever and are masked on every buffer access.
+#define RB_WRAP(rb, index)  (index)
+#define RB_POS(rb, index)   ((index) & (rb)->mask)
+#define RB_CAPACITY(rb)     ((rb)->mask + 1)
+#else
+// Indices are kept wrapped, one slot stays empty.
+#define RB_WRAP(rb, index)  ((index) & (rb)->mask)
+#define RB_POS(rb, index)   (index)
+#define RB_CAPACITY(rb)     ((rb)->mask)
+#endif
+#define RB_USED(rb, write, read) (RB_WRAP(rb, (write) - (read)))
+
+/**
+ * @brief Records a new peak fill level. Producer side only.
+ * 
+ * @param rb ring buffer being written
+ * @param used bytes waiting after the write
+ */
+static inline void noteHighWater(ring_buffer_t *rb, uint32_t used)
+{
+#ifdef RING_BUFFER_FREE_RUNNING
+    if (used > rb->high_water)
+    {
+        rb->high_water = used;
+    }
+#else
+    (void)rb;
+    (void)used;
+#endif
+}
+
 /**
  * @brief Initialises a ring buffer object.
  * 
@@ -13,6 +47,9 @@ void coreRingBufferSetup(ring_buffer_t *rb, uint8_t *buffer, uint32_t size)
     rb->read_index = 0;
     rb->write_index = 0;
     rb->mask = size - 1;
+#ifdef RING_BUFFER_FREE_RUNNING
+    rb->high_water = 0;
+#endif
 }
 
 /**
@@ -28,7 +65,7 @@ bool coreRingBufferEmpty(ring_buffer_t *rb)
 }
 
 /**
- * @brief Write a byte into a ring buffer.
+ * @brief Write a byte into a ring buffer. Producer side.
  * 
  * @param rb buffer to write into
  * @param byte byte to be written
@@ -39,24 +76,27 @@ bool coreRingBufferWrite(ring_buffer_t *rb, uint8_t byte)
 {
     uint32_t local_write_index = rb->write_index;
     uint32_t local_read_index = rb->read_index;
+    uint32_t used = RB_USED(rb, local_write_index, local_read_index);
 
     // check this. if we write into read_index then we lose all data in the buffer.
-    uint32_t next_write_index = (local_write_index + 1) & rb->mask;
-
-    if (next_write_index == local_read_index)
+    if (used == RB_CAPACITY(rb))
     {
         // drop latest piece of data.
         return false;
     }
 
-    // If we're not at the end increment and update write index.
-    rb->buffer[local_write_index] = byte;
-    rb->write_index = next_write_index;
+    // Don't touch the slot until the reader is known to have finished with it.
+    RING_BUFFER_BARRIER();
+    rb->buffer[RB_POS(rb, local_write_index)] = byte;
+    // The byte has to land before the reader can see the new index.
+    RING_BUFFER_BARRIER();
+    rb->write_index = RB_WRAP(rb, local_write_index + 1);
+    noteHighWater(rb, used + 1);
     return true;
 }
 
 /**
- * @brief Reads a byte out of the ring buffer.
+ * @brief Reads a byte out of the ring buffer. Consumer side.
  * 
  * @param rb ring buffer to be read from
  * @param byte pointer to byte to be populated by read.
@@ -75,11 +115,230 @@ bool coreRingBufferRead(ring_buffer_t *rb, uint8_t *byte)
         return false;
     }
 
-    // If it's not, read value, increment read index and return value/success.
-    *byte = rb->buffer[local_read_index];
-    local_read_index = (local_read_index + 1) & rb->mask; // Masking with power of two wraps read index back around.
-    rb->read_index = local_read_index;
+    // If it's not, read value, increment read index and return value/success. The barriers keep
+    // the read after the write index that published it and before handing the slot back.
+    RING_BUFFER_BARRIER();
+    *byte = rb->buffer[RB_POS(rb, local_read_index)];
+    RING_BUFFER_BARRIER();
+    rb->read_index = RB_WRAP(rb, local_read_index + 1); // Masking with power of two wraps read index back around.
 
     return true;
 
 }
+
+/**
+ * @brief Returns how many bytes are waiting to be read.
+ * 
+ * @param rb ring buffer to check
+ * @return uint32_t used space in bytes
+ */
+uint32_t coreRingBufferUsed(ring_buffer_t *rb)
+{
+    uint32_t local_read_index = rb->read_index;
+    uint32_t local_write_index = rb->write_index;
+
+    return RB_USED(rb, local_write_index, local_read_index);
+}
+
+/**
+ * @brief Returns how many more bytes can be written before the buffer is full.
+ * 
+ * @param rb ring buffer to check
+ * @return uint32_t free space in bytes
+ */
+uint32_t coreRingBufferFree(ring_buffer_t *rb)
+{
+    return RB_CAPACITY(rb) - coreRingBufferUsed(rb);
+}
+
+/**
+ * @brief Returns how many bytes the buffer holds when full. One less than the buffer size unless
+ * built with RING_BUFFER_FREE_RUNNING.
+ * 
+ * @param rb ring buffer to check
+ * @return uint32_t capacity in bytes
+ */
+uint32_t coreRingBufferCapacity(ring_buffer_t *rb)
+{
+    return RB_CAPACITY(rb);
+}
+
+#ifdef RING_BUFFER_FREE_RUNNING
+/**
+ * @brief Returns the most bytes that have been waiting in the buffer at once since setup.
+ * 
+ * @param rb ring buffer to check
+ * @return uint32_t peak fill level in bytes
+ */
+uint32_t coreRingBufferHighWater(ring_buffer_t *rb)
+{
+    return rb->high_water;
+}
+#endif
+
+/**
+ * @brief Publishes data that was written straight into the buffer memory by someone else (e.g. a
+ * circular DMA stream) by moving the write index up to where they have got to. Producer side,
+ * except on an overrun, where it also moves the read index past the bytes that were lost. A read
+ * running at that moment can put its old index back, which only costs more of the lost data.
+ * 
+ * @param rb ring buffer to update
+ * @param write_index new write position, already wrapped to the buffer size.
+ * @return uint32_t number of unread bytes that were overwritten, 0 if nothing was lost.
+ */
+uint32_t coreRingBufferAdvanceWrite(ring_buffer_t *rb, uint32_t write_index)
+{
+    uint32_t local_write_index = rb->write_index;
+    uint32_t advanced = (write_index - RB_POS(rb, local_write_index)) & rb->mask;
+    uint32_t used = coreRingBufferUsed(rb);
+    uint32_t space = RB_CAPACITY(rb) - used;
+
+    // Everything DMA wrote up to here must be visible before the index says so.
+    RING_BUFFER_BARRIER();
+    local_write_index = RB_WRAP(rb, local_write_index + advanced);
+    if (advanced > space)
+    {
+        // The oldest unread bytes have been written over, skip them so the buffer reads as full
+        // of the newest data instead of looking nearly empty (or empty) with the indices lapped.
+        rb->read_index = RB_WRAP(rb, local_write_index - RB_CAPACITY(rb));
+    }
+    rb->write_index = local_write_index;
+    noteHighWater(rb, advanced > space ? RB_CAPACITY(rb) : used + advanced);
+    return advanced > space ? advanced - space : 0;
+}
+
+/**
+ * @brief Gives direct access to the next contiguous run of readable bytes. Nothing is consumed
+ * until coreRingBufferCommitRead() is called. Consumer side.
+ * 
+ * @param rb ring buffer to read from
+ * @param span returned start of the readable run
+ * @return uint32_t length of the run, 0 if empty. May be less than coreRingBufferUsed() when the
+ * data wraps.
+ */
+uint32_t coreRingBufferPeekRead(ring_buffer_t *rb, const uint8_t **span)
+{
+    uint32_t local_read_index = rb->read_index;
+    uint32_t local_write_index = rb->write_index;
+    uint32_t used = RB_USED(rb, local_write_index, local_read_index);
+    // Wrapped data stops at the end of the buffer.
+    uint32_t run = rb->mask + 1 - RB_POS(rb, local_read_index);
+
+    // Span contents are only valid after the write index that published them.
+    RING_BUFFER_BARRIER();
+    *span = &rb->buffer[RB_POS(rb, local_read_index)];
+    return used < run ? used : run;
+}
+
+/**
+ * @brief Consumes bytes previously returned by coreRingBufferPeekRead(). Consumer side.
+ * 
+ * @param rb ring buffer to update
+ * @param count bytes to consume, no more than the span returned.
+ */
+void coreRingBufferCommitRead(ring_buffer_t *rb, uint32_t count)
+{
+    // Finish reading the span before the writer can reuse it.
+    RING_BUFFER_BARRIER();
+    rb->read_index = RB_WRAP(rb, rb->read_index + count);
+}
+
+/**
+ * @brief Gives direct access to the next contiguous run of writable space. Nothing is published
+ * until coreRingBufferCommitWrite() is called. Producer side.
+ * 
+ * @param rb ring buffer to write to
+ * @param span returned start of the writable run
+ * @return uint32_t length of the run, 0 if full.
+ */
+uint32_t coreRingBufferPeekWrite(ring_buffer_t *rb, uint8_t **span)
+{
+    uint32_t local_read_index = rb->read_index;
+    uint32_t local_write_index = rb->write_index;
+    uint32_t space = RB_CAPACITY(rb) - RB_USED(rb, local_write_index, local_read_index);
+    // Up to the end of the buffer, the free space check keeps the empty slot if there is one.
+    uint32_t run = rb->mask + 1 - RB_POS(rb, local_write_index);
+
+    // The reader has to be finished with the span before it gets written.
+    RING_BUFFER_BARRIER();
+    *span = &rb->buffer[RB_POS(rb, local_write_index)];
+    return space < run ? space : run;
+}
+
+/**
+ * @brief Publishes bytes written into the span returned by coreRingBufferPeekWrite(). Producer
+ * side.
+ * 
+ * @param rb ring buffer to update
+ * @param count bytes written, no more than the span returned.
+ */
+void coreRingBufferCommitWrite(ring_buffer_t *rb, uint32_t count)
+{
+    uint32_t local_write_index = rb->write_index;
+
+    // The span has to land before the reader can see the new index.
+    RING_BUFFER_BARRIER();
+    rb->write_index = RB_WRAP(rb, local_write_index + count);
+    noteHighWater(rb, coreRingBufferUsed(rb));
+}
+
+/**
+ * @brief Reads up to len bytes in at most two copies. Consumer side.
+ * 
+ * @param rb ring buffer to read from
+ * @param data destination
+ * @param len maximum bytes to read
+ * @return uint32_t bytes actually read
+ */
+uint32_t coreRingBufferReadBulk(ring_buffer_t *rb, uint8_t *data, uint32_t len)
+{
+    uint32_t total = 0;
+    // Second pass picks up the part that wrapped round to the start.
+    for (int pass = 0; pass < 2 && total < len; pass++)
+    {
+        const uint8_t *span;
+        uint32_t       count = coreRingBufferPeekRead(rb, &span);
+        if (count == 0)
+        {
+            break;
+        }
+        if (count > len - total)
+        {
+            count = len - total;
+        }
+        memcpy(&data[total], span, count);
+        coreRingBufferCommitRead(rb, count);
+        total += count;
+    }
+    return total;
+}
+
+/**
+ * @brief Writes up to len bytes in at most two copies. Producer side.
+ * 
+ * @param rb ring buffer to write into
+ * @param data source
+ * @param len bytes to write
+ * @return uint32_t bytes actually written, less than len if the buffer filled up.
+ */
+uint32_t coreRingBufferWriteBulk(ring_buffer_t *rb, const uint8_t *data, uint32_t len)
+{
+    uint32_t total = 0;
+    for (int pass = 0; pass < 2 && total < len; pass++)
+    {
+        uint8_t *span;
+        uint32_t count = coreRingBufferPeekWrite(rb, &span);
+        if (count == 0)
+        {
+            break;
+        }
+        if (count > len - total)
+        {
+            count = len - total;
+        }
+        memcpy(span, &data[total], count);
+        coreRingBufferCommitWrite(rb, count);
+        total += count;
+    }
+    return total;
+}
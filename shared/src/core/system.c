@@ -1,11 +1,31 @@
 #include "core/system.h"
+#include "core/update.h"
 
+#include <stddef.h>
+
+#include "libopencm3/stm32/flash.h"
+#include "libopencm3/stm32/pwr.h"
 #include "libopencm3/stm32/rcc.h"
+#include "libopencm3/cm3/cortex.h"
+#include "libopencm3/cm3/dwt.h"
+#include "libopencm3/cm3/scb.h"
 #include "libopencm3/cm3/systick.h"
 #include "libopencm3/cm3/vector.h"
 
 // Only local to this file, but volatile
 static volatile uint64_t ticks = 0;
+// CPU cycles spent asleep in coreSystemSleep(), only touched from thread mode.
+static uint64_t idle_cycles = 0;
+// Top half of the 64 bit cycle count, and the cycle counter when it was last looked at.
+static uint32_t cycles_high = 0;
+static uint32_t cycles_last = 0;
+// Clock rate since the last coreSystemSetClock(), and the one before it. Cycle counts are turned
+// into time from the cycle count and time of that switch.
+static uint32_t cpu_mhz = CPU_FREQ / 1000000;
+static uint32_t previous_mhz = CPU_FREQ / 1000000;
+static uint64_t switch_cycles = 0;
+static uint64_t switch_us = 0;
+static bool     clock_on_hse = false;
 
 /**
  * @brief Timer interrupt. Increments static variable ticks so we can keep track of time. 
@@ -13,6 +33,8 @@ static volatile uint64_t ticks = 0;
  */
 void sys_tick_handler(void) {
     ticks++;
+    // The cycle counter wraps every 51s, looking at it every tick means no wrap is missed.
+    (void)coreSystemCycles();
 }
 
 /**
@@ -28,7 +50,7 @@ static void loc_systick_setup(void)
 }
 
 /**
- * @brief Sets up system clock to 84mHz.
+ * @brief Sets up system clock to 84mHz off HSI, coreSystemSetClock() can change it later.
  * 
  */
 static void loc_rcc_setup(void)
@@ -44,6 +66,8 @@ void coreSystemSetup(void)
 {
     loc_rcc_setup();
     loc_systick_setup();
+    // Times sleeps for the idle counter.
+    (void)dwt_enable_cycle_counter();
 }
 
 /**
@@ -64,6 +88,241 @@ uint64_t coreGetTicks(void)
 void coreSystemDelay(uint64_t milliseconds)
 {
     uint64_t end_time = coreGetTicks() + milliseconds;
-    while (coreGetTicks() < end_time);
+    while (coreGetTicks() < end_time)
+    {
+        // Systick wakes us every millisecond to check.
+        coreSystemSleep(NULL);
+    }
+}
+
+/**
+ * @brief Delays the system for microseconds on the cycle counter, for gaps finer than a tick.
+ * Blocking mode, and the core stays awake.
+ *
+ * @param microseconds amount to delay system by, up to 40 seconds at 100MHz
+ */
+void coreSystemDelayMicros(uint32_t microseconds)
+{
+    const uint32_t start = dwt_read_cycle_counter();
+    const uint32_t cycles = microseconds * cpu_mhz;
+    while ((uint32_t)(dwt_read_cycle_counter() - start) < cycles)
+    {
+    }
+}
+
+/**
+ * @brief Sleeps until the next interrupt, unless there is already work to do. Interrupts are
+ * masked while checking so one arriving just before WFI still wakes the core (a pending interrupt
+ * ends WFI even when masked), then put back as they were, so it is handled straight away unless
+ * the caller had them masked.
+ *
+ * @param work_pending returns true if the caller has work waiting, NULL to always sleep
+ */
+void coreSystemSleep(bool (*work_pending)(void))
+{
+    uint32_t masked = cm_mask_interrupts(1);
+    if (work_pending == NULL || !work_pending())
+    {
+        uint32_t start = dwt_read_cycle_counter();
+        __asm__ volatile("wfi");
+        idle_cycles += (uint32_t)(dwt_read_cycle_counter() - start);
+    }
+    cm_mask_interrupts(masked);
+}
+
+/**
+ * @brief Get a 64 bit count of CPU cycles since power on, for timestamps finer than a tick. Safe
+ * to call from interrupts.
+ *
+ * @return uint64_t CPU cycles
+ */
+uint64_t coreSystemCycles(void)
+{
+    uint32_t masked = cm_mask_interrupts(1);
+    uint32_t now = dwt_read_cycle_counter();
+    if (now < cycles_last)
+    {
+        cycles_high++;
+    }
+    cycles_last = now;
+    uint64_t cycles = ((uint64_t)cycles_high << 32) | now;
+    cm_mask_interrupts(masked);
+    return cycles;
+}
+
+/**
+ * @brief Get the time spent asleep.
+ *
+ * @return uint64_t CPU cycles spent in coreSystemSleep() since power on
+ */
+uint64_t coreSystemIdleCycles(void)
+{
+    return idle_cycles;
 }
 
+/**
+ * @brief Resets into the bootloader, which waits for a new image on the console (see
+ * bootloader/update.py). Flush the console first, the reset cuts off anything still going out.
+ *
+ */
+void coreSystemEnterBootloader(void)
+{
+    cm_mask_interrupts(1);
+    boot_request.magic = BOOT_REQUEST_UPDATE;
+    boot_request.inverse = ~BOOT_REQUEST_UPDATE;
+    scb_reset_system();
+}
+
+/**
+ * @brief Starts HSE if something is driving it, trying an external clock (bypass, the Nucleo's
+ * ST-Link MCO) and then a crystal. Gives up after a couple of milliseconds either way.
+ *
+ * @return true HSE is running
+ * @return false nothing on HSE, it is left off
+ */
+static bool loc_hse_start(void)
+{
+    if (rcc_is_osc_ready(RCC_HSE))
+    {
+        return true;
+    }
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        // The bypass bit can only be changed with HSE off.
+        rcc_osc_off(RCC_HSE);
+        if (attempt == 0)
+        {
+            rcc_osc_bypass_enable(RCC_HSE);
+        }
+        else
+        {
+            rcc_osc_bypass_disable(RCC_HSE);
+        }
+        rcc_osc_on(RCC_HSE);
+        uint32_t start = dwt_read_cycle_counter();
+        while (dwt_read_cycle_counter() - start < cpu_mhz * 2000)
+        {
+            if (rcc_is_osc_ready(RCC_HSE))
+            {
+                return true;
+            }
+        }
+    }
+    rcc_osc_off(RCC_HSE);
+    return false;
+}
+
+/**
+ * @brief Moves the CPU to a new clock, from the PLL off HSE when it is present or HSI otherwise,
+ * and retimes systick. Buses are as fast as they are allowed to be (APB1 50MHz max), so
+ * peripheral clocks change with it: UART baudrates and timer prescalers have to be worked out
+ * again by whoever owns them. Anything being sent or received while it switches is lost.
+ *
+ * @param mhz SYSTEM_CLOCK_MIN_MHZ to SYSTEM_CLOCK_MAX_MHZ
+ * @return true switched
+ * @return false out of range
+ */
+bool coreSystemSetClock(uint32_t mhz)
+{
+    if (mhz < SYSTEM_CLOCK_MIN_MHZ || mhz > SYSTEM_CLOCK_MAX_MHZ)
+    {
+        return false;
+    }
+
+    // VCO input at 2MHz, output between 100 and 432MHz with the smallest P that gets there.
+    uint8_t pllp = 2;
+    while (mhz * pllp < 100)
+    {
+        pllp += 2;
+    }
+    const uint32_t vco_mhz = mhz * pllp;
+    const uint32_t apb1_mhz = mhz > 50 ? mhz / 2 : mhz;
+    uint32_t       pllq = (vco_mhz + 47) / 48; // 48MHz or under, nothing uses it
+    pllq = pllq < 2 ? 2 : (pllq > 15 ? 15 : pllq);
+
+    // One wait state per 30MHz at 3.3V.
+    uint32_t latency = FLASH_ACR_LATENCY_0WS;
+    if (mhz > 90)
+    {
+        latency = FLASH_ACR_LATENCY_3WS;
+    }
+    else if (mhz > 64)
+    {
+        latency = FLASH_ACR_LATENCY_2WS;
+    }
+    else if (mhz > 30)
+    {
+        latency = FLASH_ACR_LATENCY_1WS;
+    }
+
+    uint32_t masked = cm_mask_interrupts(1);
+    const bool hse = loc_hse_start();
+    const struct rcc_clock_scale scale = {
+        .pllm = (hse ? SYSTEM_HSE_MHZ : SYSTEM_HSI_MHZ) / 2,
+        .plln = (uint16_t)(vco_mhz / 2),
+        .pllp = pllp,
+        .pllq = (uint8_t)pllq,
+        .pllr = 0,
+        .pll_source = hse ? RCC_CFGR_PLLSRC_HSE_CLK : RCC_CFGR_PLLSRC_HSI_CLK,
+        .hpre = RCC_CFGR_HPRE_NODIV,
+        .ppre1 = mhz > 50 ? RCC_CFGR_PPRE_DIV2 : RCC_CFGR_PPRE_NODIV,
+        .ppre2 = RCC_CFGR_PPRE_NODIV,
+        .voltage_scale = PWR_SCALE1,
+        .flash_config = FLASH_ACR_DCEN | FLASH_ACR_ICEN | latency,
+        .ahb_frequency = mhz * 1000000,
+        .apb1_frequency = apb1_mhz * 1000000,
+        .apb2_frequency = mhz * 1000000,
+    };
+
+    // Cycles counted so far are at the old rate.
+    const uint64_t now = coreSystemCycles();
+    switch_us = coreSystemCyclesToMicros(now);
+    switch_cycles = now;
+
+    rcc_clock_setup_pll(&scale);
+    previous_mhz = cpu_mhz;
+    cpu_mhz = mhz;
+    clock_on_hse = hse;
+    systick_set_frequency(SYSTICK_FREQ, rcc_ahb_frequency);
+    systick_clear();
+    cm_mask_interrupts(masked);
+    return true;
+}
+
+/**
+ * @brief Get the CPU clock.
+ *
+ * @return uint32_t CPU (and AHB) clock in Hz
+ */
+uint32_t coreSystemCpuFrequency(void)
+{
+    return rcc_ahb_frequency;
+}
+
+/**
+ * @brief Get where the CPU clock comes from.
+ *
+ * @return true PLL off HSE
+ * @return false PLL off HSI, as at power on
+ */
+bool coreSystemClockOnHse(void)
+{
+    return clock_on_hse;
+}
+
+/**
+ * @brief Turns a coreSystemCycles() count into microseconds since power on, across clock
+ * switches. Counts from before the last switch are taken to be at the rate before it.
+ *
+ * @param cycles CPU cycles since power on
+ * @return uint64_t microseconds since power on
+ */
+uint64_t coreSystemCyclesToMicros(uint64_t cycles)
+{
+    if (cycles >= switch_cycles)
+    {
+        return switch_us + (cycles - switch_cycles) / cpu_mhz;
+    }
+    const uint64_t before = (switch_cycles - cycles) / previous_mhz;
+    return before < switch_us ? switch_us - before : 0;
+}
@@ -1,4 +1,7 @@
+#include "libopencm3/cm3/cortex.h"
+#include "libopencm3/cm3/dwt.h"
 #include "libopencm3/cm3/nvic.h"
+#include "libopencm3/stm32/dma.h"
 #include "libopencm3/stm32/rcc.h"
 #include "libopencm3/stm32/usart.h"
 #include "libopencm3/stm32/gpio.h"
@@ -6,46 +9,280 @@
 #include "core/uart.h"
 #include "core/ring-buffer.h"
 
-#define RING_BUFFER_SIZE (128) // Must be a power of two! approx ~10ms of latency
+#define RING_BUFFER_SIZE (256) // Must be a power of two! approx ~22ms of latency
+
+// Receive is done by a circular DMA stream into the RX ring buffer, unless UART_RX_IRQ is defined
+// in which case every byte raises an RXNE interrupt. USART2_RX is DMA1 stream 5 channel 4.
+#ifndef UART_RX_IRQ
+#define CONSOLE_RX_DMA         (DMA1)
+#define CONSOLE_RX_DMA_STREAM  (DMA_STREAM5)
+#define CONSOLE_RX_DMA_CHANNEL (DMA_SxCR_CHSEL_4)
+#endif
 
 static ring_buffer_t rb = {0U}; // the ringbuffer object
 static uint8_t data_buffer[RING_BUFFER_SIZE] = {0U}; // buffer in ring buffer.
 
+static ring_buffer_t tx_rb = {0U}; // TX ring buffer, drained by usart2_isr
+static uint8_t tx_data_buffer[UART_TX_BUFFER_SIZE] = {0U};
+static UartTxPolicy tx_policy = UART_TX_DEFAULT_POLICY;
+
+static volatile UartRxStats rx_stats = {0U};
+static UartFlowControl rx_flow = UART_FLOW_NONE;
+static volatile bool rx_paused = false;      // the sender should be paused
+static volatile bool rx_paused_sent = false; // the last flow byte sent was XOFF
+static UartWriteHook write_hook = NULL; // takes over stdout when set
+static uint32_t console_baudrate = 0; // as set up, kept for coreUartClockChanged()
+#ifdef LATENCY_STATS
+static uint64_t write_cycles = 0; // CPU cycles spent in _write()
+#endif
+
+/**
+ * @brief Pauses or resumes the sender when the RX ring buffer crosses a watermark. The XOFF/XON
+ * itself goes out from usart2_isr, ahead of anything waiting in the TX buffer. Called from the
+ * receive ISRs, and from the reader with interrupts masked.
+ *
+ */
+static void rxFlowUpdate(void)
+{
+    if (rx_flow != UART_FLOW_XONXOFF)
+    {
+        return;
+    }
+
+    uint32_t used = coreRingBufferUsed(&rb);
+    bool     paused = rx_paused;
+    if (!paused && used >= UART_FLOW_HIGH(RING_BUFFER_SIZE))
+    {
+        paused = true;
+    }
+    else if (paused && used <= UART_FLOW_LOW(RING_BUFFER_SIZE))
+    {
+        paused = false;
+    }
+
+    if (paused != rx_paused)
+    {
+        rx_paused = paused;
+        usart_enable_tx_interrupt(USART2);
+    }
+}
+
+#ifndef UART_RX_IRQ
+/**
+ * @brief Makes everything the DMA stream has written so far readable.
+ *
+ */
+static void rxDmaPublish(void)
+{
+    uint32_t write_index =
+        (RING_BUFFER_SIZE - dma_get_number_of_data(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM)) &
+        (RING_BUFFER_SIZE - 1);
+    rx_stats.dropped += coreRingBufferAdvanceWrite(&rb, write_index);
+    rxFlowUpdate();
+}
+
+/**
+ * @brief interrupt service routine for the console RX DMA stream. Publishes at half and full so
+ * a long burst without an idle gap is still picked up in time.
+ *
+ */
+void dma1_stream5_isr(void)
+{
+    if (dma_get_interrupt_flag(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, DMA_HTIF | DMA_TCIF))
+    {
+        dma_clear_interrupt_flags(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, DMA_HTIF | DMA_TCIF);
+        rxDmaPublish();
+    }
+}
+#endif
+
 /**
- * @brief interrupt service routine for UART RX.
+ * @brief interrupt service routine for UART RX and TX.
  *
  */
 void usart2_isr(void)
 {
     const bool overrun_occured = usart_get_flag(USART2, USART_FLAG_ORE /* Overrun flag? */) == 1;
+#ifdef UART_RX_IRQ
     const bool received_data = usart_get_flag(USART2, USART_FLAG_RXNE /* Recieved data? */) == 1;
 
+    if (overrun_occured)
+    {
+        rx_stats.overruns++;
+    }
+
     if (overrun_occured || received_data)
     {
         if (!coreRingBufferWrite(&rb, (uint8_t)usart_recv(USART2)))
         {
-            // Handle failure. Update buffer size.
+            rx_stats.dropped++;
+        }
+        rxFlowUpdate();
+    }
+#else
+    const bool line_idle = usart_get_flag(USART2, USART_FLAG_IDLE) == 1;
+
+    if (overrun_occured || line_idle)
+    {
+        if (overrun_occured)
+        {
+            rx_stats.overruns++;
+        }
+        // SR then DR read clears IDLE/ORE. The line is idle so there's no byte for DMA to miss.
+        (void)USART_DR(USART2);
+        rxDmaPublish();
+    }
+#endif
+
+    // Data register empty: send a pending XOFF/XON first, then the next byte, or stop
+    // interrupting once drained.
+    if ((USART_CR1(USART2) & USART_CR1_TXEIE) && usart_get_flag(USART2, USART_FLAG_TXE) == 1)
+    {
+        uint8_t byte;
+        if (rx_paused != rx_paused_sent)
+        {
+            rx_paused_sent = rx_paused;
+            usart_send(USART2, rx_paused_sent ? UART_XOFF : UART_XON);
+        }
+        else if (coreRingBufferRead(&tx_rb, &byte))
+        {
+            usart_send(USART2, (uint16_t)byte);
+        }
+        else
+        {
+            usart_disable_tx_interrupt(USART2);
         }
     }
 }
 
-int _write(int file, char *ptr, int len)
+/**
+ * @brief Moves one byte from the TX buffer to USART2 by polling. Used by the block policy when
+ * interrupts are masked and usart2_isr can't drain the buffer itself.
+ *
+ */
+static void txPollOnce(void)
+{
+    uint8_t byte;
+    if (coreRingBufferRead(&tx_rb, &byte))
+    {
+        usart_send_blocking(USART2, (uint16_t)byte);
+    }
+}
+
+/**
+ * @brief Queues a block for transmission with bulk ring buffer copies. What happens when it
+ * doesn't fit depends on the TX policy.
+ *
+ * @param data bytes to queue
+ * @param len number of bytes
+ * @return uint32_t bytes queued. Less than len means the rest was discarded.
+ */
+static uint32_t txWrite(const uint8_t *data, uint32_t len)
+{
+    if (tx_policy == UART_TX_DROP && len > coreRingBufferFree(&tx_rb))
+    {
+        return 0;
+    }
+
+    uint32_t written = coreRingBufferWriteBulk(&tx_rb, data, len);
+    while (written < len && tx_policy == UART_TX_BLOCK)
+    {
+        // Let the ISR start draining what's already there before waiting on it.
+        usart_enable_tx_interrupt(USART2);
+        if (cm_is_masked_interrupts())
+        {
+            txPollOnce();
+        }
+        written += coreRingBufferWriteBulk(&tx_rb, &data[written], len - written);
+    }
+    if (written > 0)
+    {
+        usart_enable_tx_interrupt(USART2);
+    }
+    return written;
+}
+
+/**
+ * @brief Writes stdout/stderr to the console, through the write hook if one is set. Kept apart
+ * from _write() so the time spent here can be counted.
+ *
+ * @param file file descriptor
+ * @param ptr bytes to write
+ * @param len number of bytes
+ * @return int bytes consumed, -1 for any other file
+ */
+static int consoleWrite(int file, char *ptr, int len)
 {
 	int i;
 
 	if (file == STDOUT_FILENO || file == STDERR_FILENO) {
-		for (i = 0; i < len; i++) {
-			if (ptr[i] == '\n') {
-				usart_send_blocking(USART2, '\r');
+		if (write_hook != NULL) {
+			return write_hook(ptr, len);
+		}
+		if (tx_policy == UART_TX_DROP) {
+			// All or nothing, so count the CR that gets added to every LF.
+			uint32_t needed = (uint32_t)len;
+			for (i = 0; i < len; i++) {
+				if (ptr[i] == '\n') {
+					needed++;
+				}
+			}
+			if (needed > coreRingBufferFree(&tx_rb)) {
+				return len;
 			}
-			usart_send_blocking(USART2, ptr[i]);
 		}
-		return i;
+		// Copy each run up to a LF in one go, then the CRLF in place of it.
+		int start = 0;
+		for (i = 0; i <= len; i++) {
+			if (i < len && ptr[i] != '\n') {
+				continue;
+			}
+			uint32_t run = (uint32_t)(i - start);
+			if (run > 0 && txWrite((const uint8_t *)&ptr[start], run) < run) {
+				break;
+			}
+			if (i < len) {
+				// Truncate the line before its CRLF rather than between the CR and LF.
+				if (tx_policy == UART_TX_TRUNCATE && coreRingBufferFree(&tx_rb) < 2) {
+					break;
+				}
+				if (txWrite((const uint8_t *)"\r\n", 2) < 2) {
+					break;
+				}
+			}
+			start = i + 1;
+		}
+		// Report everything as written so newlib doesn't retry what we chose to discard.
+		return len;
 	}
 	errno = EIO;
 	return -1;
 }
 
+int _write(int file, char *ptr, int len)
+{
+#ifdef LATENCY_STATS
+	uint32_t start = dwt_read_cycle_counter();
+	int written = consoleWrite(file, ptr, len);
+	write_cycles += (uint32_t)(dwt_read_cycle_counter() - start);
+	return written;
+#else
+	return consoleWrite(file, ptr, len);
+#endif
+}
+
+#ifdef LATENCY_STATS
+/**
+ * @brief Get the time spent in printf output, including any wait for room in the TX buffer.
+ *
+ * @return uint64_t CPU cycles spent in _write() since power on
+ */
+uint64_t coreUartWriteCycles(void)
+{
+	return write_cycles;
+}
+#endif
+
 /**
  * @brief Sets up USART2 for PC-MCU communications
  *
@@ -59,43 +296,181 @@ void coreUartSetup(uint32_t baudrate)
     gpio_set_af(UART_PORT, GPIO_AF7, UART_TX_PIN | UART_RX_PIN); // See datasheet for function.
     gpio_port_config_lock(UART_PORT, UART_TX_PIN | UART_RX_PIN); // Lock pins so they're not usuable by anything else
     coreRingBufferSetup(&rb, data_buffer, RING_BUFFER_SIZE);
+    coreRingBufferSetup(&tx_rb, tx_data_buffer, UART_TX_BUFFER_SIZE);
     rcc_periph_clock_enable(RCC_USART2);
     usart_set_mode(USART2, USART_MODE_TX_RX); // Make sure we're Rxing and Txing.
 
     usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE); // exclude the rest of RS232.
     usart_set_databits(USART2, 8);
+    console_baudrate = baudrate;
     usart_set_baudrate(USART2, baudrate); // Set to user defined baudrate.
     usart_set_parity(USART2, 0);
     usart_set_stopbits(USART2, 1);
 
+#ifdef UART_RX_IRQ
     usart_enable_rx_interrupt(USART2); // Enable specific Rx interrupt
+#else
+    // DMA writes straight into the RX ring buffer, the ISRs only move the write index.
+    rcc_periph_clock_enable(RCC_DMA1);
+    dma_stream_reset(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    dma_channel_select(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, CONSOLE_RX_DMA_CHANNEL);
+    dma_set_peripheral_address(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, (uint32_t)&USART_DR(USART2));
+    dma_set_memory_address(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, (uint32_t)data_buffer);
+    dma_set_number_of_data(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, RING_BUFFER_SIZE);
+    dma_set_transfer_mode(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+    dma_set_peripheral_size(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, DMA_SxCR_PSIZE_8BIT);
+    dma_set_memory_size(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM, DMA_SxCR_MSIZE_8BIT);
+    dma_disable_peripheral_increment_mode(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    dma_enable_memory_increment_mode(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    dma_enable_circular_mode(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    dma_enable_half_transfer_interrupt(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    dma_enable_transfer_complete_interrupt(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    nvic_enable_irq(NVIC_DMA1_STREAM5_IRQ);
+    dma_enable_stream(CONSOLE_RX_DMA, CONSOLE_RX_DMA_STREAM);
+    usart_enable_rx_dma(USART2);
+    USART_CR1(USART2) |= USART_CR1_IDLEIE; // Publish whenever the line goes quiet.
+#endif
     nvic_enable_irq(NVIC_USART2_IRQ);  // Enable interrupts for USART2
 
     usart_enable(USART2); // Turn it all on.
 }
 
 /**
- * @brief Writes a buffer of length `len` to USART2.
+ * @brief Queues a buffer of length `len` for USART2. Returns as soon as the data is queued, the
+ * full buffer policy decides what happens when it doesn't fit.
  *
  * @param data buffer to be written
  * @param len length of data.
  */
 void coreUartWrite(uint8_t *data, uint32_t len)
 {
-    for (uint32_t i = 0; i < len; i++)
-    {
-        coreUartWriteByte(data[i]);
-    }
+    (void)txWrite(data, len);
 }
 
 /**
- * @brief Writes an individual byte to USART2.
+ * @brief Queues an individual byte for USART2.
  *
  * @param byte byte to be written.
  */
 void coreUartWriteByte(uint8_t byte)
 {
-    usart_send_blocking(USART2, (uint16_t)byte);
+    (void)txWrite(&byte, 1);
+}
+
+/**
+ * @brief Returns the console's receive error counters.
+ *
+ * @return UartRxStats counters since power on.
+ */
+UartRxStats coreUartGetRxStats(void)
+{
+    UartRxStats stats = {.overruns = rx_stats.overruns, .dropped = rx_stats.dropped};
+#ifdef RING_BUFFER_FREE_RUNNING
+    stats.high_water = coreRingBufferHighWater(&rb);
+#endif
+    return stats;
+}
+
+/**
+ * @brief Sets what happens when the TX buffer is full.
+ *
+ * @param policy block, drop, or truncate.
+ */
+void coreUartSetTxPolicy(UartTxPolicy policy)
+{
+    tx_policy = policy;
+}
+
+/**
+ * @brief Sends stdout (printf) through a hook instead of straight to the TX buffer.
+ *
+ * @param hook replacement write, NULL for plain text again.
+ */
+void coreUartSetWriteHook(UartWriteHook hook)
+{
+    write_hook = hook;
+}
+
+/**
+ * @brief Sets the console's receive flow control. Only XON/XOFF is available: the ST-LINK's
+ * virtual COM port only carries TX and RX. Leaving XON/XOFF resumes a paused sender.
+ *
+ * @param flow UART_FLOW_NONE or UART_FLOW_XONXOFF
+ * @return true flow control set
+ * @return false not available on the console
+ */
+bool coreUartSetFlowControl(UartFlowControl flow)
+{
+    if (flow == UART_FLOW_RTSCTS)
+    {
+        return false;
+    }
+
+    uint32_t masked = cm_mask_interrupts(1);
+    rx_flow = flow;
+    if (flow == UART_FLOW_NONE)
+    {
+        rx_paused = false;
+        if (rx_paused_sent)
+        {
+            usart_enable_tx_interrupt(USART2);
+        }
+    }
+    else
+    {
+        rxFlowUpdate();
+    }
+    cm_mask_interrupts(masked);
+    return true;
+}
+
+/**
+ * @brief Returns the console's receive flow control.
+ *
+ * @return UartFlowControl current setting
+ */
+UartFlowControl coreUartGetFlowControl(void)
+{
+    return rx_flow;
+}
+
+/**
+ * @brief Checks whether the console has paused its sender.
+ *
+ * @return true XOFF sent and not yet followed by XON
+ * @return false sender is free to send
+ */
+bool coreUartRxPaused(void)
+{
+    return rx_paused_sent;
+}
+
+/**
+ * @brief Waits until everything queued has left the shift register. Call before anything that
+ * stops the ISR running (reset, jumping to another image, reconfiguring clocks).
+ *
+ */
+void coreUartFlush(void)
+{
+    while (!coreRingBufferEmpty(&tx_rb))
+    {
+        if (cm_is_masked_interrupts())
+        {
+            txPollOnce();
+        }
+    }
+    while (usart_get_flag(USART2, USART_FLAG_TC) == 0)
+        ;
+}
+
+/**
+ * @brief Works the console baudrate out again from the bus clock, after coreSystemSetClock().
+ * Flush first, a byte in flight when the clock switched is garbled.
+ *
+ */
+void coreUartClockChanged(void)
+{
+    usart_set_baudrate(USART2, console_baudrate);
 }
 
 /**
@@ -113,15 +488,79 @@ uint32_t coreUartRead(uint8_t *data, uint32_t len)
         return 0;
     }
 
-    for (uint32_t num_bytes = 0; num_bytes < len; num_bytes++)
+    uint32_t read = coreRingBufferReadBulk(&rb, data, len);
+    if (rx_paused)
     {
-        if (!coreRingBufferRead(&rb, &data[num_bytes]))
-        {
-            return num_bytes; // num_bytes is how many bytes we've read.
-        }
+        // The receive ISRs update the flow state too.
+        uint32_t masked = cm_mask_interrupts(1);
+        rxFlowUpdate();
+        cm_mask_interrupts(masked);
     }
+    return read;
+}
 
-    return len; // we read all the bytes
+/**
+ * @brief Gives direct access to the next run of received bytes, for passing them on without a
+ * copy in between. Nothing is consumed until coreUartCommitRead().
+ *
+ * @param span returned start of the run
+ * @return uint32_t bytes in the run, 0 if nothing has been received
+ */
+uint32_t coreUartPeekRead(const uint8_t **span)
+{
+    return coreRingBufferPeekRead(&rb, span);
+}
+
+/**
+ * @brief Consumes bytes returned by coreUartPeekRead(), resuming a paused sender once drained.
+ *
+ * @param count bytes to consume, no more than the run returned
+ */
+void coreUartCommitRead(uint32_t count)
+{
+    coreRingBufferCommitRead(&rb, count);
+    if (rx_paused)
+    {
+        uint32_t masked = cm_mask_interrupts(1);
+        rxFlowUpdate();
+        cm_mask_interrupts(masked);
+    }
+}
+
+/**
+ * @brief Queues as much of a buffer as fits in the TX buffer right now, whatever the TX policy.
+ * Bypasses the write hook.
+ *
+ * @param data bytes to queue
+ * @param len number of bytes
+ * @return uint32_t bytes queued, the caller keeps the rest
+ */
+uint32_t coreUartWriteNoWait(const uint8_t *data, uint32_t len)
+{
+    uint32_t written = coreRingBufferWriteBulk(&tx_rb, data, len);
+    if (written > 0)
+    {
+        usart_enable_tx_interrupt(USART2);
+    }
+    return written;
+}
+
+/**
+ * @brief Queues a block all or nothing, e.g. a binary frame that is no use cut short. The block
+ * policy waits for room, the others drop it unless it all fits right now.
+ *
+ * @param data bytes to queue
+ * @param len number of bytes
+ * @return true queued whole
+ * @return false dropped
+ */
+bool coreUartWriteWhole(const uint8_t *data, uint32_t len)
+{
+    if (tx_policy != UART_TX_BLOCK && len > coreRingBufferFree(&tx_rb))
+    {
+        return false;
+    }
+    return txWrite(data, len) == len;
 }
 
 /**
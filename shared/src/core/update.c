@@ -0,0 +1,5 @@
+#include "core/update.h"
+
+// Written by the app and read by the bootloader across a reset. Both images link this file, so
+// the one symbol lands at the same address through *(.noinit.boot_request) in each linkerscript.
+BootRequest boot_request __attribute__((section(".noinit.boot_request")));